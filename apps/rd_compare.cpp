@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 
 #include <iomanip>
@@ -33,6 +34,7 @@ int PerformAlgorithm(Array2D<T> a, Array2D<U> b) {
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 3) {
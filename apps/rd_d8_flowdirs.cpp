@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/depressions/Barnes2014.hpp>
 #include <richdem/flats/flat_resolution.hpp>
@@ -28,6 +29,7 @@ int PerformAlgorithm(std::string output_prefix, std::string analysis, Array2D<T>
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 3) {
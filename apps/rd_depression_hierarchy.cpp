@@ -1,5 +1,6 @@
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/gdal.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/depressions/depression_hierarchy.hpp>
 
 #include <iostream>
@@ -10,6 +11,8 @@ namespace rd = richdem;
 namespace dh = richdem::dephier;
 
 int main(int argc, char** argv) {
+  const rd::ParallelismScope parallelism(rd::ConsumeThreadsArgument(argc, argv));
+
   if (argc != 4) {
     std::cout << "Syntax: " << argv[0] << " <Input> <Output Prefix> <Ocean Level>" << std::endl;
     return -1;
@@ -1,9 +1,11 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/depressions/Lindsay2016.hpp>
 
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <string>
 
 using namespace richdem;
@@ -20,7 +22,10 @@ int PerformAlgorithm(
     Array2D<T> elevation) {
   elevation.loadData();
 
-  Lindsay2016(elevation, mode, eps_gradients, fill_depressions, max_path_len, (T)max_depth);
+  if (mode == LindsayMode::LEAST_COST_BREACHING)
+    LeastCostBreaching_Lindsay2016<Topology::D8>(elevation, (int)std::min<uint32_t>(max_path_len, std::numeric_limits<int>::max()), max_depth, eps_gradients, fill_depressions);
+  else
+    Lindsay2016(elevation, mode, eps_gradients, fill_depressions, max_path_len, (T)max_depth);
 
   elevation.saveGDAL(outputname, analysis);
 
@@ -30,17 +35,18 @@ int PerformAlgorithm(
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 8) {
     std::cerr << "Eliminate all depressions via flooding." << std::endl;
     std::cerr << argv[0] << " <Input> <Output name> <Mode> <Epsilon> <Fill Depressions> <Max Path Length> <Max Depth>"
               << std::endl;
-    std::cerr << "\t<Mode>             - COMPLETE, SELECTIVE, CONSTRAINED" << std::endl;
+    std::cerr << "\t<Mode>             - COMPLETE, SELECTIVE, CONSTRAINED, LEASTCOST" << std::endl;
     std::cerr << "\t<Epsilon>          - EPS/NOEPS: Whether to fill with epsilon-gradients" << std::endl;
     std::cerr << "\t<Fill Depressions> - FILL/NOFILL: Whether to fill depressions after breaching" << std::endl;
-    std::cerr << "\t<Max Path Length>  - Integer [0, Inf): How many cells long a breach path can be" << std::endl;
-    std::cerr << "\t<Max Depth>        - Float [0, Inf): How deep a breach path can be" << std::endl;
+    std::cerr << "\t<Max Path Length>  - Integer [0, Inf): How many cells long a breach path can be. LEASTCOST: how far from its pit" << std::endl;
+    std::cerr << "\t<Max Depth>        - Float [0, Inf): How deep a breach path can be. LEASTCOST: the total lowering it may make" << std::endl;
     return -1;
   }
 
@@ -51,6 +57,8 @@ int main(int argc, char** argv) {
     mode = LindsayMode::SELECTIVE_BREACHING;
   else if (argv[3] == std::string("CONSTRAINED"))
     mode = LindsayMode::CONSTRAINED_BREACHING;
+  else if (argv[3] == std::string("LEASTCOST"))
+    mode = LindsayMode::LEAST_COST_BREACHING;
   else
     throw std::runtime_error("Unknown breaching mode!");
 
@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/depressions/Barnes2014.hpp>
 #include <richdem/depressions/Zhou2016.hpp>
@@ -26,6 +27,7 @@ int PerformAlgorithm(std::string outputname, uint32_t max_dep_size, std::string
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 4) {
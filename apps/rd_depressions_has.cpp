@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/depressions/Barnes2014.hpp>
 
@@ -23,6 +24,7 @@ int PerformAlgorithm(std::string analysis, Array2D<T> elevation) {
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 2) {
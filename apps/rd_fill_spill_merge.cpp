@@ -1,5 +1,6 @@
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/gdal.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/depressions/fill_spill_merge.hpp>
 #include <richdem/misc/misc_methods.hpp>
 #include <richdem/ui/cli_options.hpp>
@@ -21,6 +22,7 @@ int main(int argc, char** argv) {
   double surface_water_level = std::numeric_limits<double>::quiet_NaN();
   std::string surface_water_filename;
   double ocean_level;
+  rd::ParallelismConfig parallelism;
 
   size_t num;
   size_t len;
@@ -34,9 +36,12 @@ int main(int argc, char** argv) {
       save_dh_filename,
       "Filename where you would like the depression hierarchy to be saved for reuse (optional, requires Boost). If the "
       "file is present, DH is loaded from it; otherwise, DH is saved to it.");
+  app.add_option("--threads", parallelism.threads, "Maximum number of threads to use (optional)")->check(CLI::PositiveNumber);
 
   CLI11_PARSE(app, argc, argv);
 
+  const rd::ParallelismScope parallelism_scope(parallelism);
+
   std::cout << "m Input DEM           = " << topography_filename << std::endl;
   std::cout << "m Output prefix       = " << output_prefix << std::endl;
   std::cout << "m Surface water level = " << surface_water_level << std::endl;
@@ -118,8 +123,9 @@ int main(int argc, char** argv) {
 
   timer_io.start();
 
-  // Output the water table depth
-  wtd.saveGDAL(output_prefix + "-wtd.tif");
+  // Output the water table depth. This is written from a copy in the
+  // background while we compute the hydraulic surface below.
+  auto wtd_saved = wtd.saveGDALAsync(output_prefix + "-wtd.tif");
 
   for (unsigned int i = 0; i < topo.size(); i++) {
     if (!topo.isNoData(i)) {
@@ -129,6 +135,7 @@ int main(int argc, char** argv) {
 
   // Output the new height of the hydraulic surface
   wtd.saveGDAL(output_prefix + "-hydrologic-surface-height.tif");
+  wtd_saved.get();
 
   timer_io.stop();
 
@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/methods/flow_accumulation.hpp>
 
@@ -33,17 +34,14 @@ int PerformAlgorithm(std::string output, int algorithm, float param, std::string
       FA_Tarboton(dem, accum);
       break;
     case 7:  // MD∞    - Seibert & McGlynn (2007)
-      std::cerr << "This FA is temporarily disabled.";
+      FA_SeibertMcGlynn(dem, accum, param);
       break;
-      // FA_SeibertMcGlynn(dem,accum,param);               break;
     case 8:  // D8-LTD - Orlandini et al. (2003)
-      std::cerr << "This FA is temporarily disabled.";
+      FA_Orlandini(dem, accum, OrlandiniMode::LTD, param);
       break;
-      // FA_Orlandini(dem,accum,OrlandiniMode::LTD,param); break;
     case 9:  // D8-LAD - Orlandini et al. (2003)
-      std::cerr << "This FA is temporarily disabled.";
+      FA_Orlandini(dem, accum, OrlandiniMode::LAD, param);
       break;
-      // FA_Orlandini(dem,accum,OrlandiniMode::LAD,param); break;
   }
 
   accum.scale(accum.getCellArea());
@@ -56,6 +54,7 @@ int PerformAlgorithm(std::string output, int algorithm, float param, std::string
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   int algorithm = 0;
@@ -72,8 +71,8 @@ int main(int argc, char** argv) {
     std::cerr << " 5: MD8    - Freeman (1991). Requires the parameter p. Suggested value: 1.1" << std::endl;
     std::cerr << " 6: D∞     - Tarboton (1997)" << std::endl;
     std::cerr << " 7: MD∞    - Seibert & McGlynn (2007). Requires the parameter x. Suggested value: 1.0" << std::endl;
-    std::cerr << " 8: D8-LTD - Orlandini et al. (2003). Requires the parameter x. Suggested value: 1.0" << std::endl;
-    std::cerr << " 9: D8-LAD - Orlandini et al. (2003). Requires the parameter x. Suggested value: 1.0" << std::endl;
+    std::cerr << " 8: D8-LTD - Orlandini et al. (2003). Requires the parameter lambda in [0,1]. Suggested value: 1.0" << std::endl;
+    std::cerr << " 9: D8-LAD - Orlandini et al. (2003). Requires the parameter lambda in [0,1]. Suggested value: 1.0" << std::endl;
     return -1;
   }
 
@@ -1,6 +1,7 @@
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/Layoutfile.hpp>
 #include <richdem/common/constants.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/timer.hpp>
 #include <richdem/tiled/A2Array2D.hpp>
 
@@ -38,6 +39,8 @@ void Master(std::string layoutfile, int cachesize, std::string outputname, std::
 }
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
+
   if (argc != 5) {
     std::cerr << "Syntax: " << argv[0] << " <Layout File> <Cache size> <Output File> <noflip/fliph/flipv/fliphv>"
               << std::endl;
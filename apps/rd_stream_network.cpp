@@ -0,0 +1,60 @@
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
+#include <richdem/common/version.hpp>
+#include <richdem/depressions/Barnes2014.hpp>
+#include <richdem/methods/stream_network.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace richdem;
+
+template <class T>
+int PerformAlgorithm(std::string output, uint32_t threshold, std::string reach_raster, std::string analysis, Array2D<T> dem) {
+  dem.loadData();
+
+  Array2D<d8_flowdir_t> flowdirs;
+  std::vector<typename Array2D<T>::i_t> order;
+  PriorityFloodFlowdirs_Barnes2014(dem, flowdirs, &order);
+
+  Array2D<uint32_t> labels;
+  const auto reaches = ExtractStreamNetworkFromOrder(flowdirs, order, threshold, &labels);
+
+  std::ofstream fout(output);
+  if (!fout.good()) {
+    std::cerr << "Could not open '" << output << "' for writing!" << std::endl;
+    return -1;
+  }
+  WriteStreamNetwork(fout, reaches, flowdirs);
+
+  if (!reach_raster.empty()) {
+    labels.geotransform = dem.geotransform;
+    labels.projection   = dem.projection;
+    labels.saveGDAL(reach_raster, analysis);
+  }
+
+  return 0;
+}
+
+#include "router.hpp"
+
+int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
+  std::string analysis = PrintRichdemHeader(argc, argv);
+
+  if (argc < 4 || argc > 5) {
+    std::cerr << "Extract the stream network of a DEM as an edge list of reaches" << std::endl;
+    std::cerr << argv[0] << " <DEM file> <Threshold> <Output CSV> [Reach raster]" << std::endl;
+    std::cerr << "Cells draining at least <Threshold> cells, including themselves, are streams." << std::endl;
+    return -1;
+  }
+
+  const uint32_t threshold = std::stoul(argv[2]);
+  const std::string reach_raster = (argc == 5) ? argv[4] : "";
+
+  PerformAlgorithm(argv[1], argv[3], threshold, reach_raster, analysis);
+
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/router.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/misc/misc_methods.hpp>
@@ -37,6 +38,7 @@ int PerformAlgorithm(const double zscale, std::string analysis, Array2D<T> eleva
 }
 
 int main(int argc, char** argv) {
+  const richdem::ParallelismScope parallelism(richdem::ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   if (argc != 3) {
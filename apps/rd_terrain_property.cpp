@@ -1,4 +1,5 @@
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/methods/terrain_attributes.hpp>
 
@@ -48,6 +49,7 @@ int PerformAlgorithm(std::string output, int algorithm, float z_scale, std::stri
 #include "router.hpp"
 
 int main(int argc, char** argv) {
+  const ParallelismScope parallelism(ConsumeThreadsArgument(argc, argv));
   std::string analysis = PrintRichdemHeader(argc, argv);
 
   int algorithm = 0;
@@ -10,6 +10,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/version.hpp>
 #include <richdem/common/constants.hpp>
+#include <richdem/common/cpu_dispatch.hpp>
 #include <richdem/common/ManagedVector.hpp>
 
 #include "gdal.hpp"
@@ -28,6 +29,7 @@
 #include <cmath>
 #include <ctime>         //Used for timestamping output files
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -53,7 +55,7 @@ inline std::map<std::string, std::string> ProcessMetadata(char **metadata){
   if(metadata==NULL)
     return ret;
 
-  for(int metstri=0;metadata[metstri]==NULL;metstri++){
+  for(int metstri=0;metadata[metstri]!=NULL;metstri++){
     std::string metstr = metadata[metstri];
     const auto equals  = metstr.find("=");
     if(equals==std::string::npos){
@@ -171,8 +173,8 @@ class Array2D {
 
     RDLOG_PROGRESS<<"Trying to open file '"<<filename<<"'...";
 
-    GDALDataset *fin = (GDALDataset*)GDALOpen(filename.c_str(), GA_ReadOnly);
-    if(fin==NULL)
+    const auto fin = getCachedGDALDataset(filename);
+    if(!fin)
       throw std::runtime_error("Could not open file '"+filename+"' with GDAL!");
 
     geotransform.resize(6);
@@ -213,8 +215,6 @@ class Array2D {
     view_xoff = xOffset;
     view_yoff = yOffset;
 
-    GDALClose(fin);
-
     if(load_data)
       loadData();
   }
@@ -264,7 +264,10 @@ class Array2D {
     out.write(reinterpret_cast<const char*>(&num_data_cells), sizeof(i_t));
     out.write(reinterpret_cast<const char*>(&no_data),        sizeof(T  ));
 
-    out.write(reinterpret_cast<const char*>(geotransform.data()), 6*sizeof(double));
+    //Rasters without a geotransform are cached with a blank one
+    auto out_geotransform = geotransform;
+    out_geotransform.resize(6, 0.0);
+    out.write(reinterpret_cast<const char*>(out_geotransform.data()), 6*sizeof(double));
     std::string::size_type projection_size = projection.size();
     out.write(reinterpret_cast<const char*>(&projection_size), sizeof(std::string::size_type));
     out.write(reinterpret_cast<const char*>(projection.data()), projection.size()*sizeof(const char));
@@ -466,6 +469,43 @@ class Array2D {
     this->filename = input_filename;
   }
 
+  /**
+    @brief Prepares the raster to load a GDAL file whose header has already
+           been read elsewhere, without opening the file.
+
+    This is equivalent to loading the file with `load_data=false`, but avoids
+    the cost of opening the file to read its header.
+
+    @param[in] input_filename File from which loadData() will read the data
+    @param[in] width0         Width of the file's raster in cells
+    @param[in] height0        Height of the file's raster in cells
+    @param[in] no_data0       NoData value of the file's raster
+    @param[in] geotransform0  Geotransform of the file
+    @param[in] projection0    Projection of the file
+    @param[in] metadata0      Metadata of the file
+  */
+  void setHeader(
+    const std::string &input_filename,
+    const xy_t width0,
+    const xy_t height0,
+    const T no_data0,
+    const std::vector<double> &geotransform0,
+    const std::string &projection0,
+    const std::map<std::string, std::string> &metadata0
+  ){
+    assert(empty());
+    from_cache   = false;
+    filename     = input_filename;
+    view_width   = width0;
+    view_height  = height0;
+    view_xoff    = 0;
+    view_yoff    = 0;
+    no_data      = no_data0;
+    geotransform = geotransform0;
+    projection   = projection0;
+    metadata     = metadata0;
+  }
+
   /**
     @brief Caches the raster data and all its properties to disk. Data is then
            purged from RAM.
@@ -493,9 +533,9 @@ class Array2D {
       loadNative(filename, true);
     } else {
       #ifdef USEGDAL
-      GDALDataset *fin = (GDALDataset*)GDALOpen(filename.c_str(), GA_ReadOnly);
-        if(fin==NULL)
-          throw std::runtime_error("Failed to loadData() into tile from '"+filename+"'");
+      const auto fin = getCachedGDALDataset(filename);
+      if(!fin)
+        throw std::runtime_error("Failed to loadData() into tile from '"+filename+"'");
 
       GDALRasterBand *band = fin->GetRasterBand(1);
 
@@ -503,8 +543,6 @@ class Array2D {
       auto temp = band->RasterIO( GF_Read, view_xoff, view_yoff, view_width, view_height, _data.data(), view_width, view_height, myGDALType(), 0, 0 );
       if(temp!=CE_None)
         throw std::runtime_error("An error occured while trying to read '"+filename+"' into RAM with GDAL.");
-
-      GDALClose(fin);
       #else
         throw std::runtime_error("RichDEM was not compiled with GDAL!");
       #endif
@@ -545,7 +583,7 @@ class Array2D {
   T noData() const { return no_data; }
 
   ///Finds the minimum value of the raster, ignoring NoData cells
-  T min() const {
+  RICHDEM_DISPATCH_CLONES T min() const {
     T minval = std::numeric_limits<T>::max();
     for(unsigned int i=0;i<size();i++){
       if(_data[i]==no_data)
@@ -556,7 +594,7 @@ class Array2D {
   }
 
   ///Finds the maximum value of the raster, ignoring NoData cells
-  T max() const {
+  RICHDEM_DISPATCH_CLONES T max() const {
     T maxval = std::numeric_limits<T>::lowest();
     for(unsigned int i=0;i<size();i++){
       if(_data[i]==no_data)
@@ -948,7 +986,7 @@ class Array2D {
   /**
     @brief Counts the number of cells which are not NoData.
   */
-  void countDataCells() const {
+  RICHDEM_DISPATCH_CLONES void countDataCells() const {
     num_data_cells = 0;
     for(unsigned int i=0;i<size();i++)
       if(_data[i]!=no_data)
@@ -966,6 +1004,20 @@ class Array2D {
     return num_data_cells;
   }
 
+  /**
+    @brief Determines whether any cell is NoData. Unlike numDataCells(), this
+           always looks at the cells, since writes through operator() do not
+           update the count, but stops at the first NoData cell.
+
+    @return True if at least one cell is NoData
+  */
+  RICHDEM_DISPATCH_CLONES bool hasNoData() const {
+    for(i_t i=0;i<size();i++)
+      if(_data[i]==no_data)
+        return true;
+    return false;
+  }
+
   /**
     @brief Return cell value based on i-coordinate
 
@@ -1022,6 +1074,19 @@ class Array2D {
     return _data[xyToI(x,y)];
   }
 
+  /**
+    @brief Set the value of a cell based on x,y coordinates. This is how
+           algorithms written for any raster (see raster_concept.hpp) write
+           cells.
+
+    @param[in]   x    X-coordinate of the cell
+    @param[in]   y    Y-coordinate of the cell
+    @param[in]   val  Value to give the cell
+  */
+  void set(const xy_t x, const xy_t y, const T &val){
+    (*this)(x,y) = val;
+  }
+
   /**
     @brief Returns a copy of the top row of the raster
 
@@ -1151,6 +1216,7 @@ class Array2D {
     GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
     if(poDriver==NULL)
       throw std::runtime_error("Could not open GDAL driver!");
+    forgetCachedGDALDataset(input_filename); //Don't let readers see stale data
     GDALDataset *fout    = poDriver->Create(input_filename.c_str(), width(), height(), 1, myGDALType(), papszOptions);
     if(fout==NULL)
       throw std::runtime_error("Could not open file '"+input_filename+"' for GDAL save!");
@@ -1219,6 +1285,35 @@ class Array2D {
 
     GDALClose(fout);
   }
+
+  /**
+    @brief Saves the raster on a background thread
+
+    The raster is copied and the copy is written, so this raster may be
+    modified, or destroyed, as soon as the call returns. Unlike saveGDAL(), the
+    processing history is added only to the copy's metadata.
+
+    Arguments are as for saveGDAL().
+
+    @return A future which becomes ready when the file has been written. Its
+            get() rethrows any error raised while writing.
+  */
+  std::future<void> saveGDALAsync(const std::string &filename, const std::string &metadata_str="", xy_t xoffset=0, xy_t yoffset=0, bool compress=false) const & {
+    return Array2D<T>(*this).saveGDALAsync(filename, metadata_str, xoffset, yoffset, compress);
+  }
+
+  /**
+    @brief Saves the raster on a background thread, taking ownership of it
+           rather than copying it
+
+    For use as `std::move(dem).saveGDALAsync(...)` when the raster is no longer
+    needed.
+  */
+  std::future<void> saveGDALAsync(const std::string &filename, const std::string &metadata_str="", xy_t xoffset=0, xy_t yoffset=0, bool compress=false) && {
+    return std::async(std::launch::async, [snapshot=std::move(*this), filename, metadata_str, xoffset, yoffset, compress]() mutable {
+      snapshot.saveGDAL(filename, metadata_str, xoffset, yoffset, compress);
+    });
+  }
   #endif
 
 
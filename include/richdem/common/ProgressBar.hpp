@@ -7,7 +7,7 @@
   multithreading by assuming uniform progress by all threads.
 
   Define the global macro `RICHDEM_NO_PROGRESS` disables the progress bar, which
-  may speed up the program.
+  may speed up the program. A LogSuppressor disables it on a single thread.
 
   The progress bar looks like this:
 
@@ -17,6 +17,7 @@
 */
 #pragma once
 
+#include <richdem/common/logger.hpp>
 #include <richdem/common/timer.hpp>
 
 #include <iomanip>
@@ -46,6 +47,8 @@ class ProgressBar{
 
     ///Clear current line on console so a new progress bar can be written
     void clearConsoleLine() const {
+      if(LoggingSuppressed())
+        return;
       std::cerr<<"\r\033[2K"<<std::flush;
     }
 
@@ -88,7 +91,7 @@ class ProgressBar{
         return;
       #endif
 
-      if(thread_num()!=0)
+      if(thread_num()!=0 || LoggingSuppressed())
         return;
 
       work_done = work_done0;
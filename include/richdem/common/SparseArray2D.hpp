@@ -0,0 +1,338 @@
+/**
+  @file
+  @brief Defines a block-sparse 2D array for rasters which are mostly NoData or
+         some other constant value.
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace richdem {
+
+/**
+  @brief  Class to hold rasters which are mostly a single value in little memory
+
+  Coastal and island DEMs may be mostly ocean or NoData. SparseArray2D divides
+  a raster into square blocks. A block in which every cell has the same value
+  stores only that value; other blocks store all of their cells. This is the
+  in-memory analogue of the null tiles of A2Array2D.
+
+  Algorithms which understand SparseArray2D can ask whether a block is
+  constant, or entirely NoData, and skip it wholesale rather than visiting
+  each of its cells.
+
+  Cells are read with `operator()` and written with `set()`. Writing a value to
+  a constant block which differs from the block's value allocates the block.
+  `compact()` returns blocks which have become constant to their compact form.
+
+  Only xy-addressing is supported.
+*/
+template<class T>
+class SparseArray2D {
+ public:
+  std::vector<double> geotransform; ///< Geotransform of the raster
+  std::string projection;           ///< Projection of the raster
+  std::map<std::string, std::string> metadata; ///< Raster's metadata in key-value pairs
+
+  typedef int32_t xy_t;             ///< xy-addressing data type
+
+ private:
+  template<typename> friend class SparseArray2D;
+
+  xy_t view_width       = 0;        ///< Width of raster in cells
+  xy_t view_height      = 0;        ///< Height of raster in cells
+  int  block_bits       = 6;        ///< Blocks are 2^block_bits cells on a side
+  xy_t width_in_blocks  = 0;        ///< Number of blocks across the raster
+  xy_t height_in_blocks = 0;        ///< Number of blocks down the raster
+
+  T no_data = -1;                   ///< NoData value of the raster
+
+  std::vector< std::vector<T> > blocks;       ///< Cells of each block. Empty if the block is constant.
+  std::vector<T>                block_values; ///< Value of every cell of each constant block
+
+  std::size_t blockIndex(const xy_t x, const xy_t y) const {
+    return (std::size_t)(y>>block_bits)*width_in_blocks + (x>>block_bits);
+  }
+
+  std::size_t cellIndex(const xy_t x, const xy_t y) const {
+    const xy_t mask = blockSize()-1;
+    return ((std::size_t)(y&mask)<<block_bits) + (x&mask);
+  }
+
+ public:
+  SparseArray2D() = default;
+
+  /**
+    @brief Creates a raster of the specified dimensions in which every block is
+           constant
+
+    @param[in] width       Width of the raster
+    @param[in] height      Height of the raster
+    @param[in] val         Initial value of all the raster's cells
+    @param[in] block_bits0 Blocks are 2^block_bits0 cells on a side
+  */
+  SparseArray2D(const xy_t width, const xy_t height, const T& val = T(), const int block_bits0 = 6){
+    resize(width, height, val, block_bits0);
+  }
+
+  /**
+    @brief Creates a raster with the same dimensions, blocks, and geographic
+           properties as another. All the new raster's blocks are constant.
+
+    @param[in] other   Raster to copy the shape of
+    @param[in] val     Initial value of all the raster's cells
+  */
+  template<class U>
+  SparseArray2D(const SparseArray2D<U> &other, const T& val = T()){
+    resize(other.width(), other.height(), val, other.block_bits);
+    geotransform = other.geotransform;
+    projection   = other.projection;
+    metadata     = other.metadata;
+  }
+
+  /**
+    @brief Converts a dense raster, keeping only those blocks which are not
+           constant
+
+    @param[in] dense       Raster to convert
+    @param[in] block_bits0 Blocks are 2^block_bits0 cells on a side
+  */
+  explicit SparseArray2D(const Array2D<T> &dense, const int block_bits0 = 6){
+    resize(dense.width(), dense.height(), dense.noData(), block_bits0);
+    no_data      = dense.noData();
+    geotransform = dense.geotransform;
+    projection   = dense.projection;
+    metadata     = dense.metadata;
+
+    #pragma omp parallel for schedule(dynamic)
+    for(std::size_t b=0;b<blocks.size();b++){
+      const auto [x0, y0, x1, y1] = blockExtent(b%width_in_blocks, b/width_in_blocks);
+      const T first   = dense(x0,y0);
+      bool   constant = true;
+      for(xy_t y=y0;y<y1 && constant;y++)
+      for(xy_t x=x0;x<x1;x++)
+        if(dense(x,y)!=first){
+          constant = false;
+          break;
+        }
+
+      block_values[b] = first;
+      if(constant)
+        continue;
+
+      blocks[b].resize((std::size_t)blockSize()*blockSize(), first);
+      for(xy_t y=y0;y<y1;y++)
+      for(xy_t x=x0;x<x1;x++)
+        blocks[b][cellIndex(x,y)] = dense(x,y);
+    }
+  }
+
+  /**
+    @brief Expands the raster into a dense Array2D
+
+    @return A dense copy of the raster
+  */
+  Array2D<T> toArray2D() const {
+    Array2D<T> dense(view_width, view_height);
+    dense.setNoData(no_data);
+    dense.geotransform = geotransform;
+    dense.projection   = projection;
+    dense.metadata     = metadata;
+
+    #pragma omp parallel for collapse(2)
+    for(xy_t y=0;y<view_height;y++)
+    for(xy_t x=0;x<view_width;x++)
+      dense(x,y) = (*this)(x,y);
+
+    return dense;
+  }
+
+  /**
+    @brief Resize the raster. Note: this clears all the raster's data.
+
+    @param[in] width0      New width of the raster
+    @param[in] height0     New height of the raster
+    @param[in] val0        Value to set all the cells to
+    @param[in] block_bits0 Blocks are 2^block_bits0 cells on a side
+  */
+  void resize(const xy_t width0, const xy_t height0, const T& val0 = T(), const int block_bits0 = 6){
+    if(width0<0 || height0<0)
+      throw std::runtime_error("SparseArray2D dimensions must be non-negative!");
+    if(block_bits0<1 || block_bits0>15)
+      throw std::runtime_error("SparseArray2D blocks must be between 2 and 32768 cells on a side!");
+
+    view_width       = width0;
+    view_height      = height0;
+    block_bits       = block_bits0;
+    width_in_blocks  = (width0 +blockSize()-1)>>block_bits;
+    height_in_blocks = (height0+blockSize()-1)>>block_bits;
+
+    blocks.clear();
+    blocks.resize((std::size_t)width_in_blocks*height_in_blocks);
+    block_values.assign(blocks.size(), val0);
+  }
+
+  ///@return Width of the raster in cells
+  xy_t width () const { return view_width;  }
+  ///@return Height of the raster in cells
+  xy_t height() const { return view_height; }
+  ///@return Number of cells in the raster
+  std::size_t size() const { return (std::size_t)view_width*view_height; }
+  ///@return True if the raster has no cells
+  bool empty() const { return size()==0; }
+
+  ///@return The NoData value of the raster
+  T noData() const { return no_data; }
+
+  ///@brief Sets the NoData value of the raster
+  void setNoData(const T &ndval){ no_data = ndval; }
+
+  ///@return True if (x,y) lies within the raster
+  bool inGrid(const xy_t x, const xy_t y) const {
+    return 0<=x && x<view_width && 0<=y && y<view_height;
+  }
+
+  ///@return True if (x,y) lies on the boundary of the raster
+  bool isEdgeCell(const xy_t x, const xy_t y) const {
+    return x==0 || y==0 || x==view_width-1 || y==view_height-1;
+  }
+
+  ///@return True if the cell at (x,y) is NoData
+  bool isNoData(const xy_t x, const xy_t y) const {
+    return (*this)(x,y)==no_data;
+  }
+
+  ///@return True if the cell at (x,y) is not NoData
+  bool isData(const xy_t x, const xy_t y) const {
+    return !isNoData(x,y);
+  }
+
+  /**
+    @brief Return cell value based on x,y coordinates
+
+    @param[in]   x    X-coordinate of cell whose data should be fetched.
+    @param[in]   y    Y-coordinate of cell whose data should be fetched.
+
+    @return The value of the cell identified by x,y
+  */
+  T operator()(const xy_t x, const xy_t y) const {
+    assert(inGrid(x,y));
+    const auto b = blockIndex(x,y);
+    if(blocks[b].empty())
+      return block_values[b];
+    return blocks[b][cellIndex(x,y)];
+  }
+
+  /**
+    @brief Sets the value of a cell, allocating its block if necessary
+
+    Not safe to call concurrently for cells of the same block if that block
+    may need to be allocated.
+
+    @param[in]   x    X-coordinate of cell to set
+    @param[in]   y    Y-coordinate of cell to set
+    @param[in]   val  Value to give the cell
+  */
+  void set(const xy_t x, const xy_t y, const T &val){
+    assert(inGrid(x,y));
+    const auto b = blockIndex(x,y);
+    if(blocks[b].empty()){
+      if(block_values[b]==val)
+        return;
+      blocks[b].resize((std::size_t)blockSize()*blockSize(), block_values[b]);
+    }
+    blocks[b][cellIndex(x,y)] = val;
+  }
+
+  ///@return The number of cells on a side of a block
+  xy_t blockSize() const { return xy_t(1)<<block_bits; }
+  ///@return The number of blocks across the raster
+  xy_t widthInBlocks () const { return width_in_blocks;  }
+  ///@return The number of blocks down the raster
+  xy_t heightInBlocks() const { return height_in_blocks; }
+
+  /**
+    @brief Returns the cells covered by a block. Blocks on the right and bottom
+           edges of the raster may be smaller than blockSize().
+
+    @param[in] bx  X-coordinate of the block
+    @param[in] by  Y-coordinate of the block
+
+    @return {x0, y0, x1, y1} such that the block covers x0<=x<x1, y0<=y<y1
+  */
+  std::array<xy_t, 4> blockExtent(const xy_t bx, const xy_t by) const {
+    const xy_t x0 = bx<<block_bits;
+    const xy_t y0 = by<<block_bits;
+    return {{x0, y0, std::min(x0+blockSize(),view_width), std::min(y0+blockSize(),view_height)}};
+  }
+
+  ///@return True if every cell of the block has the same, known, value
+  bool blockIsConstant(const xy_t bx, const xy_t by) const {
+    return blocks[(std::size_t)by*width_in_blocks+bx].empty();
+  }
+
+  ///@return The value of a constant block. Meaningless for other blocks.
+  T blockValue(const xy_t bx, const xy_t by) const {
+    return block_values[(std::size_t)by*width_in_blocks+bx];
+  }
+
+  ///@return True if every cell of the block is NoData
+  bool blockIsNoData(const xy_t bx, const xy_t by) const {
+    return blockIsConstant(bx,by) && blockValue(bx,by)==no_data;
+  }
+
+  ///@brief Sets every cell of a block to `val`, freeing its memory
+  void setBlock(const xy_t bx, const xy_t by, const T &val){
+    const auto b = (std::size_t)by*width_in_blocks+bx;
+    blocks[b]       = std::vector<T>();
+    block_values[b] = val;
+  }
+
+  ///@return The number of blocks which store all of their cells
+  std::size_t numAllocatedBlocks() const {
+    std::size_t count = 0;
+    for(const auto &b: blocks)
+      count += !b.empty();
+    return count;
+  }
+
+  /**
+    @brief Frees the memory of any allocated blocks whose cells have all come
+           to have the same value
+  */
+  void compact(){
+    #pragma omp parallel for schedule(dynamic)
+    for(std::size_t b=0;b<blocks.size();b++){
+      if(blocks[b].empty())
+        continue;
+      //Cells past the edge of the raster are never written and keep the value
+      //the block was allocated with, so they are compared against only if they
+      //are part of the block.
+      const auto [x0, y0, x1, y1] = blockExtent(b%width_in_blocks, b/width_in_blocks);
+      const T first   = blocks[b][cellIndex(x0,y0)];
+      bool   constant = true;
+      for(xy_t y=y0;y<y1 && constant;y++)
+      for(xy_t x=x0;x<x1;x++)
+        if(blocks[b][cellIndex(x,y)]!=first){
+          constant = false;
+          break;
+        }
+      if(constant){
+        blocks[b]       = std::vector<T>();
+        block_values[b] = first;
+      }
+    }
+  }
+};
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+
+//A disjoint-set/union-find class which many threads may use at once. Like
+//`DisjointDenseIntSet`, every integer between 0 and N-1 is a set; unlike it, N
+//is fixed at construction since the storage cannot be grown while other
+//threads are reading it.
+//
+//No locks are used. A union links one root to another with a single atomic
+//compare-and-swap and retries if another thread got there first. A find never
+//waits on another thread: it walks up the chain of parents and, as it goes,
+//points each set it visits at its grandparent ("path halving"). Path halving
+//only ever shortens chains, so it is safe even while other threads are walking
+//the same chain.
+//
+//Roots are always linked so that the root with the larger id becomes a child
+//of the root with the smaller id. Since every parent has a smaller id than its
+//child, no interleaving of unions can create a cycle. This "linking by index"
+//takes the place of the ranks used by `DisjointDenseIntSet`, which cannot be
+//kept consistent with a single compare-and-swap. In practice, path halving
+//keeps the chains short.
+class ConcurrentDisjointIntSet {
+ private:
+  //Which set is this set's parent. May be the set itself.
+  std::unique_ptr<std::atomic<uint32_t>[]> parent;
+  //Number of sets
+  uint32_t N = 0;
+
+  void checkRange(const uint32_t n, const char *const method) const {
+    if(n >= N){
+      throw std::runtime_error(std::string("ConcurrentDisjointIntSet::") + method + "(" + std::to_string(n) + ") is looking for a set outside the valid range, which is [0," + std::to_string(N) + ")!");
+    }
+  }
+
+ public:
+  // Create a ConcurrentDisjointIntSet with `N` sets, each its own parent.
+  ConcurrentDisjointIntSet(const uint32_t N0) : parent(new std::atomic<uint32_t>[N0]), N(N0) {
+    #pragma omp parallel for
+    for(uint32_t i = 0; i < N; i++) {
+      parent[i].store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentDisjointIntSet(const ConcurrentDisjointIntSet &) = delete;
+  ConcurrentDisjointIntSet& operator=(const ConcurrentDisjointIntSet &) = delete;
+
+  //Returns the number of sets
+  uint32_t size() const {
+    return N;
+  }
+
+  //Returns the highest set id.
+  uint32_t maxElement() const {
+    return N - 1;
+  }
+
+  // Follows a set's chain of parents until a set which is its own parent is
+  // reached and returns that set's id. Safe to call concurrently with
+  // `unionSet()`, though the returned root may have been linked to another by
+  // the time the caller looks at it.
+  uint32_t findSet(uint32_t n){
+    checkRange(n, "findSet");
+    while(true){
+      auto p = parent[n].load(std::memory_order_acquire);
+      if(p == n)                    //Am I my own parent?
+        return n;                   //Yes: I represent the set in question.
+      const auto gp = parent[p].load(std::memory_order_acquire);
+      if(p != gp){
+        //Skip my parent. If this fails someone else has already shortened the
+        //chain, which is just as good.
+        parent[n].compare_exchange_weak(p, gp, std::memory_order_release, std::memory_order_relaxed);
+      }
+      n = gp;
+    }
+  }
+
+  // Join two sets into a single set. Returns true if this call merged them and
+  // false if they were already the same set.
+  bool unionSet(uint32_t a, uint32_t b){
+    while(true){
+      a = findSet(a);
+      b = findSet(b);
+      if(a == b)
+        return false;
+      if(a < b)                     //Make `a` the root with the larger id
+        std::swap(a, b);
+      auto expected = a;
+      //Link A under B, but only if A is still a root. Otherwise, another thread
+      //has linked A in the meantime and we try again from A's new root.
+      if(parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel, std::memory_order_acquire))
+        return true;
+    }
+  }
+
+  //Returns true if A and B belong to the same set.
+  bool sameSet(uint32_t a, uint32_t b){
+    while(true){
+      a = findSet(a);
+      b = findSet(b);
+      if(a == b)
+        return true;
+      //A and B had different roots. If A is still a root then that was true at
+      //the moment we checked; otherwise a union intervened and we look again.
+      if(parent[a].load(std::memory_order_acquire) == a)
+        return false;
+    }
+  }
+
+  // Point every set directly at its root, in parallel. Afterwards, and until
+  // the next `unionSet()`, `parentOf(n)` is the representative of `n`. Must not
+  // run concurrently with `unionSet()`.
+  void flatten(){
+    #pragma omp parallel for
+    for(uint32_t i = 0; i < N; i++) {
+      parent[i].store(findSet(i), std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the set's parent without following the chain. After `flatten()`
+  // this is the set's representative.
+  uint32_t parentOf(const uint32_t n) const {
+    checkRange(n, "parentOf");
+    return parent[n].load(std::memory_order_relaxed);
+  }
+};
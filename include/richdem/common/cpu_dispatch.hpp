@@ -0,0 +1,70 @@
+/**
+  @file
+  @brief Selects, when a program is loaded, the best version of RichDEM's hot
+         kernels for the processor it is running on.
+
+  Binaries and Python wheels are built for a baseline processor so they run
+  everywhere, which means they would not use vector instructions such as AVX2
+  or AVX-512 even where those are available. Functions marked with
+  RICHDEM_DISPATCH_CLONES are instead compiled several times, once for each
+  supported instruction set, and the dynamic loader picks the best version for
+  the running processor the first time the program starts.
+
+  Dispatch is enabled by defining RICHDEM_CPU_DISPATCH (the CMake option of the
+  same name does this) and is available with GCC and Clang on x86-64 ELF
+  platforms such as Linux. Elsewhere the marked functions are compiled once, as
+  usual.
+
+  Since each marked function is called through a pointer chosen at load time,
+  it cannot be inlined into its caller. Only functions which do a lot of work
+  per call, such as a loop over a tile of cells, should be marked.
+*/
+#pragma once
+
+#if defined(RICHDEM_CPU_DISPATCH) && defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute)
+  #if __has_attribute(target_clones)
+    #define RICHDEM_HAS_CPU_DISPATCH
+  #endif
+#endif
+
+//GCC 12 and later can target the x86-64 microarchitecture levels, which also
+//enable FMA, BMI, and the like. Other compilers target single features.
+#if defined(RICHDEM_HAS_CPU_DISPATCH) && !defined(__clang__) && __GNUC__>=12
+  #define RICHDEM_DISPATCH_BY_LEVEL
+#endif
+
+#if defined(RICHDEM_DISPATCH_BY_LEVEL)
+  #define RICHDEM_DISPATCH_CLONES __attribute__((target_clones("default","arch=x86-64-v3","arch=x86-64-v4")))
+#elif defined(RICHDEM_HAS_CPU_DISPATCH)
+  #define RICHDEM_DISPATCH_CLONES __attribute__((target_clones("default","avx2","avx512f")))
+#else
+  #define RICHDEM_DISPATCH_CLONES
+#endif
+
+namespace richdem {
+
+/**
+  @brief Names the version of the hot kernels chosen for this processor
+
+  @return "x86-64-v4" or "avx512f" (AVX-512), "x86-64-v3" or "avx2" (AVX2),
+          "default", or "disabled" if RichDEM was compiled without dispatch
+*/
+inline const char* CPUDispatchTarget(){
+  #if defined(RICHDEM_DISPATCH_BY_LEVEL)
+    if(__builtin_cpu_supports("x86-64-v4"))
+      return "x86-64-v4";
+    if(__builtin_cpu_supports("x86-64-v3"))
+      return "x86-64-v3";
+    return "default";
+  #elif defined(RICHDEM_HAS_CPU_DISPATCH)
+    if(__builtin_cpu_supports("avx512f"))
+      return "avx512f";
+    if(__builtin_cpu_supports("avx2"))
+      return "avx2";
+    return "default";
+  #else
+    return "disabled";
+  #endif
+}
+
+}
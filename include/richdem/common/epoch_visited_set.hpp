@@ -0,0 +1,80 @@
+/**
+  @file
+  @brief Defines a set of visited cells which can be cleared in constant time.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace richdem {
+
+/**
+  @brief  Tracks which of N items have been visited by a search which is run
+          many times
+
+  Each item holds the number of the search, or "epoch", in which it was last
+  visited. An item is in the set if its stamp equals the current epoch, so
+  membership tests are a single array access with no hashing, and clearing the
+  set only increments the epoch. The stamps are zeroed only when the epoch
+  wraps around, once every four billion clears.
+
+  This makes the set well-suited to searches, such as flooding a single
+  depression, which touch a small part of a large raster but are repeated
+  many times: the memory is allocated once and reused by every search.
+
+  Items outside the set's range are never contained in it.
+*/
+class EpochVisitedSet {
+ private:
+  std::vector<uint32_t> stamps; ///< Epoch in which each item was last visited
+  uint32_t epoch = 1;           ///< Items stamped with this are in the set
+
+ public:
+  EpochVisitedSet() = default;
+
+  ///@brief Creates an empty set able to hold the items 0<=i<n
+  explicit EpochVisitedSet(const std::size_t n) : stamps(n, 0) {}
+
+  ///@brief Empties the set and makes it able to hold the items 0<=i<n
+  void resize(const std::size_t n){
+    stamps.assign(n, 0);
+    epoch = 1;
+  }
+
+  ///@return The number of items the set can hold
+  std::size_t size() const {
+    return stamps.size();
+  }
+
+  ///@brief Empties the set in constant time
+  void clear(){
+    if(++epoch==0){ //The epoch has wrapped around, so old stamps may match it
+      std::fill(stamps.begin(), stamps.end(), 0);
+      epoch = 1;
+    }
+  }
+
+  ///@return True if the item has been visited since the last clear()
+  bool contains(const std::size_t i) const {
+    return i<stamps.size() && stamps[i]==epoch;
+  }
+
+  /**
+    @brief Marks an item as visited
+
+    @param[in] i  Item to mark. Must be less than size().
+
+    @return True if the item was not already in the set
+  */
+  bool insert(const std::size_t i){
+    if(stamps[i]==epoch)
+      return false;
+    stamps[i] = epoch;
+    return true;
+  }
+};
+
+}
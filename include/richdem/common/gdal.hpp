@@ -3,11 +3,87 @@
 #ifdef USEGDAL
 
 #include "gdal_priv.h"
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <typeinfo>
+#include <vector>
 
 namespace richdem {
 
+namespace detail {
+struct CachedGDALDataset;
+}
+
+/**
+  @brief  Handle to a read-only GDAL dataset drawn from a process-wide cache
+
+  Handles are obtained from getCachedGDALDataset(). While a handle is alive its
+  dataset cannot be evicted from the cache and no other thread may use the
+  dataset: GDAL datasets are not safe for concurrent use, so a thread asking for
+  a dataset another thread holds waits until it is released. A thread may hold
+  several handles to the same dataset at once.
+
+  A default-constructed handle, or one for a file GDAL could not open, is empty
+  and converts to false.
+*/
+class GDALDatasetHandle {
+ public:
+  GDALDatasetHandle() = default;
+  explicit GDALDatasetHandle(std::shared_ptr<detail::CachedGDALDataset> entry0);
+  GDALDatasetHandle(GDALDatasetHandle &&) = default;
+
+  GDALDatasetHandle& operator=(GDALDatasetHandle &&o) noexcept {
+    //Unlock before possibly destroying the entry holding the mutex
+    lock  = std::move(o.lock);
+    entry = std::move(o.entry);
+    return *this;
+  }
+
+  ///@return The dataset, or nullptr if the handle is empty
+  GDALDataset* get() const;
+  GDALDataset* operator->() const { return get(); }
+  explicit operator bool() const { return get()!=nullptr; }
+
+ private:
+  std::shared_ptr<detail::CachedGDALDataset> entry; ///< Keeps the dataset open
+  std::unique_lock<std::recursive_mutex> lock;      ///< Gives this thread exclusive use. Destroyed before `entry`
+};
+
+/**
+  @brief  Open a GDAL file read-only, reusing a cached handle if there is one
+
+  Files are opened once per process and kept open after the last handle to them
+  is released, so their headers need not be parsed again. The least-recently
+  used idle datasets are closed when the cache holds more than
+  setGDALDatasetCacheSize() datasets; datasets with live handles are never
+  closed.
+
+  On each lookup the file's modification time and size are compared with those
+  it had when it was opened; if either has changed the file is opened afresh.
+  Handles already given out keep using the old dataset. Within RichDEM, files
+  are also forgotten before they are written.
+
+  @param[in]  filename   File to open
+
+  @return A handle to the dataset, which is empty if GDAL could not open it
+*/
+GDALDatasetHandle getCachedGDALDataset(const std::string &filename);
+
+///@brief Close and forget any cached dataset for `filename`. Should be called
+///       before the file is overwritten.
+void forgetCachedGDALDataset(const std::string &filename);
+
+///@brief Close and forget all idle cached datasets.
+void clearGDALDatasetCache();
+
+///@brief Set the number of datasets the cache may hold open (default 64).
+void setGDALDatasetCacheSize(std::size_t size);
+
 /**
   @brief  Determine data type of a GDAL file's first layer
   @author Richard Barnes (rbarnes@umn.edu)
@@ -36,9 +112,8 @@ void getGDALHeader(
   T       &no_data,
   double  geotransform[6]
 ){
-  GDALAllRegister();
-  GDALDataset *fin = (GDALDataset*)GDALOpen(filename.c_str(), GA_ReadOnly);
-  if(fin==NULL)
+  const auto fin = getCachedGDALDataset(filename);
+  if(!fin)
     throw std::runtime_error("Could not get GDAL header: file '" + filename + "'' did not open!");
 
   GDALRasterBand *band   = fin->GetRasterBand(1);
@@ -48,8 +123,6 @@ void getGDALHeader(
   width   = band->GetXSize();
 
   fin->GetGeoTransform(geotransform);
-
-  GDALClose(fin);
 }
 
 
@@ -74,6 +147,78 @@ void getGDALDimensions(
 
 
 
+///A rectangular window of a raster band: the cells xoff<=x<xoff+width,
+///yoff<=y<yoff+height. A width or height of 0 extends the window to the edge of
+///the band.
+struct GDALWindow {
+  int32_t xoff   = 0;
+  int32_t yoff   = 0;
+  int32_t width  = 0;
+  int32_t height = 0;
+};
+
+///Describes a window of a band of a GDAL file, as returned by getGDALWindowInfo()
+struct GDALWindowInfo {
+  GDALWindow   window;                  ///< Window with its width and height filled in
+  GDALDataType dtype        = GDT_Unknown;
+  double       no_data      = 0;
+  bool         has_no_data  = false;    ///< Whether the band has a NoData value
+  int32_t      block_width  = 0;        ///< Natural block size of the band. Reads are aligned to these.
+  int32_t      block_height = 0;
+  int          overview_count = 0;      ///< Number of overviews the band has
+  std::vector<double> geotransform;     ///< Geotransform of the window at the requested overview
+  std::string  projection;
+  std::map<std::string, std::string> metadata;
+};
+
+/**
+  @brief  Retrieve what readGDALWindow() will read: the window's dimensions,
+          data type, NoData value, and geotransform
+
+  @param[in]  filename   GDAL file to peek at
+  @param[in]  band       Band to read, counting from 1
+  @param[in]  overview   Overview to read, counting from 0, or -1 for full
+                         resolution. Window coordinates are in the overview's
+                         cells.
+  @param[in]  window     Window to read
+
+  @return Information about the window. Throws if the file, band, overview, or
+          window are invalid.
+*/
+GDALWindowInfo getGDALWindowInfo(const std::string &filename, int band=1, int overview=-1, GDALWindow window=GDALWindow());
+
+/**
+  @brief  Read a window of a band of a GDAL file directly into a buffer, in
+          parallel
+
+  The window is divided into strips aligned with the band's blocks, so that no
+  block is decompressed more than once, and the strips are read by several
+  threads, each with its own handle to the file. Data is converted to
+  `buf_type` by GDAL as it is read, so no intermediate copy is made.
+
+  @param[in]  filename   GDAL file to read
+  @param[in]  band       Band to read, counting from 1
+  @param[in]  overview   Overview to read, counting from 0, or -1 for full
+                         resolution
+  @param[in]  window     Window to read
+  @param[in]  buf_type   Type of the cells of `buffer`
+  @param[out] buffer     Row-major buffer with room for the whole window
+  @param[in]  threads    Maximum number of threads to use; 0 uses the calling
+                         thread's limit
+*/
+void readGDALWindow(const std::string &filename, int band, int overview, GDALWindow window, GDALDataType buf_type, void *buffer, int threads=0);
+
+/**
+  @brief  As readGDALWindow() above, for a window already described by
+          getGDALWindowInfo(), so that the file's header is not read twice
+
+  @param[in]  info       Description of the window, from getGDALWindowInfo()
+                         for the same file, band, and overview
+*/
+void readGDALWindow(const std::string &filename, int band, int overview, const GDALWindowInfo &info, GDALDataType buf_type, void *buffer, int threads=0);
+
+
+
 /**
   @brief  Convert Array2D or any other template to its GDAL data type
   @author Richard Barnes (rbarnes@umn.edu)
@@ -20,8 +20,8 @@ void LoadGDAL(
   arr.clear();
   arr.filename = filename;
 
-  GDALDataset *fin = (GDALDataset*)GDALOpen(filename.c_str(), GA_ReadOnly);
-  if(fin==NULL)
+  const auto fin = getCachedGDALDataset(filename);
+  if(!fin)
     throw std::runtime_error("Could not open file '"+filename+"' with GDAL!");
 
   arr.geotransform.resize(6);
@@ -85,8 +85,6 @@ void LoadGDAL(
   //   }
   // }
 
-  GDALClose(fin);
-
   //TODO
   // if(exact && (total_width-xOffset!=part_width || total_height-yOffset!=part_height))
     // throw std::runtime_error("Tile dimensions did not match expectations!");
@@ -105,6 +103,7 @@ void SaveGDAL(const Array2D<T> &arr, const std::string &filename, const std::str
   GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
   if(poDriver==NULL)
     throw std::runtime_error("Could not open GDAL driver!");
+  forgetCachedGDALDataset(filename); //Don't let readers see stale data
   GDALDataset *fout    = poDriver->Create(filename.c_str(), arr.width(), arr.height(), 1, NativeTypeToGDAL<T>(), papszOptions);
   if(fout==NULL)
     throw std::runtime_error("Could not open file '"+filename+"' for GDAL save!");
@@ -23,6 +23,34 @@ enum class LogFlag {
 void RDLOGfunc(const LogFlag flag, const char* file, const char* func, unsigned line, const std::string& msg);
 #endif
 
+namespace detail {
+  inline int& LogSuppressionDepth(){
+    thread_local int depth = 0;
+    return depth;
+  }
+}
+
+///@return True if log messages and progress bars are silenced on the calling
+///        thread (see LogSuppressor)
+inline bool LoggingSuppressed(){
+  return detail::LogSuppressionDepth()>0;
+}
+
+/**
+  @brief Silences log messages and progress bars on the calling thread for the
+         lifetime of the object
+
+  Useful where an algorithm is run many times on small inputs, so its output
+  would otherwise be repeated for each of them. Other threads are unaffected.
+*/
+class LogSuppressor {
+ public:
+  LogSuppressor(){ detail::LogSuppressionDepth()++; }
+  ~LogSuppressor(){ detail::LogSuppressionDepth()--; }
+  LogSuppressor(const LogSuppressor&) = delete;
+  LogSuppressor& operator=(const LogSuppressor&) = delete;
+};
+
 class StreamLogger {
  private:
   LogFlag     flag;
@@ -39,7 +67,8 @@ class StreamLogger {
     (void)func; // Suppress unused variable warning
     (void)line; // Suppress unused variable warning
     #ifdef RICHDEM_LOGGING
-      RDLOGfunc(flag, file, func, line, ss.str());
+      if(!LoggingSuppressed())
+        RDLOGfunc(flag, file, func, line, ss.str());
     #endif
   }
 
@@ -47,7 +76,8 @@ class StreamLogger {
   StreamLogger& operator<<(const T& t){
     (void)t; // Suppress unused variable warning
     #ifdef RICHDEM_LOGGING
-      ss << t;
+      if(!LoggingSuppressed())
+        ss << t;
     #endif
     return *this;
   }
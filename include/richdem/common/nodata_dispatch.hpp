@@ -0,0 +1,61 @@
+/**
+  @file
+  @brief Lets kernels skip their NoData checks where a raster has no NoData
+
+  Many inputs, such as clipped or gap-filled DEMs, contain no NoData cells at
+  all, and most cells of those which do are far from them. A kernel written as
+  a generic lambda taking an extra `check` argument, with its NoData tests
+  wrapped in `if constexpr(check)`, is compiled twice: with the tests, and
+  without them for use where they are known to pass.
+
+  WithNoDataCheck() chooses a version for a whole raster. For cell-by-cell
+  kernels, ParallelForCellsWithNoDataCheck() (in parallel.hpp) chooses one for
+  each tile, so rasters with NoData also use the fast version away from it.
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+
+#include <type_traits>
+
+namespace richdem {
+
+/**
+  @brief Calls `func` with a flag saying whether a raster has NoData cells
+
+  @param[in] raster  Raster to inspect
+  @param[in] func    Called as func(std::true_type()) if **raster** has a
+                     NoData cell and as func(std::false_type()) otherwise
+
+  @return Whatever `func` returns
+*/
+template<class T, class F>
+decltype(auto) WithNoDataCheck(const Array2D<T> &raster, F &&func){
+  if(raster.hasNoData())
+    return func(std::true_type());
+  else
+    return func(std::false_type());
+}
+
+/**
+  @brief Determines whether a rectangle of cells and all of their neighbours
+         are data cells
+
+  @param[in] raster       Raster to inspect
+  @param[in] x0,y0,x1,y1  Rectangle covering x0<=x<x1, y0<=y<y1
+
+  @return False if any cell of the rectangle, or any of their D8 neighbours, is
+          NoData or off the raster; otherwise, true
+*/
+template<class T>
+bool NeighbourhoodIsData(const Array2D<T> &raster, const int x0, const int y0, const int x1, const int y1){
+  if(x0<1 || y0<1 || x1>raster.width()-1 || y1>raster.height()-1)
+    return false;
+  for(int y=y0-1;y<=y1;y++)
+  for(int x=x0-1;x<=x1;x++)
+    if(raster.isNoData(x,y))
+      return false;
+  return true;
+}
+
+}
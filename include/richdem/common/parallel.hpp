@@ -0,0 +1,481 @@
+/**
+  @file
+  @brief Defines a tiled, load-balanced parallel-for used by RichDEM's
+         cell-by-cell algorithms.
+
+  Rather than each algorithm parallelizing over rows with its own OpenMP
+  pragma, rasters are divided into small 2D tiles which fit comfortably in
+  cache. Tiles are handed out to threads dynamically. If balancing is
+  requested, the tiles are handed out most expensive first, where a tile's
+  expense is estimated from the number of data cells it contains. This keeps
+  threads busy on rasters with large NoData regions, where some rows have much
+  more work than others, but costs an extra pass over the raster, so it is off
+  by default. ParallelForCellsWithNoDataCheck() makes that pass anyway, to find
+  the tiles near NoData, so it always balances.
+
+  The number of threads, their binding to processors, and whether nested
+  parallel regions may spawn threads can be set for a block of code with a
+  ParallelismScope. The settings apply only to the thread which creates the
+  scope, so several threads may each run RichDEM with their own limits.
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/cpu_dispatch.hpp>
+#include <richdem/common/nodata_dispatch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+namespace richdem {
+
+///How the threads of a parallel region are placed on processors
+enum class ThreadBinding {
+  Default, ///< Use the OpenMP runtime's policy (e.g. from OMP_PROC_BIND)
+  Close,   ///< Pack threads onto processors near the calling thread
+  Spread   ///< Spread threads evenly across processors and NUMA domains
+};
+
+///Limits on the parallelism RichDEM uses
+struct ParallelismConfig {
+  int threads           = 0;                      ///< Maximum number of threads. 0 uses OpenMP's default.
+  ThreadBinding binding = ThreadBinding::Default; ///< Placement of threads on processors
+  int max_active_levels = 0;                      ///< Deepest nesting of parallel regions which may spawn threads. 0 uses OpenMP's default; 1 disables nested parallelism.
+};
+
+namespace detail {
+  struct ParallelismState {
+    ParallelismConfig config;
+    int default_threads = -1; ///< OpenMP's settings before they were first changed
+    int default_levels  = -1;
+  };
+
+  inline ParallelismState& GetParallelismState(){
+    thread_local ParallelismState state;
+    return state;
+  }
+}
+
+///@return True if RichDEM was compiled with OpenMP. If not, every call runs on
+///        a single thread and the settings below have no effect.
+inline bool OpenMPEnabled(){
+  #ifdef _OPENMP
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+///@return The parallelism settings in effect for the calling thread
+inline ParallelismConfig GetParallelism(){
+  return detail::GetParallelismState().config;
+}
+
+/**
+  @brief Sets the parallelism used by RichDEM calls made from the calling
+         thread
+
+  The thread count and nesting depth are OpenMP settings of the calling thread,
+  so they apply to every parallel loop in RichDEM. Since OpenMP offers no way
+  to change thread binding at run time, the binding applies only to loops run
+  through ParallelForCells() and its relatives.
+
+  @param[in] config  Settings to use. Zeros restore OpenMP's defaults.
+*/
+inline void SetParallelism(const ParallelismConfig &config){
+  if(config.threads<0 || config.max_active_levels<0)
+    throw std::runtime_error("Thread counts and nesting levels must be non-negative!");
+
+  auto &state = detail::GetParallelismState();
+  #ifdef _OPENMP
+    if(state.default_threads<0){
+      state.default_threads = omp_get_max_threads();
+      state.default_levels  = omp_get_max_active_levels();
+    }
+    omp_set_num_threads(config.threads>0 ? config.threads : state.default_threads);
+    omp_set_max_active_levels(config.max_active_levels>0 ? config.max_active_levels : state.default_levels);
+  #endif
+  state.config = config;
+}
+
+/**
+  @brief Applies parallelism settings to the calling thread for the lifetime
+         of the object and then restores the previous settings
+
+  For example, to use at most two threads for a call:
+
+      {
+        ParallelismScope scope({2});
+        PriorityFlood_Barnes2014<Topology::D8>(dem);
+      }
+*/
+class ParallelismScope {
+ private:
+  ParallelismConfig previous;
+ public:
+  explicit ParallelismScope(const ParallelismConfig &config) : previous(GetParallelism()) {
+    SetParallelism(config);
+  }
+  ~ParallelismScope(){
+    SetParallelism(previous);
+  }
+  ParallelismScope(const ParallelismScope&) = delete;
+  ParallelismScope& operator=(const ParallelismScope&) = delete;
+};
+
+/**
+  @brief Removes a `--threads N` or `--threads=N` option from a program's
+         command line
+
+  @param[in,out] argc  Number of arguments; reduced if the option is found
+  @param[in,out] argv  Arguments; the option is removed if it is found
+
+  @return Parallelism settings using the requested number of threads, or
+          OpenMP's default if the option was not given
+*/
+inline ParallelismConfig ConsumeThreadsArgument(int &argc, char **argv){
+  ParallelismConfig config;
+  for(int i=1;i<argc;i++){
+    std::string value;
+    int used;
+    if(std::strcmp(argv[i],"--threads")==0){
+      if(i+1==argc)
+        throw std::runtime_error("--threads requires a number of threads!");
+      value = argv[i+1];
+      used  = 2;
+    } else if(std::strncmp(argv[i],"--threads=",10)==0){
+      value = argv[i]+10;
+      used  = 1;
+    } else {
+      continue;
+    }
+
+    std::size_t end = 0;
+    try {
+      config.threads = std::stoi(value, &end);
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if(end==0 || end!=value.size() || config.threads<1)
+      throw std::runtime_error("--threads must be a positive integer, not '" + value + "'!");
+
+    for(int j=i;j+used<=argc;j++) //Also moves the terminating nullptr
+      argv[j] = argv[j+used];
+    argc -= used;
+    break;
+  }
+  return config;
+}
+
+///Controls how a parallel loop divides and schedules its work
+struct ParallelOptions {
+  int tile_width  = 256; ///< Width of a tile in cells
+  int tile_height = 16;  ///< Height of a tile in cells
+  int threads     = 0;   ///< Maximum number of threads to use. 0 uses the calling thread's limit (see ParallelismScope).
+  bool balance    = false;///< Schedule the tiles of ParallelForCells() by their number of data cells. Costs a pass over the raster, so is best kept for rasters with large NoData regions.
+  ThreadBinding binding = ThreadBinding::Default; ///< Default uses the calling thread's binding (see ParallelismScope)
+};
+
+///A rectangular region of a raster covering x0<=x<x1, y0<=y<y1
+struct TileExtent {
+  int x0, y0, x1, y1;
+  uint64_t work       = 0;    ///< Estimated cost of processing the tile
+  bool     has_nodata = true; ///< Whether the tile may hold NoData cells. Set exactly by EstimateTileWork().
+};
+
+///@return The number of threads a parallel loop using `opts` will use
+inline int ParallelThreads(const ParallelOptions &opts = ParallelOptions()){
+  #ifdef _OPENMP
+    return opts.threads>0 ? opts.threads : omp_get_max_threads();
+  #else
+    (void)opts;
+    return 1;
+  #endif
+}
+
+///@return The thread binding a parallel loop using `opts` will use
+inline ThreadBinding ParallelBinding(const ParallelOptions &opts = ParallelOptions()){
+  return opts.binding!=ThreadBinding::Default ? opts.binding : GetParallelism().binding;
+}
+
+/**
+  @brief Divides a region into tiles
+
+  @param[in] x0,y0,x1,y1  Region to divide, covering x0<=x<x1, y0<=y<y1
+  @param[in] opts         Gives the tile dimensions
+
+  @return Tiles covering the region in row-major order, each with a work
+          estimate equal to its number of cells
+*/
+inline std::vector<TileExtent> DecomposeIntoTiles(const int x0, const int y0, const int x1, const int y1, const ParallelOptions &opts = ParallelOptions()){
+  std::vector<TileExtent> tiles;
+  const int tw = std::max(opts.tile_width, 1);
+  const int th = std::max(opts.tile_height,1);
+  for(int ty=y0;ty<y1;ty+=th)
+  for(int tx=x0;tx<x1;tx+=tw){
+    TileExtent t{tx, ty, std::min(tx+tw,x1), std::min(ty+th,y1)};
+    t.work = (uint64_t)(t.x1-t.x0)*(t.y1-t.y0);
+    tiles.push_back(t);
+  }
+  return tiles;
+}
+
+/**
+  @brief Estimates the work in each tile from the data cells of a raster and
+         notes which tiles hold NoData cells
+
+  NoData cells are typically skipped after a single comparison, so they are
+  counted as a small fraction of a data cell.
+
+  @param[in,out] tiles   Tiles to estimate
+  @param[in]     raster  Raster whose data cells indicate where the work is
+  @param[in]     opts    Gives the number of threads to count with
+*/
+template<class T>
+void EstimateTileWork(std::vector<TileExtent> &tiles, const Array2D<T> &raster, const ParallelOptions &opts = ParallelOptions()){
+  #pragma omp parallel for schedule(dynamic) num_threads(ParallelThreads(opts))
+  for(std::size_t i=0;i<tiles.size();i++){
+    auto &t = tiles[i];
+    const uint64_t cells = (uint64_t)(t.x1-t.x0)*(t.y1-t.y0);
+    uint64_t data_cells = 0;
+    for(int y=t.y0;y<t.y1;y++)
+    for(int x=t.x0;x<t.x1;x++)
+      data_cells += !raster.isNoData(x,y);
+    t.work       = 8*data_cells + (cells-data_cells);
+    t.has_nodata = data_cells<cells;
+  }
+}
+
+namespace detail {
+  ///Handing out the most expensive tiles first leaves the cheap ones to fill
+  ///in the gaps at the end, which gives good balance with a dynamic schedule
+  inline void OrderTilesByWork(std::vector<TileExtent> &tiles){
+    std::stable_sort(tiles.begin(), tiles.end(), [](const TileExtent &a, const TileExtent &b){
+      return a.work>b.work;
+    });
+  }
+}
+
+/**
+  @brief Estimates the work in each tile from the data cells of a raster and
+         orders the tiles most expensive first
+
+  @param[in,out] tiles   Tiles to estimate and reorder
+  @param[in]     raster  Raster whose data cells indicate where the work is
+  @param[in]     opts    Gives the number of threads to count with
+*/
+template<class T>
+void BalanceTiles(std::vector<TileExtent> &tiles, const Array2D<T> &raster, const ParallelOptions &opts = ParallelOptions()){
+  EstimateTileWork(tiles, raster, opts);
+  detail::OrderTilesByWork(tiles);
+}
+
+/**
+  @brief Calls `func(tile)` for each tile, in parallel
+
+  Tiles are handed to threads one at a time in the order given.
+
+  @param[in] tiles  Tiles to process
+  @param[in] func   Called as func(const TileExtent&)
+  @param[in] opts   Gives the number of threads to use and their binding
+*/
+template<class F>
+void ParallelForTiles(const std::vector<TileExtent> &tiles, F &&func, const ParallelOptions &opts = ParallelOptions()){
+  const int nthreads = ParallelThreads(opts);
+  //proc_bind only accepts constants, so each binding needs its own loop
+  switch(ParallelBinding(opts)){
+    case ThreadBinding::Close:
+      #pragma omp parallel for schedule(dynamic,1) num_threads(nthreads) proc_bind(close)
+      for(std::size_t i=0;i<tiles.size();i++)
+        func(tiles[i]);
+      break;
+    case ThreadBinding::Spread:
+      #pragma omp parallel for schedule(dynamic,1) num_threads(nthreads) proc_bind(spread)
+      for(std::size_t i=0;i<tiles.size();i++)
+        func(tiles[i]);
+      break;
+    case ThreadBinding::Default:
+    default:
+      #pragma omp parallel for schedule(dynamic,1) num_threads(nthreads)
+      for(std::size_t i=0;i<tiles.size();i++)
+        func(tiles[i]);
+      break;
+  }
+}
+
+namespace detail {
+  ///Visits the cells of one tile. This is the unit of work which is compiled
+  ///for each instruction set, so that the per-cell function is inlined into,
+  ///and vectorized with, the version chosen for the processor.
+  template<class F>
+  RICHDEM_DISPATCH_CLONES void ForCellsInTile(const TileExtent &t, F &func){
+    for(int y=t.y0;y<t.y1;y++)
+    for(int x=t.x0;x<t.x1;x++)
+      func(x,y);
+  }
+}
+
+/**
+  @brief Calls `func(x,y)` for every cell in a region of a raster, in parallel
+
+  @param[in] raster       Raster whose data cells are used to balance the work
+  @param[in] x0,y0,x1,y1  Region to visit, covering x0<=x<x1, y0<=y<y1
+  @param[in] func         Called as func(x,y) for each cell
+  @param[in] opts         Tile dimensions, thread count, and balancing
+*/
+template<class T, class F>
+void ParallelForCells(const Array2D<T> &raster, const int x0, const int y0, const int x1, const int y1, F &&func, const ParallelOptions &opts = ParallelOptions()){
+  auto tiles = DecomposeIntoTiles(x0, y0, x1, y1, opts);
+  if(opts.balance)
+    BalanceTiles(tiles, raster, opts);
+  ParallelForTiles(tiles, [&](const TileExtent &t){
+    detail::ForCellsInTile(t, func);
+  }, opts);
+}
+
+/**
+  @brief Calls `func(x,y)` for every cell of a raster, in parallel
+
+  @param[in] raster  Raster whose cells are visited and whose data cells are
+                     used to balance the work
+  @param[in] func    Called as func(x,y) for each cell
+  @param[in] opts    Tile dimensions, thread count, and balancing
+*/
+template<class T, class F>
+void ParallelForCells(const Array2D<T> &raster, F &&func, const ParallelOptions &opts = ParallelOptions()){
+  ParallelForCells(raster, 0, 0, raster.width(), raster.height(), std::forward<F>(func), opts);
+}
+
+/**
+  @brief Calls `func(x,y)` for every cell of a raster which is not on its
+         edge, in parallel
+
+  @param[in] raster  Raster whose cells are visited and whose data cells are
+                     used to balance the work
+  @param[in] func    Called as func(x,y) for each interior cell
+  @param[in] opts    Tile dimensions, thread count, and balancing
+*/
+template<class T, class F>
+void ParallelForInteriorCells(const Array2D<T> &raster, F &&func, const ParallelOptions &opts = ParallelOptions()){
+  ParallelForCells(raster, 1, 1, raster.width()-1, raster.height()-1, std::forward<F>(func), opts);
+}
+
+/**
+  @brief Calls `func(x,y,check)` for every cell of a raster, in parallel,
+         where `check` says whether the kernel must check for NoData and the
+         raster's edge
+
+  `check` is std::false_type for cells which are not on the raster's edge and
+  whose neighbours, and themselves, are all data cells; otherwise it is
+  std::true_type. Kernels which wrap their NoData, edge, and inGrid tests in
+  `if constexpr(check)` thus get a branch-free version for the interiors of
+  tiles which are far from NoData (see nodata_dispatch.hpp). Which tiles hold
+  NoData is found by counting each tile's data cells, and the counts are then
+  used to hand out the tiles most expensive first.
+
+  @param[in] raster  Raster whose cells are visited
+  @param[in] func    Called as func(x,y,check) for each cell
+  @param[in] opts    Tile dimensions and thread count
+*/
+template<class T, class F>
+void ParallelForCellsWithNoDataCheck(const Array2D<T> &raster, F &&func, const ParallelOptions &opts = ParallelOptions()){
+  const int width  = raster.width();
+  const int height = raster.height();
+
+  const int tw = std::max(opts.tile_width, 1);
+  const int th = std::max(opts.tile_height,1);
+
+  auto tiles = DecomposeIntoTiles(0, 0, width, height, opts);
+  EstimateTileWork(tiles, raster, opts);
+
+  //A tile's cells and their neighbours lie within the tile and the eight
+  //around it, so a tile needs no checks if none of these hold NoData. Tiles
+  //are still in row-major order here.
+  const int tiles_across = (width+tw-1)/tw;
+  const int tiles_down   = (height+th-1)/th;
+  std::vector<uint8_t> nodata_near(tiles.size(), false);
+  for(int ty=0;ty<tiles_down;ty++)
+  for(int tx=0;tx<tiles_across;tx++){
+    if(!tiles[ty*tiles_across+tx].has_nodata)
+      continue;
+    for(int ny=std::max(ty-1,0);ny<=std::min(ty+1,tiles_down-1);ny++)
+    for(int nx=std::max(tx-1,0);nx<=std::min(tx+1,tiles_across-1);nx++)
+      nodata_near[ny*tiles_across+nx] = true;
+  }
+
+  detail::OrderTilesByWork(tiles);
+
+  auto checked = [&](const int x, const int y){ func(x, y, std::true_type());  };
+  auto fast    = [&](const int x, const int y){ func(x, y, std::false_type()); };
+
+  ParallelForTiles(tiles, [&](const TileExtent &t){
+    //The part of the tile which is not on the raster's edge
+    const TileExtent inner{std::max(t.x0,1), std::max(t.y0,1), std::min(t.x1,width-1), std::min(t.y1,height-1)};
+    if(inner.x0>=inner.x1 || inner.y0>=inner.y1 || nodata_near[(t.y0/th)*tiles_across+t.x0/tw]){
+      detail::ForCellsInTile(t, checked);
+      return;
+    }
+
+    //Cells of the tile on the raster's edge
+    for(int y=t.y0;y<t.y1;y++){
+      if(inner.y0<=y && y<inner.y1){
+        for(int x=t.x0;x<inner.x0;x++)
+          checked(x,y);
+        for(int x=inner.x1;x<t.x1;x++)
+          checked(x,y);
+      } else {
+        for(int x=t.x0;x<t.x1;x++)
+          checked(x,y);
+      }
+    }
+
+    detail::ForCellsInTile(inner, fast);
+  }, opts);
+}
+
+/**
+  @brief Sorts a vector using several threads
+
+  The vector is cut into one run per thread and the runs are sorted at once.
+  Neighbouring runs are then merged pairwise, each round of merges in
+  parallel, until a single run remains. Like std::sort, the sort is not
+  stable.
+
+  @param[in,out] v     Vector to sort
+  @param[in]     comp  Comparison function, as for std::sort
+  @param[in]     opts  Gives the number of threads to use
+*/
+template<class T, class Compare>
+void ParallelSort(std::vector<T> &v, Compare comp, const ParallelOptions &opts = ParallelOptions()){
+  //Below this size threads cost more than they save
+  constexpr std::size_t min_run = 1<<14;
+  const int runs = (int)std::min<std::size_t>(ParallelThreads(opts), v.size()/min_run);
+  if(runs<=1){
+    std::sort(v.begin(), v.end(), comp);
+    return;
+  }
+
+  std::vector<std::size_t> bounds(runs+1);
+  for(int r=0;r<=runs;r++)
+    bounds[r] = v.size()*r/runs;
+
+  #pragma omp parallel for num_threads(runs)
+  for(int r=0;r<runs;r++)
+    std::sort(v.begin()+bounds[r], v.begin()+bounds[r+1], comp);
+
+  for(int width=1;width<runs;width*=2){
+    #pragma omp parallel for num_threads(runs)
+    for(int r=0;r<runs-width;r+=2*width)
+      std::inplace_merge(v.begin()+bounds[r], v.begin()+bounds[r+width], v.begin()+bounds[std::min(r+2*width,runs)], comp);
+  }
+}
+
+}
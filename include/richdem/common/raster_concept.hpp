@@ -0,0 +1,241 @@
+/**
+  @file
+  @brief Defines what algorithms may assume of a raster, so they can run on
+         any kind of raster rather than only on Array2D, and a view of a
+         rectangular window of a raster
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/constants.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace richdem {
+
+/*
+  A raster is any class R which, for a raster `r` and integer coordinates x
+  and y, offers:
+
+    r.width(), r.height()  Dimensions of the raster in cells
+    r(x,y)                 Value of a cell
+    r.noData()             The NoData value
+    r.isNoData(x,y)        Whether a cell is NoData
+    r.inGrid(x,y)          Whether (x,y) is a cell of the raster
+    r.isEdgeCell(x,y)      Whether a cell is on the raster's edge
+
+  A writable raster also offers
+
+    r.set(x,y,val)         Sets the value of a cell
+
+  An A2Array2D loaded from a layout file has set() but is read-only, so its
+  set() throws; writing algorithms stop there rather than lose their writes.
+
+  Array2D, SparseArray2D, A2Array2D, and RasterView are rasters. Since an
+  Array2D can wrap memory it does not own, so is a memory-mapped file.
+
+  Algorithms which are templated on a raster rather than on Array2D use only
+  the above and access cells by their xy-coordinates. They run on a single
+  thread, since rasters such as A2Array2D load data as they are accessed,
+  unless all of their rasters are Array2Ds (see is_array2d_v). Outputs are
+  resized to fit only if they and the input are Array2Ds (see
+  PrepareOutputRaster()).
+*/
+
+namespace detail {
+  template<class R, class = void>
+  struct is_raster : std::false_type {};
+
+  template<class R>
+  struct is_raster<R, std::void_t<
+    decltype(std::declval<R&>().width()),
+    decltype(std::declval<R&>().height()),
+    decltype(std::declval<R&>()(0,0)),
+    decltype(std::declval<R&>().noData()),
+    decltype(std::declval<R&>().isNoData(0,0)),
+    decltype(std::declval<R&>().inGrid(0,0)),
+    decltype(std::declval<R&>().isEdgeCell(0,0))
+  >> : std::true_type {};
+
+  template<class R, class = void>
+  struct is_writable_raster : std::false_type {};
+
+  template<class R>
+  struct is_writable_raster<R, std::void_t<
+    decltype(std::declval<R&>().set(0,0,std::declval<R&>().noData()))
+  >> : is_raster<R> {};
+
+  template<class R>
+  struct is_array2d : std::false_type {};
+
+  template<class T>
+  struct is_array2d<Array2D<T>> : std::true_type {};
+}
+
+///True if R is a raster. R may be const.
+template<class R>
+constexpr bool is_raster_v = detail::is_raster<R>::value;
+
+///True if cells of R can be set
+template<class R>
+constexpr bool is_writable_raster_v = detail::is_writable_raster<R>::value;
+
+///Type of the values held by the raster R
+template<class R>
+using raster_value_t = std::decay_t<decltype(std::declval<R&>().noData())>;
+
+///True if R is an Array2D. R may be const.
+template<class R>
+constexpr bool is_array2d_v = detail::is_array2d<std::remove_const_t<R>>::value;
+
+///Enables algorithms templated on the raster type: all of Rs must be rasters
+template<class... Rs>
+using EnableIfRaster = std::enable_if_t<(is_raster_v<Rs> && ...), int>;
+
+
+
+/**
+  @brief  Readies the output raster of an algorithm
+
+  If both rasters are Array2Ds, the output is resized to the input, taking its
+  geotransform and projection, and given the NoData value **no_data**.
+  Otherwise the output must already have the input's dimensions, and it keeps
+  its NoData value.
+
+  @param[in]     &input      Raster the algorithm reads
+  @param[in,out] &output     Raster the algorithm writes
+  @param[in]     no_data     NoData value for a resized output
+  @param[in]     algorithm   Name of the algorithm, for error messages
+
+  @throws std::runtime_error if an output which is not resized does not have
+          the dimensions of the input
+*/
+template<class R, class O>
+void PrepareOutputRaster(const R &input, O &output, const raster_value_t<O> no_data, const std::string &algorithm){
+  if constexpr(is_array2d_v<R> && is_array2d_v<O>){
+    output.resize(input);
+    output.setNoData(no_data);
+  } else {
+    (void)no_data;
+    if(output.width()!=input.width() || output.height()!=input.height())
+      throw std::runtime_error(algorithm+": input and output rasters must have the same dimensions!");
+  }
+}
+
+
+
+/**
+  @brief  Calls a function for each neighbour of a cell which is in the raster
+
+  @param[in]  &raster  A raster
+  @param[in]  x        x-coordinate of the cell
+  @param[in]  y        y-coordinate of the cell
+  @param[in]  func     Called as func(n,nx,ny) with the neighbour's direction
+                       and coordinates
+*/
+template<Topology topo, class R, class F>
+void ForEachNeighbour(const R &raster, const int x, const int y, F &&func){
+  constexpr auto dx   = get_dx_for_topology<topo>();
+  constexpr auto dy   = get_dy_for_topology<topo>();
+  constexpr auto nmax = get_nmax_for_topology<topo>();
+  for(int n=1;n<=nmax;n++){
+    const int nx = x+dx[n];
+    const int ny = y+dy[n];
+    if(raster.inGrid(nx,ny))
+      func(n,nx,ny);
+  }
+}
+
+
+
+/**
+  @brief  A rectangular window of a raster which is itself a raster
+
+  The view refers to the cells of the underlying raster, which must outlive
+  it, and does not copy them. Coordinates are relative to the window's
+  top-left corner and the window's edge is the view's edge, so running an
+  algorithm on a view processes the window as though it were a DEM of its own.
+  Views of views are allowed.
+
+  If R is const the view is read-only.
+*/
+template<class R>
+class RasterView {
+ public:
+  typedef raster_value_t<R> value_type;
+
+ private:
+  R  &raster;
+  int x0;
+  int y0;
+  int view_width;
+  int view_height;
+
+ public:
+  /**
+    @brief Creates a view of a window of a raster
+
+    @param[in]  &raster0   Raster to view
+    @param[in]  xmin       x-coordinate, in the raster, of the window's left column
+    @param[in]  ymin       y-coordinate, in the raster, of the window's top row
+    @param[in]  width      Width of the window in cells
+    @param[in]  height     Height of the window in cells
+
+    @throws std::runtime_error if the window does not lie within the raster
+  */
+  RasterView(R &raster0, const int xmin, const int ymin, const int width, const int height)
+    : raster(raster0), x0(xmin), y0(ymin), view_width(width), view_height(height)
+  {
+    static_assert(is_raster_v<R>, "RasterView requires a raster!");
+    if(xmin<0 || ymin<0 || width<0 || height<0 || xmin+width>raster.width() || ymin+height>raster.height())
+      throw std::runtime_error("RasterView: window at ("+std::to_string(xmin)+","+std::to_string(ymin)+") of size "+std::to_string(width)+"x"+std::to_string(height)+" does not lie within the raster!");
+  }
+
+  ///Creates a view of an entire raster
+  explicit RasterView(R &raster0) : RasterView(raster0, 0, 0, raster0.width(), raster0.height()) {}
+
+  int width () const { return view_width;  }
+  int height() const { return view_height; }
+
+  ///Number of cells in the view
+  std::size_t size() const { return (std::size_t)view_width*view_height; }
+
+  ///x-coordinate, in the underlying raster, of the view's left column
+  int xOffset() const { return x0; }
+
+  ///y-coordinate, in the underlying raster, of the view's top row
+  int yOffset() const { return y0; }
+
+  ///Value of a cell. Returns whatever the underlying raster does, so a view of
+  ///a non-const Array2D or A2Array2D returns a reference which can be assigned.
+  decltype(auto) operator()(const int x, const int y) const {
+    return raster(x0+x,y0+y);
+  }
+
+  value_type noData() const { return raster.noData(); }
+
+  bool isNoData(const int x, const int y) const {
+    return raster.isNoData(x0+x,y0+y);
+  }
+
+  bool inGrid(const int x, const int y) const {
+    return 0<=x && 0<=y && x<view_width && y<view_height;
+  }
+
+  bool isEdgeCell(const int x, const int y) const {
+    return x==0 || y==0 || x==view_width-1 || y==view_height-1;
+  }
+
+  ///Sets the value of a cell. Only available if the underlying raster is
+  ///writable.
+  template<class Q=R>
+  auto set(const int x, const int y, const value_type &val) const -> decltype(std::declval<Q&>().set(x,y,val)) {
+    return raster.set(x0+x,y0+y,val);
+  }
+};
+
+}
@@ -8,12 +8,15 @@
 
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/SparseArray2D.hpp>
+#include <richdem/common/raster_concept.hpp>
 #include <richdem/common/grid_cell.hpp>
 #include <richdem/flowmet/d8_flowdirs.hpp>
 #include <queue>
 #include <limits>
 #include <iostream>
 #include <cstdlib> //Used for exit
+#include <vector>
 
 namespace richdem {
 
@@ -211,6 +214,13 @@ void PriorityFlood_Original(Array2D<elev_t> &elevations){
     are higher than a pit being filled are added to the priority queue. In this
     way, pits are filled without incurring the expense of the priority queue.
 
+    The DEM may be any writable raster (see raster_concept.hpp), such as a
+    tiled A2Array2D which is larger than memory or a RasterView of a window of
+    a DEM. Only one bit per cell is kept in memory to mark the cells which have
+    been flooded, and since the flood spreads outwards from the lowest cells it
+    visits cells in a spatially coherent order, which suits rasters which cache
+    tiles.
+
   @param[in,out]  &elevations   A grid of cell elevations
 
   @pre
@@ -226,8 +236,11 @@ void PriorityFlood_Original(Array2D<elev_t> &elevations){
   @correctness
     The correctness of this command is determined by inspection. (TODO)
 */
-template <Topology topo, class elev_t>
-void PriorityFlood_Barnes2014(Array2D<elev_t> &elevations){
+template <Topology topo, class R, EnableIfRaster<R> = 0>
+void PriorityFlood_Barnes2014(R &elevations){
+  static_assert(is_writable_raster_v<R>, "PriorityFlood_Barnes2014 requires a writable raster!");
+  typedef raster_value_t<R> elev_t;
+
   GridCellZ_pq<elev_t> open;
   std::queue<GridCellZ<elev_t> > pit;
   uint64_t processed_cells = 0;
@@ -239,30 +252,158 @@ void PriorityFlood_Barnes2014(Array2D<elev_t> &elevations){
   RDLOG_CONFIG   <<"topology = "<<TopologyName(topo);
 
   static_assert(topo==Topology::D8 || topo==Topology::D4);
-  constexpr auto dx = get_dx_for_topology<topo>();
-  constexpr auto dy = get_dy_for_topology<topo>();
-  constexpr auto nmax = get_nmax_for_topology<topo>();
+
+  const int width  = elevations.width();
+  const int height = elevations.height();
 
   RDLOG_PROGRESS << "Setting up boolean flood array matrix...";
-  Array2D<int8_t> closed(elevations.width(),elevations.height(),false);
+  std::vector<bool> closed((std::size_t)width*height, false);
+  const auto flat = [&](const int x, const int y){ return (std::size_t)y*width+x; };
 
   RDLOG_MEM_USE<<"Priority queue requires approx = "
-           <<(elevations.width()*2+elevations.height()*2)*((long)sizeof(GridCellZ<elev_t>))/1024/1024
+           <<(width*2+height*2)*((long)sizeof(GridCellZ<elev_t>))/1024/1024
                <<"MB of RAM.";
 
   RDLOG_PROGRESS<<"Adding cells to the priority queue...";
 
-  for(int x=0;x<elevations.width();x++){
+  for(int x=0;x<width;x++){
     open.emplace(x,0,elevations(x,0) );
-    open.emplace(x,elevations.height()-1,elevations(x,elevations.height()-1) );
-    closed(x,0)=true;
-    closed(x,elevations.height()-1)=true;
+    open.emplace(x,height-1,elevations(x,height-1) );
+    closed[flat(x,0)]        = true;
+    closed[flat(x,height-1)] = true;
   }
-  for(int y=1;y<elevations.height()-1;y++){
+  for(int y=1;y<height-1;y++){
     open.emplace(0,y,elevations(0,y)  );
-    open.emplace(elevations.width()-1,y,elevations(elevations.width()-1,y) );
-    closed(0,y)=true;
-    closed(elevations.width()-1,y)=true;
+    open.emplace(width-1,y,elevations(width-1,y) );
+    closed[flat(0,y)]       = true;
+    closed[flat(width-1,y)] = true;
+  }
+
+  RDLOG_PROGRESS<<"Performing the improved Priority-Flood...";
+  progress.start( (std::size_t)width*height );
+  while(open.size()>0 || pit.size()>0){
+    GridCellZ<elev_t> c;
+    if(pit.size()>0){
+      c=pit.front();
+      pit.pop();
+    } else {
+      c=open.top();
+      open.pop();
+    }
+    processed_cells++;
+
+    ForEachNeighbour<topo>(elevations, c.x, c.y, [&](const int, const int nx, const int ny){
+      if(closed[flat(nx,ny)])
+        return;
+
+      closed[flat(nx,ny)] = true;
+      const elev_t nz = elevations(nx,ny);
+      if(nz<=c.z){
+        if(nz<c.z){
+          ++pitc;
+          elevations.set(nx,ny,c.z);
+        }
+        pit.push(GridCellZ<elev_t>(nx,ny,c.z));
+      } else
+        open.emplace(nx,ny,nz);
+    });
+    progress.update(processed_cells);
+  }
+  RDLOG_TIME_USE<<"Succeeded in "<<std::fixed<<std::setprecision(1)<<progress.stop()<<" s";
+  RDLOG_MISC    <<"Cells processed = "<<processed_cells;
+  RDLOG_MISC    <<"Cells in pits = "  <<pitc;
+}
+
+
+/**
+  @brief  Fills all pits and removes all digital dams from a block-sparse DEM
+
+    This is the improved Priority-Flood of PriorityFlood_Barnes2014() adapted
+    to SparseArray2D. Blocks which are entirely NoData are never visited and
+    blocks which are constant are visited only along their borders, so on a
+    DEM which is mostly ocean the time and memory used scale with the land
+    area rather than with the size of the raster.
+
+    Rather than being flooded from the edges of the raster inwards, NoData
+    cells are treated as drains: the flood begins from every data cell on the
+    raster's edge or adjacent to a NoData cell. For DEMs whose NoData cells are
+    all connected to the edge of the raster (such as the ocean around an
+    island) this gives the same data-cell elevations as the dense algorithm.
+    Unlike the dense algorithm, enclosed NoData regions are left as NoData
+    rather than being filled.
+
+  @param[in,out]  &elevations   A grid of cell elevations
+
+  @post
+    1. **elevations** contains the elevations of every cell or a value _NoData_
+       for cells not part of the DEM.
+    2. **elevations** contains no landscape depressions or digital dams.
+*/
+template <Topology topo, class elev_t>
+void PriorityFlood_Barnes2014(SparseArray2D<elev_t> &elevations){
+  GridCellZ_pq<elev_t> open;
+  std::queue<GridCellZ<elev_t> > pit;
+  uint64_t processed_cells = 0;
+  uint64_t pitc            = 0;
+  ProgressBar progress;
+
+  RDLOG_ALG_NAME << "Priority-Flood (Improved, Sparse)";
+  RDLOG_CITATION << "Barnes, R., Lehman, C., Mulla, D., 2014. Priority-flood: An optimal depression-filling and watershed-labeling algorithm for digital elevation models. Computers & Geosciences 62, 117–127. doi:10.1016/j.cageo.2013.04.024";
+  RDLOG_CONFIG   <<"topology = "<<TopologyName(topo);
+
+  static_assert(topo==Topology::D8 || topo==Topology::D4);
+  constexpr auto dx = get_dx_for_topology<topo>();
+  constexpr auto dy = get_dy_for_topology<topo>();
+  constexpr auto nmax = get_nmax_for_topology<topo>();
+
+  RDLOG_PROGRESS << "Setting up boolean flood array matrix...";
+  SparseArray2D<int8_t> closed(elevations, false);
+
+  RDLOG_PROGRESS<<"Adding cells to the priority queue...";
+
+  //A data cell is a seed if it is on the edge of the raster or next to NoData
+  const auto consider_seed = [&](const int x, const int y){
+    if(elevations.isNoData(x,y)){
+      closed.set(x,y,true);
+      return;
+    }
+    bool seed = elevations.isEdgeCell(x,y);
+    for(int n=1;n<=nmax && !seed;n++){
+      const int nx = x+dx[n];
+      const int ny = y+dy[n];
+      seed = elevations.inGrid(nx,ny) && elevations.isNoData(nx,ny);
+    }
+    if(seed){
+      open.emplace(x,y,elevations(x,y));
+      closed.set(x,y,true);
+    }
+  };
+
+  for(int by=0;by<elevations.heightInBlocks();by++)
+  for(int bx=0;bx<elevations.widthInBlocks();bx++){
+    if(elevations.blockIsNoData(bx,by)){
+      closed.setBlock(bx,by,true);
+      continue;
+    }
+    const auto [x0, y0, x1, y1] = elevations.blockExtent(bx,by);
+    if(elevations.blockIsConstant(bx,by)){
+      //Interior cells of a constant data block have only data neighbours and
+      //are not on the raster's edge, so only the block's border is checked
+      for(int x=x0;x<x1;x++){
+        consider_seed(x,y0);
+        if(y1-1>y0)
+          consider_seed(x,y1-1);
+      }
+      for(int y=y0+1;y<y1-1;y++){
+        consider_seed(x0,y);
+        if(x1-1>x0)
+          consider_seed(x1-1,y);
+      }
+    } else {
+      for(int y=y0;y<y1;y++)
+      for(int x=x0;x<x1;x++)
+        consider_seed(x,y);
+    }
   }
 
   RDLOG_PROGRESS<<"Performing the improved Priority-Flood...";
@@ -285,15 +426,16 @@ void PriorityFlood_Barnes2014(Array2D<elev_t> &elevations){
       if(closed(nx,ny))
         continue;
 
-      closed(nx,ny)=true;
-      if(elevations(nx,ny)<=c.z){
-        if(elevations(nx,ny)<c.z){
+      closed.set(nx,ny,true);
+      const auto nz = elevations(nx,ny);
+      if(nz<=c.z){
+        if(nz<c.z){
           ++pitc;
-          elevations(nx,ny)=c.z;
+          elevations.set(nx,ny,c.z);
         }
         pit.push(GridCellZ<elev_t>(nx,ny,c.z));
       } else
-        open.emplace(nx,ny,elevations(nx,ny));
+        open.emplace(nx,ny,nz);
     }
     progress.update(processed_cells);
   }
@@ -462,8 +604,16 @@ void PriorityFloodEpsilon_Barnes2014(Array2D<int32_t>& /*elevations*/){
 
     Based on Metz 2011.
 
+    Every cell is removed from the priority queue after the cell it flows
+    into, so the order in which cells leave the queue is a topological order
+    of the flow network. If **order** is given, this order is recorded so that
+    accumulations can be found with a single sweep (see
+    d8_flow_accum_from_order()) rather than by building a dependency graph.
+
   @param[in]   &elevations  A grid of cell elevations
   @param[out]  &flowdirs    A grid of D8 flow directions
+  @param[out]  order        If not NULL, receives the flat index of every data
+                            cell, downstream cells before upstream cells
 
   @pre
     1. **elevations** contains the elevations of every cell or a value _NoData_
@@ -475,12 +625,14 @@ void PriorityFloodEpsilon_Barnes2014(Array2D<int32_t>& /*elevations*/){
        _NO_FLOW_ for those cells which are not part of the DEM.
     2. **flowdirs** has no cells which are not part of a continuous flow
        path leading to the edge of the DEM.
+    3. If given, **order** lists each data cell once. Every cell appears after
+       the cell it flows into.
 
   @correctness
     The correctness of this command is determined by inspection. (TODO)
 */
 template <class elev_t>
-void PriorityFloodFlowdirs_Barnes2014(const Array2D<elev_t> &elevations, Array2D<d8_flowdir_t> &flowdirs){
+void PriorityFloodFlowdirs_Barnes2014(const Array2D<elev_t> &elevations, Array2D<d8_flowdir_t> &flowdirs, std::vector<typename Array2D<elev_t>::i_t> *order=nullptr){
   GridCellZk_low_pq<elev_t> open;
   uint64_t processed_cells = 0;
   ProgressBar progress;
@@ -521,6 +673,11 @@ void PriorityFloodFlowdirs_Barnes2014(const Array2D<elev_t> &elevations, Array2D
   flowdirs(0,flowdirs.height()-1)=8;
   flowdirs(flowdirs.width()-1,flowdirs.height()-1)=6;
 
+  if(order){
+    order->clear();
+    order->reserve(elevations.size());
+  }
+
   const int d8_order[9]={0,1,3,5,7,2,4,6,8};
   RDLOG_PROGRESS<<"Performing Priority-Flood+Flow Directions...";
   progress.start( elevations.size() );
@@ -529,6 +686,9 @@ void PriorityFloodFlowdirs_Barnes2014(const Array2D<elev_t> &elevations, Array2D
     open.pop();
     processed_cells++;
 
+    if(order && !elevations.isNoData(c.x,c.y))
+      order->push_back(elevations.xyToI(c.x,c.y));
+
     for(int no=1;no<=8;no++){
       int n=d8_order[no];
       int nx=c.x+d8x[n];
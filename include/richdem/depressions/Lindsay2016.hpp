@@ -2,17 +2,27 @@
 
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/nodata_dispatch.hpp>
+#include <richdem/common/epoch_visited_set.hpp>
 #include <richdem/common/grid_cell.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/timer.hpp>
+#include <richdem/depressions/Barnes2014.hpp>
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace richdem {
 
 enum LindsayMode {
   COMPLETE_BREACHING,
   SELECTIVE_BREACHING,
-  CONSTRAINED_BREACHING
+  CONSTRAINED_BREACHING,
+  LEAST_COST_BREACHING
 };
 
 enum LindsayCellType {
@@ -71,107 +81,425 @@ void CompleteBreaching_Lindsay2016(Array2D<elev_t> &dem){
 
   visited.setAll(LindsayCellType::UNVISITED);
 
-  //Seed the priority queue
-  RDLOG_PROGRESS<<"Identifying pits and edge cells...";
-  progress.start(dem.size());
-  for(int y=0;y<dem.height();y++)
-  for(int x=0;x<dem.width();x++){
-    ++progress;
+  //DEMs without NoData cells, which are common, skip checking every neighbour
+  //for it
+  WithNoDataCheck(dem, [&](const auto has_nodata){
+    //Seed the priority queue
+    RDLOG_PROGRESS<<"Identifying pits and edge cells...";
+    progress.start(dem.size());
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++){
+      ++progress;
 
-    if(dem.isNoData(x,y))             //Don't evaluate NoData cells
-      continue;
+      if constexpr(has_nodata){
+        if(dem.isNoData(x,y))           //Don't evaluate NoData cells
+          continue;
+      }
 
-    if(dem.isEdgeCell(x,y)){          //Valid edge cells go on priority-queue
-      pq.emplace(x,y,dem(x,y));
-      visited(x,y) = LindsayCellType::EDGE;
-      continue;
+      if(dem.isEdgeCell(x,y)){          //Valid edge cells go on priority-queue
+        pq.emplace(x,y,dem(x,y));
+        visited(x,y) = LindsayCellType::EDGE;
+        continue;
+      }
+
+      //Determine if this is an edge cell, gather information used to determine if
+      //it is a pit cell
+      elev_t lowest_neighbour = std::numeric_limits<elev_t>::max();
+      bool drains_to_nodata   = false;
+      for(int n=1;n<=nmax;n++){
+        const int nx = x+dx[n];
+        const int ny = y+dy[n];
+
+        //No need for an inGrid check here because edge cells are filtered above
+
+        //Cells which can drain into NoData go on priority-queue as edge cells
+        if constexpr(has_nodata){
+          if(dem.isNoData(nx,ny)){
+            pq.emplace(x,y, dem(x,y));
+            visited(x,y) = LindsayCellType::EDGE;
+            drains_to_nodata = true;
+            break;
+          }
+        }
+
+        //Used for identifying the lowest neighbour
+        lowest_neighbour = std::min(dem(nx,ny),lowest_neighbour);
+      }
+
+      if(drains_to_nodata)
+        continue;
+
+      //This is a pit cell if it is lower than any of its neighbours. In this
+      //case: raise the cell to be just lower than its lowest neighbour. This
+      //makes the breaching/tunneling procedures work better. Since depressions
+      //might have flat bottoms, we treat flats as pits. Mark flat/pits as such
+      //now.
+      if(dem(x,y)<=lowest_neighbour){
+        dem(x,y) = lowest_neighbour;
+        pits(x,y) = true;
+        total_pits++; //TODO: May not need this
+      }
     }
+    progress.stop();
 
-    //Determine if this is an edge cell, gather information used to determine if
-    //it is a pit cell
-    elev_t lowest_neighbour = std::numeric_limits<elev_t>::max();
-    for(int n=1;n<=nmax;n++){
-      const int nx = x+dx[n];
-      const int ny = y+dy[n];
 
-      //No need for an inGrid check here because edge cells are filtered above
+    //The Priority-Flood operation assures that we reach pit cells by passing into
+    //depressions over the outlet of minimal elevation on their edge.
+    RDLOG_PROGRESS<<"Breaching...";
+    progress.start(dem.numDataCells());
+    while(!pq.empty()){
+      ++progress;
 
-      //Cells which can drain into NoData go on priority-queue as edge cells
-      if(dem.isNoData(nx,ny)){
-        pq.emplace(x,y, dem(x,y));
-        visited(x,y) = LindsayCellType::EDGE;
-        goto nextcell;                //VELOCIRAPTOR
+      const auto c = pq.top();
+      pq.pop();
+
+      //This cell is a pit: let's consider doing some breaching
+      if(pits(c.x,c.y)){
+        //Locate a cell that is lower than the pit cell, or an edge cell
+        auto   cc            = dem.xyToI(c.x,c.y);               //Current cell on the path
+        elev_t target_height = dem(c.x,c.y);                     //Depth to which the cell currently being considered should be carved
+
+        //Trace path back to a cell low enough for the path to drain into it, or
+        //to an edge of the DEM
+        while(cc!=NO_BACK_LINK && dem(cc)>=target_height){
+          dem(cc) = target_height;
+          cc      = backlinks(cc);                                                  //Follow path back
+        }
+
+        --total_pits;
+        if(total_pits==0)
+          break;
       }
 
-      //Used for identifying the lowest neighbour
-      lowest_neighbour = std::min(dem(nx,ny),lowest_neighbour);
-    }
+      //Looks for neighbours which are either unvisited or pits
+      for(int n=1;n<=nmax;n++){
+        const int nx = c.x+dx[n];
+        const int ny = c.y+dy[n];
 
-    //This is a pit cell if it is lower than any of its neighbours. In this
-    //case: raise the cell to be just lower than its lowest neighbour. This
-    //makes the breaching/tunneling procedures work better. Since depressions
-    //might have flat bottoms, we treat flats as pits. Mark flat/pits as such
-    //now.
-    if(dem(x,y)<=lowest_neighbour){
-      dem(x,y) = lowest_neighbour;
-      pits(x,y) = true;
-      total_pits++; //TODO: May not need this
+        if(!dem.inGrid(nx,ny))
+          continue;
+        if constexpr(has_nodata){
+          if(dem.isNoData(nx,ny))
+            continue;
+        }
+        if(visited(nx,ny)!=LindsayCellType::UNVISITED)
+          continue;
+
+        const auto my_e = dem(nx,ny);
+
+        //The neighbour is unvisited. Add it to the queue
+        pq.emplace(nx,ny,my_e);
+        visited(nx,ny)   = LindsayCellType::VISITED;
+        backlinks(nx,ny) = dem.xyToI(c.x,c.y);
+      }
     }
+    progress.stop();
+  });
 
-    nextcell:;
-  }
-  progress.stop();
+  RDLOG_TIME_USE<<"Wall-time = "<<overall.stop();
+}
 
 
-  //The Priority-Flood operation assures that we reach pit cells by passing into
-  //depressions over the outlet of minimal elevation on their edge.
-  RDLOG_PROGRESS<<"Breaching...";
-  progress.start(dem.numDataCells());
-  while(!pq.empty()){
-    ++progress;
 
-    const auto c = pq.top();
-    pq.pop();
 
-    //This cell is a pit: let's consider doing some breaching
-    if(pits(c.x,c.y)){
-      //Locate a cell that is lower than the pit cell, or an edge cell
-      auto   cc            = dem.xyToI(c.x,c.y);               //Current cell on the path
-      elev_t target_height = dem(c.x,c.y);                     //Depth to which the cell currently being considered should be carved
-
-      //Trace path back to a cell low enough for the path to drain into it, or
-      //to an edge of the DEM
-      while(cc!=NO_BACK_LINK && dem(cc)>=target_height){
-        dem(cc) = target_height;
-        cc      = backlinks(cc);                                                  //Follow path back
+
+
+/**
+  @brief  Breach depressions along least-cost paths found by bounded searches
+
+    Each pit (a cell with no lower neighbour) is drained by a Dijkstra search
+    for the path to a cell lower than the pit, or to an edge of the DEM, which
+    requires the least total lowering of the cells along it. The cells of that
+    path are then lowered so that it drains. Unlike CompleteBreaching, which
+    follows the Priority-Flood path out of a depression however long and deep
+    it is, this chooses the path which alters the DEM least.
+
+    The search from a pit is confined to a square window extending `max_dist`
+    cells from it, so its scratch memory is allocated once per thread and
+    reused for every pit that thread handles. Pits whose windows cannot overlap
+    are breached in parallel: the DEM is divided into tiles at least
+    2*max_dist cells wide and the tiles are processed in four passes, such that
+    no two tiles processed together are adjacent. Within a tile pits are
+    breached from lowest to highest. Since this order does not depend on the
+    number of threads, neither does the result.
+
+    Pits which cannot be drained within `max_dist` cells, or only by lowering
+    the DEM by more than `max_cost` in total, are left in place. If
+    `fill_depressions` is set they, and any depressions they belong to, are
+    then filled with Priority-Flood.
+
+  @param[in,out] &dem              A grid of cell elevations
+  @param[in]     max_dist          Maximum distance, in cells, a breach path
+                                   may extend from its pit
+  @param[in]     max_cost          Maximum total lowering of a breach path
+  @param[in]     eps_gradients     If true, breach paths (and filled
+                                   depressions) are given epsilon gradients so
+                                   that they drain. Floating-point DEMs only.
+  @param[in]     fill_depressions  If true, depressions which could not be
+                                   breached are filled
+  @param[in]     opts              Gives the number of threads to use
+
+  @pre
+    1. **dem** contains the elevations of every cell or a value _NoData_
+       for cells not part of the DEM. Note that the _NoData_ value is assumed to
+       be a negative number less than any actual data value.
+
+  @correctness
+    The correctness of this command is determined by inspection and simple unit
+    tests.
+*/
+template <Topology topo, class elev_t>
+void LeastCostBreaching_Lindsay2016(
+  Array2D<elev_t> &dem,
+  int              max_dist,
+  const double     max_cost         = std::numeric_limits<double>::infinity(),
+  const bool       eps_gradients    = true,
+  const bool       fill_depressions = false,
+  const ParallelOptions &opts       = ParallelOptions()
+){
+  RDLOG_ALG_NAME<<"Lindsay2016: Least-Cost Breaching";
+  RDLOG_CITATION<<"Lindsay, J.B., 2016. Efficient hybrid breaching-filling sink removal methods for flow path enforcement in digital elevation models: Efficient Hybrid Sink Removal Methods for Flow Path Enforcement. Hydrological Processes 30, 846--857. doi:10.1002/hyp.10648";
+  RDLOG_CONFIG  <<"topology = "<<TopologyName(topo);
+  RDLOG_CONFIG  <<"max_dist = "<<max_dist;
+  RDLOG_CONFIG  <<"max_cost = "<<max_cost;
+
+  static_assert(topo==Topology::D8 || topo==Topology::D4);
+  constexpr auto dx = get_dx_for_topology<topo>();
+  constexpr auto dy = get_dy_for_topology<topo>();
+  constexpr auto nmax = get_nmax_for_topology<topo>();
+
+  if(max_dist<1)
+    throw std::runtime_error("Least-cost breaching needs a search distance of at least one cell!");
+  max_dist = std::min(max_dist, std::max(dem.width(), dem.height())); //Windows never need to be larger than the DEM
+  if(eps_gradients && !std::is_floating_point<elev_t>::value)
+    throw std::runtime_error("Least-cost breaching can only apply epsilon gradients to floating-point DEMs!");
+
+  Timer overall;
+  overall.start();
+
+  //Each cell's next elevation down a breach path
+  const auto step_down = [&](const elev_t z) -> elev_t {
+    if constexpr(std::is_floating_point<elev_t>::value){
+      if(eps_gradients)
+        return std::nextafter(z, std::numeric_limits<elev_t>::lowest());
+    }
+    return z;
+  };
+
+  //Cells on the edge of the DEM or next to NoData drain out of it
+  const auto is_outlet_edge = [&](const int x, const int y){
+    if(dem.isEdgeCell(x,y))
+      return true;
+    for(int n=1;n<=nmax;n++)
+      if(dem.isNoData(x+dx[n],y+dy[n]))
+        return true;
+    return false;
+  };
+
+  const auto is_pit = [&](const int x, const int y){
+    if(dem.isNoData(x,y) || is_outlet_edge(x,y))
+      return false;
+    for(int n=1;n<=nmax;n++)
+      if(dem(x+dx[n],y+dy[n])<dem(x,y))
+        return false;
+    return true;
+  };
+
+  //Tiles wide enough that the windows of pits in tiles which are not adjacent
+  //cannot overlap. Breaching writes to the cells within max_dist of a pit, but
+  //is_outlet_edge() and is_pit() read one cell beyond that, so each window
+  //needs a one-cell guard band: 2*max_dist+2 rather than 2*max_dist.
+  ParallelOptions tile_opts = opts;
+  tile_opts.tile_width  = std::max(2*max_dist+2, 64);
+  tile_opts.tile_height = tile_opts.tile_width;
+  const int tsize = tile_opts.tile_width;
+  const int tiles_wide = (dem.width()+tsize-1)/tsize;
+  const auto all_tiles = DecomposeIntoTiles(0, 0, dem.width(), dem.height(), tile_opts);
+  const auto tile_num  = [&](const TileExtent &t){ return (t.y0/tsize)*tiles_wide + t.x0/tsize; };
+
+  //Find the pits of each tile, lowest first
+  RDLOG_PROGRESS<<"Identifying pits...";
+  std::vector<std::vector<uint32_t>> tile_pits(all_tiles.size());
+  ParallelForTiles(all_tiles, [&](const TileExtent &t){
+    auto &pits = tile_pits[tile_num(t)];
+    for(int y=t.y0;y<t.y1;y++)
+    for(int x=t.x0;x<t.x1;x++)
+      if(is_pit(x,y))
+        pits.push_back(dem.xyToI(x,y));
+    std::stable_sort(pits.begin(), pits.end(), [&](const uint32_t a, const uint32_t b){
+      return dem(a)<dem(b);
+    });
+  }, tile_opts);
+
+  //Scratch space for searching a window, reused by each thread for all of the
+  //pits it breaches
+  struct SearchNode {
+    double   cost;
+    uint32_t len;
+    int32_t  li;  //Index in the window
+    bool operator>(const SearchNode &o) const {
+      if(cost!=o.cost) return cost>o.cost;
+      if(len !=o.len ) return len >o.len;
+      return li>o.li;
+    }
+  };
+  struct SearchScratch {
+    std::vector<double>     cost;
+    std::vector<uint32_t>   len;
+    std::vector<int32_t>    parent;
+    std::vector<elev_t>     target;
+    EpochVisitedSet         seen;
+    EpochVisitedSet         done;
+    std::vector<SearchNode> heap;
+  };
+  const std::size_t window_cells = (std::size_t)std::min(2*max_dist+1, dem.width())*std::min(2*max_dist+1, dem.height());
+  std::vector<SearchScratch> scratch(ParallelThreads(tile_opts));
+
+  //Cells which drain, used to skip pits in flats which drain through an
+  //already-breached neighbour of the same elevation
+  Array2D<uint8_t> drained(dem, false);
+
+  uint64_t breached   = 0;
+  uint64_t unbreached = 0;
+
+  //Breaches a single pit. Touches only cells within max_dist of it.
+  const auto breach_pit = [&](const uint32_t pi, SearchScratch &ss) -> bool {
+    const auto [px,py] = dem.iToxy(pi);
+    if(!is_pit(px,py))          //An earlier breach drained it
+      return true;
+
+    if(!eps_gradients){
+      for(int n=1;n<=nmax;n++){
+        if(dem(px+dx[n],py+dy[n])==dem(pi) && drained(px+dx[n],py+dy[n])){
+          drained(pi) = true;
+          return true;
+        }
       }
+    }
 
-      --total_pits;
-      if(total_pits==0)
+    //Window about the pit, clipped to the DEM
+    const int wx0 = std::max(0, px-max_dist);
+    const int wy0 = std::max(0, py-max_dist);
+    const int wx1 = std::min(dem.width(),  px+max_dist+1);
+    const int wy1 = std::min(dem.height(), py+max_dist+1);
+    const int ww  = wx1-wx0;
+
+    ss.seen.clear();
+    ss.done.clear();
+    ss.heap.clear();
+
+    const int32_t pli = (py-wy0)*ww+(px-wx0);
+    ss.cost[pli]   = 0;
+    ss.len[pli]    = 0;
+    ss.parent[pli] = -1;
+    ss.target[pli] = dem(pi);
+    ss.seen.insert(pli);
+    ss.heap.push_back({0, 0, pli});
+
+    int32_t outlet = -1;
+    while(!ss.heap.empty()){
+      std::pop_heap(ss.heap.begin(), ss.heap.end(), std::greater<SearchNode>());
+      const auto c = ss.heap.back();
+      ss.heap.pop_back();
+
+      if(!ss.done.insert(c.li))
+        continue;
+      if(c.cost>max_cost)       //Every remaining path costs at least as much
         break;
+
+      const int cx = wx0+c.li%ww;
+      const int cy = wy0+c.li/ww;
+
+      if(c.li!=pli && (dem(cx,cy)<ss.target[c.li] || is_outlet_edge(cx,cy))){
+        outlet = c.li;
+        break;
+      }
+
+      const elev_t ntarget = step_down(ss.target[c.li]);
+      for(int n=1;n<=nmax;n++){
+        const int nx = cx+dx[n];
+        const int ny = cy+dy[n];
+        if(nx<wx0 || ny<wy0 || nx>=wx1 || ny>=wy1)
+          continue;
+        if(dem.isNoData(nx,ny))
+          continue;
+        const int32_t nli = (ny-wy0)*ww+(nx-wx0);
+        if(ss.done.contains(nli))
+          continue;
+
+        const double   ncost = c.cost + std::max(0.0, (double)dem(nx,ny)-(double)ntarget);
+        const uint32_t nlen  = c.len+1;
+        if(ss.seen.insert(nli) || ncost<ss.cost[nli] || (ncost==ss.cost[nli] && nlen<ss.len[nli])){
+          ss.cost[nli]   = ncost;
+          ss.len[nli]    = nlen;
+          ss.parent[nli] = c.li;
+          ss.target[nli] = ntarget;
+          ss.heap.push_back({ncost, nlen, nli});
+          std::push_heap(ss.heap.begin(), ss.heap.end(), std::greater<SearchNode>());
+        }
+      }
     }
 
-    //Looks for neighbours which are either unvisited or pits
-    for(int n=1;n<=nmax;n++){
-      const int nx = c.x+dx[n];
-      const int ny = c.y+dy[n];
+    if(outlet==-1)
+      return false;
 
-      if(!dem.inGrid(nx,ny))
-        continue;
-      if(dem.isNoData(nx,ny))
-        continue;
-      if(visited(nx,ny)!=LindsayCellType::UNVISITED)
-        continue;
+    //Lower the path, from the outlet back to the pit
+    for(int32_t li=outlet;li!=-1;li=ss.parent[li]){
+      const int cx = wx0+li%ww;
+      const int cy = wy0+li/ww;
+      if(dem(cx,cy)>ss.target[li])
+        dem(cx,cy) = ss.target[li];
+      drained(cx,cy) = true;
+    }
+    return true;
+  };
 
-      const auto my_e = dem(nx,ny);
+  RDLOG_PROGRESS<<"Breaching...";
+  for(int pass=0;pass<4;pass++){
+    std::vector<TileExtent> tiles;
+    for(const auto &t: all_tiles){
+      const int tn = tile_num(t);
+      if(((tn%tiles_wide)%2) + 2*((tn/tiles_wide)%2)==pass && !tile_pits[tn].empty())
+        tiles.push_back(t);
+    }
 
-      //The neighbour is unvisited. Add it to the queue
-      pq.emplace(nx,ny,my_e);
-      visited(nx,ny)   = LindsayCellType::VISITED;
-      backlinks(nx,ny) = dem.xyToI(c.x,c.y);
+    #pragma omp parallel for schedule(dynamic,1) num_threads(ParallelThreads(tile_opts)) reduction(+:breached,unbreached)
+    for(std::size_t i=0;i<tiles.size();i++){
+      #ifdef _OPENMP
+        auto &ss = scratch[omp_get_thread_num()];
+      #else
+        auto &ss = scratch[0];
+      #endif
+      if(ss.cost.empty()){
+        ss.cost.resize(window_cells);
+        ss.len.resize(window_cells);
+        ss.parent.resize(window_cells);
+        ss.target.resize(window_cells);
+        ss.seen.resize(window_cells);
+        ss.done.resize(window_cells);
+      }
+      for(const auto pi: tile_pits[tile_num(tiles[i])]){
+        if(breach_pit(pi, ss))
+          breached++;
+        else
+          unbreached++;
+      }
     }
   }
-  progress.stop();
+
+  RDLOG_MISC<<"Pits drained   = "<<breached;
+  RDLOG_MISC<<"Pits remaining = "<<unbreached;
+
+  if(fill_depressions && unbreached>0){
+    if constexpr(std::is_floating_point<elev_t>::value){
+      if(eps_gradients){
+        PriorityFloodEpsilon_Barnes2014<topo>(dem);
+        RDLOG_TIME_USE<<"Wall-time = "<<overall.stop();
+        return;
+      }
+    }
+    PriorityFlood_Barnes2014<topo>(dem);
+  }
 
   RDLOG_TIME_USE<<"Wall-time = "<<overall.stop();
 }
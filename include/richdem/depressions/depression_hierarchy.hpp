@@ -2,11 +2,13 @@
 
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/ProgressBar.hpp>
+#include <richdem/common/concurrent_disjoint_int_set.hpp>
 #include <richdem/common/constants.hpp>
 #include <richdem/common/disjoint_dense_int_set.hpp>
 #include <richdem/common/grid_cell.hpp>
 #include <richdem/common/logger.hpp>
 #include <richdem/common/math.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/radix_heap.hpp>
 #include <richdem/common/timer.hpp>
 
@@ -19,13 +21,15 @@
 #include <cmath>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <queue>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 namespace richdem::dephier {
 
@@ -127,15 +131,6 @@ struct Depression {
 // we can traverse to determine which way water flows. This class keeps track of
 // which cell links two depressions, as well as the elevation of that cell.
 
-// The OutletLink is used as a key for a hashtable which stores information about
-// the outlets.
-struct OutletLink : std::pair<dh_label_t, dh_label_t> {
-  dh_label_t& depa = std::pair<dh_label_t, dh_label_t>::first;
-  dh_label_t& depb = std::pair<dh_label_t, dh_label_t>::second;
-  OutletLink(dh_label_t a, dh_label_t b) :
-    std::pair<dh_label_t, dh_label_t>((a<b)?a:b, (a<b)?b:a) {}
-};
-
 // The outlet class stores, again, the depressions being linked as well as
 // information about the link
 template <class elev_t>
@@ -170,18 +165,106 @@ struct Outlet {
   }
 };
 
-// We'll initially keep track of outlets using a hash table. Hash tables require
-// that every item they contain be reducible to a numerical "key". We provide
-// such a key for outlets here.
+// We'll initially keep track of outlets using a hash table. Every boundary
+// contact between two depressions hits this table, so rather than use a
+// node-based `std::unordered_map` we use a flat, open-addressing table with
+// linear probing. The two depression labels are packed into a single 64-bit
+// key with the smaller label in the upper half, so a link's key doesn't depend
+// on the order in which the invoking code names the depressions.
 template <class elev_t>
-struct OutletLinkHash {
-  std::size_t operator()(const OutletLink& out) const {
-    // Since depa and depb are sorted on construction, we don't have to worry
-    // about which order the invoking code called them in and our hash function
-    // doesn't need to be symmetric with respect to depa and depb.
+class OutletTable {
+ public:
+  OutletTable() { rehash(16); }
+
+  // Presize the table so that `n` outlets fit without rehashing
+  void reserve(const size_t n) {
+    size_t cap = 16;
+    while (cap * max_load_num < n * max_load_den)
+      cap *= 2;
+    if (cap > keys.size())
+      rehash(cap);
+  }
+
+  // Record an outlet between depressions `a` and `b`, keeping it only if it is
+  // lower than any outlet previously recorded between them
+  void update(const dh_label_t a, const dh_label_t b, const flat_c_idx out_cell, const elev_t out_elev) {
+    if ((count + 1) * max_load_den > keys.size() * max_load_num)
+      rehash(2 * keys.size());
+
+    const auto key = pack(a, b);
+    for (size_t i = slot(key);; i = (i + 1) & mask) {
+      if (keys[i] == EMPTY) {
+        keys[i]   = key;
+        values[i] = Outlet<elev_t>(a, b, out_cell, out_elev);
+        count++;
+        return;
+      } else if (keys[i] == key) {
+        auto& outlet = values[i];
+        if (outlet.out_elev > out_elev) {
+          outlet.out_cell = out_cell;
+          outlet.out_elev = out_elev;
+        }
+        return;
+      }
+    }
+  }
+
+  // Number of distinct depression pairs linked by an outlet
+  size_t size() const { return count; }
+
+  // Move the outlets out of the table, leaving it empty and its memory freed
+  std::vector<Outlet<elev_t>> extract() {
+    std::vector<Outlet<elev_t>> ret;
+    ret.reserve(count);
+    for (size_t i = 0; i < keys.size(); i++)
+      if (keys[i] != EMPTY)
+        ret.push_back(values[i]);
+    keys   = std::vector<uint64_t>();
+    values = std::vector<Outlet<elev_t>>();
+    count  = 0;
+    mask   = 0;
+    return ret;
+  }
+
+ private:
+  // Both labels equal to NO_VALUE is not a valid link, so this marks an empty
+  // slot
+  static constexpr uint64_t EMPTY        = std::numeric_limits<uint64_t>::max();
+  // Maximum load factor of the table: 7/10
+  static constexpr size_t   max_load_num = 7;
+  static constexpr size_t   max_load_den = 10;
+
+  std::vector<uint64_t>       keys;
+  std::vector<Outlet<elev_t>> values;
+  size_t count = 0;
+  size_t mask  = 0;
+
+  static uint64_t pack(const dh_label_t a, const dh_label_t b) {
+    return (a < b) ? (static_cast<uint64_t>(a) << 32 | b) : (static_cast<uint64_t>(b) << 32 | a);
+  }
 
-    // Boost hash combine function: https://stackoverflow.com/a/27952689/752843
-    return out.depa ^ (out.depb + 0x9e3779b9 + (out.depa << 6) + (out.depa >> 2));
+  // Fibonacci hashing spreads the consecutive labels typical of neighbouring
+  // depressions across the table
+  size_t slot(const uint64_t key) const {
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+  }
+
+  // `capacity` must be a power of two
+  void rehash(const size_t capacity) {
+    std::vector<uint64_t>       old_keys(capacity, EMPTY);
+    std::vector<Outlet<elev_t>> old_values(capacity);
+    old_keys.swap(keys);
+    old_values.swap(values);
+    mask = capacity - 1;
+    for (size_t i = 0; i < old_keys.size(); i++) {
+      if (old_keys[i] == EMPTY)
+        continue;
+      size_t j = slot(old_keys[i]);
+      while (keys[j] != EMPTY)
+        j = (j + 1) & mask;
+      keys[j]   = old_keys[i];
+      values[j] = old_values[i];
+    }
   }
 };
 
@@ -255,6 +338,105 @@ std::ostream& operator<<(std::ostream& out, const DepressionHierarchy<elev_t>& d
   return out;
 }
 
+// Join the two depressions an outlet links, or rather the meta-depressions
+// they have become part of, into a new meta-depression, or link them to the
+// ocean if one of them has found it. Outlets must be passed in order from
+// lowest to highest. Outlets between depressions which have already been
+// joined are ignored.
+template <class elev_t>
+void JoinDepressionsAtOutlet(DepressionHierarchy<elev_t>& depressions, DisjointDenseIntSet& djset, Outlet<elev_t> outlet) {
+  auto depa_set = djset.findSet(outlet.depa);  // Find the ultimate parent of Depression A
+  auto depb_set = djset.findSet(outlet.depb);  // Find the ultimate parent of Depression B
+
+  // If the depressions are already part of the same meta-depression, then
+  // nothing needs to be done.
+  if (depa_set == depb_set)
+    return;  // Do nothing, move on to the next highest outlet
+
+  if (depa_set == OCEAN || depb_set == OCEAN) {
+    // If we're here then both depressions cannot link to the ocean, since we
+    // would have returned above. Therefore, one and only one of them
+    // links to the ocean. We swap them to ensure that `depb` is the one which
+    // links to the ocean.
+    if (depa_set == OCEAN) {
+      std::swap(outlet.depa, outlet.depb);
+      std::swap(depa_set, depb_set);
+    }
+
+    // We now have four values, the Depression A Label, the Depression B Label,
+    // the Depression A MetaLabel, and the Depression B MetaLabel. We know that
+    // the Depression B MetaLabel is OCEAN. Depression B Label is the label of
+    // the actual depression this outlet links to, not the meta-depressions of
+    // which it is a part. Depression A MetaLabel is the meta-depression that
+    // has just found a path to the ocean via Depression B. Depression A Label
+    // is some value we don't care about.
+
+    // What we will do is link Depression A MetaLabel to Depression B.
+    // Depression B ultimately terminates in the ocean, but the only way to get
+    // there in real-life is to crawl into Depression B, not into its meta-
+    // depression. At this point its meta-depression is the ocean, so crawling
+    // into the meta-depression would form a direct link to the ocean, which is
+    // not realistic.
+
+    // Get a reference to Depression A MetaLabel.
+    auto& dep = depressions.at(depa_set);
+
+    // If this depression has already found the ocean then don't merge it
+    // again. (TODO: Richard)
+    // if(dep.out_cell==OCEAN)
+    // return;
+
+    // Ensure we don't modify depressions that have already found their paths
+    assert(dep.out_cell == NO_VALUE);
+    assert(dep.odep == NO_VALUE);
+
+    // Point this depression to the ocean through Depression B Label
+    dep.parent       = outlet.depb;      // Set Depression Meta(A) parent
+    dep.out_elev     = outlet.out_elev;  // Set Depression Meta(A) outlet elevation
+    dep.out_cell     = outlet.out_cell;  // Set Depression Meta(A) outlet cell index
+    dep.odep         = NO_VALUE;         // Since this is an ocean link, A has no overflow depression
+    dep.ocean_parent = true;
+    dep.geolink      = outlet.depb;  // Metadepression(A) overflows, geographically, into Depression B
+    depressions.at(outlet.depb).ocean_linked.emplace_back(depa_set);
+    djset.mergeAintoB(depa_set, OCEAN);  // Make a note that Depression A MetaLabel has a path to the ocean
+  } else {
+    // Neither depression has found the ocean, so we merge the two depressions
+    // into a new depression.
+    auto& depa = depressions.at(depa_set);  // Reference to Depression A MetaLabel
+    auto& depb = depressions.at(depb_set);  // Reference to Depression B MetaLabel
+
+    // Ensure we haven't already given these depressions outlet information
+    assert(depa.odep == NO_VALUE);
+    assert(depb.odep == NO_VALUE);
+
+    const auto newlabel = depressions.size();  // Label of A and B's new parent depression
+    depa.parent         = newlabel;            // Set Meta(A)'s parent to be the new meta-depression
+    depb.parent         = newlabel;            // Set Meta(B)'s parent to be the new meta-depression
+    depa.out_cell       = outlet.out_cell;     // Note that this is Meta(A)'s outlet
+    depb.out_cell       = outlet.out_cell;     // Note that this is Meta(B)'s outlet
+    depa.out_elev       = outlet.out_elev;     // Note that this is Meta(A)'s outlet's elevation
+    depb.out_elev       = outlet.out_elev;     // Note that this is Meta(B)'s outlet's elevation
+    depa.odep           = depb_set;            // Note that Meta(A) overflows, logically, into Meta(B)
+    depb.odep           = depa_set;            // Note that Meta(B) overflows, logically, into Meta(A)
+    depa.geolink        = outlet.depb;         // Meta(A) overflows, geographically, into B
+    depb.geolink        = outlet.depa;         // Meta(B) overflows, geographically, into A
+
+    // Be sure that this happens AFTER we are done using the `depa` and `depb`
+    // references since they will be invalidated if `depressions` has to
+    // resize!
+    const auto depa_pitcell_temp = depa.pit_cell;
+
+    auto& newdep     = depressions.emplace_back();
+    newdep.lchild    = depa_set;
+    newdep.rchild    = depb_set;
+    newdep.dep_label = newlabel;
+    newdep.pit_cell  = depa_pitcell_temp;
+
+    djset.mergeAintoB(depa_set, newlabel);  // A has a parent now
+    djset.mergeAintoB(depb_set, newlabel);  // B has a parent now
+  }
+}
+
 // Calculate the hierarchy of depressions. Takes as input a digital elevation
 // model and a set of labels. The labels should have `OCEAN` for cells
 // representing the "ocean" (the place to which depressions drain) and `NO_DEP`
@@ -293,9 +475,7 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
   // This keeps track of the outlets we find. Each pair of depressions can only
   // be linked once and the lowest link found between them is the one which is
   // retained.
-  using outletdb_t = std::unordered_map<OutletLink, Outlet<elev_t>, OutletLinkHash<elev_t>>;
-
-  outletdb_t outlet_database;
+  OutletTable<elev_t> outlet_database;
 
   // Places to seed depression growth from. These vectors are used to make the
   // search for seeds parallel, yet deterministic.
@@ -439,8 +619,8 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
   // many elevations. Later on we'll fix this and some of those outlets will
   // become inlets or the outlets of meta-depressions.
 
-  // The hash table of outlets will dynamically resize as we add elements to it.
-  // However, this slows things down a bit. Therefore, we presize the hash set to
+  // The table of outlets will dynamically resize as we add elements to it.
+  // However, this slows things down a bit. Therefore, we presize the table to
   // be equal to be 3x the number of pit cells plus the ocean cell. 3 is just a
   // guess as to how many neighbouring depressions each depression will have. If
   // we get this value too small we lose a little speed due to rehashing. If we
@@ -545,16 +725,9 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
         // sees Cell C, which is in the same depression as B, and has to update
         // the outlet information between the two depressions.
 
-        const OutletLink olink(clabel, nlabel);      // Create outlet link (order of clabel and nlabel doesn't matter)
-        if (outlet_database.count(olink) != 0) {     // Determine if the outlet is already present
-          auto& outlet = outlet_database.at(olink);  // It was. Use the outlet link to get the outlet information
-          if (outlet.out_elev > out_elev) {          // Is the previously stored link higher than the new one?
-            outlet.out_cell = out_cell;              // Yes. So update the link with new outlet cell
-            outlet.out_elev = out_elev;              // Also, update the outlet's elevation
-          }
-        } else {  // No preexisting link found; create a new one
-          outlet_database[olink] = Outlet<elev_t>(clabel, nlabel, out_cell, out_elev);
-        }
+        // Keep the link if it is the lowest yet found between the two depressions
+        // (order of clabel and nlabel doesn't matter)
+        outlet_database.update(clabel, nlabel, out_cell, out_elev);
       }
     }
   }
@@ -582,26 +755,15 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
   // In order to build the depression hierarchy, it is convenient to visit
   // outlets from lowest to highest.
 
-  // Since the `unordered_set` is, well, unordered. We create a vector into which
-  // we will move all of the outlets so we can sort them by elevation. Note that
-  // this temporarily doubles the memory required by the program. TODO: Is there
-  // a way to avoid this doubling?
-  std::vector<Outlet<elev_t>> outlets;
-
-  // Pre-size the vector to avoid expensive copy operations as we expand it
-  outlets.reserve(outlet_database.size());
+  // Since the table is unordered, we move all of the outlets into a vector so we
+  // can sort them by elevation. This also frees the table's memory.
+  std::vector<Outlet<elev_t>> outlets = outlet_database.extract();
 
-  // Copy the database into the vector
-  for (const auto& o : outlet_database)
-    outlets.push_back(o.second);
-
-  // It's a little difficult to free memory, but this should do it by replacing
-  // the outlet database with an empty database.
-  outlet_database = outletdb_t();
-
-  // Sort outlets in order from lowest to highest. Takes O(N log N) time.
+  // Sort outlets in order from lowest to highest. Takes O(N log N) time. Ties
+  // are broken by the depressions' labels so that the hierarchy doesn't depend
+  // on the table's internal layout.
   std::sort(outlets.begin(), outlets.end(), [](const Outlet<elev_t>& a, const Outlet<elev_t>& b) {
-    return a.out_elev < b.out_elev;
+    return std::tie(a.out_elev, a.depa, a.depb) < std::tie(b.out_elev, b.depa, b.depb);
   });
 
   // TODO: For debugging
@@ -635,98 +797,9 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
   // Visit outlets in order of elevation from lowest to highest. If two outlets
   // are at the same elevation, choose one arbitrarily.
   progress.start(outlets.size());
-  for (auto& outlet : outlets) {
+  for (const auto& outlet : outlets) {
     ++progress;
-    auto depa_set = djset.findSet(outlet.depa);  // Find the ultimate parent of Depression A
-    auto depb_set = djset.findSet(outlet.depb);  // Find the ultimate parent of Depression B
-
-    // If the depressions are already part of the same meta-depression, then
-    // nothing needs to be done.
-    if (depa_set == depb_set)
-      continue;  // Do nothing, move on to the next highest outlet
-
-    if (depa_set == OCEAN || depb_set == OCEAN) {
-      // If we're here then both depressions cannot link to the ocean, since we
-      // would have used `continue` above. Therefore, one and only one of them
-      // links to the ocean. We swap them to ensure that `depb` is the one which
-      // links to the ocean.
-      if (depa_set == OCEAN) {
-        std::swap(outlet.depa, outlet.depb);
-        std::swap(depa_set, depb_set);
-      }
-
-      // We now have four values, the Depression A Label, the Depression B Label,
-      // the Depression A MetaLabel, and the Depression B MetaLabel. We know that
-      // the Depression B MetaLabel is OCEAN. Depression B Label is the label of
-      // the actual depression this outlet links to, not the meta-depressions of
-      // which it is a part. Depression A MetaLabel is the meta-depression that
-      // has just found a path to the ocean via Depression B. Depression A Label
-      // is some value we don't care about.
-
-      // What we will do is link Depression A MetaLabel to Depression B.
-      // Depression B ultimately terminates in the ocean, but the only way to get
-      // there in real-life is to crawl into Depression B, not into its meta-
-      // depression. At this point its meta-depression is the ocean, so crawling
-      // into the meta-depression would form a direct link to the ocean, which is
-      // not realistic.
-
-      // Get a reference to Depression A MetaLabel.
-      auto& dep = depressions.at(depa_set);
-
-      // If this depression has already found the ocean then don't merge it
-      // again. (TODO: Richard)
-      // if(dep.out_cell==OCEAN)
-      // continue;
-
-      // Ensure we don't modify depressions that have already found their paths
-      assert(dep.out_cell == NO_VALUE);
-      assert(dep.odep == NO_VALUE);
-
-      // Point this depression to the ocean through Depression B Label
-      dep.parent       = outlet.depb;      // Set Depression Meta(A) parent
-      dep.out_elev     = outlet.out_elev;  // Set Depression Meta(A) outlet elevation
-      dep.out_cell     = outlet.out_cell;  // Set Depression Meta(A) outlet cell index
-      dep.odep         = NO_VALUE;         // Since this is an ocean link, A has no overflow depression
-      dep.ocean_parent = true;
-      dep.geolink      = outlet.depb;  // Metadepression(A) overflows, geographically, into Depression B
-      depressions.at(outlet.depb).ocean_linked.emplace_back(depa_set);
-      djset.mergeAintoB(depa_set, OCEAN);  // Make a note that Depression A MetaLabel has a path to the ocean
-    } else {
-      // Neither depression has found the ocean, so we merge the two depressions
-      // into a new depression.
-      auto& depa = depressions.at(depa_set);  // Reference to Depression A MetaLabel
-      auto& depb = depressions.at(depb_set);  // Reference to Depression B MetaLabel
-
-      // Ensure we haven't already given these depressions outlet information
-      assert(depa.odep == NO_VALUE);
-      assert(depb.odep == NO_VALUE);
-
-      const auto newlabel = depressions.size();  // Label of A and B's new parent depression
-      depa.parent         = newlabel;            // Set Meta(A)'s parent to be the new meta-depression
-      depb.parent         = newlabel;            // Set Meta(B)'s parent to be the new meta-depression
-      depa.out_cell       = outlet.out_cell;     // Note that this is Meta(A)'s outlet
-      depb.out_cell       = outlet.out_cell;     // Note that this is Meta(B)'s outlet
-      depa.out_elev       = outlet.out_elev;     // Note that this is Meta(A)'s outlet's elevation
-      depb.out_elev       = outlet.out_elev;     // Note that this is Meta(B)'s outlet's elevation
-      depa.odep           = depb_set;            // Note that Meta(A) overflows, logically, into Meta(B)
-      depb.odep           = depa_set;            // Note that Meta(B) overflows, logically, into Meta(A)
-      depa.geolink        = outlet.depb;         // Meta(A) overflows, geographically, into B
-      depb.geolink        = outlet.depa;         // Meta(B) overflows, geographically, into A
-
-      // Be sure that this happens AFTER we are done using the `depa` and `depb`
-      // references since they will be invalidated if `depressions` has to
-      // resize!
-      const auto depa_pitcell_temp = depa.pit_cell;
-
-      auto& newdep     = depressions.emplace_back();
-      newdep.lchild    = depa_set;
-      newdep.rchild    = depb_set;
-      newdep.dep_label = newlabel;
-      newdep.pit_cell  = depa_pitcell_temp;
-
-      djset.mergeAintoB(depa_set, newlabel);  // A has a parent now
-      djset.mergeAintoB(depb_set, newlabel);  // B has a parent now
-    }
+    JoinDepressionsAtOutlet(depressions, djset, outlet);
   }
   progress.stop();
 
@@ -752,6 +825,343 @@ GetDepressionHierarchy(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, A
   return depressions;
 }
 
+// Calculate the hierarchy of depressions without a priority queue. Takes the
+// same input, and gives the same output, as GetDepressionHierarchy().
+//
+// GetDepressionHierarchy() visits cells from lowest to highest using a
+// priority queue, which makes it sequential. But since every pit cell is a
+// seed, its queue releases cells in order of elevation, so that order can be
+// found up front by sorting the cells, which we do in parallel. Each cell then
+// takes its label and flow direction from the neighbour which was visited
+// first. These links form a forest whose roots are the pit cells and the
+// ocean, so the labels are found by joining each cell to its neighbour with a
+// concurrent union-find. Outlets are the links between neighbouring cells of
+// different depressions; sorted, they give the hierarchy as they do in
+// GetDepressionHierarchy().
+//
+// Cells at the same elevation are visited in flood order: first those which
+// border lower cells, then the cells they reach across the flat, and finally
+// flats with no lower neighbours, which are pits. If no two cells share an
+// elevation the labels, flow directions, and hierarchy are identical to those
+// of GetDepressionHierarchy(). Otherwise, ties may be broken differently: a
+// cell on a flat divide may join the other depression, which may change the
+// volumes of the two, but never the elevations to which depressions fill.
+//
+// @param  dem      - 2D array of elevations. May be in any data format.
+//
+// @return label    - A label indicating which depression the cell belongs to.
+//                   The indicated label is always the leaf of the depression
+//                   hierarchy, or the OCEAN.
+//
+//        flowdirs - A value [0,7] indicated which direction water from the cell
+//                   flows in order to go "downhill". All cells have a flow
+//                   direction (even flats) except for pit cells.
+template <class elev_t, Topology topo>
+DepressionHierarchy<elev_t>
+GetDepressionHierarchyBySorting(const Array2D<elev_t>& dem, Array2D<dh_label_t>& label, Array2D<int8_t>& flowdirs) {
+  Timer timer_overall;
+  Timer timer_dephier;
+  timer_overall.start();
+  timer_dephier.start();
+  RDLOG_ALG_NAME << "DepressionHierarchy (sort and union-find)";
+
+  // A D4 or D8 topology can be used.
+  static_assert(topo == Topology::D8 || topo == Topology::D4);
+  constexpr auto dx         = get_dx_for_topology<topo>();
+  constexpr auto dy         = get_dy_for_topology<topo>();
+  constexpr auto neighbours = get_nmax_for_topology<topo>();
+
+  // Ranks and cells are stored as flat_c_idx, with NO_VALUE reserved
+  if (dem.size() >= NO_VALUE) {
+    throw std::runtime_error("GetDepressionHierarchyBySorting: the DEM has too many cells!");
+  }
+
+  // Cells in the order they are visited: all of the land and the ocean cells
+  // which border it
+  std::vector<flat_c_idx> order;
+  order.reserve(dem.size());
+  // The ocean cells in `order`
+  std::vector<flat_c_idx> ocean_seeds;
+
+#pragma omp declare reduction(merge : std::vector<flat_c_idx> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
+
+  RDLOG_PROGRESS << "Gathering cells...";
+#pragma omp parallel for collapse(2) reduction(merge : order, ocean_seeds)
+  for (int y = 0; y < dem.height(); y++)
+    for (int x = 0; x < dem.width(); x++) {
+      // Ensure the input only has OCEAN and NO_DEP labels.
+      if (label(x, y) != OCEAN) {
+        if (label(x, y) != NO_DEP) {
+          throw std::runtime_error(
+              "Label array given to GetDepressionHierarchyBySorting must contain only NO_DEP and OCEAN labels!");
+        }
+        order.emplace_back(dem.xyToI(x, y));
+        continue;
+      }
+
+      for (int n = 1; n <= neighbours; n++) {
+        if (label.inGrid(x + dx[n], y + dy[n]) && label(x + dx[n], y + dy[n]) != OCEAN) {
+          order.emplace_back(dem.xyToI(x, y));
+          ocean_seeds.emplace_back(dem.xyToI(x, y));
+          break;
+        }
+      }
+    }
+
+  if (ocean_seeds.empty()) {
+    throw std::runtime_error("No OCEAN cells found, could not make a DepressionHierarchy!");
+  }
+
+  RDLOG_PROGRESS << "Sorting cells...";
+  {
+    // Sorting the elevations alongside the cells keeps the comparisons out of
+    // the DEM, which they would otherwise visit at random
+    std::vector<std::pair<elev_t, flat_c_idx>> keyed(order.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < order.size(); i++)
+      keyed[i] = {dem(order[i]), order[i]};
+    ParallelSort(keyed, std::less<std::pair<elev_t, flat_c_idx>>());
+#pragma omp parallel for
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = keyed[i].second;
+  }
+
+  // Position of each cell in `order`. Cells which are not visited (the ocean
+  // away from the land) keep NO_VALUE, so they compare as visited after every
+  // other cell.
+  constexpr flat_c_idx PENDING = NO_VALUE - 1;
+  std::vector<flat_c_idx> rank(dem.size(), NO_VALUE);
+
+  RDLOG_PROGRESS << "Ordering flats...";
+  {
+    std::vector<flat_c_idx> flat;
+    std::vector<flat_c_idx> placed;
+    for (size_t begin = 0; begin < order.size();) {
+      size_t end = begin + 1;
+      while (end < order.size() && dem(order[end]) == dem(order[begin]))
+        end++;
+
+      if (end - begin == 1) {
+        rank[order[begin]] = begin;
+        begin              = end;
+        continue;
+      }
+
+      // Cells of the flat are placed in the order water would spread across
+      // it, as the priority queue would have done.
+      flat.assign(order.begin() + begin, order.begin() + end);
+      for (const auto c : flat)
+        rank[c] = PENDING;
+
+      placed.clear();
+      flat_c_idx next_rank = begin;
+      const auto place     = [&](const flat_c_idx c) {
+        rank[c] = next_rank++;
+        placed.push_back(c);
+      };
+      // Visits the cells of the flat reachable from those placed so far
+      const auto spread = [&](size_t head) {
+        for (; head < placed.size(); head++) {
+          const auto [cx, cy] = dem.iToxy(placed[head]);
+          for (int n = 1; n <= neighbours; n++) {
+            if (dem.inGrid(cx + dx[n], cy + dy[n]) && rank[dem.xyToI(cx + dx[n], cy + dy[n])] == PENDING)
+              place(dem.xyToI(cx + dx[n], cy + dy[n]));
+          }
+        }
+      };
+
+      // Cells which border lower cells
+      for (const auto c : flat) {
+        const auto [cx, cy] = dem.iToxy(c);
+        for (int n = 1; n <= neighbours; n++) {
+          if (dem.inGrid(cx + dx[n], cy + dy[n]) && rank[dem.xyToI(cx + dx[n], cy + dy[n])] < begin) {
+            place(c);
+            break;
+          }
+        }
+      }
+      spread(0);
+
+      // The rest of the flat has no lower neighbours
+      for (const auto c : flat) {
+        if (rank[c] == PENDING) {
+          const auto head = placed.size();
+          place(c);
+          spread(head);
+        }
+      }
+
+      std::copy(placed.begin(), placed.end(), order.begin() + begin);
+      begin = end;
+    }
+  }
+
+  RDLOG_PROGRESS << "Linking cells to their neighbours...";
+
+  // Each land cell is linked to the neighbour visited first, if that neighbour
+  // was visited before it; otherwise, the cell is a pit.
+  std::vector<flat_c_idx> pits;
+  ConcurrentDisjointIntSet links(dem.size());
+#pragma omp parallel for reduction(merge : pits)
+  for (size_t r = 0; r < order.size(); r++) {
+    const auto c = order[r];
+    if (label(c) == OCEAN)
+      continue;
+    const auto [cx, cy] = dem.iToxy(c);
+    flat_c_idx first    = NO_VALUE;
+    int first_dir       = NO_FLOW;
+    for (int n = 1; n <= neighbours; n++) {
+      const int nx = cx + dx[n];
+      const int ny = cy + dy[n];
+      if (!dem.inGrid(nx, ny))
+        continue;
+      const auto ni = dem.xyToI(nx, ny);
+      if (rank[ni] < rank[c] && (first == NO_VALUE || rank[ni] < rank[first])) {
+        first     = ni;
+        first_dir = n;
+      }
+    }
+    if (first == NO_VALUE) {
+      pits.emplace_back(c);
+    } else {
+      flowdirs(c) = first_dir;
+      links.unionSet(c, first);
+    }
+  }
+  links.flatten();
+
+  // Depressions are numbered in the order their pits are visited
+  std::sort(pits.begin(), pits.end(), [&](const flat_c_idx a, const flat_c_idx b) { return rank[a] < rank[b]; });
+
+  DepressionHierarchy<elev_t> depressions;
+  depressions.reserve(2 * pits.size() + 1);
+  {  // The ocean is depression 0
+    auto& oceandep     = depressions.emplace_back();
+    oceandep.pit_elev  = -std::numeric_limits<elev_t>::infinity();
+    oceandep.pit_cell  = NO_VALUE;
+    oceandep.dep_label = 0;
+  }
+  for (const auto c : pits) {
+    auto& newdep     = depressions.emplace_back();
+    newdep.pit_cell  = c;
+    newdep.pit_elev  = dem(c);
+    newdep.dep_label = depressions.size() - 1;
+    label(c)         = newdep.dep_label;
+  }
+
+  RDLOG_PROGRESS << "Labeling cells...";
+
+  // Each set of linked cells holds one pit or one ocean cell. That cell passes
+  // its label to the set's representative, from which the others take it.
+  const auto label_representative = [&](const flat_c_idx c) {
+    if (links.parentOf(c) != c)
+      label(links.parentOf(c)) = label(c);
+  };
+#pragma omp parallel for
+  for (size_t i = 0; i < pits.size(); i++)
+    label_representative(pits[i]);
+#pragma omp parallel for
+  for (size_t i = 0; i < ocean_seeds.size(); i++)
+    label_representative(ocean_seeds[i]);
+  pits        = std::vector<flat_c_idx>();
+  ocean_seeds = std::vector<flat_c_idx>();
+
+#pragma omp parallel for
+  for (size_t r = 0; r < order.size(); r++) {
+    const auto c = order[r];
+    if (label(c) != OCEAN && links.parentOf(c) != c)
+      label(c) = label(links.parentOf(c));
+  }
+
+  RDLOG_PROGRESS << "Searching for outlets...";
+
+  // Neighbouring cells of different depressions link those depressions at the
+  // higher of the two cells. Each pair is found from the cell visited second.
+  std::vector<Outlet<elev_t>> outlets;
+#pragma omp declare reduction(merge_outlets : std::vector<Outlet<elev_t>> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
+#pragma omp parallel for reduction(merge_outlets : outlets)
+  for (size_t r = 0; r < order.size(); r++) {
+    const auto c        = order[r];
+    const auto clabel   = label(c);
+    const auto [cx, cy] = dem.iToxy(c);
+    for (int n = 1; n <= neighbours; n++) {
+      const int nx = cx + dx[n];
+      const int ny = cy + dy[n];
+      if (!dem.inGrid(nx, ny))
+        continue;
+      const auto ni = dem.xyToI(nx, ny);
+      if (rank[ni] < rank[c] && label(ni) != clabel) {
+        // On a flat the cell visited first is the outlet
+        const auto out_cell = (dem(ni) < dem(c)) ? c : ni;
+        outlets.emplace_back(clabel, label(ni), out_cell, dem(out_cell));
+      }
+    }
+  }
+
+  // Visiting the outlets from lowest to highest builds the hierarchy. Only the
+  // lowest outlet between two depressions has an effect, since by the time
+  // any others are reached the depressions have been joined.
+  ParallelSort(outlets, [&](const Outlet<elev_t>& a, const Outlet<elev_t>& b) {
+    return std::tie(a.out_elev, a.depa, a.depb, rank[a.out_cell]) <
+           std::tie(b.out_elev, b.depa, b.depb, rank[b.out_cell]);
+  });
+
+  RDLOG_PROGRESS << "Constructing hierarchy from outlets...";
+  DisjointDenseIntSet djset(depressions.size());
+  for (const auto& outlet : outlets)
+    JoinDepressionsAtOutlet(depressions, djset, outlet);
+
+  RDLOG_TIME_USE << "Time to construct Depression Hierarchy = " << timer_dephier.stop() << " s";
+
+  Timer timer_volumes;
+  timer_volumes.start();
+
+  CalculateMarginalVolumes(depressions, dem, label);
+
+  CalculateTotalVolumes(depressions);
+
+  RDLOG_TIME_USE << "Time to calculate volumes = " << timer_volumes.stop() << " s";
+  RDLOG_TIME_USE << "Total time in depression hierarchy calculations = " << timer_overall.stop() << " s";
+
+  return depressions;
+}
+
+// Elevation at which each depression spills to the ocean: the outlet elevation
+// of the top of its tree of meta-depressions. Water standing in a depression
+// cannot rise above this. The ocean's spill elevation is negative infinity.
+template <class elev_t>
+std::vector<elev_t> GetSpillElevations(const DepressionHierarchy<elev_t>& deps) {
+  std::vector<elev_t> spill(deps.size(), -std::numeric_limits<elev_t>::infinity());
+  // A depression's parent always has a larger label than it does unless the
+  // depression links to the ocean, so we can find all the tops in one
+  // backwards pass.
+  for (size_t d = deps.size() - 1; d > OCEAN; d--) {
+    const auto& dep = deps[d];
+    spill[d]        = (dep.ocean_parent || dep.parent == NO_PARENT) ? dep.out_elev : spill[dep.parent];
+  }
+  return spill;
+}
+
+// Fill all depressions to the elevations at which they spill to the ocean.
+// Gives the same result as Priority-Flood filling from the ocean cells.
+//
+// @param  dem   - DEM from which `label` and `deps` were calculated. Filled
+//                 in place.
+// @param  label - Labels from GetDepressionHierarchy() or
+//                 GetDepressionHierarchyBySorting().
+// @param  deps  - The depression hierarchy
+template <class elev_t>
+void FillDepressionsFromHierarchy(
+    Array2D<elev_t>& dem,
+    const Array2D<dh_label_t>& label,
+    const DepressionHierarchy<elev_t>& deps) {
+  const auto spill = GetSpillElevations(deps);
+  ParallelForCells(dem, [&](const int x, const int y) {
+    if (label(x, y) != OCEAN && label(x, y) != NO_DEP)
+      dem(x, y) = std::max(dem(x, y), spill.at(label(x, y)));
+  });
+}
+
 // Accelerates marginal volume calculations by caching previous DH lookups
 template <class elev_t>
 struct CachingOutletChecker {
@@ -931,21 +1341,480 @@ void CalculateTotalVolumes(DepressionHierarchy<elev_t>& deps) {
 // hierarchy.
 template <class elev_t>
 void LastLayer(Array2D<dh_label_t>& label, const Array2D<elev_t>& dem, const DepressionHierarchy<elev_t>& depressions) {
-#pragma omp parallel for collapse(2)
-  for (int y = 0; y < label.height(); y++)
-    for (int x = 0; x < label.width(); x++) {
-      auto mylabel = label(x, y);
-      while (true) {
-        if (dem(x, y) >= depressions.at(mylabel).out_elev) {
-          mylabel = depressions.at(mylabel).parent;
-        } else {
-          if (mylabel != 0)
-            mylabel = -3;
+  ParallelForCells(dem, [&](const int x, const int y) {
+    auto mylabel = label(x, y);
+    while (true) {
+      if (dem(x, y) >= depressions.at(mylabel).out_elev) {
+        mylabel = depressions.at(mylabel).parent;
+      } else {
+        if (mylabel != 0)
+          mylabel = -3;
+        break;
+      }
+    }
+    label(x, y) = mylabel;
+  });
+}
+
+// Update a depression hierarchy after some of the DEM's elevations have
+// changed, without recalculating it for the whole DEM.
+//
+// An edit can only alter the depressions whose cells it touches and the cells
+// which drain to the ocean through it. We call a depression together with all
+// of its subdepressions and meta-depressions, up to the point where it finds a
+// path to the ocean, a "tree". The trees touched by the changed cells and their
+// neighbours, plus any land cells whose flow reaches the ocean through them,
+// form a region. We rebuild the hierarchy of that region alone by treating all
+// cells outside of it as ocean, and then check that this was a fair thing to
+// do: every link between the region and its surroundings must involve one
+// side which reaches the ocean at a lower elevation than the link. Otherwise
+// the two sides would have merged into a single tree in a full calculation, so
+// the region is grown to include the offending tree and the region is rebuilt.
+// Cells of the region that drain out of it but lie at or below the spill
+// elevation of the tree they drain into grow the region in the same way,
+// since they would add to that tree's volume.
+//
+// Once the region is settled its old depressions are removed, the remaining
+// depressions are renumbered to close the gaps, and the region's new
+// depressions are appended after them. Depressions which spilled into the
+// region are relinked to the leaf depressions which now receive their
+// overflow. The volumes and cell counts of the new depressions are
+// calculated from scratch; those of all other depressions are unaffected by
+// the edit and are kept, as is their `water_vol`. The `water_vol` of the new
+// depressions is zero.
+//
+// Cells on a divide between two trees, which could drain either way, may be
+// assigned differently than a full recalculation would have done: which side
+// wins depends on the order in which the full calculation visits them. This
+// never affects which cells lie below a depression's outlet.
+//
+// @param  deps          - Depression hierarchy to update, as returned by
+//                         GetDepressionHierarchy() or by this function.
+// @param  dem           - DEM, with the changes already made.
+// @param  label         - Labels belonging to `deps`. Updated in place.
+// @param  flowdirs      - Flow directions belonging to `deps`. Updated in
+//                         place. Since the update needs to tell the ocean
+//                         apart from land which drains into it, ocean cells
+//                         must have the flow direction NO_FLOW, as they do if
+//                         `flowdirs` was initialized to NO_FLOW before calling
+//                         GetDepressionHierarchy().
+// @param  changed_cells - Flat indices of the cells whose elevations changed.
+//                         Changes to ocean cells have no effect.
+//
+// @return The number of cells whose depressions were recalculated.
+template <class elev_t, Topology topo>
+size_t UpdateDepressionHierarchy(
+    DepressionHierarchy<elev_t>& deps,
+    const Array2D<elev_t>& dem,
+    Array2D<dh_label_t>& label,
+    Array2D<int8_t>& flowdirs,
+    const std::vector<flat_c_idx>& changed_cells) {
+  Timer timer_overall;
+  timer_overall.start();
+  RDLOG_ALG_NAME << "DepressionHierarchy Update";
+
+  static_assert(topo == Topology::D8 || topo == Topology::D4);
+  constexpr auto dx         = get_dx_for_topology<topo>();
+  constexpr auto dy         = get_dy_for_topology<topo>();
+  constexpr auto dinverse   = get_dinverse_for_topology<topo>();
+  constexpr auto neighbours = get_nmax_for_topology<topo>();
+
+  constexpr double LOWEST = -std::numeric_limits<double>::infinity();
+
+  if (dem.width() != label.width() || dem.height() != label.height() || dem.width() != flowdirs.width() ||
+      dem.height() != flowdirs.height()) {
+    throw std::runtime_error("UpdateDepressionHierarchy: dem, label, and flowdirs must have the same dimensions!");
+  }
+  if (deps.empty()) {
+    throw std::runtime_error("UpdateDepressionHierarchy: the depression hierarchy is empty!");
+  }
+  for (const auto c : changed_cells) {
+    if (c >= dem.size()) {
+      throw std::runtime_error("UpdateDepressionHierarchy: changed cell is outside of the DEM!");
+    }
+  }
+
+  // The top of the tree each depression belongs to. A depression's parent
+  // always has a larger label than it does unless the depression links to the
+  // ocean, so we can find all the tops in one backwards pass.
+  std::vector<dh_label_t> old_root(deps.size(), OCEAN);
+  for (size_t d = deps.size() - 1; d > OCEAN; d--) {
+    const auto& dep = deps[d];
+    old_root[d]     = (dep.ocean_parent || dep.parent == NO_PARENT) ? d : old_root[dep.parent];
+  }
+
+  // Elevation at which the tree a label belongs to finds the ocean
+  const auto old_ocean_elev = [&](const dh_label_t lbl) -> double {
+    return (lbl == OCEAN) ? LOWEST : static_cast<double>(deps[old_root[lbl]].out_elev);
+  };
+
+  // Trees which are rebuilt
+  std::vector<bool> affected(deps.size(), false);
+
+  // The region being rebuilt and a quick way of checking membership in it
+  Array2D<uint8_t> in_region(dem.width(), dem.height(), 0);
+  std::vector<flat_c_idx> region;
+  std::vector<flat_c_idx> frontier;
+
+  const auto is_ocean_land = [&](const flat_c_idx c) { return label(c) == OCEAN && flowdirs(c) != NO_FLOW; };
+
+  const auto add_to_region = [&](const flat_c_idx c) {
+    if (in_region(c))
+      return;
+    in_region(c) = 1;
+    region.push_back(c);
+    frontier.push_back(c);
+  };
+
+  // Grow the region from the cells added to it so far. Depressions are
+  // followed to all of the cells of their trees; land draining to the ocean is
+  // followed upstream to all of the cells whose flow passes through it.
+  const auto grow_region = [&]() {
+    while (!frontier.empty()) {
+      const auto c = frontier.back();
+      frontier.pop_back();
+      const auto [cx, cy] = dem.iToxy(c);
+      for (int n = 1; n <= neighbours; n++) {
+        const int nx = cx + dx[n];
+        const int ny = cy + dy[n];
+        if (!dem.inGrid(nx, ny))
+          continue;
+        const auto ni = dem.xyToI(nx, ny);
+        if (in_region(ni))
+          continue;
+        const auto nlabel = label(ni);
+        if (nlabel != OCEAN && affected[old_root[nlabel]]) {
+          add_to_region(ni);
+        } else if (label(c) == OCEAN && nlabel == OCEAN && flowdirs(ni) == dinverse[n]) {
+          add_to_region(ni);
+        }
+      }
+    }
+  };
+
+  // Seed the region with the changed cells and their neighbours
+  {
+    const auto seed = [&](const flat_c_idx c) {
+      const auto clabel = label(c);
+      if (clabel != OCEAN) {
+        affected[old_root[clabel]] = true;
+        add_to_region(c);
+      } else if (is_ocean_land(c)) {
+        add_to_region(c);
+      }
+    };
+    for (const auto c : changed_cells) {
+      const auto [cx, cy] = dem.iToxy(c);
+      seed(c);
+      for (int n = 1; n <= neighbours; n++) {
+        if (dem.inGrid(cx + dx[n], cy + dy[n]))
+          seed(dem.xyToI(cx + dx[n], cy + dy[n]));
+      }
+    }
+    grow_region();
+  }
+
+  if (region.empty()) {
+    RDLOG_MISC << "No land cells were changed, the depression hierarchy is unaffected.";
+    return 0;
+  }
+
+  DepressionHierarchy<elev_t> sub_deps;
+  Array2D<dh_label_t> sub_label;
+  Array2D<int8_t> sub_flowdirs;
+  // Within the sub-grid, the outside cell which each cell of the region that
+  // drains out of the region ultimately drains to
+  Array2D<flat_c_idx> drains_to;
+  std::vector<dh_label_t> sub_root;
+  int x0 = 0;
+  int y0 = 0;
+
+  // Convert between flat indices of the DEM and the sub-grid
+  const auto to_sub = [&](const flat_c_idx c) {
+    const auto [cx, cy] = dem.iToxy(c);
+    return sub_label.xyToI(cx - x0, cy - y0);
+  };
+  const auto from_sub = [&](const flat_c_idx s) {
+    const auto [sx, sy] = sub_label.iToxy(s);
+    return dem.xyToI(sx + x0, sy + y0);
+  };
+
+  // Identity of the tree a cell belongs to after the update. New trees are
+  // marked by the high bit. The ocean is OCEAN.
+  constexpr dh_label_t NEW_TREE = dh_label_t{1} << (std::numeric_limits<dh_label_t>::digits - 1);
+  struct TreeOf {
+    dh_label_t tree;
+    double ocean_elev;
+    flat_c_idx witness;  // A cell outside the region which belongs to the tree
+  };
+  const auto tree_of = [&](const flat_c_idx c) -> TreeOf {
+    if (!in_region(c)) {
+      return {label(c) == OCEAN ? OCEAN : old_root[label(c)], old_ocean_elev(label(c)), c};
+    }
+    const auto s = to_sub(c);
+    if (sub_label(s) != OCEAN) {
+      const auto root = sub_root[sub_label(s)];
+      return {NEW_TREE | root, static_cast<double>(sub_deps[root].out_elev), NO_VALUE};
+    }
+    const auto o = drains_to(s);
+    return {label(o) == OCEAN ? OCEAN : old_root[label(o)], old_ocean_elev(label(o)), o};
+  };
+
+  for (int iteration = 1;; iteration++) {
+    RDLOG_PROGRESS << "Rebuilding a region of " << region.size() << " cells (iteration " << iteration << ")...";
+
+    // Bounding box of the region plus a margin of outside cells, which become
+    // the sub-grid's ocean
+    int x1 = 0;
+    int y1 = 0;
+    x0 = dem.width();
+    y0 = dem.height();
+    for (const auto c : region) {
+      const auto [cx, cy] = dem.iToxy(c);
+      x0 = std::min<int>(x0, cx);
+      y0 = std::min<int>(y0, cy);
+      x1 = std::max<int>(x1, cx);
+      y1 = std::max<int>(y1, cy);
+    }
+    x0 = std::max(x0 - 1, 0);
+    y0 = std::max(y0 - 1, 0);
+    x1 = std::min(x1 + 1, dem.width() - 1);
+    y1 = std::min(y1 + 1, dem.height() - 1);
+
+    Array2D<elev_t> sub_dem(x1 - x0 + 1, y1 - y0 + 1);
+    sub_dem.setNoData(dem.noData());
+    sub_label    = Array2D<dh_label_t>(sub_dem.width(), sub_dem.height(), OCEAN);
+    sub_flowdirs = Array2D<int8_t>(sub_dem.width(), sub_dem.height(), NO_FLOW);
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++) {
+        sub_dem(x - x0, y - y0) = dem(x, y);
+        if (in_region(x, y))
+          sub_label(x - x0, y - y0) = NO_DEP;
+      }
+
+    sub_deps = GetDepressionHierarchy<elev_t, topo>(sub_dem, sub_label, sub_flowdirs);
+
+    sub_root.assign(sub_deps.size(), OCEAN);
+    for (size_t d = sub_deps.size() - 1; d > OCEAN; d--) {
+      const auto& dep = sub_deps[d];
+      sub_root[d]     = (dep.ocean_parent || dep.parent == NO_PARENT) ? d : sub_root[dep.parent];
+    }
+
+    // Follow the flow of cells which left the region to the cell outside of it
+    // where they went
+    drains_to = Array2D<flat_c_idx>(sub_dem.width(), sub_dem.height(), NO_VALUE);
+    std::vector<flat_c_idx> path;
+    for (const auto c : region) {
+      auto s = to_sub(c);
+      if (sub_label(s) != OCEAN)
+        continue;
+      while (drains_to(s) == NO_VALUE) {
+        path.push_back(s);
+        const auto [sx, sy] = sub_label.iToxy(s);
+        const auto f        = sub_flowdirs(s);
+        const auto ds       = sub_label.xyToI(sx + dx[f], sy + dy[f]);
+        if (!in_region(from_sub(ds))) {
+          drains_to(s) = from_sub(ds);
+          path.pop_back();
           break;
         }
+        s = ds;
+      }
+      for (const auto p : path)
+        drains_to(p) = drains_to(s);
+      path.clear();
+    }
+
+    // Find the trees which should have been part of the region. They are only
+    // added to it once we're done looking at the current region.
+    std::vector<flat_c_idx> missed;
+    const auto grow_by = [&](const TreeOf& t) {
+      if (t.tree == OCEAN || (t.tree & NEW_TREE) || affected[t.tree])
+        return;
+      affected[t.tree] = true;
+      missed.push_back(t.witness);
+    };
+
+    for (const auto c : region) {
+      const auto tc       = tree_of(c);
+      const auto [cx, cy] = dem.iToxy(c);
+      const bool c_is_new = tc.tree & NEW_TREE;
+
+      // Overflow from the region adds to the volume of the tree it goes to
+      if (!c_is_new && tc.tree != OCEAN && static_cast<double>(dem(c)) <= tc.ocean_elev) {
+        grow_by(tc);
+      }
+
+      for (int n = 1; n <= neighbours; n++) {
+        const int nx = cx + dx[n];
+        const int ny = cy + dy[n];
+        if (!dem.inGrid(nx, ny))
+          continue;
+        const auto ni = dem.xyToI(nx, ny);
+        const auto tn = tree_of(ni);
+        // Links between new trees were taken care of by the rebuild
+        if (tc.tree == tn.tree || (c_is_new && (tn.tree & NEW_TREE)))
+          continue;
+        const double link_elev = std::max(dem(c), dem(ni));
+        if (std::min(tc.ocean_elev, tn.ocean_elev) < link_elev)
+          continue;
+        // Neither side could reach the ocean before this link was reached, so
+        // in a full calculation the two trees would have merged
+        grow_by(tc);
+        grow_by(tn);
+      }
+    }
+
+    if (missed.empty())
+      break;
+    for (const auto c : missed)
+      add_to_region(c);
+    grow_region();
+  }
+
+  RDLOG_PROGRESS << "Splicing the rebuilt region into the depression hierarchy...";
+
+  // Renumber the depressions which are kept so they occupy [0, base) and the
+  // new ones so they occupy [base, base + sub_deps.size() - 1)
+  std::vector<dh_label_t> new_label(deps.size(), NO_VALUE);
+  dh_label_t base = 0;
+  for (size_t d = 0; d < deps.size(); d++) {
+    if (d == OCEAN || !affected[old_root[d]])
+      new_label[d] = base++;
+  }
+  const auto from_sub_label = [&](const dh_label_t s) -> dh_label_t {
+    return (s == NO_VALUE) ? NO_VALUE : base + s - 1;
+  };
+  const auto remap = [&](const dh_label_t d) -> dh_label_t { return (d == NO_VALUE) ? NO_VALUE : new_label[d]; };
+
+  // Label of a cell after the update
+  const auto final_label = [&](const flat_c_idx c) -> dh_label_t {
+    if (!in_region(c))
+      return new_label[label(c)];
+    const auto s = to_sub(c);
+    if (sub_label(s) != OCEAN)
+      return from_sub_label(sub_label(s));
+    return new_label[label(drains_to(s))];
+  };
+
+  // A tree whose outlet is at `out_cell` overflows into another tree (or the
+  // ocean) through one of these cells. Pick the one which finds the ocean
+  // first, breaking ties by position so the result is deterministic.
+  const auto spill_target = [&](const flat_c_idx out_cell, const elev_t out_elev, const auto& eligible) -> dh_label_t {
+    const auto [ox, oy] = dem.iToxy(out_cell);
+    double best_elev    = std::numeric_limits<double>::infinity();
+    flat_c_idx best     = NO_VALUE;
+    for (int n = 0; n <= neighbours; n++) {
+      const int nx = ox + dx[n];
+      const int ny = oy + dy[n];
+      if (!dem.inGrid(nx, ny))
+        continue;
+      const auto ni = dem.xyToI(nx, ny);
+      if (dem(ni) > out_elev || !eligible(ni))
+        continue;
+      const auto t = tree_of(ni);
+      if (t.ocean_elev < best_elev || (t.ocean_elev == best_elev && ni < best)) {
+        best_elev = t.ocean_elev;
+        best      = ni;
       }
-      label(x, y) = mylabel;
     }
+    assert(best != NO_VALUE);
+    return final_label(best);
+  };
+
+  DepressionHierarchy<elev_t> updated;
+  updated.reserve(base + sub_deps.size() - 1);
+
+  // Depressions outside the region
+  for (size_t d = 0; d < deps.size(); d++) {
+    if (new_label[d] == NO_VALUE)
+      continue;
+    auto dep      = std::move(deps[d]);
+    dep.dep_label = new_label[d];
+    dep.lchild    = remap(dep.lchild);
+    dep.rchild    = remap(dep.rchild);
+    dep.odep      = remap(dep.odep);
+    std::vector<dh_label_t> ocean_linked;
+    for (const auto x : dep.ocean_linked) {
+      if (new_label[x] != NO_VALUE)
+        ocean_linked.push_back(new_label[x]);
+    }
+    dep.ocean_linked = std::move(ocean_linked);
+    if (dep.parent != NO_PARENT && new_label[dep.parent] == NO_VALUE) {
+      // This tree overflowed into the region. Relinking it must wait until
+      // all of the depressions are in place.
+      dep.parent  = NO_VALUE;
+      dep.geolink = NO_VALUE;
+    } else if (dep.parent != NO_PARENT) {
+      dep.parent  = new_label[dep.parent];
+      dep.geolink = remap(dep.geolink);
+    }
+    updated.push_back(std::move(dep));
+  }
+
+  // Depressions of the region
+  for (size_t s = 1; s < sub_deps.size(); s++) {
+    auto dep      = std::move(sub_deps[s]);
+    dep.dep_label = from_sub_label(s);
+    dep.lchild    = from_sub_label(dep.lchild);
+    dep.rchild    = from_sub_label(dep.rchild);
+    dep.odep      = from_sub_label(dep.odep);
+    dep.pit_cell  = (dep.pit_cell == NO_VALUE) ? NO_VALUE : from_sub(dep.pit_cell);
+    dep.out_cell  = (dep.out_cell == NO_VALUE) ? NO_VALUE : from_sub(dep.out_cell);
+    for (auto& x : dep.ocean_linked)
+      x = from_sub_label(x);
+    if (dep.parent == OCEAN) {
+      // Overflows out of the region. Relinked below.
+      dep.parent  = NO_VALUE;
+      dep.geolink = NO_VALUE;
+    } else if (dep.parent != NO_PARENT) {
+      dep.parent  = from_sub_label(dep.parent);
+      dep.geolink = from_sub_label(dep.geolink);
+    }
+    dep.water_vol = 0;
+    updated.push_back(std::move(dep));
+  }
+
+  // Link the trees which overflow across the region's boundary
+  for (size_t d = 1; d < updated.size(); d++) {
+    auto& dep = updated[d];
+    if (dep.parent != NO_VALUE)
+      continue;
+    dh_label_t target;
+    if (d < base) {
+      target = spill_target(dep.out_cell, dep.out_elev, [&](const flat_c_idx c) { return in_region(c) != 0; });
+    } else {
+      target = spill_target(dep.out_cell, dep.out_elev, [&](const flat_c_idx c) {
+        return !in_region(c) || sub_label(to_sub(c)) == OCEAN;
+      });
+    }
+    dep.parent  = target;
+    dep.geolink = target;
+    updated[target].ocean_linked.push_back(d);
+  }
+
+  // Relabel the cells
+  bool renumbered = false;
+  for (size_t d = 0; d < deps.size(); d++) {
+    renumbered |= new_label[d] != NO_VALUE && new_label[d] != d;
+  }
+  for (const auto c : region) {
+    label(c)    = final_label(c);
+    flowdirs(c) = sub_flowdirs(to_sub(c));
+  }
+  if (renumbered) {
+#pragma omp parallel for
+    for (flat_c_idx i = 0; i < label.size(); i++) {
+      if (!in_region(i))
+        label(i) = new_label[label(i)];
+    }
+  }
+
+  deps = std::move(updated);
+
+  RDLOG_TIME_USE << "Time to update depression hierarchy = " << timer_overall.stop() << " s";
+
+  return region.size();
 }
 
 }  // namespace richdem::dephier
@@ -6,6 +6,7 @@
 #include <richdem/depressions/Wei2018.hpp>
 #include <richdem/depressions/Zhou2016.hpp>
 #include <stdexcept>
+#include <type_traits>
 
 namespace richdem {
 
@@ -22,4 +23,9 @@ void FillDepressions(Array2D<T> &dem){
 template<Topology topo, class T> void FillDepressionsEpsilon(Array2D<T> &dem){ PriorityFloodEpsilon_Barnes2014<topo>(dem); }
 template<Topology topo, class T> void BreachDepressions     (Array2D<T> &dem){ CompleteBreaching_Lindsay2016<topo>  (dem); }
 
+template<Topology topo, class T>
+void BreachDepressionsLeastCost(Array2D<T> &dem, const int max_dist, const double max_cost, const bool fill_depressions){
+  LeastCostBreaching_Lindsay2016<topo>(dem, max_dist, max_cost, std::is_floating_point<T>::value, fill_depressions);
+}
+
 }
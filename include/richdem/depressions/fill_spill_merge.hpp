@@ -1,7 +1,9 @@
 #pragma once
 
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/epoch_visited_set.hpp>
 #include <richdem/common/math.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/logger.hpp>
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/timer.hpp>
@@ -75,7 +77,9 @@ static SubtreeDepressionInfo FindDepressionsToFill(
   const DepressionHierarchy<elev_t> &deps,
   const Array2D<elev_t>             &topo,
   const Array2D<dh_label_t>         &label,
-  Array2D<wtd_t>                    &wtd
+  Array2D<wtd_t>                    &wtd,
+  EpochVisitedSet                   &dep_labels,
+  EpochVisitedSet                   &visited
 );
 
 template<class elev_t, class wtd_t>
@@ -89,6 +93,18 @@ void FillDepressions(
   Array2D<wtd_t>                       &wtd
 );
 
+template<class elev_t, class wtd_t>
+void FillDepressions(
+  const flat_c_idx                      pit_cell,
+  const flat_c_idx                      out_cell,
+  const EpochVisitedSet                &dep_labels,
+  double                                water_vol,
+  const Array2D<elev_t>                &topo,
+  const Array2D<dh_label_t>            &label,
+  Array2D<wtd_t>                       &wtd,
+  EpochVisitedSet                      &visited
+);
+
 template<class elev_t, class wtd_t>
 void BackfillDepression(
   const double water_level,
@@ -190,7 +206,12 @@ void FillSpillMerge(
   //determine which depressions or metadepressions contain standing water. We
   //then modify `wtd` in order to distribute this water across the cells of the
   //depression which will lie below its surface.
-  FindDepressionsToFill(OCEAN, deps, topo, label, wtd);
+  {
+    //Every depression's fill reuses these, so their memory is allocated once
+    EpochVisitedSet dep_labels(deps.size());
+    EpochVisitedSet visited(topo.size());
+    FindDepressionsToFill(OCEAN, deps, topo, label, wtd, dep_labels, visited);
+  }
   RDLOG_TIME_USE<<"t FlowInDepressionHierarchy: Fill time = "<<timer_filled.stop()<<" s";
   RDLOG_TIME_USE<<"t FlowInDepressionHierarchy = "<<timer_overall.stop()<<" s";
 }
@@ -244,17 +265,16 @@ static void MoveWaterIntoPits(
 
   //Calculate how many upstream cells flow into each cell
   Array2D<char>  dependencies(topo.width(),topo.height(),0);
-  #pragma omp parallel for collapse(2)
-  for(int y=0;y<topo.height();y++)
-  for(int x=0;x<topo.width(); x++)
-  for(int n=1;n<=8;n++){               //Loop through neighbours
-    const int nx = x+d8x[n];           //Identify coordinates of neighbour
-    const int ny = y+d8y[n];
-    if(!topo.inGrid(nx,ny))
-      continue;
-    if(flowdirs(nx,ny)==d8_inverse[n])  //Does my neighbour flow into me?
-      dependencies(x,y)++;              //Increment my dependencies
-  }
+  ParallelForCells(topo, [&](const int x, const int y){
+    for(int n=1;n<=8;n++){               //Loop through neighbours
+      const int nx = x+d8x[n];           //Identify coordinates of neighbour
+      const int ny = y+d8y[n];
+      if(!topo.inGrid(nx,ny))
+        continue;
+      if(flowdirs(nx,ny)==d8_inverse[n])  //Does my neighbour flow into me?
+        dependencies(x,y)++;              //Increment my dependencies
+    }
+  });
 
   //Find the peaks. These are the cells into which no other cells pass flow (i.e. 0 dependencies). We
   //know the flow accumulation of the peaks without having to perform any
@@ -617,8 +637,9 @@ class SubtreeDepressionInfo {
   dh_label_t top_label = NO_VALUE;
   //Here we keep track of which depressions are contained within the
   //metadepression. This allows us to limit the spreading function to cells
-  //within the metadepression.
-  std::unordered_set<dh_label_t> my_labels;
+  //within the metadepression. The subtrees of a metadepression's children are
+  //disjoint, so no label appears twice.
+  std::vector<dh_label_t> my_labels;
 };
 
 
@@ -649,6 +670,8 @@ class SubtreeDepressionInfo {
 ///@param wtd      Water table depth. Values of 0 indicate saturation.
 ///                Negative values indicate additional water can be added to the
 ///                cell. Positive values indicate standing surface water.
+///@param dep_labels Scratch space able to hold every depression label
+///@param visited  Scratch space able to hold every cell of `topo`
 ///@return Information about the subtree: its leaf node, depressions it
 ///        contains, and its root node.
 template<class elev_t, class wtd_t>
@@ -657,7 +680,9 @@ static SubtreeDepressionInfo FindDepressionsToFill(
   const DepressionHierarchy<elev_t> &deps,                  //Depression hierarchy
   const Array2D<elev_t>             &topo,                  //Topographic data (used for determinining volumes as we're spreading stuff)
   const Array2D<dh_label_t>         &label,                 //Array indicating which leaf depressions each cell belongs to
-  Array2D<wtd_t>                    &wtd                    //Water table depth
+  Array2D<wtd_t>                    &wtd,                   //Water table depth
+  EpochVisitedSet                   &dep_labels,            //Scratch space for the labels of the metadepression being filled
+  EpochVisitedSet                   &visited                //Scratch space for the cells visited while filling
 ){
   //Stop when we reach one level below the leaves
   if(current_depression==NO_VALUE)
@@ -670,7 +695,7 @@ static SubtreeDepressionInfo FindDepressionsToFill(
   //metadepression tree by MoveWaterInDepHier(). Similar, it doesn't mater what their leaf
   //labels are since we will never spread water into them.
   for(const auto c: this_dep.ocean_linked)
-    FindDepressionsToFill(c, deps, topo, label, wtd);
+    FindDepressionsToFill(c, deps, topo, label, wtd, dep_labels, visited);
 
   //At this point we've visited all of the ocean-linked depressions. Since all
   //depressions link to the ocean and the ocean has no children, this means we
@@ -681,13 +706,13 @@ static SubtreeDepressionInfo FindDepressionsToFill(
 
   //We visit both of the children. We need to keep track of info from these
   //because we may spread water across them.
-  SubtreeDepressionInfo left_info  = FindDepressionsToFill(this_dep.lchild, deps, topo, label, wtd);
-  SubtreeDepressionInfo right_info = FindDepressionsToFill(this_dep.rchild, deps, topo, label, wtd);
+  SubtreeDepressionInfo left_info  = FindDepressionsToFill(this_dep.lchild, deps, topo, label, wtd, dep_labels, visited);
+  SubtreeDepressionInfo right_info = FindDepressionsToFill(this_dep.rchild, deps, topo, label, wtd, dep_labels, visited);
 
   SubtreeDepressionInfo combined;
-  combined.my_labels.emplace(current_depression);
-  combined.my_labels.merge(left_info.my_labels);
-  combined.my_labels.merge(right_info.my_labels);
+  combined.my_labels = std::move(left_info.my_labels);
+  combined.my_labels.push_back(current_depression);
+  combined.my_labels.insert(combined.my_labels.end(), right_info.my_labels.begin(), right_info.my_labels.end());
 
   combined.leaf_label = left_info.leaf_label;  //Choose left because right is not guaranteed to exist
   if(combined.leaf_label==NO_VALUE)            //If there's no label, then there was no child
@@ -714,14 +739,19 @@ static SubtreeDepressionInfo FindDepressionsToFill(
     //not want to attempt to do so again in an empty parent depression. We check
     //to see if both children have finished spreading water.
 
+    dep_labels.clear();
+    for(const auto l: combined.my_labels)
+      dep_labels.insert(l);
+
     FillDepressions(
       deps.at(combined.leaf_label).pit_cell,
       deps.at(combined.top_label).out_cell,
-      combined.my_labels,
+      dep_labels,
       this_dep.water_vol,
       topo,
       label,
-      wtd
+      wtd,
+      visited
     );
 
     //At this point there should be no more water all the way up the tree until
@@ -766,28 +796,29 @@ static SubtreeDepressionInfo FindDepressionsToFill(
 ///                Negative values indicate additional water can be added to the
 ///                cell. Positive values indicate standing surface water. We may
 ///                add water to it.
+///@param visited  Scratch space able to hold every cell of `topo`. Cleared on
+///                entry.
 ///@return         N/A
 template<class elev_t, class wtd_t>
 void FillDepressions(
   const flat_c_idx                      pit_cell,
   const flat_c_idx                      out_cell,
-  const std::unordered_set<dh_label_t> &dep_labels,
+  const EpochVisitedSet                &dep_labels,
   double                                water_vol,
   const Array2D<elev_t>                &topo,
   const Array2D<dh_label_t>            &label,
-  Array2D<wtd_t>                       &wtd
+  Array2D<wtd_t>                       &wtd,
+  EpochVisitedSet                      &visited
 ){
   //Nothing to do if we have no water
   if(water_vol==0)
     return;
 
-  //Hashset stores the ids of the cells we've visited. We don't want to use a 2D
-  //array because the size of the DEM as a whole could be massive and that's a
-  //lot of memory to allocate/deallocate each time this function is called. We
-  //arbitrarily reserve enough space in the hashset for a few thousand items.
-  //This should be large than most depressions while still being small by the
-  //computer's standards.
-  std::unordered_set<flat_c_idx> visited(2048);
+  //Stores the ids of the cells we've visited. The DEM as a whole could be
+  //massive, so rather than allocating a 2D array each time this function is
+  //called we reuse the caller's; clearing it takes constant time.
+  assert(visited.size()==topo.size());
+  visited.clear();
 
   //Priority queue that sorts cells by lowest elevation first. If two cells are
   //of equal elevation the one added most recently is popped first. The ordering
@@ -809,7 +840,7 @@ void FillDepressions(
     topo(pit_cell)
   );
 
-  visited.emplace(pit_cell);
+  visited.insert(pit_cell);
 
   //Cells whose wtd will be affected as we spread water around
   std::vector<flat_c_idx> cells_affected;
@@ -847,7 +878,7 @@ void FillDepressions(
     //into the pit cell. Since we may already have filled other depressions
     //their cells are allowed to have wtd>0. Thus, we raise a warning if we are
     //looking at a cell in this unfilled depression with wtd>0.
-    if(dep_labels.count(label(c.x,c.y))==1 && wtd(c.x,c.y)>0)
+    if(dep_labels.contains(label(c.x,c.y)) && wtd(c.x,c.y)>0)
       throw std::runtime_error("A cell was discovered in an unfilled depression with wtd>0!");
 
     //There are two possibilities:
@@ -907,7 +938,7 @@ void FillDepressions(
 
       //Don't add cells which are not part of the depression unless the cell in
       //question is the outlet cell.
-      if(dep_labels.count(label(ni))==0 && ni!=out_cell)
+      if(!dep_labels.contains(label(ni)) && ni!=out_cell)
         continue;
 
       if(topo(nx,ny) > topo(out_cell))  //We may not add any cells higher than the out_cell. Without this check, we would sometimes look at higher cells before checking out_cell for the second time.
@@ -919,10 +950,8 @@ void FillDepressions(
       //ocean and try to add it. The ocean would then be called instead of
       //more cells within the depression. Therefore, we do not add ocean
       //cells.
-      if(visited.count(ni)==0){
+      if(visited.insert(ni))
         flood_q.emplace(nx,ny,topo(nx,ny));
-        visited.emplace(ni);
-      }
     }
 
     //The queue is empty, so we add the outlet cell. We may have already visited
@@ -933,7 +962,7 @@ void FillDepressions(
     if(flood_q.empty()){
       const auto [x, y] = topo.iToxy(out_cell);
       flood_q.emplace(x, y, topo(out_cell));
-      visited.emplace(out_cell);
+      visited.insert(out_cell);
     }
   }
 
@@ -947,6 +976,33 @@ void FillDepressions(
 
 
 
+///Convenience form of FillDepressions() for a single fill. Since it allocates
+///scratch space the size of `topo`, callers filling many depressions should use
+///the form taking EpochVisitedSets and reuse them.
+template<class elev_t, class wtd_t>
+void FillDepressions(
+  const flat_c_idx                      pit_cell,
+  const flat_c_idx                      out_cell,
+  const std::unordered_set<dh_label_t> &dep_labels,
+  double                                water_vol,
+  const Array2D<elev_t>                &topo,
+  const Array2D<dh_label_t>            &label,
+  Array2D<wtd_t>                       &wtd
+){
+  dh_label_t max_label = 0;
+  for(const auto l: dep_labels)
+    max_label = std::max(max_label, l);
+
+  EpochVisitedSet label_set(dep_labels.empty() ? 0 : max_label+1);
+  for(const auto l: dep_labels)
+    label_set.insert(l);
+
+  EpochVisitedSet visited(topo.size());
+  FillDepressions(pit_cell, out_cell, label_set, water_vol, topo, label, wtd, visited);
+}
+
+
+
 ///Calculates the volume of a depression contained by a sill
 ///@param sill_elevation  Elevation of the sill
 ///@param cells_in_depression Number of cells contained by the sill
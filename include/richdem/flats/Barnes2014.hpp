@@ -12,6 +12,7 @@
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/grid_cell.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 
 #include <richdem/flats/find_flats.hpp>
 
@@ -165,10 +166,9 @@ static void BuildTowardsCombinedGradient(
   RDLOG_PROGRESS<<"Barnes flat resolution: toward and combined gradients...";
 
   //Make previous flat_mask negative so that we can keep track of where we are
-  #pragma omp parallel for collapse(2)
-  for(int x=0;x<flat_mask.width();x++)
-  for(int y=0;y<flat_mask.height();y++)
+  ParallelForCells(flat_mask, [&](const int x, const int y){
     flat_mask(x,y) *= -1;
+  });
 
 
   //Incrementation
@@ -603,15 +603,13 @@ void ResolveFlatsFlowdirs_Barnes2014(
 
   progress.start( flat_mask.size() );
 
-  #pragma omp parallel for collapse(2)
-  for(int y=1;y<flat_mask.width()-1;y++)
-  for(int x=1;x<flat_mask.height()-1;x++){
+  ParallelForInteriorCells(flat_mask, [&](const int x, const int y){
     const int ci = y*flat_mask.width()+x;
 
     if(flat_mask.isNoData(x,y))
-      continue;
+      return;
     if (flowdirs.at(9*ci)!=NO_FLOW_GEN)
-      continue;
+      return;
 
     int minimum_elevation = flat_mask(ci);
     int flowdir           = NO_FLOW_GEN;
@@ -631,7 +629,7 @@ void ResolveFlatsFlowdirs_Barnes2014(
 
     flowdirs.at(9*ci+0)       = HAS_FLOW_GEN;
     flowdirs.at(9*ci+flowdir) = 1;
-  }
+  });
 
   RDLOG_TIME_USE<<"Succeeded in = "<<progress.stop()<<" s";
 }
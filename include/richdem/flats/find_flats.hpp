@@ -3,6 +3,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 
 namespace richdem {
 
@@ -36,17 +37,17 @@ void FindFlats(
 
   progress.start( elevations.size() );
 
-  #pragma omp parallel for
-  for(int y=0;y<elevations.height();y++)
-  for(int x=0;x<elevations.width();x++){
-    if(elevations.isNoData(x,y)){
-      flats(x,y) = FLAT_NO_DATA;
-      continue;
-    }
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        flats(x,y) = FLAT_NO_DATA;
+        return;
+      }
 
-    if(elevations.isEdgeCell(x,y)){
-      flats(x,y) = NOT_A_FLAT;
-      continue;
+      if(elevations.isEdgeCell(x,y)){
+        flats(x,y) = NOT_A_FLAT;
+        return;
+      }
     }
 
     //We'll now assume that the cell is a flat unless proven otherwise
@@ -55,14 +56,14 @@ void FindFlats(
     for(int n=1;n<=8;n++){
       const int nx = x+d8x[n];
       const int ny = y+d8y[n];
-      if(elevations(nx,ny)<elevations(x,y) || elevations.isNoData(nx,ny)){
+      if(elevations(nx,ny)<elevations(x,y) || (check && elevations.isNoData(nx,ny))){
         flats(x,y) = NOT_A_FLAT;
         break;
       }
     }
 
     //We handled the base case just above the for loop
-  }
+  });
 
   RDLOG_TIME_USE<<"Succeeded in = "<<progress.stop()<<" s";
 }
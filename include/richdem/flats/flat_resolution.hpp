@@ -11,6 +11,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/grid_cell.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/flowmet/d8_flowdirs.hpp>
 #include <deque>
 #include <vector>
@@ -102,15 +103,13 @@ void d8_flow_flats(
 
   RDLOG_ALG_NAME<<"Calculating D8 flow directions using flat mask...";
   progress.start( flat_mask.width()*flat_mask.height() );
-  #pragma omp parallel for
-  for(int x=1;x<flat_mask.width()-1;x++){
-    progress.update( x*flat_mask.height() );
-    for(int y=1;y<flat_mask.height()-1;y++)
-      if(flat_mask(x,y)==flat_mask.noData())
-        continue;
-      else if (flowdirs(x,y)==NO_FLOW)
-        flowdirs(x,y)=d8_masked_FlowDir(flat_mask,labels,x,y);
-  }
+  ParallelForInteriorCells(flat_mask, [&](const int x, const int y){
+    ++progress;
+    if(flat_mask(x,y)==flat_mask.noData())
+      return;
+    else if (flowdirs(x,y)==NO_FLOW)
+      flowdirs(x,y)=d8_masked_FlowDir(flat_mask,labels,x,y);
+  });
   RDLOG_TIME_USE<<"Succeeded in = "<<progress.stop()<<" s";
 }
 
@@ -255,10 +254,9 @@ static void BuildTowardsCombinedGradient(
   RDLOG_PROGRESS<<"Barnes flat resolution: toward and combined gradients...";
 
   //Make previous flat_mask negative so that we can keep track of where we are
-  #pragma omp parallel for collapse(2)
-  for(int x=0;x<flat_mask.width();x++)
-  for(int y=0;y<flat_mask.height();y++)
+  ParallelForCells(flat_mask, [&](const int x, const int y){
     flat_mask(x,y)*=-1;
+  });
 
 
   //Incrementation
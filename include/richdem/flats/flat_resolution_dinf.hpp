@@ -81,15 +81,13 @@ void dinf_flow_flats(
 
   RDLOG_PROGRESS<<"Calculating Dinf flow directions using flat mask...";
   progress.start( flat_resolution_mask.width()*flat_resolution_mask.height() );
-  #pragma omp parallel for
-  for(int x=1;x<flat_resolution_mask.width()-1;x++){
-    progress.update( x*flat_resolution_mask.height() );
-    for(int y=1;y<flat_resolution_mask.height()-1;y++)
-      if(flat_resolution_mask(x,y)==flat_resolution_mask.noData())
-        continue;
-      else if(flowdirs(x,y)==NO_FLOW)
-        flowdirs(x,y)=dinf_masked_FlowDir(flat_resolution_mask,groups,x,y);
-  }
+  ParallelForInteriorCells(flat_resolution_mask, [&](const int x, const int y){
+    ++progress;
+    if(flat_resolution_mask(x,y)==flat_resolution_mask.noData())
+      return;
+    else if(flowdirs(x,y)==NO_FLOW)
+      flowdirs(x,y)=dinf_masked_FlowDir(flat_resolution_mask,groups,x,y);
+  });
   RDLOG_TIME_USE<<"Succeeded in "<<progress.stop()<<" s";
 }
 
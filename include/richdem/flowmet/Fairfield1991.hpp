@@ -4,6 +4,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/Array3D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 #include <richdem/common/random.hpp>
 
@@ -24,18 +25,18 @@ void FM_FairfieldLeymarie(const Array2D<elev_t> &elevations, Array3D<float> &pro
   ProgressBar progress;
   progress.start(elevations.size());
 
-  #pragma omp parallel for collapse(2)
-  for(int y=0;y<elevations.height();y++)
-  for(int x=0;x<elevations.width();x++){
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
     ++progress;
 
-    if(elevations.isNoData(x,y)){
-      props(x,y,0) = NO_DATA_GEN;
-      continue;
-    }
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        props(x,y,0) = NO_DATA_GEN;
+        return;
+      }
 
-    if(elevations.isEdgeCell(x,y))
-      continue;
+      if(elevations.isEdgeCell(x,y))
+        return;
+    }
 
     const elev_t e    = elevations(x,y);
 
@@ -45,10 +46,12 @@ void FM_FairfieldLeymarie(const Array2D<elev_t> &elevations, Array3D<float> &pro
       const int nx = x+dx[n];
       const int ny = y+dy[n];
 
-      if(!elevations.inGrid(nx,ny))
-        continue;
-      if(elevations.isNoData(nx,ny)) //TODO: Don't I want water to drain this way?
-        continue;
+      if constexpr(check){
+        if(!elevations.inGrid(nx,ny))
+          continue;
+        if(elevations.isNoData(nx,ny)) //TODO: Don't I want water to drain this way?
+          continue;
+      }
 
       const elev_t ne = elevations(nx,ny);
 
@@ -68,13 +71,13 @@ void FM_FairfieldLeymarie(const Array2D<elev_t> &elevations, Array3D<float> &pro
     }
 
     if(greatest_n==0)
-      continue;
+      return;
 
     props(x,y,0)          = HAS_FLOW_GEN;
     props(x,y,greatest_n) = 1;
 
     assert(elevations(x,y)>=elevations(x+dx[greatest_n],y+dy[greatest_n])); //Ensure flow goes downhill
-  }
+  });
   progress.stop();
 }
 
@@ -4,6 +4,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/Array3D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 
 namespace richdem {
@@ -24,18 +25,18 @@ void FM_Freeman(
   ProgressBar progress;
   progress.start(elevations.size());
 
-  #pragma omp parallel for collapse(2)
-  for(int y=0;y<elevations.height();y++)
-  for(int x=0;x<elevations.width();x++){
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
     ++progress;
 
-    if(elevations.isNoData(x,y)){
-      props(x,y,0) = NO_DATA_GEN;
-      continue;
-    }
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        props(x,y,0) = NO_DATA_GEN;
+        return;
+      }
 
-    if(elevations.isEdgeCell(x,y))
-      continue;
+      if(elevations.isEdgeCell(x,y))
+        return;
+    }
 
     const E e    = elevations(x,y);
 
@@ -44,10 +45,12 @@ void FM_Freeman(
       const int nx = x+d8x[n];
       const int ny = y+d8y[n];
 
-      if(!elevations.inGrid(nx,ny))
-        continue;
-      if(elevations.isNoData(nx,ny)) //TODO: Don't I want water to drain this way?
-        continue;
+      if constexpr(check){
+        if(!elevations.inGrid(nx,ny))
+          continue;
+        if(elevations.isNoData(nx,ny)) //TODO: Don't I want water to drain this way?
+          continue;
+      }
 
       const E ne = elevations(nx,ny);
 
@@ -74,7 +77,7 @@ void FM_Freeman(
           this_por = 0;
       }
     }
-  }
+  });
   progress.stop();
 }
 
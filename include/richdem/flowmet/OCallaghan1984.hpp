@@ -4,6 +4,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/Array3D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 
 namespace richdem {
@@ -28,18 +29,18 @@ void FM_OCallaghan(
   ProgressBar progress;
   progress.start(elevations.size());
 
-  #pragma omp parallel for collapse(2)
-  for(int y=0;y<elevations.height();y++)
-  for(int x=0;x<elevations.width();x++){
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
     ++progress;
 
-    if(elevations.isNoData(x,y)){
-      props(x,y,0) = NO_DATA_GEN;
-      continue;
-    }
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        props(x,y,0) = NO_DATA_GEN;
+        return;
+      }
 
-    if(elevations.isEdgeCell(x,y))
-      continue;
+      if(elevations.isEdgeCell(x,y))
+        return;
+    }
 
     const auto ci = elevations.xyToI(x, y);
     const auto ce = elevations(ci);
@@ -50,8 +51,10 @@ void FM_OCallaghan(
       const int nx = x + dx[n];
       const int ny = y + dy[n];
 
-      if(elevations.isNoData(nx, ny)) //TODO: Don't I want water to drain this way?
-        continue;
+      if constexpr(check){
+        if(elevations.isNoData(nx, ny)) //TODO: Don't I want water to drain this way?
+          continue;
+      }
 
       const elev_t ne = elevations(nx, ny);
 
@@ -65,14 +68,14 @@ void FM_OCallaghan(
     }
 
     if(lowest_n==0)
-      continue;
+      return;
 
     props(x,y,0) = HAS_FLOW_GEN;
 
     assert(ce>=elevations(ci+elevations.nshift(lowest_n))); //Ensure flow goes downhill
 
     props(x,y,lowest_n) = 1;
-  }
+  });
   progress.stop();
 }
 
@@ -1,189 +1,266 @@
 #pragma once
 
+#include <richdem/common/constants.hpp>
+#include <richdem/common/logger.hpp>
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/Array3D.hpp>
+#include <richdem/common/parallel.hpp>
+#include <richdem/common/ProgressBar.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
 namespace richdem {
 
-// enum OrlandiniMode {
-//   LAD,
-//   LTD
-// };
-
-
-// template<class AccumF, class E, class A>
-// static void KernelOrlandini(
-//   const FDMode mode,
-//   AccumF accumf,
-//   const Array2D<E> &elevations,
-//   Array2D<A> &accum,
-//   dep_t &dep,
-//   std::queue<GridCell> &q,
-//   const int x,
-//   const int y,
-//   Array2D<double> &delta,
-//   const OrlandiniMode omode,
-//   const double lambda
-// ){
-//   //TODO: Assumes that the width and height of grid cells are equal and scaled
-//   //to 1.
-//   constexpr double d1   = 1;
-//   constexpr double d2   = 1;
-//   constexpr float  dang = std::atan2(d2,d1);
-
-//   //Table 1 of Tarboton (1997)
-//   //          Column #  =   0    1    2    3    4    5   6    7
-//   // const int    dy_e1[8] = { 0 , -1 , -1 ,  0 ,  0 ,  1 , 1 ,  0 };
-//   // const int    dx_e1[8] = { 1 ,  0 ,  0 , -1 , -1 ,  0 , 0 ,  1 };
-//   // const int    dy_e2[8] = {-1 , -1 , -1 , -1 ,  1 ,  1 , 1 ,  1 };
-//   // const int    dx_e2[8] = { 1 ,  1 , -1 , -1 , -1 , -1 , 1 ,  1 };
-
-//   //I remapped the foregoing table for ease of use with RichDEM. The facets
-//   //are renumbered as follows:
-//   //    3->1    2->2    1->3    0->4    7->5    6->6    5->7    4->8
-//   //This gives the following table
-//   //  Remapped Facet #  =  -   1    2     3    4    5   6    7    8
-//   //  Tarboton Facet #  =  -   3    2     1    0    7   6    5    4
-//   const int    dy_e1[9] = {0,  0 , -1 ,  -1 ,  0 ,  0 , 1 ,  1 ,  0  };
-//   const int    dx_e1[9] = {0, -1 ,  0 ,   0 ,  1 ,  1 , 0 ,  0 , -1  };
-//   const int    dy_e2[9] = {0, -1 , -1 ,  -1 , -1 ,  1 , 1 ,  1 ,  1  };
-//   const int    dx_e2[9] = {0, -1 , -1 ,   1 ,  1 ,  1 , 1 , -1 , -1  };
-
-//   //Table 1 of Orlandini et al (2003)
-//   //                        021 023 063 069 089 087 047 041
-//   //                p1  =     2   2   6   6   8   8   4   4
-//   //                p2  =     1   3   3   9   9   7   7   1
-//   //             sigma  =     1  -1   1  -1   1  -1   1  -1
-//   //Orlandini et al number neighbour cells like so:
-//   //    369
-//   //    208
-//   //    147
-//   //Therefore, facets correspond as follows:
-//   //RichDEM   Orlandini
-//   //    012 = 023
-//   //    023 = 036
-//   //    034 = 069
-//   //    045 = 089
-//   //    056 = 078
-//   //    067 = 047
-//   //    078 = 014
-//   //    081 = 012
-//   //We also convert Orlandini's coordinate system to the RichDEM system like so:
-//   //    2->1, 3->2, 6->3, 9->4, 8->5, 7->6, 4->7, 1->8
-//   //The remapped Table 1 is then
-//   //                         023  063  069   089  087   047  041  021
-//   //                p1  =      1    3    3     5    5     7    7    1
-//   //                p2  =      2    2    4     4    6     6    8    8
-//   //             sigma  =     -1    1   -1     1   -1     1   -1    1
-//   const int       p1[9] = {0,  1 ,  3 ,  3 ,   5,   5,    7,   7,   1  };
-//   const int       p2[9] = {0,  2 ,  2 ,  4 ,   4,   6,    6,   8,   8  };
-//   const int    sigma[9] = {0,  -1,  1 , -1 ,   1,  -1,    1,  -1,   1  };
-
-//   int8_t nmax = -1;
-//   double smax = 0;
-//   float  rmax = 0;
-
-//   for(int n=1;n<=8;n++){
-//     if(!elevations.inGrid (x+dx_e1[n],y+dy_e1[n]))
-//       continue;
-//     if(elevations.isNoData(x+dx_e1[n],y+dy_e1[n]))
-//       continue;
-//     if(!elevations.inGrid (x+dx_e2[n],y+dy_e2[n]))
-//       continue;
-//     if(elevations.isNoData(x+dx_e2[n],y+dy_e2[n]))
-//       continue;
-
-//     //Is is assumed that cells with a value of NoData have very negative
-//     //elevations with the result that they draw flow off of the grid.
-
-//     //Choose elevations based on Table 1 of Tarboton (1997), Barnes TODO
-//     const double e0 = elevations(x,y);
-//     const double e1 = elevations(x+dx_e1[n],y+dy_e1[n]);
-//     const double e2 = elevations(x+dx_e2[n],y+dy_e2[n]);
-
-//     const double s1 = (e0-e1)/d1;
-//     const double s2 = (e1-e2)/d2;
-
-//     double r = std::atan2(s2,s1);
-//     double s;
-
-//     if(r<1e-7){
-//       r = 0;
-//       s = s1;
-//     } else if(r>dang-1e-7){
-//       r = dang;
-//       s = (e0-e2)/sqrt(d1*d1+d2*d2);
-//     } else {
-//       s = sqrt(s1*s1+s2*s2);
-//     }
-
-//     if(s>smax){
-//       smax = s;
-//       nmax = n;
-//       rmax = r;
-//     }
-//   }
-
-//   if(nmax==-1)
-//     return;
-
-//   double d1me;
-//   double d2me;
-
-//   if(omode==OrlandiniMode::LTD){
-//     d1me = lambda*delta(x,y) + sigma[nmax]*d1*std::sin(rmax);
-//     d2me = lambda*delta(x,y) - sigma[nmax]*std::sqrt(d1*d1+d2*d2)*std::sin(dang-rmax);
-//   } else if(omode==OrlandiniMode::LAD){
-//     d1me = lambda*delta(x,y) + sigma[nmax]*rmax;
-//     d2me = lambda*delta(x,y) - sigma[nmax]*(dang-rmax);
-//   }
-
-//   int p;
-
-//   if(std::abs(d1me)<=std::abs(d2me)){
-//     delta(x,y) = d1me;
-//     p = p1[nmax];
-//   } else {
-//     delta(x,y) = d2me;
-//     p = p2[nmax];
-//   }
-
-//   //TODO: This fixes issues, but makes me think I have one or more constants wrong
-//   if(elevations(x,y)<elevations(x+dx[p],y+dy[p])){
-//     if(std::abs(d1me)<=std::abs(d2me)){
-//       delta(x,y) = d2me;
-//       p = p2[nmax];
-//     } else {
-//       delta(x,y) = d1me;
-//       p = p1[nmax];
-//     }
-//   }
-
-//   const int nx = x+dx[p];
-//   const int ny = y+dy[p];
-
-//   if(elevations(x,y)<elevations(nx,ny)){
-//     RDLOG_DEBUG<<"Uh oh";
-//     RDLOG_DEBUG<<"p="<<(int)p;
-//     RDLOG_DEBUG<<"nmax="<<(int)nmax;
-//     for(int iy=std::max(0,y-1);iy<=std::min(elevations.height()-1,y+1);iy++){
-//       for(int ix=std::max(0,x-1);ix<=std::min(elevations.width()-1,x+1);ix++)
-//         RDLOG_DEBUG<<std::setprecision(15)<<elevations(ix,iy)<<" ";
-//       RDLOG_DEBUG;
-//     }
-//   }
-//   RDLOG_DEBUG<<std::flush;
-//   assert(elevations(x,y)>=elevations(nx,ny)); //Ensure flow goes downhill
-
-//   delta(nx,ny) = delta(x,y);
-
-//   accumf(x,y,p,          dep,accum,q, accum(x,y));
-// }
-
-// template<class E, class A>
-// void FM_Orlandini(const Array2D<E> &elevations, Array2D<A> &accum, OrlandiniMode mode, double lambda){
-//   RDLOG_ALG_NAME<<"Orlandini et al. (2003) Flow Accumulation (aka D8-LTD, D8-LAD)";
-//   RDLOG_CITATION<<"Orlandini, S., Moretti, G., Franchini, M., Aldighieri, B., Testa, B., 2003. Path-based methods for the determination of nondispersive drainage directions in grid-based digital elevation models: TECHNICAL NOTE. Water Resources Research 39(6). doi:10.1029/2002WR001639.";
-//   RDLOG_CONFIG<<"lambda = "<<lambda;
-//   Array2D<double> delta(elevations,0);
-//   KernelFlowdir(KernelOrlandini<decltype(PassAccumulation<A>),E,A>,PassAccumulation<A>,elevations,accum,delta,mode,lambda);
-// }
+///Deviations from the steepest direction which Orlandini et al. (2003)
+///accumulate along a flow path
+enum class OrlandiniMode {
+  LTD, ///< Least transversal deviation: distance from the steepest line (D8-LTD)
+  LAD  ///< Least angular deviation: angle from the steepest line (D8-LAD)
+};
+
+/**
+  @brief  Calculates flow directions using the path-based D8-LTD or D8-LAD
+          methods
+
+  The steepest direction within each cell is found with the triangular facets
+  of Tarboton (1997). It generally lies between two neighbours, and D8 picks
+  the one closest to it, so the error made at each step is lost. Orlandini et
+  al. (2003) instead carry the deviation between the chosen path and the
+  steepest one downslope and pick, at each cell, the neighbour which keeps the
+  accumulated deviation smallest. Straight flow paths over planes oriented
+  between the D8 directions are therefore not bent onto a D8 direction.
+
+  The steepest directions are found for all cells in parallel. Since a cell's
+  deviation depends on the cells upslope of it, the deviations are then
+  propagated in a single topological pass over the graph of the at most two
+  downslope neighbours which a cell may drain to. Where several flow paths
+  join, the cell continues the path coming from its highest upslope neighbour,
+  with ties broken by cell index, so the result does not depend on the order
+  in which the cells are visited.
+
+  @param[in]  &elevations  A DEM
+  @param[out] &props       Flow proportions, in the same format as
+                           FM_Tarboton. Each cell drains to a single neighbour.
+  @param[in]  mode         Whether to accumulate transversal or angular
+                           deviations
+  @param[in]  lambda       Dampens deviations along a path. 0 gives D8,
+                           1 accumulates deviations without dampening.
+*/
+template<class E>
+void FM_Orlandini(
+  const Array2D<E> &elevations,
+  Array3D<float> &props,
+  const OrlandiniMode mode,
+  const double lambda
+){
+  RDLOG_ALG_NAME<<"Orlandini et al. (2003) Flow Accumulation (aka D8-LTD, D8-LAD)";
+  RDLOG_CITATION<<"Orlandini, S., Moretti, G., Franchini, M., Aldighieri, B., Testa, B., 2003. Path-based methods for the determination of nondispersive drainage directions in grid-based digital elevation models: TECHNICAL NOTE. Water Resources Research 39(6). doi:10.1029/2002WR001639.";
+  RDLOG_CONFIG<<"mode   = "<<((mode==OrlandiniMode::LTD)?"LTD":"LAD");
+  RDLOG_CONFIG<<"lambda = "<<lambda;
+
+  if(lambda<0 || lambda>1)
+    throw std::runtime_error("Orlandini's lambda must be in the range [0,1]!");
+
+  props.setAll(NO_FLOW_GEN);
+  props.setNoData(NO_DATA_GEN);
+
+  //TODO: Assumes that the width and height of grid cells are equal and scaled
+  //to 1.
+  constexpr double d1   = 1;
+  constexpr double d2   = 1;
+  const     double dang = std::atan2(d2,d1);
+
+  //Facets of Tarboton (1997), numbered as in FM_Tarboton
+  const int    dy_e1[9] = {0,  0 , -1 ,  -1 ,  0 ,  0 , 1 ,  1 ,  0  };
+  const int    dx_e1[9] = {0, -1 ,  0 ,   0 ,  1 ,  1 , 0 ,  0 , -1  };
+  const int    dy_e2[9] = {0, -1 , -1 ,  -1 , -1 ,  1 , 1 ,  1 ,  1  };
+  const int    dx_e2[9] = {0, -1 , -1 ,   1 ,  1 ,  1 , 1 , -1 , -1  };
+
+  //Table 1 of Orlandini et al (2003), who number neighbour cells like so:
+  //    369
+  //    208
+  //    147
+  //Converting to RichDEM's neighbours (2->1, 3->2, 6->3, 9->4, 8->5, 7->6,
+  //4->7, 1->8) and facets gives the following table, in which p1 is the
+  //cardinal neighbour e1, p2 the diagonal neighbour e2, and sigma orients
+  //deviations so that they are positive when clockwise of the steepest line.
+  const int       p1[9] = {0,  1 ,  3 ,  3 ,   5,   5,    7,   7,   1  };
+  const int       p2[9] = {0,  2 ,  2 ,  4 ,   4,   6,    6,   8,   8  };
+  const int    sigma[9] = {0,  -1,  1 , -1 ,   1,  -1,    1,  -1,   1  };
+
+  //Steepest facet of each cell, the angle of steepest descent within it
+  //measured from e1, and a bitmask of which of the facet's neighbours are
+  //lower than the cell and may therefore receive its flow
+  Array2D<int8_t>  facet(elevations, 0);
+  Array2D<float>   angle(elevations, 0);
+  Array2D<uint8_t> cands(elevations, 0);
+
+  RDLOG_PROGRESS<<"Finding steepest facets...";
+  ProgressBar progress;
+  progress.start(elevations.size());
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
+    ++progress;
+
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        props(x,y,0) = NO_DATA_GEN;
+        return;
+      }
+
+      if(elevations.isEdgeCell(x,y))
+        return;
+    }
+
+    int8_t nmax = 0;
+    double smax = 0;
+    double rmax = 0;
+
+    const double e0 = elevations(x,y);
+
+    for(int n=1;n<=8;n++){
+      if constexpr(check){
+        if(elevations.isNoData(x+dx_e1[n],y+dy_e1[n]))
+          continue;
+        if(elevations.isNoData(x+dx_e2[n],y+dy_e2[n]))
+          continue;
+      }
+
+      const double e1 = elevations(x+dx_e1[n],y+dy_e1[n]);
+      const double e2 = elevations(x+dx_e2[n],y+dy_e2[n]);
+
+      const double s1 = (e0-e1)/d1;
+      const double s2 = (e1-e2)/d2;
+
+      double r = std::atan2(s2,s1);
+      double s;
+
+      if(r<1e-7){
+        r = 0;
+        s = s1;
+      } else if(r>dang-1e-7){
+        r = dang;
+        s = (e0-e2)/std::sqrt(d1*d1+d2*d2);
+      } else {
+        s = std::sqrt(s1*s1+s2*s2);
+      }
+
+      if(s>smax){
+        smax = s;
+        nmax = n;
+        rmax = r;
+      }
+    }
+
+    if(nmax==0)
+      return;
+
+    facet(x,y) = nmax;
+    angle(x,y) = rmax;
+
+    //A facet is only chosen if its steepest direction slopes downward, so at
+    //least one of these neighbours is lower
+    uint8_t mask = 0;
+    if(elevations(x+d8x[p1[nmax]],y+d8y[p1[nmax]])<e0)
+      mask |= 1<<p1[nmax];
+    if(elevations(x+d8x[p2[nmax]],y+d8y[p2[nmax]])<e0)
+      mask |= 1<<p2[nmax];
+    cands(x,y) = mask;
+  });
+  progress.stop();
+
+  //Number of upslope neighbours which may drain into each cell
+  Array2D<uint8_t> deps(elevations, 0);
+  ParallelForCells(elevations, [&](const int x, const int y){
+    uint8_t count = 0;
+    for(int n=1;n<=8;n++){
+      const int nx = x+d8x[n];
+      const int ny = y+d8y[n];
+      if(elevations.inGrid(nx,ny) && (cands(nx,ny) & (1<<d8_inverse[n])))
+        count++;
+    }
+    deps(x,y) = count;
+  });
+
+  //Deviation accumulated along the path reaching each cell and the direction
+  //to the upslope neighbour whose path it continues, or 0 if it has none
+  Array2D<double> delta(elevations, 0);
+  Array2D<int8_t> donor(elevations, 0);
+
+  std::vector<typename Array2D<E>::i_t> stack;
+  for(auto i=elevations.i0();i<elevations.size();i++)
+    if(deps(i)==0 && cands(i)!=0)
+      stack.push_back(i);
+
+  RDLOG_PROGRESS<<"Following flow paths...";
+  progress.start(elevations.numDataCells());
+  while(!stack.empty()){
+    const auto ci = stack.back();
+    stack.pop_back();
+    ++progress;
+
+    const auto [x,y] = elevations.iToxy(ci);
+    const int    f = facet(ci);
+    const double r = angle(ci);
+
+    double dev1;
+    double dev2;
+    if(mode==OrlandiniMode::LTD){
+      dev1 = lambda*delta(ci) + sigma[f]*d1*std::sin(r);
+      dev2 = lambda*delta(ci) - sigma[f]*std::sqrt(d1*d1+d2*d2)*std::sin(dang-r);
+    } else {
+      dev1 = lambda*delta(ci) + sigma[f]*r;
+      dev2 = lambda*delta(ci) - sigma[f]*(dang-r);
+    }
+
+    //Prefer the neighbour which keeps the deviation smallest, but never send
+    //flow to a neighbour which is not lower
+    const bool use_p1 = (cands(ci) & (1<<p1[f])) && (std::abs(dev1)<=std::abs(dev2) || !(cands(ci) & (1<<p2[f])));
+    const int    p   = use_p1 ? p1[f] : p2[f];
+    const double dev = use_p1 ? dev1  : dev2;
+
+    props(x,y,0) = HAS_FLOW_GEN;
+    props(x,y,p) = 1;
+
+    //Continue this path into the receiving cell unless a higher cell's path
+    //already does so
+    const auto ni = ci+elevations.nshift(p);
+    if(donor(ni)==0){
+      donor(ni) = d8_inverse[p];
+      delta(ni) = dev;
+    } else {
+      const auto oi = ni+elevations.nshift(donor(ni));
+      if(elevations(ci)>elevations(oi) || (elevations(ci)==elevations(oi) && ci<oi)){
+        donor(ni) = d8_inverse[p];
+        delta(ni) = dev;
+      }
+    }
+
+    for(int n=1;n<=8;n++){
+      if(!(cands(ci) & (1<<n)))
+        continue;
+      const auto di = ci+elevations.nshift(n);
+      if(--deps(di)==0 && cands(di)!=0)
+        stack.push_back(di);
+    }
+  }
+  progress.stop();
+}
+
+
+
+template<class E>
+void FM_OrlandiniLTD(const Array2D<E> &elevations, Array3D<float> &props, const double lambda){
+  FM_Orlandini(elevations, props, OrlandiniMode::LTD, lambda);
+}
+
+
+
+template<class E>
+void FM_OrlandiniLAD(const Array2D<E> &elevations, Array3D<float> &props, const double lambda){
+  FM_Orlandini(elevations, props, OrlandiniMode::LAD, lambda);
+}
 
 }
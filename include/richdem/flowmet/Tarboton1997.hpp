@@ -4,6 +4,7 @@
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/Array3D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 
 #include <cmath>
@@ -54,32 +55,34 @@ void FM_Tarboton(
   ProgressBar progress;
   progress.start(elevations.size());
 
-  #pragma omp parallel for collapse(2)
-  for(int y=0;y<elevations.height();y++)
-  for(int x=0;x<elevations.width();x++){
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
     ++progress;
 
-    if(elevations.isNoData(x,y)){
-      props(x,y,0) = NO_DATA_GEN;
-      continue;
-    }
+    if constexpr(check){
+      if(elevations.isNoData(x,y)){
+        props(x,y,0) = NO_DATA_GEN;
+        return;
+      }
 
-    if(elevations.isEdgeCell(x,y))
-      continue;
+      if(elevations.isEdgeCell(x,y))
+        return;
+    }
 
     int8_t nmax = -1;
     double smax = 0;
     float  rmax = 0;
 
     for(int n=1;n<=8;n++){
-      if(!elevations.inGrid (x+dx_e1[n],y+dy_e1[n]))
-        continue;
-      if(elevations.isNoData(x+dx_e1[n],y+dy_e1[n]))
-        continue;
-      if(!elevations.inGrid (x+dx_e2[n],y+dy_e2[n]))
-        continue;
-      if(elevations.isNoData(x+dx_e2[n],y+dy_e2[n]))
-        continue;
+      if constexpr(check){
+        if(!elevations.inGrid (x+dx_e1[n],y+dy_e1[n]))
+          continue;
+        if(elevations.isNoData(x+dx_e1[n],y+dy_e1[n]))
+          continue;
+        if(!elevations.inGrid (x+dx_e2[n],y+dy_e2[n]))
+          continue;
+        if(elevations.isNoData(x+dx_e2[n],y+dy_e2[n]))
+          continue;
+      }
 
       //Is is assumed that cells with a value of NoData have very negative
       //elevations with the result that they draw flow off of the grid.
@@ -113,7 +116,7 @@ void FM_Tarboton(
     }
 
     if(nmax==-1)
-      continue;
+      return;
 
     props(x,y,0) = HAS_FLOW_GEN;
 
@@ -138,7 +141,7 @@ void FM_Tarboton(
       props(x,y,nmax)          = rmax/(M_PI/4.);
       props(x,y,nwrap(nmax+1)) = 1-rmax/(M_PI/4.);
     }
-  }
+  });
   progress.stop();
 }
 
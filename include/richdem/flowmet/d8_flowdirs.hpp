@@ -8,7 +8,9 @@
 
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
+#include <richdem/common/raster_concept.hpp>
 
 namespace richdem {
 
@@ -22,33 +24,38 @@ namespace richdem {
 
   Helper function for d8_flow_directions().
 
-  @param[in]  &elevations  A DEM
+  @param[in]  &elevations  A DEM, which may be any raster (see raster_concept.hpp)
   @param[in]  x            x coordinate of cell
   @param[in]  y            y coordinate of cell
 
   @returns The D8 flow direction of the cell
 */
-template<class T>
-static int d8_FlowDir(const Array2D<T> &elevations, const int x, const int y){
+template<class R>
+static int d8_FlowDir(R &elevations, const int x, const int y){
+  typedef raster_value_t<R> T;
   T minimum_elevation = elevations(x,y);
   int flowdir         = NO_FLOW;
 
   if (elevations.isEdgeCell(x,y)){
-    if(elevations.isTopLeft(x,y))
+    const bool left   = x==0;
+    const bool right  = x==elevations.width()-1;
+    const bool top    = y==0;
+    const bool bottom = y==elevations.height()-1;
+    if(left && top)
       return 2;
-    else if(elevations.isBottomLeft(x,y))
+    else if(left && bottom)
       return 8;
-    else if(elevations.isTopRight(x,y))
+    else if(right && top)
       return 4;
-    else if(elevations.isBottomRight(x,y))
+    else if(right && bottom)
       return 6;
-    else if(elevations.isLeftCol(x,y))
+    else if(left)
       return 1;
-    else if(elevations.isRightCol(x,y))
+    else if(right)
       return 5;
-    else if(elevations.isTopRow(x,y))
+    else if(top)
       return 3;
-    else if(elevations.isBottomRow(x,y))
+    else if(bottom)
       return 7;
   }
 
@@ -59,15 +66,17 @@ static int d8_FlowDir(const Array2D<T> &elevations, const int x, const int y){
   number, such that all water which makes it to the edge of the DEM's region
   of defined elevations is sucked directly off the grid, rather than piling up
   on the edges.*/
-  for(int n=1;n<=8;n++)
+  for(int n=1;n<=8;n++){
+    const T nz = elevations(x+d8x[n],y+d8y[n]);
     if(
-      elevations(x+d8x[n],y+d8y[n])<minimum_elevation
-      || (elevations(x+d8x[n],y+d8y[n])==minimum_elevation
+      nz<minimum_elevation
+      || (nz==minimum_elevation
             && flowdir>0 && flowdir%2==0 && n%2==1) //TODO: What is this modulus stuff for?
     ){
-      minimum_elevation=elevations(x+d8x[n],y+d8y[n]);
+      minimum_elevation=nz;
       flowdir=n;
     }
+  }
 
   return flowdir;
 }
@@ -87,36 +96,54 @@ static int d8_FlowDir(const Array2D<T> &elevations, const int x, const int y){
 
   Uses d8_FlowDir() as a helper function.
 
+  The rasters may be of any kind (see raster_concept.hpp), such as a tiled
+  A2Array2D or a RasterView of a window of a DEM. If both are Array2Ds the
+  cells are processed in parallel; otherwise they are visited row by row,
+  which suits rasters which cache tiles.
+
   @todo                    Combine dinf and d8 neighbour systems
 
   @param[in]  &elevations  A DEM
-  @param[out] &flowdirs    Returns the flow direction of each cell
+  @param[out] &flowdirs    Returns the flow direction of each cell. It is
+                           resized to fit if both rasters are Array2Ds;
+                           otherwise it must already have the dimensions of
+                           **elevations**.
+
+  @throws std::runtime_error if **flowdirs** is not resized and its dimensions
+          differ from those of **elevations**
 */
-template<class T, class U>
+template<class E, class F, EnableIfRaster<E,F> = 0>
 void d8_flow_directions(
-  const Array2D<T> &elevations,
-        Array2D<U> &flowdirs
+  E &elevations,
+  F &flowdirs
 ){
+  static_assert(is_writable_raster_v<F>, "d8_flow_directions requires writable flowdirs!");
+  typedef raster_value_t<F> dir_t;
+
   ProgressBar progress;
 
   RDLOG_ALG_NAME<<"D8 Flow Directions";
   RDLOG_CITATION<<"TODO";
 
   RDLOG_PROGRESS<<"Setting up the flow directions matrix...";
-  flowdirs.resize(elevations);
-  flowdirs.setAll(NO_FLOW);
-  flowdirs.setNoData(FLOWDIR_NO_DATA);
+  PrepareOutputRaster(elevations, flowdirs, FLOWDIR_NO_DATA, "d8_flow_directions");
+
+  const auto flowdir_of = [&](const int x, const int y){
+    ++progress;
+    if(elevations.isNoData(x,y))
+      flowdirs.set(x,y,flowdirs.noData());
+    else
+      flowdirs.set(x,y,static_cast<dir_t>(d8_FlowDir(elevations,x,y)));
+  };
 
   RDLOG_PROGRESS<<"Calculating D8 flow directions...";
-  progress.start( elevations.width()*elevations.height() );
-  #pragma omp parallel for
-  for(int y=0;y<elevations.height();y++){
-    progress.update( y*elevations.width() );
+  progress.start( (std::size_t)elevations.width()*elevations.height() );
+  if constexpr(is_array2d_v<E> && is_array2d_v<F>){
+    ParallelForCells(elevations, flowdir_of);
+  } else {
+    for(int y=0;y<elevations.height();y++)
     for(int x=0;x<elevations.width();x++)
-      if(elevations(x,y)==elevations.noData())
-        flowdirs(x,y) = flowdirs.noData();
-      else
-        flowdirs(x,y) = d8_FlowDir(elevations,x,y);
+      flowdir_of(x,y);
   }
   RDLOG_TIME_USE<<"Succeeded in = "<<progress.stop()<<" s";
 }
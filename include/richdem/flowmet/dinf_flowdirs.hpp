@@ -12,6 +12,7 @@ described in Barnes (TODO).
 
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
 
 namespace richdem {
@@ -138,15 +139,13 @@ void dinf_flow_directions(const Array2D<T> &elevations, Array2D<float> &flowdirs
 
   RDLOG_PROGRESS<<"Calculating Dinf flow directions...";
   progress.start( elevations.size() );
-  #pragma omp parallel for
-  for(int y=0;y<elevations.height();y++){
-    progress.update( y*elevations.width() );
-    for(int x=0;x<elevations.width();x++)
-      if(elevations(x,y)==elevations.noData())
-        flowdirs(x,y) = flowdirs.noData();
-      else
-        flowdirs(x,y) = dinf_FlowDir(elevations,x,y);
-  }
+  ParallelForCells(elevations, [&](const int x, const int y){
+    ++progress;
+    if(elevations(x,y)==elevations.noData())
+      flowdirs(x,y) = flowdirs.noData();
+    else
+      flowdirs(x,y) = dinf_FlowDir(elevations,x,y);
+  });
   RDLOG_TIME_USE<<"Succeeded in = "<<progress.stop()<<" s";
 }
 
@@ -0,0 +1,272 @@
+/**
+  @file
+  @brief Runs a pipeline of operations on each of many small rasters
+
+  Cutting a large area into chips, as is done to prepare training data for
+  machine learning, gives thousands of rasters, each too small for RichDEM's
+  parallel loops to be worthwhile. ProcessBatch() instead runs the whole
+  pipeline of a chip on a single thread and processes as many chips at once as
+  there are threads. Each thread keeps its working rasters from one chip to the
+  next, so chips of the same size are processed without reallocating them, and
+  log messages and progress bars are suppressed so that they are not repeated
+  for every chip.
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/constants.hpp>
+#include <richdem/common/logger.hpp>
+#include <richdem/common/parallel.hpp>
+#include <richdem/common/timer.hpp>
+#include <richdem/depressions/Barnes2014.hpp>
+#include <richdem/depressions/Zhou2016.hpp>
+#include <richdem/methods/d8_methods.hpp>
+#include <richdem/methods/terrain_attributes.hpp>
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace richdem {
+
+///Operations which may make up a batch pipeline
+enum class BatchOp {
+  FillDepressions,        ///< Fill depressions (PriorityFlood_Zhou2016). Later steps see the filled DEM.
+  FillDepressionsEpsilon, ///< Fill depressions so that flats drain (PriorityFloodEpsilon_Barnes2014). Later steps see the filled DEM. Floating-point DEMs only.
+  D8FlowDirections,       ///< D8 flow directions routed through depressions (PriorityFloodFlowdirs_Barnes2014)
+  D8FlowAccumulation,     ///< Number of cells draining through each cell along the routes of D8FlowDirections
+  SlopeRiseRun,           ///< TA_slope_riserun()
+  SlopePercentage,        ///< TA_slope_percentage()
+  SlopeDegrees,           ///< TA_slope_degrees()
+  SlopeRadians,           ///< TA_slope_radians()
+  Aspect,                 ///< TA_aspect()
+  Curvature,              ///< TA_curvature()
+  PlanformCurvature,      ///< TA_planform_curvature()
+  ProfileCurvature        ///< TA_profile_curvature()
+};
+
+///Kinds of raster produced by the steps of a batch pipeline
+enum class BatchResultType {
+  Elevation,      ///< An Array2D<elev_t> holding the modified DEM
+  FlowDirections, ///< An Array2D<d8_flowdir_t>
+  Value           ///< An Array2D<float>
+};
+
+///@return The kind of raster produced by an operation
+inline BatchResultType BatchOpResultType(const BatchOp op){
+  switch(op){
+    case BatchOp::FillDepressions:
+    case BatchOp::FillDepressionsEpsilon:
+      return BatchResultType::Elevation;
+    case BatchOp::D8FlowDirections:
+      return BatchResultType::FlowDirections;
+    default:
+      return BatchResultType::Value;
+  }
+}
+
+/**
+  @brief Looks up an operation by name
+
+  @param[in] name  One of "fill", "fill_epsilon", "d8_flowdirs",
+                   "d8_accumulation", or the name of a terrain attribute:
+                   "slope_riserun", "slope_percentage", "slope_degrees",
+                   "slope_radians", "aspect", "curvature",
+                   "planform_curvature", or "profile_curvature"
+
+  @return The operation
+
+  @throws std::runtime_error if the name is not recognised
+*/
+inline BatchOp BatchOpFromName(const std::string &name){
+  if(name=="fill")               return BatchOp::FillDepressions;
+  if(name=="fill_epsilon")       return BatchOp::FillDepressionsEpsilon;
+  if(name=="d8_flowdirs")        return BatchOp::D8FlowDirections;
+  if(name=="d8_accumulation")    return BatchOp::D8FlowAccumulation;
+  if(name=="slope_riserun")      return BatchOp::SlopeRiseRun;
+  if(name=="slope_percentage")   return BatchOp::SlopePercentage;
+  if(name=="slope_degrees")      return BatchOp::SlopeDegrees;
+  if(name=="slope_radians")      return BatchOp::SlopeRadians;
+  if(name=="aspect")             return BatchOp::Aspect;
+  if(name=="curvature")          return BatchOp::Curvature;
+  if(name=="planform_curvature") return BatchOp::PlanformCurvature;
+  if(name=="profile_curvature")  return BatchOp::ProfileCurvature;
+  throw std::runtime_error("Unrecognised batch operation '"+name+"'!");
+}
+
+///One step of a batch pipeline
+struct BatchStep {
+  BatchOp op;
+  float zscale = 1.0f; ///< Elevation scaling used by terrain attributes
+};
+
+
+
+namespace detail {
+  ///Rasters a thread keeps from one chip to the next
+  template<class elev_t>
+  struct BatchWorkspace {
+    Array2D<elev_t>       dem;      ///< The chip as modified by the pipeline so far
+    Array2D<d8_flowdir_t> flowdirs;
+    std::vector<typename Array2D<elev_t>::i_t> order; ///< Topological order of flowdirs
+    bool flowdirs_current = false;  ///< Whether flowdirs and order belong to dem
+    Array2D<float>        accum;
+    Array2D<float>        values;   ///< Terrain attributes
+  };
+
+  template<class elev_t>
+  void BatchFlowdirs(BatchWorkspace<elev_t> &ws){
+    if(ws.flowdirs_current)
+      return;
+    PriorityFloodFlowdirs_Barnes2014(ws.dem, ws.flowdirs, &ws.order);
+    ws.flowdirs_current = true;
+  }
+
+  ///Runs a pipeline on a single chip, calling emit(step,result) after each
+  ///step. Kernels which take ParallelOptions are given `opts`.
+  template<class elev_t, class F>
+  void RunBatchPipeline(BatchWorkspace<elev_t> &ws, const Array2D<elev_t> &chip, const std::vector<BatchStep> &pipeline, F &&emit, const ParallelOptions &opts){
+    if(ws.dem.width()!=chip.width() || ws.dem.height()!=chip.height())
+      ws.dem.resize(chip.width(), chip.height());
+    ws.dem.geotransform = chip.geotransform;
+    ws.dem.setNoData(chip.noData());
+    for(auto i=chip.i0();i<chip.size();i++)
+      ws.dem(i) = chip(i);
+    ws.flowdirs_current = false;
+
+    //The TA_* functions only add logging to TerrainProcessor(), which is called
+    //directly so that it can be given `opts`
+    const auto attribute = [&](const std::size_t s, const auto func){
+      TerrainProcessor(func, ws.dem, pipeline[s].zscale, ws.values, opts);
+      emit(s, ws.values);
+    };
+
+    for(std::size_t s=0;s<pipeline.size();s++){
+      switch(pipeline[s].op){
+        case BatchOp::FillDepressions:
+          PriorityFlood_Zhou2016(ws.dem);
+          ws.flowdirs_current = false;
+          emit(s, ws.dem);
+          break;
+        case BatchOp::FillDepressionsEpsilon:
+          PriorityFloodEpsilon_Barnes2014<Topology::D8>(ws.dem);
+          ws.flowdirs_current = false;
+          emit(s, ws.dem);
+          break;
+        case BatchOp::D8FlowDirections:
+          BatchFlowdirs(ws);
+          emit(s, ws.flowdirs);
+          break;
+        case BatchOp::D8FlowAccumulation:
+          BatchFlowdirs(ws);
+          d8_flow_accum_from_order(ws.flowdirs, ws.order, ws.accum, opts);
+          emit(s, ws.accum);
+          break;
+        case BatchOp::SlopeRiseRun:      attribute(s, [](const auto&... args){ return Terrain_Slope_RiseRun(args...);      }); break;
+        case BatchOp::SlopePercentage:   attribute(s, [](const auto&... args){ return Terrain_Slope_Percent(args...);      }); break;
+        case BatchOp::SlopeDegrees:      attribute(s, [](const auto&... args){ return Terrain_Slope_Degree(args...);       }); break;
+        case BatchOp::SlopeRadians:      attribute(s, [](const auto&... args){ return Terrain_Slope_Radian(args...);       }); break;
+        case BatchOp::Aspect:            attribute(s, [](const auto&... args){ return Terrain_Aspect(args...);             }); break;
+        case BatchOp::Curvature:         attribute(s, [](const auto&... args){ return Terrain_Curvature(args...);          }); break;
+        case BatchOp::PlanformCurvature: attribute(s, [](const auto&... args){ return Terrain_Planform_Curvature(args...); }); break;
+        case BatchOp::ProfileCurvature:  attribute(s, [](const auto&... args){ return Terrain_Profile_Curvature(args...);  }); break;
+      }
+    }
+  }
+}
+
+
+
+/**
+  @brief  Runs a pipeline of operations on each of many rasters
+
+    Each raster, or chip, is processed from start to finish by a single
+    thread, while the threads process different chips. This suits many small
+    rasters, for which splitting each operation between threads costs more
+    than it saves. Per-chip log messages and progress bars are suppressed.
+
+    Each step of the pipeline works on the DEM as left by the steps before it,
+    so "fill" followed by "slope_degrees" gives the slopes of the filled DEM.
+    Flow directions are found once per version of the DEM and shared by the
+    flow direction and accumulation steps.
+
+  @param[in]  &dems       Rasters to process. These are not modified. To
+                          process a stack of rasters held in one block of
+                          memory, wrap each of its slices in an Array2D.
+                          Terrain attributes need each raster to have a
+                          geotransform.
+  @param[in]  &pipeline   Steps to apply to each raster, in order
+  @param[in]  on_result   Called as on_result(chip,step,result) after each
+                          step with the indices of the raster and step and the
+                          step's result, whose type is given by
+                          BatchOpResultType(). The result is reused by later
+                          steps, so it must be copied if it is to be kept. Calls
+                          for different chips are made concurrently from
+                          different threads.
+  @param[in]  &opts       Gives the number of threads to use
+
+  @throws std::runtime_error if FillDepressionsEpsilon is used with an integer
+          DEM. Exceptions thrown while processing a chip are rethrown once all
+          the threads have finished.
+*/
+template<class elev_t, class F>
+void ProcessBatch(
+  const std::vector<Array2D<elev_t>> &dems,
+  const std::vector<BatchStep>       &pipeline,
+  F                                 &&on_result,
+  const ParallelOptions              &opts = ParallelOptions()
+){
+  RDLOG_ALG_NAME<<"Batch processing";
+
+  if(std::is_integral<elev_t>::value)
+    for(const auto &step: pipeline)
+      if(step.op==BatchOp::FillDepressionsEpsilon)
+        throw std::runtime_error("Priority-Flood+Epsilon is only available for floating-point data types!");
+
+  Timer timer;
+  timer.start();
+
+  std::exception_ptr error;
+
+  //OpenMP's limits are changed here, by the calling thread, since the team's
+  //threads would otherwise all change them at once. Limiting nesting to one
+  //level keeps parallel loops in the kernels from spawning threads of their
+  //own; those which take ParallelOptions are also told to use one thread.
+  ParallelismConfig nesting = GetParallelism();
+  nesting.max_active_levels = 1;
+  const ParallelismScope no_nesting(nesting);
+
+  ParallelOptions serial = opts;
+  serial.threads = 1;
+
+  #pragma omp parallel num_threads(ParallelThreads(opts))
+  {
+    LogSuppressor quiet;
+    detail::BatchWorkspace<elev_t> ws;
+
+    #pragma omp for schedule(dynamic)
+    for(std::size_t c=0;c<dems.size();c++){
+      try {
+        detail::RunBatchPipeline(ws, dems[c], pipeline, [&](const std::size_t s, const auto &result){
+          on_result(c, s, result);
+        }, serial);
+      } catch (...) {
+        #pragma omp critical(batch_error)
+        if(!error)
+          error = std::current_exception();
+      }
+    }
+  }
+
+  if(error)
+    std::rethrow_exception(error);
+
+  timer.stop();
+  RDLOG_MISC<<"Rasters processed = "<<dems.size();
+  RDLOG_TIME_USE<<"Batch wall-time = "<<timer.accumulated()<<" s";
+}
+
+}
@@ -0,0 +1,299 @@
+/**
+  @file
+  @brief Defines an index for answering queries about D8 flow paths in
+         logarithmic time
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/constants.hpp>
+#include <richdem/common/logger.hpp>
+#include <richdem/common/timer.hpp>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace richdem {
+
+/**
+  @brief  Answers questions about where the cells of a D8 flowdir grid drain
+          without walking their flow paths
+
+  The D8 flow directions of a grid form a forest in which every cell points to
+  the cell it drains into. A cell which flows off the grid, into NoData, or
+  nowhere is the root, or outlet, of its tree. Tracing a path through the
+  forest one cell at a time takes time proportional to its length, which may
+  be most of the grid's width.
+
+  This index stores, for each cell, the cell 2^k steps downstream of it for
+  every k (binary lifting). Any number of steps can then be taken in
+  O(log n) jumps. The index is built with pointer doubling: each round doubles
+  the distance every cell's pointer covers, so the outlet and distance to it
+  of all cells are known after O(log n) parallel sweeps of the grid.
+
+  Storing log(n) jumps for every cell may take too much memory for large
+  grids. If `sample_interval` is s>1, the jumps are only stored for cells whose
+  distance to their outlet is a multiple of s, and they cover multiples of s
+  steps. Since every path passes through such a cell at least once every s
+  steps, queries walk at most s steps before and after jumping, and cost
+  O(s + log n). This cuts the jump table by a factor of about s.
+
+  Cells are referred to by their flat indices in the grid.
+*/
+class D8JumpPointers {
+ public:
+  typedef uint32_t i_t;
+
+  ///Returned by queries which have no answer
+  static constexpr i_t NO_CELL = std::numeric_limits<i_t>::max();
+
+ private:
+  std::array<int, 9> nshift;        ///< Flat offsets to D8 neighbours
+  std::vector<uint8_t> step;        ///< Direction to each cell's downstream neighbour. 0 for outlets.
+  std::vector<uint32_t> depth_;     ///< Number of steps from each cell to its outlet
+  std::vector<i_t> outlet_;         ///< Outlet of each cell
+  uint32_t interval = 1;            ///< Jumps are stored for cells whose depth is a multiple of this
+  std::vector<i_t> sample_id;       ///< Position of each sampled cell in the jump table (only if interval>1)
+  std::vector<i_t> sampled_cells;   ///< Cell of each position in the jump table (only if interval>1)
+  std::vector<std::vector<i_t>> jumps; ///< jumps[k][j]: position of the cell interval*2^k steps downstream of position j
+
+  i_t down(const i_t c) const {
+    return c+nshift[step[c]];
+  }
+
+  i_t sid(const i_t c) const {
+    return (interval==1) ? c : sample_id[c];
+  }
+
+  i_t cell(const i_t j) const {
+    return (interval==1) ? j : sampled_cells[j];
+  }
+
+  ///Move `c` downstream `n` cells, one at a time
+  i_t walk(i_t c, uint32_t n) const {
+    for(;n>0;n--)
+      c = down(c);
+    return c;
+  }
+
+ public:
+  D8JumpPointers() = default;
+
+  /**
+    @brief  Builds the index
+
+    @param[in]  &flowdirs         A D8 flowdir grid, as from d8_flow_directions()
+    @param[in]  sample_interval   Store jumps only for every this-many-th cell
+                                  along each flow path. 1 stores them for all
+                                  cells.
+
+    @throws std::runtime_error if the flow directions contain a loop
+  */
+  template<class T>
+  explicit D8JumpPointers(const Array2D<T> &flowdirs, const uint32_t sample_interval=1) : interval(sample_interval) {
+    RDLOG_ALG_NAME<<"D8 Jump Pointers";
+    RDLOG_CONFIG<<"sample interval = "<<sample_interval;
+
+    if(sample_interval<1)
+      throw std::runtime_error("D8JumpPointers: sample_interval must be at least 1!");
+
+    Timer timer;
+    timer.start();
+
+    const i_t size = flowdirs.size();
+    for(int n=0;n<=8;n++)
+      nshift[n] = flowdirs.nshift(n);
+
+    RDLOG_PROGRESS<<"Finding downstream neighbours...";
+    step.resize(size);
+    bool bad_dir = false;
+    #pragma omp parallel for reduction(||:bad_dir)
+    for(i_t i=0;i<size;i++){
+      step[i] = 0;
+      if(flowdirs.isNoData(i))
+        continue;
+      const int n = flowdirs(i);
+      if(n==NO_FLOW)
+        continue;
+      if(n<1 || n>8){
+        bad_dir = true;
+        continue;
+      }
+      const auto [x,y] = flowdirs.iToxy(i);
+      if(flowdirs.inGrid(x+d8x[n],y+d8y[n]) && !flowdirs.isNoData(x+d8x[n],y+d8y[n]))
+        step[i] = n;
+    }
+    if(bad_dir)
+      throw std::runtime_error("D8JumpPointers: flowdirs contains a value which is not a D8 direction!");
+
+    //Pointer doubling. After round k every cell points 2^k steps downstream,
+    //or to its outlet if that is closer, and knows how many steps it points.
+    RDLOG_PROGRESS<<"Finding outlets by pointer doubling...";
+    outlet_.resize(size);
+    depth_.resize(size);
+    #pragma omp parallel for
+    for(i_t i=0;i<size;i++){
+      outlet_[i] = down(i);
+      depth_[i]  = (step[i]!=0);
+    }
+
+    std::vector<i_t>      next_outlet(size);
+    std::vector<uint32_t> next_depth(size);
+    bool changed = true;
+    for(int round=0;changed;round++){
+      //A forest of n cells has paths at most n long, so no pointer should need
+      //more than log2(n)+1 doublings
+      if(round>std::numeric_limits<i_t>::digits+1)
+        throw std::runtime_error("D8JumpPointers: flowdirs contains a loop!");
+      changed = false;
+      #pragma omp parallel for reduction(||:changed)
+      for(i_t i=0;i<size;i++){
+        const auto o   = outlet_[i];
+        next_outlet[i] = outlet_[o];
+        next_depth[i]  = depth_[i]+depth_[o];
+        changed        = changed || (outlet_[o]!=o);
+      }
+      outlet_.swap(next_outlet);
+      depth_.swap(next_depth);
+    }
+    next_outlet = std::vector<i_t>();
+    next_depth  = std::vector<uint32_t>();
+
+    //A loop whose length is a power of two settles on a cell of the loop
+    //rather than failing to settle at all
+    for(i_t i=0;i<size;i++)
+      if(step[outlet_[i]]!=0)
+        throw std::runtime_error("D8JumpPointers: flowdirs contains a loop!");
+
+    uint32_t max_depth = 0;
+    #pragma omp parallel for reduction(max:max_depth)
+    for(i_t i=0;i<size;i++)
+      max_depth = std::max(max_depth, depth_[i]);
+
+    RDLOG_PROGRESS<<"Building jump table...";
+    if(interval>1){
+      sample_id.assign(size, NO_CELL);
+      for(i_t i=0;i<size;i++)
+        if(depth_[i]%interval==0){
+          sample_id[i] = sampled_cells.size();
+          sampled_cells.push_back(i);
+        }
+    }
+
+    const i_t samples = (interval==1) ? size : sampled_cells.size();
+
+    jumps.emplace_back(samples);
+    #pragma omp parallel for
+    for(i_t j=0;j<samples;j++){
+      const auto c = cell(j);
+      jumps[0][j]  = sid((depth_[c]>=interval) ? walk(c,interval) : outlet_[c]);
+    }
+
+    for(uint64_t reach=2*static_cast<uint64_t>(interval);reach<=max_depth;reach*=2){
+      const auto &prev = jumps.back();
+      std::vector<i_t> level(samples);
+      #pragma omp parallel for
+      for(i_t j=0;j<samples;j++)
+        level[j] = prev[prev[j]];
+      jumps.push_back(std::move(level));
+    }
+
+    RDLOG_MISC<<"Jump table has "<<jumps.size()<<" levels for "<<samples<<" of "<<size<<" cells";
+    RDLOG_TIME_USE<<"Time to build jump pointers = "<<timer.stop()<<" s";
+  }
+
+  ///@return The cell which `c` flows into, or `c` if it is an outlet
+  i_t downstream(const i_t c) const {
+    return down(c);
+  }
+
+  ///@return The number of steps from `c` to its outlet
+  uint32_t depth(const i_t c) const {
+    return depth_[c];
+  }
+
+  ///@return The cell at the end of the flow path starting at `c`
+  i_t outlet(const i_t c) const {
+    return outlet_[c];
+  }
+
+  ///@return The cell `k` steps downstream of `c`, or its outlet if that is
+  ///        fewer than `k` steps away
+  i_t ancestor(i_t c, uint32_t k) const {
+    if(k>=depth_[c])
+      return outlet_[c];
+
+    //Walk to a sampled cell
+    while(depth_[c]%interval!=0){
+      if(k==0)
+        return c;
+      c = down(c);
+      k--;
+    }
+
+    //Jump by multiples of the interval
+    auto j = sid(c);
+    const uint32_t q = k/interval;
+    for(size_t level=0;(q>>level)!=0;level++)
+      if((q>>level)&1)
+        j = jumps[level][j];
+
+    return walk(cell(j), k%interval);
+  }
+
+  ///@return True if `b` lies on the flow path starting at `a` (including `a`)
+  bool is_downstream(const i_t a, const i_t b) const {
+    return outlet_[a]==outlet_[b] && depth_[b]<=depth_[a] && ancestor(a,depth_[a]-depth_[b])==b;
+  }
+
+  ///@return True if the flow paths starting at `a` and `b` join
+  bool shares_path(const i_t a, const i_t b) const {
+    return outlet_[a]==outlet_[b];
+  }
+
+  ///@return The first cell on both the flow path starting at `a` and the one
+  ///        starting at `b`, or NO_CELL if the paths never join
+  i_t confluence(i_t a, i_t b) const {
+    if(outlet_[a]!=outlet_[b])
+      return NO_CELL;
+
+    //Bring both cells to the same distance from the outlet
+    if(depth_[a]>depth_[b])
+      a = ancestor(a, depth_[a]-depth_[b]);
+    else
+      b = ancestor(b, depth_[b]-depth_[a]);
+
+    //Walk both to sampled cells
+    while(a!=b && depth_[a]%interval!=0){
+      a = down(a);
+      b = down(b);
+    }
+    if(a==b)
+      return a;
+
+    //Jump as far as possible without the paths joining
+    auto ja = sid(a);
+    auto jb = sid(b);
+    for(size_t level=jumps.size();level-->0;){
+      if(jumps[level][ja]!=jumps[level][jb]){
+        ja = jumps[level][ja];
+        jb = jumps[level][jb];
+      }
+    }
+
+    //The paths join within the next `interval` steps
+    a = cell(ja);
+    b = cell(jb);
+    while(a!=b){
+      a = down(a);
+      b = down(b);
+    }
+    return a;
+  }
+};
+
+}
@@ -11,10 +11,13 @@
 #include <richdem/common/constants.hpp>
 #include <richdem/common/grid_cell.hpp>
 #include <richdem/common/logger.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/ProgressBar.hpp>
+#include <richdem/common/raster_concept.hpp>
 
 #include <queue>
 #include <stdexcept>
+#include <vector>
 
 namespace richdem {
 
@@ -41,38 +44,53 @@ static inline T sgn(T val){
   calculating each cell's dependency on its neighbours and then using a
   priority-queue to process cells in a top-of-the-watershed-down fashion
 
+  The rasters may be of any kind (see raster_concept.hpp), such as a tiled
+  A2Array2D or a RasterView of a window of a flowdir grid. Dependencies are
+  counted in parallel only if both are Array2Ds.
+
   @param[in]  &flowdirs  A D8 flowdir grid from d8_flow_directions()
-  @param[out] &area      Returns the up-slope area of each cell
+  @param[out] &area      Returns the up-slope area of each cell. It is resized
+                         to fit if both rasters are Array2Ds; otherwise it
+                         must already have the dimensions of **flowdirs**.
+
+  @throws std::runtime_error if **area** is not resized and its dimensions
+          differ from those of **flowdirs**
 */
-template<class T, class U>
-void d8_flow_accum(const Array2D<T> &flowdirs, Array2D<U> &area){
+template<class T, class U, EnableIfRaster<T,U> = 0>
+void d8_flow_accum(T &flowdirs, U &area){
+  static_assert(is_writable_raster_v<U>, "d8_flow_accum requires a writable area raster!");
+  typedef raster_value_t<U> area_t;
+
   std::queue<GridCell> sources;
   ProgressBar progress;
 
   RDLOG_ALG_NAME<<"D8 Flow Accumulation";
   RDLOG_CITATION<<"TODO";
 
+  const int width  = flowdirs.width();
+  const int height = flowdirs.height();
+
   RDLOG_MEM_USE<<"The sources queue will require at most approximately "
-               <<(flowdirs.size()*((long)sizeof(GridCell))/1024/1024)
+               <<((std::size_t)width*height*((long)sizeof(GridCell))/1024/1024)
                <<"MB of RAM.";
 
   RDLOG_PROGRESS<<"Resizing dependency matrix...";
-  Array2D<int8_t> dependency(flowdirs,0);
+  Array2D<int8_t> dependency(width,height,0);
 
   RDLOG_PROGRESS<<"Setting up the area matrix...";
-  area.resize(flowdirs,0);
-  area.setNoData(-1);
+  PrepareOutputRaster(flowdirs, area, -1, "d8_flow_accum");
 
   RDLOG_PROGRESS<<"Calculating dependency matrix & setting noData() cells...";
-  progress.start( flowdirs.size() );
-  #pragma omp parallel for
-  for(int y=0;y<flowdirs.height();y++){
-    progress.update( y*flowdirs.width() );
-    for(int x=0;x<flowdirs.width();x++){
+  progress.start( (std::size_t)width*height );
+  #pragma omp parallel for if(is_array2d_v<T> && is_array2d_v<U>)
+  for(int y=0;y<height;y++){
+    progress.update( y*width );
+    for(int x=0;x<width;x++){
       if(flowdirs.isNoData(x,y)){
-        area(x,y) = area.noData();
+        area.set(x,y,area.noData());
         continue;
       }
+      area.set(x,y,0);
 
       int n = flowdirs(x,y); //The neighbour this cell flows into
       if(n==NO_FLOW)         //This cell does not flow into a neighbour
@@ -93,13 +111,13 @@ void d8_flow_accum(const Array2D<T> &flowdirs, Array2D<U> &area){
   RDLOG_TIME_USE<<"Dependency calculation time = "<<progress.stop()<<" s";
 
   RDLOG_PROGRESS<<"Locating source cells...";
-  for(int y=0;y<flowdirs.height();y++)
-  for(int x=0;x<flowdirs.width();x++)
+  for(int y=0;y<height;y++)
+  for(int x=0;x<width;x++)
     if(dependency(x,y)==0 && !flowdirs.isNoData(x,y))
       sources.emplace(x,y);
 
   RDLOG_PROGRESS<<"Calculating flow accumulation areas...";
-  progress.start(flowdirs.numDataCells());
+  progress.start( (std::size_t)width*height );
   long int ccount=0;
   while(sources.size()>0){
     GridCell c=sources.front();
@@ -108,7 +126,8 @@ void d8_flow_accum(const Array2D<T> &flowdirs, Array2D<U> &area){
     ccount++;
     progress.update(ccount);
 
-    area(c.x,c.y)++;
+    const area_t ca = area(c.x,c.y)+1;
+    area.set(c.x,c.y,ca);
 
     int n = flowdirs(c.x,c.y);
 
@@ -123,7 +142,7 @@ void d8_flow_accum(const Array2D<T> &flowdirs, Array2D<U> &area){
     if(flowdirs.isNoData(nx,ny))
       continue;
 
-    area(nx,ny)+=area(c.x,c.y);
+    area.set(nx,ny,area(nx,ny)+ca);
     --dependency(nx,ny);
 
     if(dependency(nx,ny)==0)
@@ -140,6 +159,109 @@ void d8_flow_accum(const Array2D<T> &flowdirs, Array2D<U> &area){
 
 
 
+/**
+  @brief  Calculates the D8 flow accumulation, given the D8 flow directions and
+          a topological order of the cells
+
+  Since every cell's upstream neighbours come after it in **order**, a single
+  sweep through **order** from back to front finds each cell's up-slope area
+  before that area is passed downstream. No dependency matrix or queue is
+  needed. The result is the same as that of d8_flow_accum().
+
+  @param[in]  &flowdirs  A D8 flowdir grid
+  @param[in]  &order     Flat indices of the data cells of **flowdirs**, each
+                         cell after the cell it flows into, as produced by
+                         PriorityFloodFlowdirs_Barnes2014()
+  @param[out] &area      Returns the up-slope area of each cell
+  @param[in]  &opts      Gives the number of threads used to set up **area**
+
+  @pre **order** contains every data cell of **flowdirs** exactly once
+*/
+template<class T, class U, class I>
+void d8_flow_accum_from_order(const Array2D<T> &flowdirs, const std::vector<I> &order, Array2D<U> &area, const ParallelOptions &opts = ParallelOptions()){
+  ProgressBar progress;
+
+  RDLOG_ALG_NAME<<"D8 Flow Accumulation (from topological order)";
+
+  RDLOG_PROGRESS<<"Setting up the area matrix...";
+  area.resize(flowdirs,0);
+  area.setNoData(-1);
+
+  #pragma omp parallel for num_threads(ParallelThreads(opts))
+  for(auto i=flowdirs.i0();i<flowdirs.size();i++)
+    if(flowdirs.isNoData(i))
+      area(i) = area.noData();
+
+  RDLOG_PROGRESS<<"Calculating flow accumulation areas...";
+  progress.start(order.size());
+  for(auto oi=order.rbegin();oi!=order.rend();++oi){
+    ++progress;
+    const auto ci = *oi;
+
+    area(ci)++;
+
+    const int n = flowdirs(ci);
+    if(n==NO_FLOW)
+      continue;
+
+    const auto [cx, cy] = flowdirs.iToxy(ci);
+    const int nx = cx+d8x[n];
+    const int ny = cy+d8y[n];
+
+    if(!flowdirs.inGrid(nx,ny))
+      continue;
+    if(flowdirs.isNoData(nx,ny))
+      continue;
+
+    area(nx,ny)+=area(ci);
+  }
+  RDLOG_TIME_USE<<"Flow accumulation calculation time = "<<progress.stop()<<" s";
+}
+
+
+
+/**
+  @brief  Labels the watershed of each cell, given the D8 flow directions and
+          a topological order of the cells
+
+  Each cell which flows off the grid, into NoData, or nowhere is an outlet and
+  starts a new watershed. Every other cell takes the label of the cell it flows
+  into, which **order** guarantees has already been labeled.
+
+  @param[in]  &flowdirs  A D8 flowdir grid
+  @param[in]  &order     Flat indices of the data cells of **flowdirs**, each
+                         cell after the cell it flows into, as produced by
+                         PriorityFloodFlowdirs_Barnes2014()
+  @param[out] &labels    Returns the watershed label of each cell. Labels start
+                         at 1; NoData cells are 0.
+
+  @pre **order** contains every data cell of **flowdirs** exactly once
+*/
+template<class T, class U, class I>
+void d8_watersheds_from_order(const Array2D<T> &flowdirs, const std::vector<I> &order, Array2D<U> &labels){
+  RDLOG_ALG_NAME<<"D8 Watershed Labels (from topological order)";
+
+  labels.resize(flowdirs,0);
+  labels.setNoData(0);
+
+  U next_label = 1;
+  for(const auto ci: order){
+    const int n = flowdirs(ci);
+    if(n!=NO_FLOW){
+      const auto [cx, cy] = flowdirs.iToxy(ci);
+      const int nx = cx+d8x[n];
+      const int ny = cy+d8y[n];
+      if(flowdirs.inGrid(nx,ny) && !flowdirs.isNoData(nx,ny)){
+        labels(ci) = labels(nx,ny);
+        continue;
+      }
+    }
+    labels(ci) = next_label++;
+  }
+}
+
+
+
 
 //d8_upslope_cells
 /**
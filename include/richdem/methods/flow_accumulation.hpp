@@ -1,5 +1,7 @@
 #pragma once
 
+#include <richdem/common/SparseArray2D.hpp>
+#include <richdem/common/grid_cell.hpp>
 #include <richdem/flowmet/Fairfield1991.hpp>
 #include <richdem/flowmet/Freeman1991.hpp>
 #include <richdem/flowmet/Holmgren1994.hpp>
@@ -18,6 +20,11 @@ template<class elev_t, class accum_t> void FA_Dinfinity          (const Array2D<
 template<class elev_t, class accum_t> void FA_Holmgren           (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double xparam) { Array3D<float> props(elevations); FM_Holmgren                       (elevations, props, xparam );  FlowAccumulation(props, accum); }
 template<class elev_t, class accum_t> void FA_Quinn              (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum)                { Array3D<float> props(elevations); FM_Quinn                          (elevations, props         );  FlowAccumulation(props, accum); }
 template<class elev_t, class accum_t> void FA_Freeman            (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double xparam) { Array3D<float> props(elevations); FM_Freeman                        (elevations, props, xparam );  FlowAccumulation(props, accum); }
+template<class elev_t, class accum_t> void FA_Seibert            (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double xparam) { Array3D<float> props(elevations); FM_Seibert                        (elevations, props, xparam );  FlowAccumulation(props, accum); }
+template<class elev_t, class accum_t> void FA_SeibertMcGlynn     (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double xparam) { Array3D<float> props(elevations); FM_SeibertMcGlynn                 (elevations, props, xparam );  FlowAccumulation(props, accum); }
+template<class elev_t, class accum_t> void FA_Orlandini          (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, OrlandiniMode mode, double lambda) { Array3D<float> props(elevations); FM_Orlandini(elevations, props, mode, lambda);  FlowAccumulation(props, accum); }
+template<class elev_t, class accum_t> void FA_OrlandiniLTD       (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double lambda) { Array3D<float> props(elevations); FM_OrlandiniLTD                   (elevations, props, lambda );  FlowAccumulation(props, accum); }
+template<class elev_t, class accum_t> void FA_OrlandiniLAD       (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum, double lambda) { Array3D<float> props(elevations); FM_OrlandiniLAD                   (elevations, props, lambda );  FlowAccumulation(props, accum); }
 template<class elev_t, class accum_t> void FA_FairfieldLeymarieD8(const Array2D<elev_t> &elevations, Array2D<accum_t> &accum)                { Array3D<float> props(elevations); FM_FairfieldLeymarie<Topology::D8>(elevations, props         );  FlowAccumulation(props, accum); }
 template<class elev_t, class accum_t> void FA_FairfieldLeymarieD4(const Array2D<elev_t> &elevations, Array2D<accum_t> &accum)                { Array3D<float> props(elevations); FM_FairfieldLeymarie<Topology::D4>(elevations, props         );  FlowAccumulation(props, accum); }
 template<class elev_t, class accum_t> void FA_Rho8               (const Array2D<elev_t> &elevations, Array2D<accum_t> &accum)                { Array3D<float> props(elevations); FM_Rho8                           (elevations, props         );  FlowAccumulation(props, accum); }
@@ -126,4 +133,129 @@ Array2D<uint32_t> flow_accumulation_from_d8(const Array2D<T>& d8_in) {
   return accum;
 }
 
+/**
+  @brief  Calculate flow accumulation from a block-sparse D8 raster
+
+  As flow_accumulation_from_d8(const Array2D<T>&), but blocks of the input
+  which are entirely NoData are never visited and remain constant NoData
+  blocks in the output.
+
+  @param[in]     &d8_in       D8 matrix - each cell has a weight of 1
+
+  @return        A matrix of flow accumulation
+*/
+template <class T>
+SparseArray2D<uint32_t> flow_accumulation_from_d8(const SparseArray2D<T>& d8_in) {
+  Timer overall;
+  overall.start();
+
+  RDLOG_ALG_NAME << "D8 Raster -> Flow Accumulation (Sparse)";
+
+  SparseArray2D<uint32_t> accum(d8_in, 0);
+  accum.setNoData(ACCUM_NO_DATA);
+
+  // Visits the cells of every block which is not entirely NoData
+  const auto for_data_blocks = [&](auto &&func) {
+    for (int by = 0; by < d8_in.heightInBlocks(); by++) {
+      for (int bx = 0; bx < d8_in.widthInBlocks(); bx++) {
+        if (d8_in.blockIsNoData(bx, by)) {
+          continue;
+        }
+        const auto [x0, y0, x1, y1] = d8_in.blockExtent(bx, by);
+        for (int y = std::max(y0, 1); y < std::min(y1, d8_in.height()-1); y++) {
+          for (int x = std::max(x0, 1); x < std::min(x1, d8_in.width()-1); x++) {
+            func(x, y);
+          }
+        }
+      }
+    }
+  };
+
+  // Create dependencies array
+  RDLOG_PROGRESS << "Creating dependencies array..." << std::endl;
+  SparseArray2D<int8_t> deps(d8_in, 0);
+  for_data_blocks([&](const int x, const int y) {
+    if (d8_in.isNoData(x, y)) {
+      return;
+    }
+    const auto n = d8_in(x, y);
+    if (n == NO_FLOW) {
+      return;
+    }
+    const auto nx = x + d8x[n];
+    const auto ny = y + d8y[n];
+    if (!d8_in.inGrid(nx, ny)) {
+      return;
+    }
+    deps.set(nx, ny, deps(nx, ny) + 1);
+  });
+
+  // Find sources
+  std::queue<GridCell> q;
+  for_data_blocks([&](const int x, const int y) {
+    if (deps(x, y) == 0 && !d8_in.isNoData(x, y)) {
+      q.emplace(x, y);
+    }
+  });
+
+  RDLOG_DEBUG << "Source cells found = " << q.size();  // TODO: Switch log target
+
+  RDLOG_PROGRESS << "Calculating flow accumulation...";
+  ProgressBar progress;
+  progress.start(d8_in.size());
+  while (!q.empty()) {
+    ++progress;
+
+    const auto c = q.front();
+    q.pop();
+
+    assert(!d8_in.isNoData(c.x, c.y));
+
+    const auto c_accum = accum(c.x, c.y) + 1;  // Add my own accumulation to myself
+    accum.set(c.x, c.y, c_accum);
+    const auto n = d8_in(c.x, c.y);            // Direction of my neighbor
+    if (n == NO_FLOW) {
+      continue;
+    }
+
+    const int nx = c.x + d8x[n];
+    const int ny = c.y + d8y[n];
+
+    // Make sure my neighbor is in the grid and is not no data
+    if (!d8_in.inGrid(nx, ny) || d8_in.isEdgeCell(nx, ny) || d8_in.isNoData(nx, ny)) {
+      continue;
+    }
+
+    accum.set(nx, ny, accum(nx, ny) + c_accum);
+    const auto ndeps = deps(nx, ny) - 1;
+    deps.set(nx, ny, ndeps);
+    if (ndeps == 0) {
+      q.emplace(nx, ny);
+    }
+    assert(ndeps >= 0);
+  }
+  progress.stop();
+
+  for (int by = 0; by < d8_in.heightInBlocks(); by++) {
+    for (int bx = 0; bx < d8_in.widthInBlocks(); bx++) {
+      if (d8_in.blockIsNoData(bx, by)) {
+        accum.setBlock(bx, by, accum.noData());
+        continue;
+      }
+      const auto [x0, y0, x1, y1] = d8_in.blockExtent(bx, by);
+      for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+          if (d8_in.isNoData(x, y)) {
+            accum.set(x, y, accum.noData());
+          }
+        }
+      }
+    }
+  }
+
+  RDLOG_TIME_USE << "Wall-time = " << overall.stop() << " s";
+
+  return accum;
+}
+
 }  // namespace richdem
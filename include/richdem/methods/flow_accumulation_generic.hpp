@@ -5,6 +5,7 @@
 #include <richdem/common/ProgressBar.hpp>
 
 #include <queue>
+#include <type_traits>
 
 namespace richdem {
 
@@ -84,7 +85,10 @@ void FlowAccumulation(const Array3D<float> &props, Array2D<A> &accum){
       const int ni = ci+accum.nshift(n);
       if(props.isNoData(ni))
         continue;
-      accum(ni) += props.getIN(ci,n)*c_accum;
+      if constexpr(std::is_integral<A>::value)
+        accum(ni) += static_cast<A>(props.getIN(ci,n)*static_cast<double>(c_accum)); //A float would lose counts above 2^24
+      else
+        accum(ni) += props.getIN(ci,n)*c_accum;
       if(--deps(ni)==0)
         q.emplace(ni);
       assert(deps(ni)>=0);
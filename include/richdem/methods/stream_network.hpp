@@ -0,0 +1,291 @@
+/**
+  @file
+  @brief Extracts a stream network, as a graph of reaches, from D8 flow
+         directions
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/constants.hpp>
+#include <richdem/common/logger.hpp>
+#include <richdem/common/timer.hpp>
+#include <richdem/methods/d8_methods.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+namespace richdem {
+
+///@brief A stretch of stream running from a source or confluence to the next
+///       confluence or to an outlet
+struct StreamReach {
+  ///Marks a reach which does not flow into another reach
+  static constexpr uint32_t NO_REACH = std::numeric_limits<uint32_t>::max();
+
+  uint32_t head          = 0;        ///< Flat index of the reach's most upstream cell
+  uint32_t tail          = 0;        ///< Flat index of the reach's most downstream cell
+  uint32_t downstream    = NO_REACH; ///< Reach this one flows into
+  uint32_t cells         = 0;        ///< Number of cells in the reach
+  double   length        = 0;        ///< Distance from the centre of the head to the centre of the downstream reach's head, or to the tail at outlets
+  uint32_t strahler      = 0;        ///< Strahler order
+  uint32_t shreve        = 0;        ///< Shreve magnitude: the number of sources upstream
+  double   upstream_area = 0;        ///< Flow accumulation at the tail times the area of a cell
+};
+
+
+
+/**
+  @brief  Extracts the reaches of the stream network defined by thresholding
+          flow accumulation
+
+  Cells whose flow accumulation is at least **threshold** are stream cells. A
+  reach starts at every stream cell which does not have exactly one stream
+  cell flowing into it, i.e. at sources and confluences, and follows the flow
+  directions until the next cell starts a reach or is not a stream cell.
+
+  Since every stream cell belongs to exactly one reach, all reaches are traced
+  in parallel, each in a single pass over its cells. Orders are then found by
+  a topological sweep of the much smaller graph of reaches.
+
+  Reaches are numbered by the flat indices of their heads, so the output does
+  not depend on the number of threads. Lengths are in map units and upstream
+  areas in square map units if the grid has a geotransform; otherwise both
+  are in cells. An upstream area is the accumulation at the reach's tail
+  times the area of a cell, so it is a true area only if the accumulation
+  counts cells.
+
+  @param[in]  &flowdirs      A D8 flowdir grid
+  @param[in]  &accum         Flow accumulation, e.g. from d8_flow_accum()
+  @param[in]  threshold      Smallest accumulation of a stream cell
+  @param[out] *reach_labels  If not NULL, returns the reach each cell belongs
+                             to, or StreamReach::NO_REACH
+
+  @return The reaches of the network
+*/
+template<class T, class A>
+std::vector<StreamReach> ExtractStreamNetwork(
+  const Array2D<T> &flowdirs,
+  const Array2D<A> &accum,
+  const A           threshold,
+  Array2D<uint32_t> *reach_labels = nullptr
+){
+  RDLOG_ALG_NAME<<"D8 Stream Network Extraction";
+  RDLOG_CONFIG<<"threshold = "<<threshold;
+
+  if(flowdirs.width()!=accum.width() || flowdirs.height()!=accum.height())
+    throw std::runtime_error("ExtractStreamNetwork: flowdirs and accum must have the same dimensions!");
+
+  Timer timer;
+  timer.start();
+
+  typedef typename Array2D<T>::i_t i_t;
+  constexpr auto NO_REACH = StreamReach::NO_REACH;
+
+  const auto is_stream = [&](const i_t i){
+    return !flowdirs.isNoData(i) && !accum.isNoData(i) && accum(i)>=threshold;
+  };
+
+  //The stream cell a stream cell flows into, or NO_REACH if it doesn't flow
+  //into one
+  const auto next = [&](const i_t i) -> i_t {
+    const int n = flowdirs(i);
+    if(n==NO_FLOW)
+      return NO_REACH;
+    const auto [x,y] = flowdirs.iToxy(i);
+    if(!flowdirs.inGrid(x+d8x[n],y+d8y[n]))
+      return NO_REACH;
+    const auto ni = flowdirs.xyToI(x+d8x[n],y+d8y[n]);
+    return is_stream(ni) ? ni : NO_REACH;
+  };
+
+  double cell_width  = 1;
+  double cell_height = 1;
+  if(flowdirs.geotransform.size()==6){
+    cell_width  = std::abs(flowdirs.geotransform[1]);
+    cell_height = std::abs(flowdirs.geotransform[5]);
+  }
+  std::array<double,9> step_length;
+  for(int n=0;n<=8;n++)
+    step_length[n] = std::hypot(d8x[n]*cell_width, d8y[n]*cell_height);
+
+  RDLOG_PROGRESS<<"Finding reach heads...";
+  //A stream cell starts a reach unless exactly one stream cell flows into it
+  std::vector<i_t> heads;
+  #pragma omp declare reduction(merge : std::vector<i_t> : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
+  #pragma omp parallel for reduction(merge:heads)
+  for(int y=0;y<flowdirs.height();y++)
+  for(int x=0;x<flowdirs.width();x++){
+    const auto i = flowdirs.xyToI(x,y);
+    if(!is_stream(i))
+      continue;
+    int inflows = 0;
+    for(int n=1;n<=8;n++){
+      const int nx = x+d8x[n];
+      const int ny = y+d8y[n];
+      if(!flowdirs.inGrid(nx,ny))
+        continue;
+      const auto ni = flowdirs.xyToI(nx,ny);
+      if(is_stream(ni) && flowdirs(ni)==d8_inverse[n])
+        inflows++;
+    }
+    if(inflows!=1)
+      heads.push_back(i);
+  }
+  std::sort(heads.begin(), heads.end());
+
+  Array2D<uint32_t> own_labels;
+  auto &labels = reach_labels ? *reach_labels : own_labels;
+  labels.resize(flowdirs.width(), flowdirs.height(), NO_REACH);
+  labels.setNoData(NO_REACH);
+
+  const uint32_t reach_count = heads.size();
+  std::vector<StreamReach> reaches(reach_count);
+
+  #pragma omp parallel for
+  for(uint32_t r=0;r<reach_count;r++)
+    labels(heads[r]) = r;
+
+  RDLOG_PROGRESS<<"Tracing "<<reach_count<<" reaches...";
+  //Only the thread tracing a reach labels its cells other than the head, and
+  //the heads were labeled above, so the threads don't interfere
+  #pragma omp parallel for schedule(dynamic,64)
+  for(uint32_t r=0;r<reach_count;r++){
+    auto &reach = reaches[r];
+    reach.head  = heads[r];
+
+    i_t c = heads[r];
+    for(;;){
+      reach.cells++;
+      const auto nc = next(c);
+      if(nc==NO_REACH)
+        break;
+      reach.length += step_length[flowdirs(c)];
+      if(labels(nc)!=NO_REACH && nc==heads[labels(nc)]){
+        reach.downstream = labels(nc);
+        break;
+      }
+      labels(nc) = r;
+      c = nc;
+    }
+    reach.tail          = c;
+    reach.upstream_area = accum(c)*cell_width*cell_height;
+  }
+
+  RDLOG_PROGRESS<<"Calculating stream orders...";
+  std::vector<uint32_t> inflows(reach_count, 0);
+  for(const auto &reach: reaches)
+    if(reach.downstream!=NO_REACH)
+      inflows[reach.downstream]++;
+
+  //Largest order flowing into each reach and how many inflows share it
+  std::vector<uint32_t> max_order(reach_count, 0);
+  std::vector<uint32_t> max_count(reach_count, 0);
+  std::vector<uint32_t> open;
+  for(uint32_t r=0;r<reach_count;r++)
+    if(inflows[r]==0)
+      open.push_back(r);
+
+  while(!open.empty()){
+    const auto r = open.back();
+    open.pop_back();
+    auto &reach = reaches[r];
+
+    if(reach.shreve==0){ //Source
+      reach.strahler = 1;
+      reach.shreve   = 1;
+    } else {
+      reach.strahler = max_order[r] + (max_count[r]>=2);
+    }
+
+    const auto d = reach.downstream;
+    if(d==NO_REACH)
+      continue;
+    reaches[d].shreve += reach.shreve;
+    if(reach.strahler>max_order[d]){
+      max_order[d] = reach.strahler;
+      max_count[d] = 1;
+    } else if(reach.strahler==max_order[d]){
+      max_count[d]++;
+    }
+    if(--inflows[d]==0)
+      open.push_back(d);
+  }
+
+  RDLOG_TIME_USE<<"Time to extract stream network = "<<timer.stop()<<" s";
+
+  return reaches;
+}
+
+
+
+/**
+  @brief  Extracts the reaches of a stream network given the D8 flow
+          directions and a topological order of the cells
+
+  The flow accumulation is found with d8_flow_accum_from_order() and the
+  network with ExtractStreamNetwork().
+
+  @param[in]  &flowdirs        A D8 flowdir grid
+  @param[in]  &order           Flat indices of the data cells of **flowdirs**,
+                               each cell after the cell it flows into, as
+                               produced by PriorityFloodFlowdirs_Barnes2014()
+  @param[in]  threshold_cells  Number of cells upslope of a stream cell,
+                               including itself
+  @param[out] *reach_labels    If not NULL, returns the reach each cell
+                               belongs to, or StreamReach::NO_REACH
+
+  @return The reaches of the network
+*/
+template<class T, class I>
+std::vector<StreamReach> ExtractStreamNetworkFromOrder(
+  const Array2D<T>     &flowdirs,
+  const std::vector<I> &order,
+  const uint32_t        threshold_cells,
+  Array2D<uint32_t>    *reach_labels = nullptr
+){
+  Array2D<uint32_t> area;
+  d8_flow_accum_from_order(flowdirs, order, area);
+  area.setNoData(std::numeric_limits<uint32_t>::max());
+  return ExtractStreamNetwork(flowdirs, area, threshold_cells, reach_labels);
+}
+
+
+
+/**
+  @brief  Writes a stream network as an edge list
+
+  Each reach becomes a line of comma-separated values giving its id, the id
+  of the reach it flows into (-1 for none), the x and y cell coordinates of
+  its head and tail, its number of cells, length, Strahler order, Shreve
+  magnitude, and upstream area. The first line is a header.
+
+  @param[out] &out      Stream to write to
+  @param[in]  &reaches  Reaches from ExtractStreamNetwork()
+  @param[in]  &grid     Any grid with the dimensions of the one the reaches
+                        were extracted from
+*/
+template<class T>
+void WriteStreamNetwork(std::ostream &out, const std::vector<StreamReach> &reaches, const Array2D<T> &grid){
+  out<<"reach,downstream,head_x,head_y,tail_x,tail_y,cells,length,strahler,shreve,upstream_area\n";
+  out<<std::setprecision(10);
+  for(size_t r=0;r<reaches.size();r++){
+    const auto &reach = reaches[r];
+    const auto [hx,hy] = grid.iToxy(reach.head);
+    const auto [tx,ty] = grid.iToxy(reach.tail);
+    out<<r<<','
+       <<((reach.downstream==StreamReach::NO_REACH) ? -1 : static_cast<int64_t>(reach.downstream))<<','
+       <<hx<<','<<hy<<','<<tx<<','<<ty<<','
+       <<reach.cells<<','<<reach.length<<','
+       <<reach.strahler<<','<<reach.shreve<<','
+       <<reach.upstream_area<<'\n';
+  }
+}
+
+}
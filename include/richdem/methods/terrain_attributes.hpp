@@ -2,9 +2,12 @@
 
 #include <richdem/common/logger.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
 #include <richdem/common/constants.hpp>
 #include <richdem/common/ProgressBar.hpp>
 
+#include <type_traits>
+
 namespace richdem {
 
 //d8_SPI
@@ -45,13 +48,12 @@ void TA_SPI(
 
   RDLOG_PROGRESS<<"Calculating SPI...";
   timer.start();
-  #pragma omp parallel for collapse(2)
-  for(int x=0;x<flow_accumulation.width();x++)
-    for(int y=0;y<flow_accumulation.height();y++)
-      if(flow_accumulation(x,y)==flow_accumulation.noData() || riserun_slope(x,y)==riserun_slope.noData())
-        result(x,y)=result.noData();
-      else
-        result(x,y)=log( (flow_accumulation(x,y)/flow_accumulation.getCellArea()) * (riserun_slope(x,y)+0.001) );
+  ParallelForCells(flow_accumulation, [&](const int x, const int y){
+    if(flow_accumulation(x,y)==flow_accumulation.noData() || riserun_slope(x,y)==riserun_slope.noData())
+      result(x,y)=result.noData();
+    else
+      result(x,y)=log( (flow_accumulation(x,y)/flow_accumulation.getCellArea()) * (riserun_slope(x,y)+0.001) );
+  });
   RDLOG_TIME_USE<<"succeeded in "<<timer.stop()<<"s.";
 }
 
@@ -97,13 +99,12 @@ void TA_CTI(
 
   RDLOG_PROGRESS<<"Calculating CTI..."<<std::flush;
   timer.start();
-  #pragma omp parallel for collapse(2)
-  for(int x=0;x<flow_accumulation.width();x++)
-    for(int y=0;y<flow_accumulation.height();y++)
-      if(flow_accumulation(x,y)==flow_accumulation.noData() || riserun_slope(x,y)==riserun_slope.noData())
-        result(x,y)=result.noData();
-      else
-        result(x,y)=log( (flow_accumulation(x,y)/flow_accumulation.getCellArea()) / (riserun_slope(x,y)+0.001) );
+  ParallelForCells(flow_accumulation, [&](const int x, const int y){
+    if(flow_accumulation(x,y)==flow_accumulation.noData() || riserun_slope(x,y)==riserun_slope.noData())
+      result(x,y)=result.noData();
+    else
+      result(x,y)=log( (flow_accumulation(x,y)/flow_accumulation.getCellArea()) / (riserun_slope(x,y)+0.001) );
+  });
   RDLOG_TIME_USE<<"succeeded in "<<timer.stop()<<"s.";
 }
 
@@ -176,18 +177,31 @@ http://support.esri.com/en/knowledgebase/techarticles/detail/21942
 //Deal with grid edges and NoData values in the manner suggested by
 //ArcGIS. Note that this function should never be called on a NoData cell
 
-template<class T>
-static inline TA_Setup_Vars TerrainSetup(const Array2D<T> &elevations, const int x, const int y, const float zscale){
+template<class T, class Check=std::true_type>
+static inline TA_Setup_Vars TerrainSetup(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
   TA_Setup_Vars tsv;
-  tsv.a=tsv.b=tsv.c=tsv.d=tsv.e=tsv.f=tsv.g=tsv.h=tsv.i=elevations(x,y);
-  if(elevations.inGrid(x-1,y-1) && elevations(x-1,y-1)!=elevations.noData()) tsv.a = elevations(x-1,y-1);
-  if(elevations.inGrid(x-1,y  ) && elevations(x-1,y  )!=elevations.noData()) tsv.d = elevations(x-1,y  );
-  if(elevations.inGrid(x-1,y+1) && elevations(x-1,y+1)!=elevations.noData()) tsv.g = elevations(x-1,y+1);
-  if(elevations.inGrid(x  ,y-1) && elevations(x,  y-1)!=elevations.noData()) tsv.b = elevations(x,  y-1);
-  if(elevations.inGrid(x  ,y+1) && elevations(x,  y+1)!=elevations.noData()) tsv.h = elevations(x,  y+1);
-  if(elevations.inGrid(x+1,y-1) && elevations(x+1,y-1)!=elevations.noData()) tsv.c = elevations(x+1,y-1);
-  if(elevations.inGrid(x+1,y  ) && elevations(x+1,y  )!=elevations.noData()) tsv.f = elevations(x+1,y  );
-  if(elevations.inGrid(x+1,y+1) && elevations(x+1,y+1)!=elevations.noData()) tsv.i = elevations(x+1,y+1);
+  if constexpr(check){
+    tsv.a=tsv.b=tsv.c=tsv.d=tsv.e=tsv.f=tsv.g=tsv.h=tsv.i=elevations(x,y);
+    if(elevations.inGrid(x-1,y-1) && elevations(x-1,y-1)!=elevations.noData()) tsv.a = elevations(x-1,y-1);
+    if(elevations.inGrid(x-1,y  ) && elevations(x-1,y  )!=elevations.noData()) tsv.d = elevations(x-1,y  );
+    if(elevations.inGrid(x-1,y+1) && elevations(x-1,y+1)!=elevations.noData()) tsv.g = elevations(x-1,y+1);
+    if(elevations.inGrid(x  ,y-1) && elevations(x,  y-1)!=elevations.noData()) tsv.b = elevations(x,  y-1);
+    if(elevations.inGrid(x  ,y+1) && elevations(x,  y+1)!=elevations.noData()) tsv.h = elevations(x,  y+1);
+    if(elevations.inGrid(x+1,y-1) && elevations(x+1,y-1)!=elevations.noData()) tsv.c = elevations(x+1,y-1);
+    if(elevations.inGrid(x+1,y  ) && elevations(x+1,y  )!=elevations.noData()) tsv.f = elevations(x+1,y  );
+    if(elevations.inGrid(x+1,y+1) && elevations(x+1,y+1)!=elevations.noData()) tsv.i = elevations(x+1,y+1);
+  } else {
+    //The whole neighbourhood is known to be data
+    tsv.a = elevations(x-1,y-1);
+    tsv.b = elevations(x,  y-1);
+    tsv.c = elevations(x+1,y-1);
+    tsv.d = elevations(x-1,y  );
+    tsv.e = elevations(x,  y  );
+    tsv.f = elevations(x+1,y  );
+    tsv.g = elevations(x-1,y+1);
+    tsv.h = elevations(x,  y+1);
+    tsv.i = elevations(x+1,y+1);
+  }
 
   tsv.a *= zscale;
   tsv.b *= zscale;
@@ -202,9 +216,9 @@ static inline TA_Setup_Vars TerrainSetup(const Array2D<T> &elevations, const int
   return tsv;
 }
 
-template<class T>
-static inline TA_Setup_Curves_Vars TerrainCurvatureSetup(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const TA_Setup_Vars tsv = TerrainSetup(elevations, x, y, zscale);
+template<class T, class Check=std::true_type>
+static inline TA_Setup_Curves_Vars TerrainCurvatureSetup(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const TA_Setup_Vars tsv = TerrainSetup(elevations, x, y, zscale, check);
 
   TA_Setup_Curves_Vars tscv;
   //Z1 Z2 Z3   a b c
@@ -225,9 +239,9 @@ static inline TA_Setup_Curves_Vars TerrainCurvatureSetup(const Array2D<T> &eleva
 ///@brief  Calculates aspect in degrees in the manner of Horn 1981
 ///@return Aspect in degrees in the manner of Horn 1981
 //ArcGIS doesn't use cell size for aspect calculations.
-template<class T>
-static inline double Terrain_Aspect(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const auto tsv = TerrainSetup(elevations,x,y,zscale);
+template<class T, class Check=std::true_type>
+static inline double Terrain_Aspect(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const auto tsv = TerrainSetup(elevations,x,y,zscale,check);
 
   //See p. 18 of Horn (1981)
   double dzdx       = ( (tsv.c+2*tsv.f+tsv.i) - (tsv.a+2*tsv.d+tsv.g) ) / 8 / elevations.getCellLengthX();
@@ -243,9 +257,9 @@ static inline double Terrain_Aspect(const Array2D<T> &elevations, const int x, c
 
 ///@brief  Calculates the rise/run slope along the maximum gradient on a fitted surface over a 3x3 be neighbourhood in the manner of Horn 1981
 ///@return Rise/run slope
-template<class T>
-static inline double Terrain_Slope_RiseRun(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const auto tsv = TerrainSetup(elevations,x,y,zscale);
+template<class T, class Check=std::true_type>
+static inline double Terrain_Slope_RiseRun(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const auto tsv = TerrainSetup(elevations,x,y,zscale,check);
 
   //See p. 18 of Horn (1981)
   double dzdx = ( (tsv.c+2*tsv.f+tsv.i) - (tsv.a+2*tsv.d+tsv.g) ) / 8 / elevations.getCellLengthX();
@@ -256,16 +270,16 @@ static inline double Terrain_Slope_RiseRun(const Array2D<T> &elevations, const i
   return sqrt(dzdx*dzdx+dzdy*dzdy);
 }
 
-template<class T>
-static inline double Terrain_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const auto tscv = TerrainCurvatureSetup(elevations,x,y,zscale);
+template<class T, class Check=std::true_type>
+static inline double Terrain_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const auto tscv = TerrainCurvatureSetup(elevations,x,y,zscale,check);
 
   return (-2*(tscv.D+tscv.E)*100);
 }
 
-template<class T>
-static inline double Terrain_Planform_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const auto p = TerrainCurvatureSetup(elevations,x,y,zscale);
+template<class T, class Check=std::true_type>
+static inline double Terrain_Planform_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const auto p = TerrainCurvatureSetup(elevations,x,y,zscale,check);
 
   if(p.G==0 && p.H==0)
     return 0;
@@ -273,9 +287,9 @@ static inline double Terrain_Planform_Curvature(const Array2D<T> &elevations, co
     return (-2*(p.D*p.H*p.H+p.E*p.G*p.G-p.F*p.G*p.H)/(p.G*p.G+p.H*p.H)*100);
 }
 
-template<class T>
-static inline double Terrain_Profile_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  const auto p = TerrainCurvatureSetup(elevations,x,y,zscale);
+template<class T, class Check=std::true_type>
+static inline double Terrain_Profile_Curvature(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  const auto p = TerrainCurvatureSetup(elevations,x,y,zscale,check);
 
   if(p.G==0 && p.H==0)
     return 0;
@@ -283,19 +297,19 @@ static inline double Terrain_Profile_Curvature(const Array2D<T> &elevations, con
     return (2*(p.D*p.G*p.G+p.E*p.H*p.H+p.F*p.G*p.H)/(p.G*p.G+p.H*p.H)*100);
 }
 
-template<class T>
-static inline double Terrain_Slope_Percent(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  return Terrain_Slope_RiseRun(elevations,x,y,zscale)*100;
+template<class T, class Check=std::true_type>
+static inline double Terrain_Slope_Percent(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  return Terrain_Slope_RiseRun(elevations,x,y,zscale,check)*100;
 }
 
-template<class T>
-static inline double Terrain_Slope_Radian(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  return std::atan(Terrain_Slope_RiseRun(elevations,x,y,zscale));
+template<class T, class Check=std::true_type>
+static inline double Terrain_Slope_Radian(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  return std::atan(Terrain_Slope_RiseRun(elevations,x,y,zscale,check));
 }
 
-template<class T>
-static inline double Terrain_Slope_Degree(const Array2D<T> &elevations, const int x, const int y, const float zscale){
-  return std::atan(Terrain_Slope_RiseRun(elevations,x,y,zscale))*180/M_PI;
+template<class T, class Check=std::true_type>
+static inline double Terrain_Slope_Degree(const Array2D<T> &elevations, const int x, const int y, const float zscale, const Check check=Check()){
+  return std::atan(Terrain_Slope_RiseRun(elevations,x,y,zscale,check))*180/M_PI;
 }
 
 
@@ -324,15 +338,19 @@ static inline double Terrain_Slope_Degree(const Array2D<T> &elevations, const in
     <li>TATTRIB_SLOPE_DEGREE</li>
   </ul>
 
-  @param[in]  func         The attribute function to be used
+  @param[in]  func         The attribute function to be used, called as
+                           func(elevations,x,y,zscale,check) where `check`
+                           is std::false_type if the cell's neighbourhood is
+                           known to be data (see ParallelForCellsWithNoDataCheck())
   @param[in]  &elevations  An elevation grid
   @param[in]  zscale       Value by which to scale elevation
   @param[out] &output      A grid to hold the results
+  @param[in]  &opts        Tile dimensions and thread count
 
   @post \p output takes the properties and dimensions of \p elevations
 */
 template<class F, class T>
-static inline void TerrainProcessor(F func, const Array2D<T> &elevations, const float zscale, Array2D<float> &output){
+static inline void TerrainProcessor(F func, const Array2D<T> &elevations, const float zscale, Array2D<float> &output, const ParallelOptions &opts = ParallelOptions()){
   if(elevations.getCellLengthX()!=elevations.getCellLengthY())
     RDLOG_WARN<<"Cell X and Y dimensions are not equal!";
 
@@ -340,15 +358,13 @@ static inline void TerrainProcessor(F func, const Array2D<T> &elevations, const
   ProgressBar progress;
 
   progress.start(elevations.size());
-  #pragma omp parallel for
-  for(int y=0;y<elevations.height();y++){
-    progress.update(y*elevations.width());
-    for(int x=0;x<elevations.width();x++)
-      if(elevations.isNoData(x,y))
-        output(x,y) = output.noData();
-      else
-        output(x,y) = func(elevations,x,y,zscale);
-  }
+  ParallelForCellsWithNoDataCheck(elevations, [&](const int x, const int y, const auto check){
+    ++progress;
+    if(check && elevations.isNoData(x,y))
+      output(x,y) = output.noData();
+    else
+      output(x,y) = func(elevations,x,y,zscale,check);
+  }, opts);
   RDLOG_TIME_USE<<"Wall-time = "<<progress.stop();
 }
 
@@ -373,7 +389,7 @@ void TA_slope_riserun(
 ){
   RDLOG_ALG_NAME<<"Slope calculation (rise/run)";
   RDLOG_CITATION<<"Horn, B.K.P., 1981. Hill shading and the reflectance map. Proceedings of the IEEE 69, 14–47. doi:10.1109/PROC.1981.11918";
-  TerrainProcessor(Terrain_Slope_RiseRun<T>, elevations, zscale, slopes);
+  TerrainProcessor([](const auto&... args){ return Terrain_Slope_RiseRun(args...); }, elevations, zscale, slopes);
 }
 
 /**
@@ -395,7 +411,7 @@ void TA_slope_percentage(
 ){
   RDLOG_ALG_NAME<<"Slope calculation (percentage)";
   RDLOG_CITATION<<"Horn, B.K.P., 1981. Hill shading and the reflectance map. Proceedings of the IEEE 69, 14–47. doi:10.1109/PROC.1981.11918";
-  TerrainProcessor(Terrain_Slope_Percent<T>, elevations, zscale, slopes);
+  TerrainProcessor([](const auto&... args){ return Terrain_Slope_Percent(args...); }, elevations, zscale, slopes);
 }
 
 /**
@@ -417,7 +433,7 @@ void TA_slope_degrees(
 ){
   RDLOG_ALG_NAME<<"Slope calculation (degrees)";
   RDLOG_CITATION<<"Horn, B.K.P., 1981. Hill shading and the reflectance map. Proceedings of the IEEE 69, 14–47. doi:10.1109/PROC.1981.11918";
-  TerrainProcessor(Terrain_Slope_Degree<T>, elevations, zscale, slopes);
+  TerrainProcessor([](const auto&... args){ return Terrain_Slope_Degree(args...); }, elevations, zscale, slopes);
 }
 
 /**
@@ -439,7 +455,7 @@ void TA_slope_radians(
 ){
   RDLOG_ALG_NAME<<"Slope calculation (radians)";
   RDLOG_CITATION<<"Horn, B.K.P., 1981. Hill shading and the reflectance map. Proceedings of the IEEE 69, 14–47. doi:10.1109/PROC.1981.11918";
-  TerrainProcessor(Terrain_Slope_Radian<T>, elevations, zscale, slopes);
+  TerrainProcessor([](const auto&... args){ return Terrain_Slope_Radian(args...); }, elevations, zscale, slopes);
 }
 
 /**
@@ -462,7 +478,7 @@ void TA_aspect(
 ){
   RDLOG_ALG_NAME<<"Aspect attribute calculation";
   RDLOG_CITATION<<"Horn, B.K.P., 1981. Hill shading and the reflectance map. Proceedings of the IEEE 69, 14–47. doi:10.1109/PROC.1981.11918";
-  TerrainProcessor(Terrain_Aspect<T>, elevations, zscale, aspects);
+  TerrainProcessor([](const auto&... args){ return Terrain_Aspect(args...); }, elevations, zscale, aspects);
 }
 
 /**
@@ -484,7 +500,7 @@ void TA_curvature(
 ){
   RDLOG_ALG_NAME<<"Curvature attribute calculation";
   RDLOG_CITATION<<"Zevenbergen, L.W., Thorne, C.R., 1987. Quantitative analysis of land surface topography. Earth surface processes and landforms 12, 47–56.";
-  TerrainProcessor(Terrain_Curvature<T>, elevations, zscale, curvatures);
+  TerrainProcessor([](const auto&... args){ return Terrain_Curvature(args...); }, elevations, zscale, curvatures);
 }
 
 
@@ -507,7 +523,7 @@ void TA_planform_curvature(
 ){
   RDLOG_ALG_NAME<<"Planform curvature attribute calculation";
   RDLOG_CITATION<<"Zevenbergen, L.W., Thorne, C.R., 1987. Quantitative analysis of land surface topography. Earth surface processes and landforms 12, 47–56.";
-  TerrainProcessor(Terrain_Planform_Curvature<T>, elevations, zscale, planform_curvatures);
+  TerrainProcessor([](const auto&... args){ return Terrain_Planform_Curvature(args...); }, elevations, zscale, planform_curvatures);
 }
 
 /**
@@ -529,7 +545,7 @@ void TA_profile_curvature(
 ){
   RDLOG_ALG_NAME<<"Profile curvature attribute calculation";
   RDLOG_CITATION<<"Zevenbergen, L.W., Thorne, C.R., 1987. Quantitative analysis of land surface topography. Earth surface processes and landforms 12, 47–56.";
-  TerrainProcessor(Terrain_Profile_Curvature<T>, elevations, zscale, profile_curvatures);
+  TerrainProcessor([](const auto&... args){ return Terrain_Profile_Curvature(args...); }, elevations, zscale, profile_curvatures);
 }
 
 }
@@ -2,11 +2,16 @@
 
 #include "common/Array2D.hpp"
 #include "common/constants.hpp"
+#include "common/epoch_visited_set.hpp"
 #include "common/grid_cell.hpp"
 #include "common/ManagedVector.hpp"
 #include "common/memory.hpp"
+#include "common/nodata_dispatch.hpp"
+#include "common/parallel.hpp"
 #include "common/ProgressBar.hpp"
 #include "common/random.hpp"
+#include "common/raster_concept.hpp"
+#include "common/SparseArray2D.hpp"
 #include "common/timer.hpp"
 #include "common/version.hpp"
 
@@ -29,11 +34,14 @@
 #include "flowmet/Seibert2007.hpp"
 #include "flowmet/Tarboton1997.hpp"
 
+#include "methods/batch.hpp"
+#include "methods/d8_jump_pointers.hpp"
 #include "methods/d8_methods.hpp"
 #include "methods/dinf_methods.hpp"
 #include "methods/flow_accumulation.hpp"
 #include "methods/flow_accumulation_generic.hpp"
 #include "methods/strahler.hpp"
+#include "methods/stream_network.hpp"
 #include "methods/terrain_attributes.hpp"
 
 #ifdef USEGDAL
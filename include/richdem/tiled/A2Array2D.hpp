@@ -10,50 +10,36 @@
 #include <richdem/common/Array2D.hpp>
 #include <richdem/common/gdal.hpp>
 #include <richdem/tiled/lru.hpp>
+#include <richdem/tiled/tile_index.hpp>
 #include "gdal_priv.h"
 
 namespace richdem {
 
-GDALDataType peekLayoutType(const std::string &layout_filename) {
-  LayoutfileReader lf(layout_filename);
-
-  while(lf.next()){
-    if(lf.getFilename().size()==0)
-      continue;
-
-    GDALAllRegister();
-    std::string tile_path = lf.getPath()+lf.getFilename();
-    GDALDataset *fin = (GDALDataset*)GDALOpen(tile_path.c_str(), GA_ReadOnly);
-    if(fin==NULL)
-      throw std::runtime_error("Could not open '"+(lf.getPath()+lf.getFilename())+"' to determine layout type.");
-
-    GDALRasterBand *band   = fin->GetRasterBand(1);
-    GDALDataType data_type = band->GetRasterDataType();
-
-    GDALClose(fin);
-
-    return data_type;
+namespace detail {
+  ///@return The header of the first tile of a layout which is not null. Only
+  ///        that tile is opened.
+  inline TileHeader PeekLayoutHeader(const std::string &layout_filename){
+    LayoutfileReader lf(layout_filename);
+    while(lf.next()){
+      if(lf.isNullTile())
+        continue;
+      GDALAllRegister();
+      TileHeader th;
+      th.filename = lf.getPath()+lf.getFilename();
+      ReadTileHeader(th);
+      return th;
+    }
+    throw std::runtime_error("Empty layout file!");
   }
+}
 
-  throw std::runtime_error("Empty layout file!");
+GDALDataType peekLayoutType(const std::string &layout_filename) {
+  return static_cast<GDALDataType>(detail::PeekLayoutHeader(layout_filename).dtype);
 }
 
 int peekLayoutTileSize(const std::string &layout_filename) {
-  LayoutfileReader lf(layout_filename);
-
-  GDALAllRegister();
-  while(lf.next()){
-    if(lf.getFilename().size()==0)
-      continue;
-
-    int height;
-    int width;
-    GDALDataType dtype;
-    getGDALDimensions(lf.getPath()+lf.getFilename(),height,width,dtype,NULL);
-    return width*height;
-  }
-
-  throw std::runtime_error("Empty layout file!");
+  const auto th = detail::PeekLayoutHeader(layout_filename);
+  return th.width*th.height;
 }
 
 template<class T>
@@ -77,6 +63,7 @@ class A2Array2D {
     bool do_set_all        = false; //If true, then set all to 'set_all_val' when tile is loaded
     int create_with_width  = -1;
     int create_with_height = -1;
+    int pins               = 0;     //Number of cursors holding this tile; pinned tiles are never evicted
     T set_all_val          = 0;
     void lazySetAll(){
       if(do_set_all){
@@ -112,18 +99,29 @@ class A2Array2D {
       return;
     }
 
-    if(lru.full()){
-      auto tile_to_unload = lru.back();
+    if(lru.size()>=lru.getCapacity()){
+      //Evict the least-recently used tile which is not pinned by a cursor. If
+      //every cached tile is pinned we temporarily exceed the cache's capacity
+      //rather than pull data out from under a cursor.
+      WrappedArray2D* tile_to_unload = nullptr;
+      for(auto ci=lru.cache.rbegin();ci!=lru.cache.rend();++ci){
+        if((*ci)->pins==0){
+          tile_to_unload = *ci;
+          break;
+        }
+      }
 
-      if(readonly)
-        tile_to_unload->clear();
-      else
-        tile_to_unload->dumpData();
+      if(tile_to_unload!=nullptr){
+        if(readonly)
+          tile_to_unload->clear();
+        else
+          tile_to_unload->dumpData();
 
-      evictions++;
+        evictions++;
 
-      tile_to_unload->loaded = false;
-      lru.pop_back();
+        tile_to_unload->loaded = false;
+        lru.erase(tile_to_unload);
+      }
     }
 
     if(tile.created){
@@ -155,38 +153,30 @@ class A2Array2D {
     lru.setCapacity(cachesize);
     readonly = true;
 
-    LayoutfileReader lf(layoutfile);
-    while(lf.next()){
-      if(lf.newRow()) //Add a row to the grid of chunks
-        data.emplace_back();
-
-      if(lf.isNullTile()){
+    //Tile headers come from the layout's sidecar index, or are scanned in
+    //parallel, so that no tile is opened here
+    for(const auto &row: ScanLayoutHeaders(layoutfile)){
+      data.emplace_back(); //Add a row to the grid of chunks
+      for(const auto &th: row){
         data.back().emplace_back();
-        data.back().back().null_tile = true;
-        continue;
-      }
+        auto &this_tile = data.back().back();
 
-      not_null_tiles++;
+        if(th.isNullTile()){
+          this_tile.null_tile = true;
+          continue;
+        }
 
-      data.back().emplace_back(
-        lf.getPath()+lf.getFilename(),
-        false,
-        0,
-        0,
-        0,
-        0,
-        false,
-        false
-      );
+        not_null_tiles++;
 
-      auto &this_tile = data.back().back();
+        this_tile.setHeader(th.filename, th.width, th.height, th.no_data, th.geotransform, th.projection, th.metadata);
 
-      per_tile_height = std::max(per_tile_height,this_tile.height());
-      per_tile_width  = std::max(per_tile_width, this_tile.width() );
+        per_tile_height = std::max(per_tile_height,this_tile.height());
+        per_tile_width  = std::max(per_tile_width, this_tile.width() );
 
-      cells_in_not_null_tiles += per_tile_width*per_tile_height;
+        cells_in_not_null_tiles += per_tile_width*per_tile_height;
 
-      this_tile.basename = lf.getBasename();
+        this_tile.basename = th.basename;
+      }
     }
 
     quick_width_in_tiles  = widthInTiles();
@@ -243,6 +233,10 @@ class A2Array2D {
         data.back().back().created  = false;
       }
     }
+
+    quick_width_in_tiles  = width;
+    quick_height_in_tiles = height;
+    null_tile_quick.resize(quick_width_in_tiles*quick_height_in_tiles, false);
   }
 
   template<class U>
@@ -282,6 +276,174 @@ class A2Array2D {
     }
   }
 
+  /**
+    @brief Accessor which pins a tile (and, lazily, its neighbours) in the cache
+
+    Accessing an A2Array2D through operator()(x,y) requires a division and
+    modulus to find the tile, a null-tile check, and an LRU update for every
+    cell. A Cursor instead pins the tile containing the most recently accessed
+    cell, so that subsequent accesses within that tile cost the same as an
+    Array2D access. Accesses to the eight tiles surrounding the pinned tile
+    (the halo) pin those tiles as well and are resolved without any division or
+    cache lookup. Only when an access falls outside of this 3x3 block of tiles
+    does the Cursor re-centre itself, releasing its pins.
+
+    Pinned tiles are never evicted, so a cursor may hold up to 9 tiles in
+    memory beyond what other cursors or the A2Array2D itself hold. If the cache
+    is too small for this, it temporarily grows.
+
+    Cursors are obtained from A2Array2D::cursor() and must not outlive the
+    A2Array2D they are drawn from.
+  */
+  class Cursor {
+   private:
+    A2Array2D<T> &arr;
+    int32_t ctx = -1;                       ///< X-coordinate of the centre tile
+    int32_t cty = -1;                       ///< Y-coordinate of the centre tile
+    int32_t x0  = 0;                        ///< Global x-coordinate of the centre tile's upper-left cell
+    int32_t y0  = 0;                        ///< Global y-coordinate of the centre tile's upper-left cell
+    int32_t tw  = 0;                        ///< Width of the tiles
+    int32_t th  = 0;                        ///< Height of the tiles
+    std::array<WrappedArray2D*, 9> tiles;   ///< The 3x3 block of tiles around the centre, row-major
+    std::array<bool, 9> resolved;           ///< Whether the corresponding entry of `tiles` has been looked up
+    std::array<T, 9> null_values;           ///< NoData values of null tiles in the 3x3 block
+    WrappedArray2D* centre = nullptr;       ///< Shortcut to tiles[4]
+    T no_data_to_set;                       ///< Used to disguise null tiles
+    int last_slot = 4;                      ///< Slot of the tile found by the last call to locate()
+
+    ///Look up, load, and pin the tile in slot `s` of the 3x3 block
+    WrappedArray2D* resolve(const int s){
+      if(resolved[s])
+        return tiles[s];
+
+      resolved[s] = true;
+      const int32_t tx = ctx+s%3-1;
+      const int32_t ty = cty+s/3-1;
+      assert(0<=tx && tx<arr.widthInTiles());
+      assert(0<=ty && ty<arr.heightInTiles());
+      if(arr.isNullTile(tx,ty)){
+        tiles[s]       = nullptr;
+        null_values[s] = arr.data[ty][tx].noData();
+        return nullptr;
+      }
+
+      auto &tile = arr.data[ty][tx];
+      arr._LoadTile(tx,ty);
+      tile.pins++;
+      tiles[s] = &tile;
+      return &tile;
+    }
+
+    ///Finds the tile containing global cell (x,y), re-centring if necessary,
+    ///and converts (x,y) to that tile's local coordinates
+    WrappedArray2D* locate(int32_t &x, int32_t &y){
+      assert(arr.in_grid(x,y));
+
+      int32_t lx = x-x0;
+      int32_t ly = y-y0;
+      if(ctx==-1 || lx<-tw || ly<-th || lx>=2*tw || ly>=2*th){
+        pin(x/tw, y/th);
+        lx = x-x0;
+        ly = y-y0;
+      }
+
+      const int sx = (lx<0) ? 0 : (lx<tw) ? 1 : 2;
+      const int sy = (ly<0) ? 0 : (ly<th) ? 1 : 2;
+      x         = lx-(sx-1)*tw;
+      y         = ly-(sy-1)*th;
+      last_slot = 3*sy+sx;
+      return resolve(last_slot);
+    }
+
+   public:
+    explicit Cursor(A2Array2D<T> &arr0) : arr(arr0) {
+      tw = arr.stdTileWidth();
+      th = arr.stdTileHeight();
+      tiles.fill(nullptr);
+      resolved.fill(false);
+    }
+
+    Cursor(const Cursor &) = delete;
+    Cursor& operator=(const Cursor &) = delete;
+
+    ~Cursor(){
+      release();
+    }
+
+    ///Unpin all of the tiles held by this cursor
+    void release(){
+      for(int s=0;s<9;s++)
+        if(resolved[s] && tiles[s]!=nullptr)
+          tiles[s]->pins--;
+      tiles.fill(nullptr);
+      resolved.fill(false);
+      centre = nullptr;
+      ctx    = -1;
+      cty    = -1;
+    }
+
+    /**
+      @brief Centre the cursor on a tile, loading and pinning that tile
+
+      @param[in] tx  X-coordinate of the tile
+      @param[in] ty  Y-coordinate of the tile
+
+      @return The tile, or nullptr if the tile is a null tile
+    */
+    Array2D<T>* pin(const int32_t tx, const int32_t ty){
+      assert(0<=tx && tx<arr.widthInTiles());
+      assert(0<=ty && ty<arr.heightInTiles());
+      if(tx==ctx && ty==cty)
+        return centre;
+      release();
+      ctx    = tx;
+      cty    = ty;
+      x0     = tx*tw;
+      y0     = ty*th;
+      centre = resolve(4);
+      return centre;
+    }
+
+    ///Returns the tile the cursor is centred on, or nullptr if it is a null
+    ///tile or the cursor has not yet been positioned
+    Array2D<T>* tile() const {
+      return centre;
+    }
+
+    ///Value of the cell at global coordinates (x,y)
+    T& operator()(int32_t x, int32_t y){
+      const int32_t lx = x-x0;
+      const int32_t ly = y-y0;
+      if(centre!=nullptr && 0<=lx && lx<tw && 0<=ly && ly<th)
+        return (*centre)(lx,ly);
+
+      auto *const tile = locate(x,y);
+      if(tile==nullptr){
+        no_data_to_set = null_values[last_slot];
+        return no_data_to_set;
+      }
+      return (*tile)(x,y);
+    }
+
+    ///Whether the cell at global coordinates (x,y) is NoData
+    bool isNoData(int32_t x, int32_t y){
+      const int32_t lx = x-x0;
+      const int32_t ly = y-y0;
+      if(centre!=nullptr && 0<=lx && lx<tw && 0<=ly && ly<th)
+        return centre->isNoData(lx,ly);
+
+      auto *const tile = locate(x,y);
+      if(tile==nullptr)
+        return true;
+      return tile->isNoData(x,y);
+    }
+  };
+
+  ///Returns a Cursor for fast, tile-pinned access to this A2Array2D
+  Cursor cursor() {
+    return Cursor(*this);
+  }
+
   // T& getn(int tx, int ty, int x, int y, int dx, int dy){
   //   x += dx;
   //   y += dy;
@@ -527,6 +689,7 @@ class A2Array2D {
     GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
     if(poDriver==NULL)
       throw std::runtime_error("Could not open GDAL driver!");
+    forgetCachedGDALDataset(outputname); //Don't let readers see stale data
     GDALDataset *fout    = poDriver->Create(outputname.c_str(), width(), height(), 1, myGDALType(), NULL);
     if(fout==NULL)
       throw std::runtime_error("Could not open file '"+outputname+"' for GDAL save!");
@@ -549,16 +712,15 @@ class A2Array2D {
     oband->SetNoDataValue(no_data);
     oband->Fill(no_data);
 
+    Cursor cur(*this);
     for(int32_t ty=0;ty<heightInTiles();ty++)
     for(int32_t tx=0;tx<widthInTiles();tx++){
-      auto& tile = data[ty][tx];
-
-      if(tile.null_tile)
+      if(isNullTile(tx,ty))
         continue;
 
-      _LoadTile(tx,ty);
+      auto *const tile = cur.pin(tx,ty);
 
-      auto temp = oband->RasterIO(GF_Write, tx*stdTileWidth(), ty*stdTileHeight(), tileWidth(tx,ty), tileHeight(tx,ty), data[ty][tx].getData(), tileWidth(tx,ty), tileHeight(tx,ty), myGDALType(), 0, 0);
+      auto temp = oband->RasterIO(GF_Write, tx*stdTileWidth(), ty*stdTileHeight(), tile->width(), tile->height(), tile->data(), tile->width(), tile->height(), myGDALType(), 0, 0);
       if(temp!=CE_None)
         throw std::runtime_error("Error writing file!");
     }
@@ -589,6 +751,27 @@ class A2Array2D {
     return (x>=0 && y>=0 && x<total_width_in_cells && y<total_height_in_cells);
   }
 
+  ///Same as in_grid(), named as in Array2D so that A2Array2D is a raster (see
+  ///raster_concept.hpp)
+  bool inGrid(int32_t x, int32_t y) const {
+    return in_grid(x,y);
+  }
+
+  ///NoData value of the tiles, which setNoData() keeps the same for all of them
+  T noData() const {
+    return data[0][0].noData();
+  }
+
+  ///Sets the value of a cell. Writes to null tiles are ignored.
+  ///@throws std::runtime_error if the raster was loaded from a layout file:
+  ///        its tiles are discarded, not saved, when evicted from the cache,
+  ///        so writes would be lost
+  void set(int32_t x, int32_t y, const T &val){
+    if(readonly)
+      throw std::runtime_error("An A2Array2D loaded from a layout file is read-only! Copy it into one made with a cache prefix to modify it.");
+    (*this)(x,y) = val;
+  }
+
   bool isInteriorCell(int32_t x, int32_t y) const {
     return (1<=x && 1<=y && x<total_width_in_cells-1 && y<total_height_in_cells-1);
   }
@@ -28,6 +28,7 @@ class LRU {
   LRU(){
     len    = 0;
     maxlen = -1;
+    last   = T();
   }
 
   ///@brief Insert an item into the LRU.
@@ -86,11 +87,26 @@ class LRU {
 
   ///@brief Evict the least-recently used item out of the LRU cache.
   void pop_back() {
+    if(cache.back()==last)
+      last = T();
     visited.erase(cache.back());
     cache.pop_back();
     len--;
   }
 
+  ///@brief Evict a particular item from the LRU cache, wherever it is.
+  ///@param entry The item to evict. Nothing happens if it is not in the cache.
+  void erase(const T &entry) {
+    const auto existing_entry = visited.find(entry);
+    if(existing_entry==visited.end())
+      return;
+    if(entry==last)
+      last = T();
+    cache.erase(existing_entry->second);
+    visited.erase(existing_entry);
+    len--;
+  }
+
   ///@brief Evict items from the LRU cache until it is within its capacity.
   void prune(){
     if(maxlen == -1) return;
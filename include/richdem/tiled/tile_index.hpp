@@ -0,0 +1,249 @@
+/**
+  @file
+  @brief Parallel, cached scanning of the headers of the tiles named in a layout file
+
+  Constructing an A2Array2D requires knowing the dimensions, data type,
+  geotransform, and NoData value of every tile in a layout. Opening 50,000
+  tiles one after another on networked storage just to learn this takes many
+  minutes. The functions here scan tile headers in parallel and persist what
+  they learn to a sidecar index next to the layout file, so that subsequent
+  runs need only check each tile's modification time.
+*/
+#pragma once
+
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/Layoutfile.hpp>
+#include <richdem/common/gdal.hpp>
+#include <richdem/common/logger.hpp>
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gdal_priv.h"
+
+namespace richdem {
+
+///Header information about a single tile of a layout
+struct TileHeader {
+  std::string filename;                        ///< Path to the tile. Empty for null tiles
+  std::string basename;                        ///< Filename of the tile without path or extension
+  int64_t     mtime   = -1;                    ///< Modification time of the tile when it was scanned
+  int32_t     width   = 0;                     ///< Width of the tile in cells
+  int32_t     height  = 0;                     ///< Height of the tile in cells
+  int32_t     dtype   = GDT_Unknown;           ///< GDALDataType of the tile's first band
+  double      no_data = 0;                     ///< NoData value of the tile's first band
+  std::vector<double> geotransform;            ///< Geotransform of the tile
+  std::string projection;                      ///< Projection of the tile
+  std::map<std::string, std::string> metadata; ///< Tile's metadata in key-value pairs
+
+  ///@return True if there is no tile at this position of the layout
+  bool isNullTile() const {
+    return filename.empty();
+  }
+
+  template<class Archive>
+  void serialize(Archive &ar){
+    ar(filename, basename, mtime, width, height, dtype, no_data, geotransform, projection, metadata);
+  }
+};
+
+///Identifies the format of the sidecar index. Increment when TileHeader changes.
+constexpr char TILE_INDEX_MAGIC[] = "richdem-tile-index-v1";
+
+///@return The filename of the sidecar index belonging to a layout file
+inline std::string TileIndexFilename(const std::string &layout_filename){
+  return layout_filename+".rdindex";
+}
+
+///@brief Returns the modification time of a file as an integer.
+///
+///@return The modification time or -1 if it could not be determined (for
+///        instance, because the path is a GDAL virtual filesystem path). Files
+///        with an mtime of -1 are always rescanned.
+inline int64_t TileModificationTime(const std::string &filename){
+  std::error_code ec;
+  const auto mtime = std::filesystem::last_write_time(filename, ec);
+  if(ec)
+    return -1;
+  return static_cast<int64_t>(mtime.time_since_epoch().count());
+}
+
+///@brief Opens a tile with GDAL (through the shared dataset cache) and reads
+///its header.
+///
+///@param[in,out] th  Header to fill. Its `filename` must be set.
+inline void ReadTileHeader(TileHeader &th){
+  const auto fin = getCachedGDALDataset(th.filename);
+  if(!fin)
+    throw std::runtime_error("Could not open '"+th.filename+"' to read its header.");
+
+  th.geotransform.resize(6);
+  if(fin->GetGeoTransform(th.geotransform.data())!=CE_None)
+    th.geotransform = {{1000., 1., 0., 1000., 0., -1.}};
+
+  th.projection = std::string(fin->GetProjectionRef());
+
+  th.metadata   = ProcessMetadata(fin->GetMetadata());
+
+  GDALRasterBand *band = fin->GetRasterBand(1);
+  th.width   = band->GetXSize();
+  th.height  = band->GetYSize();
+  th.dtype   = band->GetRasterDataType();
+  th.no_data = band->GetNoDataValue();
+}
+
+///@brief Reads a sidecar index into a map keyed by tile filename.
+///
+///A missing, stale-format, or corrupt index yields an empty map.
+inline std::unordered_map<std::string, TileHeader> LoadTileIndex(const std::string &index_filename){
+  std::unordered_map<std::string, TileHeader> ret;
+
+  std::ifstream fin(index_filename, std::ios::in | std::ios::binary);
+  if(!fin.good())
+    return ret;
+
+  try {
+    cereal::BinaryInputArchive archive(fin);
+    std::string magic;
+    archive(magic);
+    if(magic!=TILE_INDEX_MAGIC){
+      RDLOG_WARN<<"Ignoring tile index '"<<index_filename<<"' with unrecognized format.";
+      return ret;
+    }
+    std::vector<TileHeader> headers;
+    archive(headers);
+    for(auto &th: headers)
+      ret[th.filename] = std::move(th);
+  } catch (const std::exception &e) {
+    RDLOG_WARN<<"Ignoring unreadable tile index '"<<index_filename<<"': "<<e.what();
+    ret.clear();
+  }
+
+  return ret;
+}
+
+///@brief Writes a sidecar index.
+///
+///The index is written to a temporary file which is then renamed so that
+///concurrent readers never see a partial index. Failure to write the index
+///(e.g. because the layout lives in a read-only directory) is not an error.
+inline void SaveTileIndex(const std::string &index_filename, const std::vector<TileHeader> &headers){
+  const std::string temp_filename = index_filename+".tmp"+std::to_string(std::random_device()());
+  {
+    std::ofstream fout(temp_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!fout.good()){
+      RDLOG_WARN<<"Could not write tile index '"<<index_filename<<"'. Headers will be rescanned next time.";
+      return;
+    }
+    cereal::BinaryOutputArchive archive(fout);
+    archive(std::string(TILE_INDEX_MAGIC));
+    archive(headers);
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_filename, index_filename, ec);
+  if(ec){
+    RDLOG_WARN<<"Could not write tile index '"<<index_filename<<"': "<<ec.message();
+    std::filesystem::remove(temp_filename, ec);
+  }
+}
+
+/**
+  @brief  Retrieves the headers of all the tiles in a layout file
+
+  Headers are taken from the layout's sidecar index when the tile's
+  modification time matches that recorded in the index. All other tiles are
+  opened in parallel and their headers read. If any headers were read, the
+  index is then rewritten.
+
+  @param[in] layout_filename  Layout file to scan
+  @param[in] use_index        If false, the sidecar index is neither read nor
+                              written
+
+  @return A grid of headers arranged as in the layout file, indexed [y][x].
+          Null tiles have an empty filename.
+*/
+inline std::vector<std::vector<TileHeader>> ScanLayoutHeaders(const std::string &layout_filename, const bool use_index=true){
+  std::vector<std::vector<TileHeader>> grid;
+  std::vector<TileHeader*> tiles;
+
+  LayoutfileReader lf(layout_filename);
+  while(lf.next()){
+    if(lf.newRow())
+      grid.emplace_back();
+    grid.back().emplace_back();
+    if(lf.isNullTile())
+      continue;
+    grid.back().back().filename = lf.getPath()+lf.getFilename();
+    grid.back().back().basename = lf.getBasename();
+  }
+
+  //Pointers are only taken once the grid has stopped growing
+  for(auto &row: grid)
+  for(auto &th: row)
+    if(!th.isNullTile())
+      tiles.push_back(&th);
+
+  const auto index_filename = TileIndexFilename(layout_filename);
+  std::unordered_map<std::string, TileHeader> index;
+  if(use_index)
+    index = LoadTileIndex(index_filename);
+
+  GDALAllRegister();
+
+  int64_t     rescanned = 0;
+  std::string error;
+
+  //Tiles may be on networked storage, so stat'ing and opening them is largely
+  //latency-bound: a dynamic schedule keeps all the threads busy
+  #pragma omp parallel for schedule(dynamic) reduction(+:rescanned)
+  for(std::size_t i=0;i<tiles.size();i++){
+    auto &th = *tiles[i];
+    th.mtime = TileModificationTime(th.filename);
+
+    const auto cached = index.find(th.filename);
+    if(th.mtime!=-1 && cached!=index.end() && cached->second.mtime==th.mtime){
+      const auto basename = th.basename;
+      th          = cached->second;
+      th.basename = basename;
+      continue;
+    }
+
+    try {
+      ReadTileHeader(th);
+      rescanned++;
+    } catch (const std::exception &e) {
+      #pragma omp critical
+      error = e.what();
+    }
+  }
+
+  if(!error.empty())
+    throw std::runtime_error(error);
+
+  RDLOG_MISC<<"Read headers of "<<rescanned<<" of "<<tiles.size()<<" tiles; the rest came from the tile index.";
+
+  if(use_index && rescanned>0){
+    std::vector<TileHeader> headers;
+    headers.reserve(tiles.size());
+    for(const auto *th: tiles)
+      headers.push_back(*th);
+    SaveTileIndex(index_filename, headers);
+  }
+
+  return grid;
+}
+
+}
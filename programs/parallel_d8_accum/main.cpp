@@ -14,8 +14,10 @@
 
 #include <gdal_priv.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <fstream> //For reading layout files
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -552,7 +554,9 @@ class ConsumerSpecifics {
     timer_calc.stop();
   }
 
-  void SecondRound(const TileInfo &tile, Job2<T> &job2){
+  //An empty job2 means that no flow enters the tile from its neighbours, so
+  //the tile's own accumulation is already the final answer
+  std::future<void> SecondRound(const TileInfo &tile, Job2<T> &job2){
     #ifdef DEBUG
       std::cerr<<"d SECOND ROUND"<<std::endl;
       std::cerr<<"d Grid tile: "<<tile.gridx<<","<<tile.gridy<<std::endl;
@@ -572,6 +576,12 @@ class ConsumerSpecifics {
 
     //At this point we're done with the calculation! Boo-yeah!
 
+    return SaveOutput(tile);
+  }
+
+  //Writes the tile's accumulation to the output. The tile is written in the
+  //background so that the consumer can move on to its next job.
+  std::future<void> SaveOutput(const TileInfo &tile){
     accum.printStamp(5,"Saving output before reorientation");
 
     timer_io.start();
@@ -584,8 +594,10 @@ class ConsumerSpecifics {
     accum.printStamp(5,"Saving output after reorientation");
 
     timer_io.start();
-    accum.saveGDAL(tile.outputname, tile.analysis, tile.x, tile.y);
+    auto written = std::move(accum).saveGDALAsync(tile.outputname, tile.analysis, tile.x, tile.y);
     timer_io.stop();
+
+    return written;
   }
 
   void SaveToCache(const TileInfo &tile){
@@ -861,7 +873,17 @@ class ProducerSpecifics {
     timer_calc.stop();
   }
 
+  //True if flow enters tile (tx,ty) from its neighbours. Otherwise, the
+  //tile's first-round accumulation is already its final output.
+  bool TileChanged(int tx, int ty) const {
+    const auto &accum_in = job2s_to_dist.at(ty).at(tx).accum_in;
+    return std::any_of(accum_in.begin(), accum_in.end(), [](const accum_t a){ return a!=0; });
+  }
+
   Job2<T> DistributeJob2(const TileGrid &tiles, int tx, int ty){
+    if(!TileChanged(tx, ty))
+      return Job2<T>();
+
     auto &this_job = job2s_to_dist.at(ty).at(tx);
     // for(size_t s=0;s<this_job.accum.size();s++)
     //   this_job.accum[s] -= this_job.accum_orig[s];
@@ -927,6 +949,10 @@ void Consumer(){
   TileInfo      tile;
   StorageType<T> storage;
 
+  //The output of the previous second-round job, which may still be being
+  //written
+  std::future<void> pending_write;
+
   //Have the consumer process messages as long as they are coming using a
   //blocking receive to wait.
   while(true){
@@ -937,6 +963,8 @@ void Consumer(){
     //This message indicates that everything is done and the Consumer should shut
     //down.
     if(the_job==SYNC_MSG_KILL){
+      if(pending_write.valid())
+        pending_write.get();
       return;
 
     //This message indicates that the consumer should prepare to perform the
@@ -959,7 +987,14 @@ void Consumer(){
       consumer.FirstRound(tile, job1);
 
       if(tile.retention=="@evict"){
-        //Nothing to do: it will all get overwritten
+        //Reloading the tile for the second round means reading and
+        //accumulating it again, so its output is written now. The second
+        //round then only revisits tiles which receive flow from outside.
+        consumer.timer_io.start();
+        if(pending_write.valid())
+          pending_write.get();
+        consumer.timer_io.stop();
+        pending_write = consumer.SaveOutput(tile);
       } else if(tile.retention=="@retain"){
         consumer.SaveToRetain(tile,storage);
       } else {
@@ -991,7 +1026,14 @@ void Consumer(){
       else
         consumer.LoadFromCache(tile);
 
-      consumer.SecondRound(tile, job2);
+      //Only one finished tile is kept waiting to be written at a time, which
+      //bounds the memory used
+      consumer.timer_io.start();
+      if(pending_write.valid())
+        pending_write.get();
+      consumer.timer_io.stop();
+
+      pending_write = consumer.SecondRound(tile, job2);
 
       timer_overall.stop();
 
@@ -1081,18 +1123,37 @@ void Producer(TileGrid &tiles){
   jobs_out = 0;
   msgs     = std::vector<msg_type>();
 
+  //Tiles are sent to the same consumers as in the first round. In @evict mode
+  //a consumer has already written each of its tiles' first-round output, and
+  //it finishes that write before starting another, so a tile is never being
+  //written by two consumers at once.
+  int tile_num  = 0;
+  int unchanged = 0;
   for(int y=0;y<gridheight;y++)
   for(int x=0;x<gridwidth;x++){
     if(tiles[y][x].nullTile)
       continue;
 
+    const int consumer = (tile_num++%active_consumer_limit)+1;
+
+    //Tiles which receive no flow from outside already have their final
+    //output: in @evict mode it has been written, otherwise the consumer need
+    //only write what it kept from the first round
+    if(!producer.TileChanged(x, y)){
+      unchanged++;
+      if(tiles[y][x].retention=="@evict")
+        continue;
+    }
+
     auto job2 = producer.DistributeJob2(tiles, x, y);
 
     msgs.push_back(CommPrepare(&tiles.at(y).at(x),&job2));
-    CommISend(msgs.back(), (jobs_out%active_consumer_limit)+1, JOB_SECOND);
+    CommISend(msgs.back(), consumer, JOB_SECOND);
     jobs_out++;
   }
 
+  std::cerr<<"m Tiles receiving no external flow = "<<unchanged<<std::endl;
+
   //There's no further processing to be done at this point, but we'll gather
   //timing and memory statistics from the consumers.
   TimeInfo time_second_total;
@@ -11,12 +11,15 @@
 #include <richdem/common/grid_cell.hpp>
 #include <richdem/common/Layoutfile.hpp>
 #include <richdem/common/memory.hpp>
+#include <richdem/common/radix_heap.hpp>
 #include <richdem/common/timer.hpp>
 #include <richdem/common/version.hpp>
 
 #include <gdal_priv.h>
 
+#include <algorithm>
 #include <fstream> //For reading layout files
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -25,6 +28,8 @@
 #include <string>
 #include <vector>
 
+#include <omp.h>
+
 using namespace richdem;
 
 const std::string algname  = "Barnes (2016) Parallel Priority-Flood";
@@ -159,6 +164,7 @@ class Job1 {
        left_label,
        right_label,
        graph,
+       label_min,
        time_info,
        gridy,
        gridx);
@@ -167,6 +173,7 @@ class Job1 {
   std::vector<elev_t > top_elev,  bot_elev,  left_elev,  right_elev;  //TODO: Consider using std::array instead
   std::vector<label_t> top_label, bot_label, left_label, right_label; //TODO: Consider using std::array instead
   std::vector< std::map<label_t, elev_t> > graph;
+  std::vector<elev_t> label_min; //Lowest cell of each label after the tile is filled on its own
   TimeInfo time_info;
   int gridy, gridx;
   Job1(){}
@@ -276,6 +283,17 @@ class ConsumerSpecifics {
   void FirstRound(const TileInfo &tile, Job1<elev_t> &job1){
     job1.graph = std::move(spillover_graph);
 
+    //The second round raises a label's cells only if they are lower than the
+    //label's spill elevation, so recording each label's lowest cell lets the
+    //Producer tell which tiles the global solution leaves unchanged
+    timer_calc.start();
+    job1.label_min.assign(job1.graph.size(), std::numeric_limits<elev_t>::max());
+    for(int32_t y=0;y<dem.height();y++)
+    for(int32_t x=0;x<dem.width();x++)
+      if(labels(x,y)>1)
+        job1.label_min.at(labels(x,y)) = std::min(job1.label_min.at(labels(x,y)), dem(x,y));
+    timer_calc.stop();
+
     //The tile's edge info is needed to solve the global problem. Collect it.
     job1.top_elev    = dem.topRow     ();
     job1.bot_elev    = dem.bottomRow  ();
@@ -312,27 +330,60 @@ class ConsumerSpecifics {
     }
   }
 
-  void SecondRound(const TileInfo &tile, Job2<elev_t> &job2){
+  //An empty job2 means that the global solution raises no cell of the tile, so
+  //the tile as filled on its own is already the final answer
+  std::future<void> SecondRound(const TileInfo &tile, Job2<elev_t> &job2){
     timer_calc.start();
-    for(int32_t y=0;y<dem.height();y++)
-    for(int32_t x=0;x<dem.width();x++)
-      if(labels(x,y)>1 && dem(x,y)<job2.at(labels(x,y)))
-        dem(x,y) = job2.at(labels(x,y));
+    if(!job2.empty()){
+      for(int32_t y=0;y<dem.height();y++)
+      for(int32_t x=0;x<dem.width();x++)
+        if(labels(x,y)>1 && dem(x,y)<job2.at(labels(x,y)))
+          dem(x,y) = job2.at(labels(x,y));
+    }
     timer_calc.stop();
 
     //At this point we're done with the calculation! Boo-yeah!
 
+    return SaveOutput(tile);
+  }
+
+  //Writes the tile to the output. The tile is written in the background so
+  //that the consumer can move on to its next job.
+  std::future<void> SaveOutput(const TileInfo &tile){
     dem.printStamp(5,"Unorientated output stamp");
 
     timer_io.start();
-    dem.saveGDAL(tile.outputname, tile.analysis, tile.x, tile.y);
+    auto written = std::move(dem).saveGDALAsync(tile.outputname, tile.analysis, tile.x, tile.y);
     timer_io.stop();
+
+    return written;
   }
 };
 
 
 
 
+///A directed edge of the spillover graph, before it is compacted
+template<class elev_t>
+struct SpillEdge {
+  label_t a, b; ///< Edge runs from label `a` to label `b`
+  elev_t  elev; ///< Elevation at which water spills across the edge
+  SpillEdge(label_t a0, label_t b0, elev_t elev0) : a(a0), b(b0), elev(elev0) {}
+};
+
+///@brief Spillover graph of all tiles in compressed sparse row form.
+///
+///The neighbours of label `l` are `targets[offsets[l]]` to
+///`targets[offsets[l+1]-1]` with spill elevations given by the corresponding
+///entries of `elevs`. Each undirected edge appears once in each direction and
+///has the lowest spill elevation of all the connections between its labels.
+template<class elev_t>
+struct SpillGraph {
+  std::vector<uint64_t> offsets;
+  std::vector<label_t>  targets;
+  std::vector<elev_t>   elevs;
+};
+
 template<class elev_t>
 class ProducerSpecifics {
  public:
@@ -340,16 +391,22 @@ class ProducerSpecifics {
 
  private:
   std::vector<elev_t> graph_elev;
+  std::vector<elev_t> label_min;  //Lowest cell of each label, from the tiles
+
+  typedef std::vector< SpillEdge<elev_t> > EdgeList;
 
+  //Appends the edges from the cells along tile edge `a` to those of the
+  //adjacent tile edge `b`. The reverse edges are added when tile `b` is
+  //handled.
   void HandleEdge(
     const std::vector<elev_t>  &elev_a,
     const std::vector<elev_t>  &elev_b,
     const std::vector<label_t> &label_a,
     const std::vector<label_t> &label_b,
-    std::vector< std::map<label_t, elev_t> > &mastergraph,
+    EdgeList                   &edges,
     const label_t label_a_offset,
     const label_t label_b_offset
-  ){
+  ) const {
     //Guarantee that all vectors are of the same length
     assert(elev_a.size ()==elev_b.size ());
     assert(label_a.size()==label_b.size());
@@ -370,11 +427,7 @@ class ProducerSpecifics {
         if(c_l==n_l) //Only happens when labels are both 1
           continue;
 
-        auto elev_over = std::max(elev_a[i],elev_b[ni]);
-        if(mastergraph.at(c_l).count(n_l)==0 || elev_over<mastergraph.at(c_l)[n_l]){
-          mastergraph[c_l][n_l] = elev_over;
-          mastergraph[n_l][c_l] = elev_over;
-        }
+        edges.emplace_back(c_l, n_l, std::max(elev_a[i],elev_b[ni]));
       }
     }
   }
@@ -384,24 +437,144 @@ class ProducerSpecifics {
     const elev_t  elev_b,
     label_t       l_a,
     label_t       l_b,
-    std::vector< std::map<label_t, elev_t> > &mastergraph,
+    EdgeList     &edges,
     const label_t l_a_offset,
     const label_t l_b_offset
-  ){
+  ) const {
     if(l_a>1) l_a += l_a_offset;
     if(l_b>1) l_b += l_b_offset;
-    auto elev_over = std::max(elev_a,elev_b);
-    if(mastergraph.at(l_a).count(l_b)==0 || elev_over<mastergraph.at(l_a)[l_b]){
-      mastergraph[l_a][l_b] = elev_over;
-      mastergraph[l_b][l_a] = elev_over;
+    edges.emplace_back(l_a, l_b, std::max(elev_a,elev_b));
+  }
+
+  //Appends every edge touching tile (x,y): those of the tile's own spillover
+  //graph, in both directions, and those leading from the tile into its
+  //neighbours. The tile's graph is cleared as we go.
+  void GatherTileEdges(TileGrid &tiles, Job1Grid<elev_t> &jobs1, const int x, const int y, EdgeList &edges) const {
+    const int gridheight = tiles.size();
+    const int gridwidth  = tiles[0].size();
+
+    auto &c = jobs1[y][x];
+
+    const label_t label_offset = tiles[y][x].label_offset;
+    for(int l=0;l<(int)c.graph.size();l++)
+    for(auto const &skey: c.graph[l]){
+      label_t first_label  = l;
+      label_t second_label = skey.first;
+      if(first_label >1) first_label +=label_offset;
+      if(second_label>1) second_label+=label_offset;
+      //We insert both ends of the bidirectional edge because in the watershed
+      //labeling process, we only inserted one. We need both here because we
+      //don't know which end of the edge we will approach from as we traverse
+      //the spillover graph.
+      edges.emplace_back(first_label,  second_label, skey.second);
+      edges.emplace_back(second_label, first_label,  skey.second);
     }
+    c.graph.clear();
+    c.graph.shrink_to_fit();
+
+    if(y>0            && !tiles[y-1][x].nullTile)
+      HandleEdge(c.top_elev,   jobs1[y-1][x].bot_elev,   c.top_label,   jobs1[y-1][x].bot_label,   edges, tiles[y][x].label_offset, tiles[y-1][x].label_offset);
+
+    if(y<gridheight-1 && !tiles[y+1][x].nullTile)
+      HandleEdge(c.bot_elev,   jobs1[y+1][x].top_elev,   c.bot_label,   jobs1[y+1][x].top_label,   edges, tiles[y][x].label_offset, tiles[y+1][x].label_offset);
+
+    if(x>0            && !tiles[y][x-1].nullTile)
+      HandleEdge(c.left_elev,  jobs1[y][x-1].right_elev, c.left_label,  jobs1[y][x-1].right_label, edges, tiles[y][x].label_offset, tiles[y][x-1].label_offset);
+
+    if(x<gridwidth-1  && !tiles[y][x+1].nullTile)
+      HandleEdge(c.right_elev, jobs1[y][x+1].left_elev,  c.right_label, jobs1[y][x+1].left_label,  edges, tiles[y][x].label_offset, tiles[y][x+1].label_offset);
+
+
+    //I wish I had wrote it all in LISP.
+    //Top left
+    if(y>0 && x>0                      && !tiles[y-1][x-1].nullTile)
+      HandleCorner(c.top_elev.front(), jobs1[y-1][x-1].bot_elev.back(),  c.top_label.front(), jobs1[y-1][x-1].bot_label.back(),  edges, tiles[y][x].label_offset, tiles[y-1][x-1].label_offset);
+
+    //Bottom right
+    if(y<gridheight-1 && x<gridwidth-1 && !tiles[y+1][x+1].nullTile)
+      HandleCorner(c.bot_elev.back(),  jobs1[y+1][x+1].top_elev.front(), c.bot_label.back(),  jobs1[y+1][x+1].top_label.front(), edges, tiles[y][x].label_offset, tiles[y+1][x+1].label_offset);
+
+    //Top right
+    if(y>0 && x<gridwidth-1            && !tiles[y-1][x+1].nullTile)
+      HandleCorner(c.top_elev.back(),  jobs1[y-1][x+1].bot_elev.front(), c.top_label.back(),  jobs1[y-1][x+1].bot_label.front(), edges, tiles[y][x].label_offset, tiles[y-1][x+1].label_offset);
+
+    //Bottom left
+    if(x>0 && y<gridheight-1           && !tiles[y+1][x-1].nullTile)
+      HandleCorner(c.bot_elev.front(), jobs1[y+1][x-1].top_elev.back(),  c.bot_label.front(), jobs1[y+1][x-1].top_label.back(),  edges, tiles[y][x].label_offset, tiles[y+1][x-1].label_offset);
+  }
+
+  //Builds the compacted spillover graph from per-thread edge lists. Edges are
+  //bucketed by their source label (a counting sort), then each label's
+  //neighbours are sorted and duplicate edges reduced to their minimum spill
+  //elevation. The edge lists are released as they are consumed.
+  SpillGraph<elev_t> CompactEdges(std::vector<EdgeList> &edge_lists, const label_t maxlabel) const {
+    SpillGraph<elev_t> sg;
+
+    //Count the out-degree of each label
+    std::vector<uint64_t> degree(maxlabel,0);
+    #pragma omp parallel for schedule(static,1)
+    for(std::size_t t=0;t<edge_lists.size();t++)
+    for(const auto &e: edge_lists[t]){
+      #pragma omp atomic
+      degree[e.a]++;
+    }
+
+    std::vector<uint64_t> starts(maxlabel+1,0);
+    for(label_t l=0;l<maxlabel;l++)
+      starts[l+1] = starts[l]+degree[l];
+
+    //Scatter edges into their source label's bucket
+    std::vector< std::pair<label_t, elev_t> > buckets(starts.back());
+    std::vector<uint64_t> fill(starts.begin(), starts.end()-1);
+    #pragma omp parallel for schedule(static,1)
+    for(std::size_t t=0;t<edge_lists.size();t++){
+      for(const auto &e: edge_lists[t]){
+        uint64_t slot;
+        #pragma omp atomic capture
+        slot = fill[e.a]++;
+        buckets[slot] = std::make_pair(e.b, e.elev);
+      }
+      edge_lists[t].clear();
+      edge_lists[t].shrink_to_fit();
+    }
+    fill.clear();
+    fill.shrink_to_fit();
+
+    //Sort each bucket and keep only the lowest spill to each neighbour. The
+    //pairs sort by neighbour and then by elevation, so the first of each run
+    //of a neighbour is the one to keep.
+    #pragma omp parallel for schedule(dynamic,1024)
+    for(label_t l=0;l<maxlabel;l++){
+      const auto b = buckets.begin()+starts[l];
+      const auto e = buckets.begin()+starts[l+1];
+      std::sort(b,e);
+      const auto last = std::unique(b,e,[](const std::pair<label_t,elev_t> &p, const std::pair<label_t,elev_t> &q){
+        return p.first==q.first;
+      });
+      degree[l] = last-b;
+    }
+
+    sg.offsets.resize(maxlabel+1,0);
+    for(label_t l=0;l<maxlabel;l++)
+      sg.offsets[l+1] = sg.offsets[l]+degree[l];
+
+    sg.targets.resize(sg.offsets.back());
+    sg.elevs.resize  (sg.offsets.back());
+    #pragma omp parallel for schedule(dynamic,1024)
+    for(label_t l=0;l<maxlabel;l++)
+    for(uint64_t i=0;i<degree[l];i++){
+      sg.targets[sg.offsets[l]+i] = buckets[starts[l]+i].first;
+      sg.elevs  [sg.offsets[l]+i] = buckets[starts[l]+i].second;
+    }
+
+    return sg;
   }
 
  public:
   void Calculations(TileGrid &tiles, Job1Grid<elev_t> &jobs1){
-    //Merge all of the graphs together into one very big graph. Clear information
-    //as we go in order to save space, though I am not sure if the map::clear()
-    //method is not guaranteed to release space.
+    //Merge all of the graphs together into one very big graph. Each tile's
+    //edges are gathered independently, so this is done in parallel, and the
+    //result is compacted into a CSR graph rather than nested maps.
     std::cerr<<"Constructing mastergraph..."<<std::endl;
     std::cerr<<"Merging graphs..."<<std::endl;
     timer_calc.start();
@@ -411,84 +584,50 @@ class ProducerSpecifics {
     const int gridheight = tiles.size();
     const int gridwidth  = tiles[0].size();
 
-    //Get a tile size so we can calculate the max label
+    //Assign each tile a contiguous range of labels
     label_t maxlabel = 0;
     for(int y=0;y<gridheight;y++)
-    for(int x=0;x<gridwidth;x++)
-      maxlabel+=jobs1[y][x].graph.size();
-    std::cerr<<"!Total labels required: "<<maxlabel<<std::endl;
-
-    std::vector< std::map<label_t, elev_t> > mastergraph(maxlabel);
-
-    label_t label_offset = 0;
-    for(int y=0;y<gridheight;y++)
     for(int x=0;x<gridwidth;x++){
       if(tiles[y][x].nullTile)
         continue;
+      tiles[y][x].label_offset    = maxlabel;
+      tiles[y][x].label_increment = jobs1[y][x].graph.size();
+      maxlabel                   += jobs1[y][x].graph.size();
+    }
+    std::cerr<<"!Total labels required: "<<maxlabel<<std::endl;
 
-      auto &this_job = jobs1.at(y).at(x);
-
-      tiles[y][x].label_offset = label_offset;
-
-      for(int l=0;l<(int)this_job.graph.size();l++)
-      for(auto const &skey: this_job.graph[l]){
-        label_t first_label  = l;
-        label_t second_label = skey.first;
-        if(first_label >1) first_label +=label_offset;
-        if(second_label>1) second_label+=label_offset;
-        //We insert both ends of the bidirectional edge because in the watershed
-        //labeling process, we only inserted one. We need both here because we
-        //don't know which end of the edge we will approach from as we traverse
-        //the spillover graph.
-        mastergraph.at(first_label)[second_label] = skey.second;
-        mastergraph.at(second_label)[first_label] = skey.second;
+    std::cerr<<"Handling adjacent edges and corners..."<<std::endl;
+    std::vector<EdgeList> edge_lists;
+    #pragma omp parallel
+    {
+      #pragma omp single
+      edge_lists.resize(omp_get_num_threads());
+
+      auto &edges = edge_lists[omp_get_thread_num()];
+
+      #pragma omp for collapse(2) schedule(dynamic)
+      for(int y=0;y<gridheight;y++)
+      for(int x=0;x<gridwidth;x++){
+        if(!tiles[y][x].nullTile)
+          GatherTileEdges(tiles, jobs1, x, y, edges);
       }
-      tiles[y][x].label_increment = this_job.graph.size();
-      label_offset                += this_job.graph.size();
-      this_job.graph.clear();
     }
 
-    std::cerr<<"Handling adjacent edges and corners..."<<std::endl;
+    const auto mastergraph = CompactEdges(edge_lists, maxlabel);
+    timer_mg_construct.stop();
+
+    //Keep the tiles' lowest cells so that unchanged tiles can be found once
+    //the spill elevations are known
+    label_min.resize(maxlabel);
+    #pragma omp parallel for collapse(2) schedule(dynamic)
     for(int y=0;y<gridheight;y++)
     for(int x=0;x<gridwidth;x++){
-      if(tiles[y][x].nullTile)
-        continue;
-
-      auto &c = jobs1[y][x];
-
-      if(y>0            && !tiles[y-1][x].nullTile)
-        HandleEdge(c.top_elev,   jobs1[y-1][x].bot_elev,   c.top_label,   jobs1[y-1][x].bot_label,   mastergraph, tiles[y][x].label_offset, tiles[y-1][x].label_offset);
-
-      if(y<gridheight-1 && !tiles[y+1][x].nullTile)
-        HandleEdge(c.bot_elev,   jobs1[y+1][x].top_elev,   c.bot_label,   jobs1[y+1][x].top_label,   mastergraph, tiles[y][x].label_offset, tiles[y+1][x].label_offset);
-
-      if(x>0            && !tiles[y][x-1].nullTile)
-        HandleEdge(c.left_elev,  jobs1[y][x-1].right_elev, c.left_label,  jobs1[y][x-1].right_label, mastergraph, tiles[y][x].label_offset, tiles[y][x-1].label_offset);
-
-      if(x<gridwidth-1  && !tiles[y][x+1].nullTile)
-        HandleEdge(c.right_elev, jobs1[y][x+1].left_elev,  c.right_label, jobs1[y][x+1].left_label,  mastergraph, tiles[y][x].label_offset, tiles[y][x+1].label_offset);
-
-
-      //I wish I had wrote it all in LISP.
-      //Top left
-      if(y>0 && x>0                      && !tiles[y-1][x-1].nullTile)
-        HandleCorner(c.top_elev.front(), jobs1[y-1][x-1].bot_elev.back(),  c.top_label.front(), jobs1[y-1][x-1].bot_label.back(),  mastergraph, tiles[y][x].label_offset, tiles[y-1][x-1].label_offset);
-
-      //Bottom right
-      if(y<gridheight-1 && x<gridwidth-1 && !tiles[y+1][x+1].nullTile)
-        HandleCorner(c.bot_elev.back(),  jobs1[y+1][x+1].top_elev.front(), c.bot_label.back(),  jobs1[y+1][x+1].top_label.front(), mastergraph, tiles[y][x].label_offset, tiles[y+1][x+1].label_offset);
-
-      //Top right
-      if(y>0 && x<gridwidth-1            && !tiles[y-1][x+1].nullTile)
-        HandleCorner(c.top_elev.back(),  jobs1[y-1][x+1].bot_elev.front(), c.top_label.back(),  jobs1[y-1][x+1].bot_label.front(), mastergraph, tiles[y][x].label_offset, tiles[y-1][x+1].label_offset);
-
-      //Bottom left
-      if(x>0 && y<gridheight-1           && !tiles[y+1][x-1].nullTile)
-        HandleCorner(c.bot_elev.front(), jobs1[y+1][x-1].top_elev.back(),  c.bot_label.front(), jobs1[y+1][x-1].top_label.back(),  mastergraph, tiles[y][x].label_offset, tiles[y+1][x-1].label_offset);
+      if(!tiles[y][x].nullTile)
+        std::copy(jobs1[y][x].label_min.begin(), jobs1[y][x].label_min.end(), label_min.begin()+tiles[y][x].label_offset);
     }
-    timer_mg_construct.stop();
 
     std::cerr<<"!Mastergraph constructed in "<<timer_mg_construct.accumulated()<<"s. "<<std::endl;
+    std::cerr<<"!Mastergraph edges: "<<mastergraph.targets.size()<<std::endl;
 
     //Clear the jobs1 data from memory since we no longer need it
     jobs1.clear();
@@ -498,47 +637,30 @@ class ProducerSpecifics {
     std::cerr<<"Performing aggregated priority flood"<<std::endl;
     Timer agg_pflood_timer;
     agg_pflood_timer.start();
-    typedef std::pair<elev_t, label_t>  graph_node;
-    std::priority_queue<graph_node, std::vector<graph_node>, std::greater<graph_node> > open;
-    std::queue<graph_node> pit;
-    std::vector<bool>   visited(maxlabel,false); //TODO
-    graph_elev.resize(maxlabel);                 //TODO
-
-    open.emplace(std::numeric_limits<elev_t>::lowest(),1);
-
-    while(open.size()>0 || pit.size()>0){
-      graph_node c;
-      if(pit.size()>0){
-        c = pit.front();
-        pit.pop();
-      } else {
-        c = open.top();
-        open.pop();
-      }
+    //Elevations leave the queue in non-decreasing order, so a radix heap can be
+    //used in place of a binary heap
+    radix_heap::pair_radix_heap<elev_t, label_t> open;
+    std::vector<uint8_t> visited(maxlabel,false);
+    graph_elev.resize(maxlabel);
+
+    open.push(std::numeric_limits<elev_t>::lowest(),1);
+
+    while(!open.empty()){
+      const auto my_elev       = open.top_key();
+      const auto my_vertex_num = open.top_value();
+      open.pop();
 
-      auto my_elev       = c.first;
-      auto my_vertex_num = c.second;
       if(visited[my_vertex_num])
         continue;
 
       graph_elev[my_vertex_num] = my_elev;
       visited   [my_vertex_num] = true;
 
-      for(auto &n: mastergraph[my_vertex_num]){
-        auto n_vertex_num = n.first;
-        auto n_elev       = n.second;
+      for(auto i=mastergraph.offsets[my_vertex_num];i<mastergraph.offsets[my_vertex_num+1];i++){
+        const auto n_vertex_num = mastergraph.targets[i];
         if(visited[n_vertex_num])
           continue;
-        open.emplace(std::max(my_elev,n_elev),n_vertex_num);
-        //Turning on these lines activates the improved priority flood. It is
-        //disabled to make the algorithm easier to verify by inspection, and
-        //because it made little difference in the overall speed of the algorithm.
-
-        // if(n_elev<=my_elev){
-        //   pit.emplace(my_elev,n_vertex_num);
-        // } else {
-        //   open.emplace(n_elev,n_vertex_num);
-        // }
+        open.push(std::max(my_elev,mastergraph.elevs[i]),n_vertex_num);
       }
     }
     agg_pflood_timer.stop();
@@ -546,7 +668,22 @@ class ProducerSpecifics {
     timer_calc.stop();
   }
 
+  //True if the global solution raises any cell of tile (tx,ty), which happens
+  //only if one of the tile's labels spills at an elevation above its lowest
+  //cell. Otherwise, the tile as filled on its own is already its final output.
+  bool TileChanged(const TileGrid &tiles, int tx, int ty) const {
+    const auto &tile = tiles[ty][tx];
+    //Labels 0 and 1 are never raised
+    for(label_t l=2;l<tile.label_increment;l++)
+      if(label_min[tile.label_offset+l]<graph_elev[tile.label_offset+l])
+        return true;
+    return false;
+  }
+
   Job2<elev_t> DistributeJob2(const TileGrid &tiles, int tx, int ty){
+    if(!TileChanged(tiles, tx, ty))
+      return Job2<elev_t>();
+
     timer_calc.start();
     auto job2 = Job2<elev_t>(graph_elev.begin()+tiles[ty][tx].label_offset,graph_elev.begin()+tiles[ty][tx].label_offset+tiles[ty][tx].label_increment);
     timer_calc.stop();
@@ -605,6 +742,10 @@ void Consumer(){
   TileInfo      tile;
   StorageType<T> storage;
 
+  //The output of the previous second-round job, which may still be being
+  //written
+  std::future<void> pending_write;
+
   //Have the consumer process messages as long as they are coming using a
   //blocking receive to wait.
   while(true){
@@ -615,6 +756,8 @@ void Consumer(){
     //This message indicates that everything is done and the Consumer should shut
     //down.
     if(the_job==SYNC_MSG_KILL){
+      if(pending_write.valid())
+        pending_write.get();
       return;
 
     //This message indicates that the consumer should prepare to perform the
@@ -637,7 +780,14 @@ void Consumer(){
       consumer.FirstRound(tile, job1);
 
       if(tile.retention=="@evict"){
-        //Nothing to do: it will all get overwritten
+        //Reloading the tile for the second round means reading and filling it
+        //again, so its output is written now. The second round then only
+        //revisits tiles which the global solution changes.
+        consumer.timer_io.start();
+        if(pending_write.valid())
+          pending_write.get();
+        consumer.timer_io.stop();
+        pending_write = consumer.SaveOutput(tile);
       } else if(tile.retention=="@retain"){
         consumer.SaveToRetain(tile,storage);
       } else {
@@ -669,7 +819,14 @@ void Consumer(){
       else
         consumer.LoadFromCache(tile);
 
-      consumer.SecondRound(tile, job2);
+      //Only one finished tile is kept waiting to be written at a time, which
+      //bounds the memory used
+      consumer.timer_io.start();
+      if(pending_write.valid())
+        pending_write.get();
+      consumer.timer_io.stop();
+
+      pending_write = consumer.SecondRound(tile, job2);
 
       timer_overall.stop();
 
@@ -766,18 +923,37 @@ void Producer(TileGrid &tiles){
   jobs_out = 0;
   msgs     = std::vector<msg_type>();
 
+  //Tiles are sent to the same consumers as in the first round. In @evict mode
+  //a consumer has already written each of its tiles' first-round output, and
+  //it finishes that write before starting another, so a tile is never being
+  //written by two consumers at once.
+  int tile_num  = 0;
+  int unchanged = 0;
   for(int y=0;y<gridheight;y++)
   for(int x=0;x<gridwidth;x++){
     if(tiles[y][x].nullTile)
       continue;
 
+    const int consumer = (tile_num++%active_consumer_limit)+1;
+
+    //Tiles which the global solution leaves unchanged already have their
+    //final output: in @evict mode it has been written, otherwise the consumer
+    //need only write what it kept from the first round
+    if(!producer.TileChanged(tiles, x, y)){
+      unchanged++;
+      if(tiles[y][x].retention=="@evict")
+        continue;
+    }
+
     auto job2 = producer.DistributeJob2(tiles, x, y);
 
     msgs.push_back(CommPrepare(&tiles.at(y).at(x),&job2));
-    CommISend(msgs.back(), (jobs_out%active_consumer_limit)+1, JOB_SECOND);
+    CommISend(msgs.back(), consumer, JOB_SECOND);
     jobs_out++;
   }
 
+  std::cerr<<"m Tiles unchanged by the global solution = "<<unchanged<<std::endl;
+
   //There's no further processing to be done at this point, but we'll gather
   //timing and memory statistics from the consumers.
   TimeInfo time_second_total;
@@ -17,8 +17,9 @@ typedef uint8_t flowdirs_t;
 
 template<class T>
 void ProcessFlat(
-  A2Array2D<T>          &dem,
-  A2Array2D<flowdirs_t> &fds,
+  const A2Array2D<T>                      &dem_arr,
+  typename A2Array2D<T>::Cursor           &dem,
+  typename A2Array2D<flowdirs_t>::Cursor  &fds,
   const int x0,
   const int y0
 ){
@@ -32,12 +33,12 @@ void ProcessFlat(
     q.pop();
 
     for(int n=1;n<=8;n++){
-      const int nx = c.first +dx[n];
-      const int ny = c.second+dy[n];
+      const int nx = c.first +d8x[n];
+      const int ny = c.second+d8y[n];
 
-      if(!dem.in_grid(nx,ny))
+      if(!dem_arr.in_grid(nx,ny))
         continue;
-      if(dem.isEdgeCell(nx,ny))
+      if(dem_arr.isEdgeCell(nx,ny))
         continue;
       if(fds(nx,ny)!=NO_FLOW)
         continue;
@@ -108,6 +109,11 @@ void Master(std::string layoutfile, int cachesize, std::string tempfile_name, st
   int processed_cells = 0;
   int processed_tiles = 0;
 
+  //Cursors pin the tile being processed (and its neighbours), so that cell
+  //accesses within it do not go through the tile cache
+  auto demc = dem.cursor();
+  auto fdsc = fds.cursor();
+
   for(int32_t ty=0;ty<dem.heightInTiles();ty++)
   for(int32_t tx=0;tx<dem.widthInTiles(); tx++){
     if(dem.isNullTile(tx,ty))
@@ -120,6 +126,9 @@ void Master(std::string layoutfile, int cachesize, std::string tempfile_name, st
 
     processed_tiles++;
 
+    demc.pin(tx,ty);
+    fdsc.pin(tx,ty);
+
     for(int py=0;py<dem.tileHeight(tx,ty);py++)
     for(int px=0;px<dem.tileWidth(tx,ty); px++){
 
@@ -128,31 +137,31 @@ void Master(std::string layoutfile, int cachesize, std::string tempfile_name, st
 
       processed_cells++;
 
-      if(fds(tx,ty,px,py)!=NO_FLOW)
+      if(fdsc(x,y)!=NO_FLOW)
         continue;
 
-      if(dem.isNoData(tx,ty,px,py)){
-        fds(tx,ty,px,py) = FLOWDIR_NO_DATA;
+      if(demc.isNoData(x,y)){
+        fdsc(x,y) = FLOWDIR_NO_DATA;
         continue;
       }
 
-      const auto myelev = dem(tx,ty,px,py);
+      const auto myelev = demc(x,y);
 
       bool    drains       = false;
       bool    has_flat     = false;
       uint8_t nlowest      = 0;
       T       nlowest_elev = std::numeric_limits<T>::max();
       for(int n=1;n<=8;n++){
-        const int nx = x+dx[n];
-        const int ny = y+dy[n];
-        if(!dem.in_grid(nx,ny) || dem.isNoData(nx,ny)){
+        const int nx = x+d8x[n];
+        const int ny = y+d8y[n];
+        if(!dem.in_grid(nx,ny) || demc.isNoData(nx,ny)){
           drains       = true;
           nlowest_elev = std::numeric_limits<T>::lowest();
           nlowest      = n;
           continue;
         }
 
-        const auto nelev = dem(nx,ny);
+        const auto nelev = demc(nx,ny);
 
         if(nelev==myelev){
           has_flat = true;
@@ -164,19 +173,22 @@ void Master(std::string layoutfile, int cachesize, std::string tempfile_name, st
       }
 
       if(nlowest!=0){
-        fds(tx,ty,px,py) = nlowest;
-        int nx = x+dx[nlowest];
-        int ny = y+dy[nlowest];
-        if(fds.in_grid(nx,ny) && fds(nx,ny)==d8_inverse[nlowest]){
+        fdsc(x,y) = nlowest;
+        int nx = x+d8x[nlowest];
+        int ny = y+d8y[nlowest];
+        if(fds.in_grid(nx,ny) && fdsc(nx,ny)==d8_inverse[nlowest]){
           std::cerr<<"Two cell loop detected!"<<std::endl;
         }
       }
 
       if(dem.isEdgeCell(x,y))
-        fds(tx,ty,px,py) = d8EdgeFlow(dem,x,y);
+        fdsc(x,y) = d8EdgeFlow(dem,x,y);
 
-      if(drains && has_flat)
-        ProcessFlat(dem,fds,x,y);
+      if(drains && has_flat){
+        ProcessFlat<T>(dem,demc,fdsc,x,y);
+        demc.pin(tx,ty);
+        fdsc.pin(tx,ty);
+      }
     }
   }
 
@@ -196,14 +208,17 @@ void Master(std::string layoutfile, int cachesize, std::string tempfile_name, st
   //     continue;
   //   }
 
-  //   int nx = x+dx[my_fd];
-  //   int ny = y+dy[my_fd];
+  //   int nx = x+d8x[my_fd];
+  //   int ny = y+d8y[my_fd];
   //   if(fds.in_grid(nx,ny) && my_fd==d8_inverse[fds(nx,ny)])
   //     loops++;
   // }
   // std::cerr<<"Found "<<loops<<" loops."<<std::endl;
   // std::cerr<<"Found "<<no_flows<<" cells with no flow."<<std::endl;
 
+  demc.release();
+  fdsc.release();
+
   fds.printStamp(5); //TODO
 
   std::cerr<<"p Saving results..."<<std::endl;
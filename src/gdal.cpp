@@ -2,23 +2,298 @@
 
 #ifdef USEGDAL
 
+#include <richdem/common/Array2D.hpp>
+#include <richdem/common/parallel.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
 namespace richdem {
 
+namespace detail {
+
+///A dataset held open by the cache. Closed when the last reference goes away.
+struct CachedGDALDataset {
+  GDALDataset *dataset;
+  std::recursive_mutex mutex; ///< Held by handles for exclusive use of `dataset`
+  uint64_t last_used = 0;     ///< Cache tick at which this was last handed out
+  GIntBig  mtime     = -1;    ///< Modification time of the file when it was opened
+  GIntBig  size      = -1;    ///< Size of the file when it was opened
+
+  explicit CachedGDALDataset(GDALDataset *dataset0) : dataset(dataset0) {}
+  CachedGDALDataset(const CachedGDALDataset &) = delete;
+  CachedGDALDataset& operator=(const CachedGDALDataset &) = delete;
+  ~CachedGDALDataset(){
+    GDALClose(dataset);
+  }
+};
+
+///Process-wide cache of read-only datasets, keyed by filename
+struct GDALDatasetCache {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<CachedGDALDataset>> datasets;
+  std::size_t capacity = 64;
+  uint64_t    tick     = 0;
+
+  ///Close least-recently used datasets without live handles until the cache is
+  ///within its capacity. Caller must hold `mutex`.
+  void prune(){
+    while(datasets.size()>capacity){
+      auto victim = datasets.end();
+      for(auto di=datasets.begin();di!=datasets.end();++di){
+        if(di->second.use_count()>1) //Someone holds a handle
+          continue;
+        if(victim==datasets.end() || di->second->last_used<victim->second->last_used)
+          victim = di;
+      }
+      if(victim==datasets.end())
+        return;
+      datasets.erase(victim);
+    }
+  }
+};
+
+///Reads the modification time and size of a file. Both are -1 if the file
+///cannot be stat'd, as for some of GDAL's virtual file systems.
+static void StatGDALFile(const std::string &filename, GIntBig &mtime, GIntBig &size){
+  VSIStatBufL stat_buf;
+  if(VSIStatL(filename.c_str(), &stat_buf)==0){
+    mtime = static_cast<GIntBig>(stat_buf.st_mtime);
+    size  = static_cast<GIntBig>(stat_buf.st_size);
+  } else {
+    mtime = size = -1;
+  }
+}
+
+///Constructed on first use so it is destroyed before GDAL is torn down
+static GDALDatasetCache& dataset_cache(){
+  static GDALDatasetCache cache;
+  return cache;
+}
+
+}
+
+GDALDatasetHandle::GDALDatasetHandle(std::shared_ptr<detail::CachedGDALDataset> entry0)
+  : entry(std::move(entry0)), lock(entry->mutex) {}
+
+GDALDataset* GDALDatasetHandle::get() const {
+  return entry ? entry->dataset : nullptr;
+}
+
+GDALDatasetHandle getCachedGDALDataset(const std::string &filename){
+  auto &cache = detail::dataset_cache();
+
+  //A cached dataset is only reused if its file has not changed since it was
+  //opened. Handles to a stale dataset stay valid; it is closed once they are
+  //all released.
+  GIntBig mtime, size;
+  detail::StatGDALFile(filename, mtime, size);
+
+  std::shared_ptr<detail::CachedGDALDataset> entry;
+  {
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    const auto existing = cache.datasets.find(filename);
+    if(existing!=cache.datasets.end()){
+      if(existing->second->mtime==mtime && existing->second->size==size){
+        entry            = existing->second;
+        entry->last_used = ++cache.tick;
+      } else {
+        cache.datasets.erase(existing);
+      }
+    }
+  }
+
+  if(!entry){
+    //Opening may be slow (e.g. on networked storage), so it is done without
+    //holding the cache's lock. If another thread opened the same file in the
+    //meantime we use its dataset and close ours.
+    GDALAllRegister();
+    auto *const fin = static_cast<GDALDataset*>(GDALOpen(filename.c_str(), GA_ReadOnly));
+    if(fin==nullptr)
+      return GDALDatasetHandle();
+
+    auto fresh = std::make_shared<detail::CachedGDALDataset>(fin);
+    fresh->mtime = mtime;
+    fresh->size  = size;
+
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    entry            = cache.datasets.emplace(filename, std::move(fresh)).first->second;
+    entry->last_used = ++cache.tick;
+    cache.prune();
+  }
+
+  return GDALDatasetHandle(std::move(entry));
+}
+
+void forgetCachedGDALDataset(const std::string &filename){
+  auto &cache = detail::dataset_cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  cache.datasets.erase(filename);
+}
+
+void clearGDALDatasetCache(){
+  auto &cache = detail::dataset_cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  for(auto di=cache.datasets.begin();di!=cache.datasets.end();){
+    if(di->second.use_count()>1)
+      ++di;
+    else
+      di = cache.datasets.erase(di);
+  }
+}
+
+void setGDALDatasetCacheSize(const std::size_t size){
+  auto &cache = detail::dataset_cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  cache.capacity = size;
+  cache.prune();
+}
+
 GDALDataType peekGDALType(const std::string &filename){
-  GDALAllRegister();
-  auto *const fin = static_cast<GDALDataset*>(GDALOpen(filename.c_str(), GA_ReadOnly));
-  if(fin==nullptr){
+  const auto fin = getCachedGDALDataset(filename);
+  if(!fin){
     throw std::runtime_error("Unable to open file '"+filename+"'!");
   }
 
   GDALRasterBand *band   = fin->GetRasterBand(1);
   GDALDataType data_type = band->GetRasterDataType();
 
-  GDALClose(fin);
-
   return data_type;
 }
 
+namespace {
+
+///@return The band or overview to read. Throws if it does not exist.
+GDALRasterBand* SelectGDALBand(GDALDataset *const dataset, const std::string &filename, const int band, const int overview){
+  if(band<1 || band>dataset->GetRasterCount())
+    throw std::runtime_error("File '"+filename+"' has no band "+std::to_string(band)+"!");
+
+  GDALRasterBand *const rband = dataset->GetRasterBand(band);
+  if(overview<0)
+    return rband;
+  if(overview>=rband->GetOverviewCount())
+    throw std::runtime_error("Band "+std::to_string(band)+" of '"+filename+"' has no overview "+std::to_string(overview)+"!");
+  return rband->GetOverview(overview);
+}
+
+}
+
+GDALWindowInfo getGDALWindowInfo(const std::string &filename, const int band, const int overview, const GDALWindow window){
+  const auto fin = getCachedGDALDataset(filename);
+  if(!fin)
+    throw std::runtime_error("Could not open file '"+filename+"' with GDAL!");
+
+  GDALRasterBand *const full  = SelectGDALBand(fin.get(), filename, band, -1);
+  GDALRasterBand *const rband = SelectGDALBand(fin.get(), filename, band, overview);
+
+  GDALWindowInfo info;
+  info.window = window;
+  auto &w = info.window;
+  const int32_t band_width  = rband->GetXSize();
+  const int32_t band_height = rband->GetYSize();
+  if(w.width==0)
+    w.width  = band_width-w.xoff;
+  if(w.height==0)
+    w.height = band_height-w.yoff;
+  if(w.xoff<0 || w.yoff<0 || w.width<=0 || w.height<=0 || w.xoff+w.width>band_width || w.yoff+w.height>band_height)
+    throw std::runtime_error("Window does not fit within the "+std::to_string(band_width)+"x"+std::to_string(band_height)+" raster of '"+filename+"'!");
+
+  int has_no_data     = 0;
+  info.dtype          = rband->GetRasterDataType();
+  info.no_data        = rband->GetNoDataValue(&has_no_data);
+  info.has_no_data    = has_no_data!=0;
+  info.overview_count = full->GetOverviewCount();
+  int bw = 0, bh = 0;
+  rband->GetBlockSize(&bw, &bh);
+  info.block_width  = bw;
+  info.block_height = bh;
+
+  info.projection = fin->GetProjectionRef();
+  info.metadata   = ProcessMetadata(fin->GetMetadata());
+
+  info.geotransform.resize(6);
+  if(fin->GetGeoTransform(info.geotransform.data())==CE_None){
+    auto &gt = info.geotransform;
+    //Cells of an overview cover several cells of the full-resolution raster
+    const double sx = (double)full->GetXSize()/band_width;
+    const double sy = (double)full->GetYSize()/band_height;
+    gt[1] *= sx; gt[4] *= sx;
+    gt[2] *= sy; gt[5] *= sy;
+    //Move the origin to the window's top-left corner
+    gt[0] += w.xoff*gt[1] + w.yoff*gt[2];
+    gt[3] += w.xoff*gt[4] + w.yoff*gt[5];
+  } else {
+    info.geotransform.clear();
+  }
+
+  return info;
+}
+
+void readGDALWindow(const std::string &filename, const int band, const int overview, const GDALWindow window, const GDALDataType buf_type, void *const buffer, const int threads){
+  readGDALWindow(filename, band, overview, getGDALWindowInfo(filename, band, overview, window), buf_type, buffer, threads);
+}
+
+void readGDALWindow(const std::string &filename, const int band, const int overview, const GDALWindowInfo &info, const GDALDataType buf_type, void *const buffer, const int threads){
+  const auto &w = info.window;
+
+  const int cell_bytes = GDALGetDataTypeSizeBytes(buf_type);
+  if(cell_bytes<=0)
+    throw std::runtime_error("Cannot read '"+filename+"' into a buffer of unknown type!");
+
+  //Strips start on block boundaries, so each block is decompressed by only one
+  //thread. Bands stored a row or two per block are grouped into taller strips
+  //to limit the number of reads.
+  const int32_t block_height = std::max(info.block_height, 1);
+  const int32_t strip_height = block_height*std::max(1, 64/block_height);
+  std::vector<std::pair<int32_t,int32_t>> strips; //Rows y0<=y<y1 of the band
+  for(int32_t y=w.yoff;y<w.yoff+w.height;){
+    const int32_t next = std::min((y/strip_height+1)*strip_height, w.yoff+w.height);
+    strips.emplace_back(y, next);
+    y = next;
+  }
+
+  ParallelOptions opts;
+  opts.threads = threads;
+  const int nthreads = std::max(1, std::min<int>(ParallelThreads(opts), strips.size()));
+
+  std::string error;
+  #pragma omp parallel num_threads(nthreads)
+  {
+    //GDAL datasets cannot be used by several threads at once, so each thread
+    //opens its own rather than using the cache
+    auto *const fin = static_cast<GDALDataset*>(GDALOpen(filename.c_str(), GA_ReadOnly));
+    GDALRasterBand *rband = nullptr;
+    try {
+      if(fin==nullptr)
+        throw std::runtime_error("Could not open file '"+filename+"' with GDAL!");
+      rband = SelectGDALBand(fin, filename, band, overview);
+    } catch (const std::exception &e) {
+      #pragma omp critical(richdem_read_gdal_window)
+      error = e.what();
+    }
+
+    #pragma omp for schedule(dynamic,1)
+    for(std::size_t s=0;s<strips.size();s++){
+      if(rband==nullptr)
+        continue;
+      const auto [y0, y1] = strips[s];
+      auto *const dst = static_cast<char*>(buffer) + (std::size_t)(y0-w.yoff)*w.width*cell_bytes;
+      if(rband->RasterIO(GF_Read, w.xoff, y0, w.width, y1-y0, dst, w.width, y1-y0, buf_type, 0, 0)!=CE_None){
+        #pragma omp critical(richdem_read_gdal_window)
+        error = "Error reading rows "+std::to_string(y0)+"-"+std::to_string(y1)+" of '"+filename+"'!";
+      }
+    }
+
+    if(fin!=nullptr)
+      GDALClose(fin);
+  }
+
+  if(!error.empty())
+    throw std::runtime_error(error);
+}
+
 void getGDALDimensions(
   const   std::string &filename,
   int32_t &height,
@@ -26,9 +301,8 @@ void getGDALDimensions(
   GDALDataType &dtype,
   double geotransform[6]
 ){
-  GDALAllRegister();
-  auto *const fin = static_cast<GDALDataset*>(GDALOpen(filename.c_str(), GA_ReadOnly));
-  if(fin==nullptr){
+  const auto fin = getCachedGDALDataset(filename);
+  if(!fin){
     throw std::runtime_error("Could not open file '"+filename+"' to get dimensions.");
   }
 
@@ -42,10 +316,8 @@ void getGDALDimensions(
 
   height  = band->GetYSize();
   width   = band->GetXSize();
-
-  GDALClose(fin);
 }
 
 }
 
-#endif
\ No newline at end of file
+#endif
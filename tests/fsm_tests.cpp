@@ -692,6 +692,160 @@ TEST_CASE("RandomizedMassConservation"){
   RandomizedMassConservation(number_of_large_tests, 100, 300);
 }
 
+TEST_CASE("Incremental depression hierarchy update"){
+  const auto check_against_rebuild = [](const Array2D<double> &dem, const Array2D<dh_label_t> &labels, const DepressionHierarchy<double> &deps){
+    Array2D<dh_label_t> full_labels  (dem.width(), dem.height(), NO_DEP );
+    Array2D<flowdir_t>  full_flowdirs(dem.width(), dem.height(), NO_FLOW);
+    full_labels.setEdges(OCEAN);
+    const auto full = GetDepressionHierarchy<double,Topology::D8>(dem, full_labels, full_flowdirs);
+
+    REQUIRE(deps.size()==full.size());
+
+    //Depressions are numbered differently, so compare them by their outlets
+    const auto summarize = [](const DepressionHierarchy<double> &dh){
+      std::vector<std::tuple<double,uint32_t,double>> summary;
+      for(size_t d=1;d<dh.size();d++){
+        CHECK(dh[d].dep_label==d);
+        CHECK((dh[d].lchild==NO_VALUE || dh[d].lchild<d));
+        summary.emplace_back(dh[d].out_elev, dh[d].cell_count, dh[d].dep_vol);
+      }
+      std::sort(summary.begin(), summary.end());
+      return summary;
+    };
+    const auto a = summarize(deps);
+    const auto b = summarize(full);
+    for(size_t i=0;i<a.size();i++){
+      CHECK(std::get<0>(a[i])==std::get<0>(b[i]));
+      CHECK(std::get<1>(a[i])==std::get<1>(b[i]));
+      CHECK(std::get<2>(a[i])==doctest::Approx(std::get<2>(b[i])));
+    }
+
+    //Cells below the outlet of their leaf depression must be in the same one
+    for(auto i=dem.i0();i<dem.size();i++){
+      if(full_labels(i)==OCEAN || dem(i)>full.at(full_labels(i)).out_elev)
+        continue;
+      REQUIRE(labels(i)!=OCEAN);
+      CHECK(deps.at(labels(i)).pit_cell==full.at(full_labels(i)).pit_cell);
+    }
+  };
+
+  SUBCASE("Random edits"){
+    std::mt19937_64 edit_gen(2024);
+    for(int trial=0;trial<40;trial++){
+      auto dem = random_terrain(gen, 20, 60);
+      dem.setEdges(-1);
+
+      Array2D<dh_label_t> labels  (dem.width(), dem.height(), NO_DEP );
+      Array2D<flowdir_t>  flowdirs(dem.width(), dem.height(), NO_FLOW);
+      labels.setEdges(OCEAN);
+      auto deps = GetDepressionHierarchy<double,Topology::D8>(dem, labels, flowdirs);
+
+      double min_elev = std::numeric_limits<double>::max();
+      for(auto i=dem.i0();i<dem.size();i++)
+        if(!dem.isEdgeCell(i))
+          min_elev = std::min(min_elev, dem(i));
+      std::uniform_real_distribution<double> elev_dist(min_elev, dem.max());
+      std::uniform_int_distribution<int> x_dist(1, dem.width()-2);
+      std::uniform_int_distribution<int> y_dist(1, dem.height()-2);
+
+      //Apply a few rounds of edits to check that updates can be chained
+      for(int round=0;round<3;round++){
+        std::vector<flat_c_idx> changed;
+        for(int e=0;e<3;e++){
+          const auto i = dem.xyToI(x_dist(edit_gen), y_dist(edit_gen));
+          dem(i) = elev_dist(edit_gen);
+          changed.push_back(i);
+        }
+        UpdateDepressionHierarchy<double,Topology::D8>(deps, dem, labels, flowdirs, changed);
+        check_against_rebuild(dem, labels, deps);
+      }
+    }
+  }
+
+  SUBCASE("No edits"){
+    auto dem = generate_perlin_terrain(30, 1234);
+    dem.setEdges(-1);
+
+    Array2D<dh_label_t> labels  (dem.width(), dem.height(), NO_DEP );
+    Array2D<flowdir_t>  flowdirs(dem.width(), dem.height(), NO_FLOW);
+    labels.setEdges(OCEAN);
+    auto deps = GetDepressionHierarchy<double,Topology::D8>(dem, labels, flowdirs);
+    const auto old_labels = labels;
+
+    CHECK(UpdateDepressionHierarchy<double,Topology::D8>(deps, dem, labels, flowdirs, {})==0);
+    CHECK(labels==old_labels);
+  }
+}
+
+TEST_CASE("Depression hierarchy by sorting"){
+  SUBCASE("Matches the priority queue"){
+    const auto compare = [](const Array2D<double> &dem, auto topo){
+      constexpr Topology T = decltype(topo)::value;
+      Array2D<dh_label_t> pq_labels  (dem.width(), dem.height(), NO_DEP );
+      Array2D<flowdir_t>  pq_flowdirs(dem.width(), dem.height(), NO_FLOW);
+      pq_labels.setEdges(OCEAN);
+      auto sort_labels   = pq_labels;
+      auto sort_flowdirs = pq_flowdirs;
+
+      const auto pq_deps   = GetDepressionHierarchy<double,T>(dem, pq_labels, pq_flowdirs);
+      const auto sort_deps = GetDepressionHierarchyBySorting<double,T>(dem, sort_labels, sort_flowdirs);
+
+      CHECK(sort_labels==pq_labels);
+      CHECK(sort_flowdirs==pq_flowdirs);
+      REQUIRE(sort_deps.size()==pq_deps.size());
+      for(size_t d=0;d<pq_deps.size();d++){
+        const auto &a = sort_deps[d];
+        const auto &b = pq_deps[d];
+        CHECK(a.pit_cell==b.pit_cell);
+        CHECK(a.out_cell==b.out_cell);
+        CHECK(a.out_elev==b.out_elev);
+        CHECK(a.parent==b.parent);
+        CHECK(a.odep==b.odep);
+        CHECK(a.geolink==b.geolink);
+        CHECK(a.lchild==b.lchild);
+        CHECK(a.rchild==b.rchild);
+        CHECK(a.ocean_parent==b.ocean_parent);
+        CHECK(a.ocean_linked==b.ocean_linked);
+        CHECK(a.cell_count==b.cell_count);
+        CHECK(equal_or_both_nan(a.dep_vol, b.dep_vol));
+      }
+    };
+
+    //Without ties between elevations the two must agree exactly
+    std::uniform_real_distribution<double> jitter_dist(0, 1e-6);
+    for(int trial=0;trial<20;trial++){
+      auto dem = random_terrain(gen, 20, 200);
+      for(auto i=dem.i0();i<dem.size();i++)
+        dem(i) += jitter_dist(gen);
+      compare(dem, std::integral_constant<Topology,Topology::D8>());
+      compare(dem, std::integral_constant<Topology,Topology::D4>());
+    }
+  }
+
+  SUBCASE("Fills like Priority-Flood"){
+    //Integer terrain has many flats, so only the filled surface must agree
+    for(int trial=0;trial<20;trial++){
+      auto dem = random_integer_terrain(gen, 20, 200);
+      Array2D<dh_label_t> labels  (dem.width(), dem.height(), NO_DEP );
+      Array2D<flowdir_t>  flowdirs(dem.width(), dem.height(), NO_FLOW);
+      labels.setEdges(OCEAN);
+
+      const auto deps = GetDepressionHierarchyBySorting<double,Topology::D8>(dem, labels, flowdirs);
+
+      auto filled = dem;
+      FillDepressionsFromHierarchy(filled, labels, deps);
+      auto comparison_dem = dem;
+      PriorityFlood_Zhou2016(comparison_dem);
+      CHECK(MaxArrayDiff(comparison_dem, filled)==0);
+
+      //Every land cell but a pit has a flow direction
+      for(auto i=dem.i0();i<dem.size();i++)
+        if(labels(i)!=OCEAN && deps.at(labels(i)).pit_cell!=i)
+          CHECK(flowdirs(i)!=NO_FLOW);
+    }
+  }
+}
+
 #ifdef RICHDEM_USE_BOOST_SERIALIZATION
 TEST_CASE("DH serialization"){
   auto dem = generate_perlin_terrain(100, 123456);
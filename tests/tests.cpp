@@ -2,13 +2,22 @@
 
 #include <richdem/common/constants.hpp>
 #include <richdem/common/Array2D.hpp>
+#include <richdem/common/concurrent_disjoint_int_set.hpp>
+#include <richdem/common/disjoint_dense_int_set.hpp>
+#include <richdem/common/epoch_visited_set.hpp>
 #include <richdem/common/loaders.hpp>
+#include <richdem/flats/find_flats.hpp>
 #include <richdem/misc/misc_methods.hpp>
 #include <richdem/richdem.hpp>
 #include <richdem/terrain_generation.hpp>
+#ifdef USEGDAL
+#include <richdem/tiled/A2Array2D.hpp>
+#endif
 
 #include <filesystem>
 #include <queue>
+#include <random>
+#include <sstream>
 
 namespace fs = std::filesystem;
 using namespace richdem;
@@ -36,6 +45,173 @@ TEST_CASE("ManagedVector Resizing"){
   REQUIRE_NOTHROW(mvec.resize(30));
 }
 
+TEST_CASE("ConcurrentDisjointIntSet matches DisjointDenseIntSet"){
+  const uint32_t N = 20000;
+
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<uint32_t> set_dist(0, N-1);
+  std::vector<std::pair<uint32_t,uint32_t>> unions(15000);
+  for(auto &u: unions)
+    u = {set_dist(gen), set_dist(gen)};
+
+  DisjointDenseIntSet      serial(N);
+  ConcurrentDisjointIntSet concurrent(N);
+
+  for(const auto &u: unions)
+    serial.unionSet(u.first, u.second);
+
+  #pragma omp parallel for
+  for(std::size_t i=0;i<unions.size();i++)
+    concurrent.unionSet(unions[i].first, unions[i].second);
+
+  REQUIRE_THROWS(concurrent.findSet(N));
+
+  concurrent.flatten();
+  for(uint32_t i=0;i<N;i++){
+    CHECK(concurrent.parentOf(i)==concurrent.findSet(i));
+    //Same partition: sets that share a root in one share a root in the other
+    const auto j = set_dist(gen);
+    CHECK(serial.sameSet(i,j)==concurrent.sameSet(i,j));
+    CHECK(serial.sameSet(i,unions[i%unions.size()].first)==concurrent.sameSet(i,unions[i%unions.size()].first));
+  }
+}
+
+TEST_CASE("EpochVisitedSet"){
+  richdem::EpochVisitedSet visited(10);
+  CHECK(!visited.contains(3));
+  CHECK(visited.insert(3));
+  CHECK(!visited.insert(3));
+  CHECK(visited.contains(3));
+  CHECK(!visited.contains(4));
+  CHECK(!visited.contains(100)); //Out of range items are never contained
+
+  visited.clear();
+  CHECK(!visited.contains(3));
+  CHECK(visited.insert(3));
+
+  //Stamps from many clears ago must not reappear
+  for(int i=0;i<1000;i++)
+    visited.clear();
+  for(std::size_t i=0;i<visited.size();i++)
+    CHECK(!visited.contains(i));
+}
+
+TEST_CASE("ParallelForCells visits every cell once"){
+  Array2D<int> dem(517, 93, 1);
+  dem.setNoData(-1);
+  for(int y=0;y<40;y++)
+  for(int x=0;x<300;x++)
+    dem(x,y) = -1;
+
+  ParallelOptions opts;
+  opts.tile_width  = 37;
+  opts.tile_height = 11;
+
+  SUBCASE("All cells"){
+    Array2D<int> visits(dem.width(), dem.height(), 0);
+    ParallelForCells(dem, [&](const int x, const int y){
+      visits(x,y)++;
+    }, opts);
+    for(unsigned int i=0;i<visits.size();i++)
+      CHECK(visits(i)==1);
+  }
+
+  SUBCASE("All cells, balanced"){
+    opts.balance = true;
+    Array2D<int> visits(dem.width(), dem.height(), 0);
+    ParallelForCells(dem, [&](const int x, const int y){
+      visits(x,y)++;
+    }, opts);
+    for(unsigned int i=0;i<visits.size();i++)
+      CHECK(visits(i)==1);
+  }
+
+  SUBCASE("Interior cells"){
+    Array2D<int> visits(dem.width(), dem.height(), 0);
+    ParallelForInteriorCells(dem, [&](const int x, const int y){
+      visits(x,y)++;
+    }, opts);
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      CHECK(visits(x,y)==(dem.isEdgeCell(x,y)?0:1));
+  }
+
+  SUBCASE("Thread limit"){
+    opts.threads = 1;
+    std::vector<int> seen;
+    ParallelForCells(dem, [&](const int, const int){
+      seen.push_back(0); //Would race if more than one thread were used
+    }, opts);
+    CHECK(seen.size()==dem.size());
+  }
+
+  SUBCASE("Parallelism scope"){
+    const auto before = ParallelThreads();
+    {
+      ParallelismScope scope({1, ThreadBinding::Close});
+      CHECK(ParallelThreads()==1);
+      CHECK(ParallelBinding()==ThreadBinding::Close);
+      std::vector<int> seen;
+      ParallelForCells(dem, [&](const int, const int){
+        seen.push_back(0);
+      }, opts);
+      CHECK(seen.size()==dem.size());
+    }
+    CHECK(ParallelThreads()==before);
+    CHECK(ParallelBinding()==ThreadBinding::Default);
+  }
+
+  SUBCASE("Balancing puts data-heavy tiles first"){
+    auto tiles = DecomposeIntoTiles(0, 0, dem.width(), dem.height(), opts);
+    CHECK(tiles.size()==14*9);
+    BalanceTiles(tiles, dem, opts);
+    for(std::size_t i=1;i<tiles.size();i++)
+      CHECK(tiles[i-1].work>=tiles[i].work);
+  }
+}
+
+TEST_CASE("ConsumeThreadsArgument"){
+  char prog[] = "rd_app", in[] = "in.tif", flag[] = "--threads", four[] = "4", eq[] = "--threads=3", bad[] = "--threads=x";
+
+  char *argv1[] = {prog, in, flag, four, nullptr};
+  int argc1 = 4;
+  CHECK(ConsumeThreadsArgument(argc1, argv1).threads==4);
+  CHECK(argc1==2);
+  CHECK(argv1[1]==in);
+  CHECK(argv1[2]==nullptr);
+
+  char *argv2[] = {prog, eq, in, nullptr};
+  int argc2 = 3;
+  CHECK(ConsumeThreadsArgument(argc2, argv2).threads==3);
+  CHECK(argc2==2);
+  CHECK(argv2[1]==in);
+
+  char *argv3[] = {prog, in, nullptr};
+  int argc3 = 2;
+  CHECK(ConsumeThreadsArgument(argc3, argv3).threads==0);
+  CHECK(argc3==2);
+
+  char *argv4[] = {prog, bad, nullptr};
+  int argc4 = 2;
+  CHECK_THROWS(ConsumeThreadsArgument(argc4, argv4));
+}
+
+TEST_CASE("CPU dispatch"){
+  const std::string target = CPUDispatchTarget();
+  const std::vector<std::string> known = {"x86-64-v4", "x86-64-v3", "avx512f", "avx2", "default", "disabled"};
+  CHECK(std::find(known.begin(), known.end(), target)!=known.end());
+
+  //Whichever version of the kernels was chosen must give the same answers
+  Array2D<float> dem(37, 23, 5);
+  dem.setNoData(-9999);
+  dem(3,4)   = -9999;
+  dem(10,20) = -2;
+  dem(36,22) = 12;
+  CHECK(dem.min()==-2);
+  CHECK(dem.max()==12);
+  CHECK(dem.numDataCells()==37*23-1);
+}
+
 #ifdef USEGDAL
 TEST_CASE("Test padding on load") {
   Array2D<int> temp;
@@ -49,6 +225,64 @@ TEST_CASE("Test padding on load") {
     }
   }
 }
+
+TEST_CASE("Asynchronous saving"){
+  const auto dir = fs::temp_directory_path();
+  Array2D<float> dem(31, 17, 3);
+  dem.setNoData(-9999);
+  dem.geotransform = {{0,1,0,0,0,-1}};
+  dem(4,5) = 7;
+
+  //The snapshot is taken at the call, so later changes are not written
+  auto copied = dem.saveGDALAsync((dir/"rd_async_copy.tif").string());
+  dem(4,5) = 8;
+  auto moved  = Array2D<float>(dem).saveGDALAsync((dir/"rd_async_move.tif").string());
+  copied.get();
+  moved.get();
+
+  Array2D<float> copy_in((dir/"rd_async_copy.tif").string());
+  Array2D<float> move_in((dir/"rd_async_move.tif").string());
+  CHECK(copy_in(4,5)==7);
+  CHECK(move_in(4,5)==8);
+  CHECK(move_in(0,0)==3);
+
+  CHECK_THROWS(dem.saveGDALAsync((dir/"no_such_directory"/"out.tif").string()).get());
+}
+
+TEST_CASE("Reading a GDAL window in parallel"){
+  const auto filename = (fs::temp_directory_path()/"rd_window.tif").string();
+  Array2D<int16_t> dem(301, 517);
+  dem.setNoData(-9999);
+  dem.geotransform = {{100,2,0,500,0,-2}};
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = i%30000;
+  dem.saveGDAL(filename);
+
+  const GDALWindow window{10, 20, 50, 400};
+  const auto info = getGDALWindowInfo(filename, 1, -1, window);
+  CHECK(info.dtype==GDT_Int16);
+  CHECK(info.has_no_data);
+  CHECK(info.no_data==-9999);
+  CHECK(info.geotransform[0]==120);
+  CHECK(info.geotransform[3]==460);
+
+  //Read as floats to check that GDAL converts while reading
+  std::vector<float> buffer(window.width*window.height);
+  readGDALWindow(filename, 1, -1, window, GDT_Float32, buffer.data(), 4);
+  for(int y=0;y<window.height;y++)
+  for(int x=0;x<window.width;x++)
+    CHECK(buffer[y*window.width+x]==dem(window.xoff+x, window.yoff+y));
+
+  //Reading with the window's description gives the same data
+  std::vector<int16_t> native(window.width*window.height);
+  readGDALWindow(filename, 1, -1, info, info.dtype, native.data(), 4);
+  for(std::size_t i=0;i<native.size();i++)
+    CHECK(native[i]==buffer[i]);
+
+  CHECK_THROWS(getGDALWindowInfo(filename, 1, -1, GDALWindow{300, 0, 2, 1}));
+  CHECK_THROWS(getGDALWindowInfo(filename, 2));
+  CHECK_THROWS(getGDALWindowInfo(filename, 1, 0));
+}
 #endif
 
 TEST_CASE( "Array2D works" ) {
@@ -148,7 +382,466 @@ TEST_CASE("Checking flow accumulation") {
     }
   }
 
+TEST_CASE("Flow accumulation from Priority-Flood order") {
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<float> elev_dist(0, 100);
+  Array2D<float> dem(83, 61);
+  dem.setNoData(-9999);
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = elev_dist(gen);
+  for(int y=20;y<30;y++)
+  for(int x=10;x<40;x++)
+    dem(x,y) = dem.noData();
+
+  Array2D<d8_flowdir_t> fds;
+  std::vector<Array2D<float>::i_t> order;
+  PriorityFloodFlowdirs_Barnes2014(dem, fds, &order);
+  CHECK(order.size()==dem.numDataCells());
+
+  Array2D<int32_t> expected, actual;
+  d8_flow_accum(fds, expected);
+  d8_flow_accum_from_order(fds, order, actual);
+  CHECK(expected==actual);
+
+  Array2D<int32_t> labels;
+  d8_watersheds_from_order(fds, order, labels);
+  for(int y=0;y<dem.height();y++)
+  for(int x=0;x<dem.width();x++){
+    if(dem.isNoData(x,y)){
+      CHECK(labels(x,y)==0);
+      continue;
+    }
+    CHECK(labels(x,y)>0);
+    const int nx = x+d8x[fds(x,y)];
+    const int ny = y+d8y[fds(x,y)];
+    if(dem.inGrid(nx,ny) && !dem.isNoData(nx,ny))
+      CHECK(labels(x,y)==labels(nx,ny));
+  }
+}
+
+TEST_CASE("D8 jump pointers") {
+  std::mt19937 gen(17);
+  std::uniform_real_distribution<float> elev_dist(0, 100);
+  Array2D<float> dem(97, 71);
+  dem.setNoData(-9999);
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = elev_dist(gen);
+  for(int y=30;y<35;y++)
+  for(int x=20;x<60;x++)
+    dem(x,y) = dem.noData();
+
+  Array2D<d8_flowdir_t> fds;
+  PriorityFloodFlowdirs_Barnes2014(dem, fds);
+
+  //Flow path of a cell, found by walking it
+  const auto path_of = [&](uint32_t c){
+    std::vector<uint32_t> path{c};
+    while(!fds.isNoData(c) && fds(c)!=NO_FLOW){
+      const auto [x,y] = fds.iToxy(c);
+      const int nx = x+d8x[fds(c)];
+      const int ny = y+d8y[fds(c)];
+      if(!fds.inGrid(nx,ny) || fds.isNoData(nx,ny))
+        break;
+      c = fds.xyToI(nx,ny);
+      path.push_back(c);
+    }
+    return path;
+  };
+
+  std::uniform_int_distribution<uint32_t> cell_dist(0, dem.size()-1);
+  for(const uint32_t interval: {1u, 5u}){
+    const D8JumpPointers jp(fds, interval);
+    for(int t=0;t<500;t++){
+      const auto a  = cell_dist(gen);
+      const auto b  = cell_dist(gen);
+      const auto pa = path_of(a);
+      const auto pb = path_of(b);
+
+      CHECK(jp.outlet(a)==pa.back());
+      CHECK(jp.depth(a)==pa.size()-1);
+      const auto k = std::uniform_int_distribution<uint32_t>(0, pa.size()+3)(gen);
+      CHECK(jp.ancestor(a,k)==pa.at(std::min<size_t>(k, pa.size()-1)));
+
+      auto expected = D8JumpPointers::NO_CELL;
+      for(const auto c: pb)
+        if(std::find(pa.begin(), pa.end(), c)!=pa.end()){
+          expected = c;
+          break;
+        }
+      CHECK(jp.confluence(a,b)==expected);
+      CHECK(jp.shares_path(a,b)==(expected!=D8JumpPointers::NO_CELL));
+      CHECK(jp.is_downstream(a,b)==(expected==b));
+      CHECK(jp.is_downstream(a,pa.at(pa.size()/2)));
+    }
+  }
+
+  SUBCASE("Loops are detected"){
+    for(const int len: {2, 3}){
+      Array2D<d8_flowdir_t> loop(len, 1, 1);
+      loop(0,0) = 5;
+      CHECK_THROWS_AS(D8JumpPointers(loop, 1), std::runtime_error);
+    }
+  }
+}
+
+TEST_CASE("Stream network extraction") {
+  SUBCASE("Three sources meeting at a confluence"){
+    //Sources at (0,0), (2,0), and (4,0) all reach (2,2), which flows off the
+    //bottom of the grid through (2,3)
+    Array2D<d8_flowdir_t> fds(5, 4, FLOWDIR_NO_DATA);
+    fds.setNoData(FLOWDIR_NO_DATA);
+    fds(0,0) = 6; fds(1,1) = 6;
+    fds(4,0) = 8; fds(3,1) = 8;
+    fds(2,0) = 7; fds(2,1) = 7;
+    fds(2,2) = 7; fds(2,3) = 7;
+
+    Array2D<int32_t> accum;
+    d8_flow_accum(fds, accum);
+
+    Array2D<uint32_t> labels;
+    const auto reaches = ExtractStreamNetwork(fds, accum, 1, &labels);
+    REQUIRE(reaches.size()==4);
+
+    for(int r=0;r<3;r++){
+      CHECK(reaches[r].downstream==3);
+      CHECK(reaches[r].cells==2);
+      CHECK(reaches[r].strahler==1);
+      CHECK(reaches[r].shreve==1);
+      CHECK(reaches[r].upstream_area==2);
+    }
+    CHECK(reaches[0].head==fds.xyToI(0,0));
+    CHECK(reaches[0].tail==fds.xyToI(1,1));
+    CHECK(reaches[0].length==doctest::Approx(2*std::sqrt(2)));
+    CHECK(reaches[1].length==doctest::Approx(2));
+    CHECK(reaches[3].head==fds.xyToI(2,2));
+    CHECK(reaches[3].downstream==StreamReach::NO_REACH);
+    CHECK(reaches[3].length==doctest::Approx(1));
+    CHECK(reaches[3].strahler==2);
+    CHECK(reaches[3].shreve==3);
+    CHECK(reaches[3].upstream_area==8);
+    CHECK(labels(1,1)==0);
+    CHECK(labels(2,3)==3);
+    CHECK(labels(0,3)==StreamReach::NO_REACH);
+
+    std::ostringstream oss;
+    WriteStreamNetwork(oss, reaches, fds);
+    CHECK(oss.str().find("\n3,-1,2,2,2,3,2,1,2,3,8\n")!=std::string::npos);
+
+    //With a geotransform, lengths and areas are in map units
+    fds.geotransform = {{0,10,0,0,0,-10}};
+    const auto mapped = ExtractStreamNetwork(fds, accum, 1);
+    CHECK(mapped[3].length==doctest::Approx(10));
+    CHECK(mapped[3].upstream_area==doctest::Approx(800));
+  }
+
+  SUBCASE("Random terrain"){
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> elev_dist(0, 100);
+    Array2D<float> dem(120, 90);
+    for(auto i=dem.i0();i<dem.size();i++)
+      dem(i) = elev_dist(gen);
+
+    Array2D<d8_flowdir_t> fds;
+    std::vector<Array2D<float>::i_t> order;
+    PriorityFloodFlowdirs_Barnes2014(dem, fds, &order);
+
+    Array2D<uint32_t> area;
+    d8_flow_accum_from_order(fds, order, area);
+
+    Array2D<uint32_t> labels;
+    const auto reaches = ExtractStreamNetworkFromOrder(fds, order, 20, &labels);
+
+    //Every stream cell is in exactly one reach, which can be walked from its
+    //head to its tail
+    uint32_t stream_cells = 0;
+    for(auto i=fds.i0();i<fds.size();i++){
+      stream_cells += area(i)>=20;
+      CHECK((labels(i)!=StreamReach::NO_REACH)==(area(i)>=20));
+    }
+    uint32_t reach_cells = 0;
+    for(size_t r=0;r<reaches.size();r++){
+      const auto &reach = reaches[r];
+      reach_cells += reach.cells;
+      auto c = reach.head;
+      for(uint32_t n=1;n<reach.cells;n++){
+        CHECK(labels(c)==r);
+        c = fds.getN(c, fds(c));
+      }
+      CHECK(c==reach.tail);
+      CHECK(reach.upstream_area==area(c));
+      if(reach.downstream!=StreamReach::NO_REACH){
+        CHECK(reaches[reach.downstream].head==fds.getN(c, fds(c)));
+        CHECK(reaches[reach.downstream].strahler>=reach.strahler);
+        CHECK(reaches[reach.downstream].shreve>reach.shreve);
+      }
+    }
+    CHECK(reach_cells==stream_cells);
+  }
+}
+
+TEST_CASE("Flow accumulation into native types") {
+  std::mt19937 gen(13);
+  std::uniform_int_distribution<int16_t> elev_dist(0, 1000);
+  Array2D<int16_t> dem(47, 39);
+  dem.setNoData(-9999);
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = elev_dist(gen);
+
+  Array2D<double>   as_double(dem, 1);
+  Array2D<float>    as_float (dem, 1);
+  Array2D<uint32_t> as_uint  (dem, 1);
+  FA_D8(dem, as_double);
+  FA_D8(dem, as_float);
+  FA_D8(dem, as_uint);
+  for(auto i=dem.i0();i<dem.size();i++){
+    if(as_double.isNoData(i))
+      continue;
+    CHECK(as_float(i)==doctest::Approx(as_double(i)));
+    CHECK(as_uint(i)==(uint32_t)as_double(i));
+  }
+}
+
+
+
+TEST_CASE("Orlandini and Seibert flow proportions") {
+  std::mt19937 gen(17);
+  std::uniform_real_distribution<float> elev_dist(0, 100);
+  Array2D<float> dem(41, 37);
+  dem.setNoData(-9999);
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = (i%53==0) ? dem.noData() : elev_dist(gen);
+
+  Array3D<float> props(dem);
+  const auto check_props = [&](const bool single_direction){
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++){
+      if(dem.isNoData(x,y)){
+        CHECK(props(x,y,0)==NO_DATA_GEN);
+        continue;
+      }
+      if(props(x,y,0)!=HAS_FLOW_GEN)
+        continue;
+      double total = 0;
+      int receivers = 0;
+      for(int n=1;n<=8;n++){
+        if(props(x,y,n)<=0)
+          continue;
+        CHECK(dem(x+d8x[n],y+d8y[n])<dem(x,y)); //Flow goes downhill
+        total += props(x,y,n);
+        receivers++;
+      }
+      CHECK(total==doctest::Approx(1));
+      if(single_direction)
+        CHECK(receivers==1);
+    }
+  };
+
+  FM_Seibert(dem, props, 1.0);
+  check_props(false);
+  FM_Orlandini(dem, props, OrlandiniMode::LTD, 1.0);
+  check_props(true);
+  FM_Orlandini(dem, props, OrlandiniMode::LAD, 1.0);
+  check_props(true);
+
+  //On a plane sloping between east and south-east D8 sends all flow
+  //south-east, while the path-based methods alternate between the two
+  Array2D<float> plane(30, 30);
+  for(int y=0;y<plane.height();y++)
+  for(int x=0;x<plane.width();x++)
+    plane(x,y) = 1000-2*x-y;
+  for(const auto mode: {OrlandiniMode::LTD, OrlandiniMode::LAD}){
+    FM_Orlandini(plane, props, mode, 1.0);
+    int east = 0;
+    int south_east = 0;
+    for(int y=1;y<plane.height()-1;y++)
+    for(int x=1;x<plane.width()-1;x++){
+      east       += props(x,y,D8_EAST)==1;
+      south_east += props(x,y,D8_EAST+1)==1;
+    }
+    CHECK(east+south_east==(plane.width()-2)*(plane.height()-2));
+    CHECK(east>0);
+    CHECK(south_east>0);
+  }
 
+  CHECK_THROWS(FM_Orlandini(plane, props, OrlandiniMode::LTD, 2.0));
+}
+
+
+TEST_CASE("NoData-free fast paths") {
+  //Rounding produces flats
+  auto dem = generate_perlin_terrain(120, 2718);
+  for(auto i=dem.i0();i<dem.size();i++)
+    dem(i) = std::round(dem(i)/4);
+  dem.geotransform = {{0,1,0,0,0,-1}};
+  CHECK(!dem.hasNoData());
+
+  //Scatter NoData so that every tile is processed with NoData checks
+  auto holed = dem;
+  holed.setNoData(-9999);
+  for(int y=3;y<holed.height();y+=7)
+  for(int x=3;x<holed.width();x+=7)
+    holed(x,y) = holed.noData();
+  CHECK(holed.hasNoData());
+
+  //Cells away from NoData and the edge must agree between the two rasters
+  const auto comparable = [&](const int x, const int y){
+    return NeighbourhoodIsData(holed, x, y, x+1, y+1);
+  };
+
+  SUBCASE("Checks skipped only away from NoData"){
+    //A lone NoData cell on a tile's corner must be seen by the tiles around it
+    ParallelOptions opts;
+    opts.tile_width  = 16;
+    opts.tile_height = 16;
+    auto lone = dem;
+    lone.setNoData(-9999);
+    lone(48,32) = lone.noData();
+    Array2D<int8_t> checked(lone.width(), lone.height(), -1);
+    ParallelForCellsWithNoDataCheck(lone, [&](const int x, const int y, const auto check){
+      checked(x,y) = decltype(check)::value;
+    }, opts);
+    int fast_cells = 0;
+    for(int y=0;y<lone.height();y++)
+    for(int x=0;x<lone.width();x++){
+      CHECK(checked(x,y)!=-1);
+      if(checked(x,y)==0){
+        CHECK(!lone.isEdgeCell(x,y));
+        CHECK(NeighbourhoodIsData(lone, x, y, x+1, y+1));
+        fast_cells++;
+      }
+    }
+    CHECK(fast_cells>0);
+    CHECK(checked(47,31)==1);
+    CHECK(checked(49,33)==1);
+  }
+
+  SUBCASE("Flow metrics"){
+    Array3D<float> fast(dem), slow(holed);
+    const auto compare = [&](){
+      for(int y=0;y<dem.height();y++)
+      for(int x=0;x<dem.width();x++)
+      for(int n=0;n<=8;n++)
+        if(comparable(x,y))
+          CHECK(fast(x,y,n)==slow(x,y,n));
+    };
+    FM_D8(dem, fast);           FM_D8(holed, slow);           compare();
+    FM_Rho8(dem, fast);         FM_Rho8(holed, slow);         compare();
+    FM_Freeman(dem, fast, 1.1); FM_Freeman(holed, slow, 1.1); compare();
+    FM_Quinn(dem, fast);        FM_Quinn(holed, slow);        compare();
+    FM_Tarboton(dem, fast);     FM_Tarboton(holed, slow);     compare();
+    FM_Seibert(dem, fast, 1.0); FM_Seibert(holed, slow, 1.0); compare();
+  }
+
+  SUBCASE("Terrain attributes and flats"){
+    const auto compare = [&](const Array2D<float> &fast, const Array2D<float> &slow){
+      for(int y=0;y<dem.height();y++)
+      for(int x=0;x<dem.width();x++)
+        if(comparable(x,y))
+          CHECK(fast(x,y)==slow(x,y));
+    };
+    Array2D<float> fast, slow;
+    TA_slope_riserun(dem, fast);       TA_slope_riserun(holed, slow);       compare(fast, slow);
+    TA_aspect(dem, fast);              TA_aspect(holed, slow);              compare(fast, slow);
+    TA_profile_curvature(dem, fast);   TA_profile_curvature(holed, slow);   compare(fast, slow);
+
+    Array2D<int8_t> fast_flats, slow_flats;
+    FindFlats(dem, fast_flats);
+    FindFlats(holed, slow_flats);
+    int flats = 0;
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      if(comparable(x,y)){
+        CHECK(fast_flats(x,y)==slow_flats(x,y));
+        flats += fast_flats(x,y)==IS_A_FLAT;
+      }
+    CHECK(flats>0);
+  }
+
+  SUBCASE("Complete breaching"){
+    //Surrounding the DEM by NoData makes its edge cells into cells next to
+    //NoData, so the checked and unchecked versions must breach identically
+    Array2D<double> padded(dem.width()+2, dem.height()+2, -9999);
+    padded.setNoData(-9999);
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      padded(x+1,y+1) = dem(x,y);
+    CompleteBreaching_Lindsay2016<Topology::D8>(dem);
+    CompleteBreaching_Lindsay2016<Topology::D8>(padded);
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      CHECK(dem(x,y)==padded(x+1,y+1));
+  }
+}
+
+
+
+TEST_CASE("Batch processing of small rasters") {
+  const int count = 7;
+  const int size  = 40;
+
+  //A stack of chips held in one block of memory, as from a NumPy array
+  std::vector<double> stack;
+  for(int c=0;c<count;c++){
+    const auto chip = generate_perlin_terrain(size, 100+c);
+    stack.insert(stack.end(), chip.data(), chip.data()+chip.size());
+  }
+  const auto original = stack;
+  std::vector<Array2D<double>> dems;
+  for(int c=0;c<count;c++){
+    dems.emplace_back(stack.data()+c*size*size, size, size);
+    dems.back().geotransform = {{0,1,0,0,0,-1}};
+  }
+
+  const std::vector<BatchStep> pipeline = {
+    {BatchOpFromName("fill")},
+    {BatchOpFromName("d8_flowdirs")},
+    {BatchOpFromName("d8_accumulation")},
+    {BatchOpFromName("slope_degrees"), 2.0f},
+    {BatchOpFromName("aspect")}
+  };
+
+  std::vector<Array2D<double>>       filled(count);
+  std::vector<Array2D<d8_flowdir_t>> flowdirs(count);
+  std::vector<Array2D<float>>        accum(count), slope(count), aspect(count);
+  ProcessBatch(dems, pipeline, [&](const std::size_t c, const std::size_t s, const auto &result){
+    using result_t = raster_value_t<std::decay_t<decltype(result)>>;
+    if constexpr(std::is_same<result_t,double>::value){
+      filled[c] = result;
+    } else if constexpr(std::is_same<result_t,d8_flowdir_t>::value){
+      flowdirs[c] = result;
+    } else {
+      (s==2 ? accum : s==3 ? slope : aspect)[c] = result;
+    }
+  }, ParallelOptions{256, 16, 3});
+
+  //The nesting limit set for the batch is restored
+  CHECK(GetParallelism().max_active_levels==0);
+  CHECK(stack==original);
+  for(int c=0;c<count;c++){
+    auto expected = dems[c];
+    PriorityFlood_Zhou2016(expected);
+    CHECK(filled[c]==expected);
+
+    Array2D<d8_flowdir_t> expected_flowdirs;
+    std::vector<Array2D<double>::i_t> order;
+    PriorityFloodFlowdirs_Barnes2014(expected, expected_flowdirs, &order);
+    CHECK(flowdirs[c]==expected_flowdirs);
+
+    Array2D<float> expected_values;
+    d8_flow_accum_from_order(expected_flowdirs, order, expected_values);
+    CHECK(accum[c]==expected_values);
+    TA_slope_degrees(expected, expected_values, 2.0f);
+    CHECK(slope[c]==expected_values);
+    TA_aspect(expected, expected_values);
+    CHECK(aspect[c]==expected_values);
+  }
+
+  SUBCASE("Bad pipelines"){
+    CHECK_THROWS(BatchOpFromName("no_such_operation"));
+    std::vector<Array2D<int32_t>> int_dems(2, Array2D<int32_t>(size, size, 1));
+    CHECK_THROWS(ProcessBatch(int_dems, {{BatchOp::FillDepressionsEpsilon}}, [](auto...){}));
+  }
+}
 
 
 
@@ -357,6 +1050,63 @@ TEST_CASE("Checking depression breaching") {
 }
 
 
+TEST_CASE("Least-cost breaching") {
+  const auto count_pits = [](const Array2D<double> &dem){
+    int pits = 0;
+    for(int y=1;y<dem.height()-1;y++)
+    for(int x=1;x<dem.width()-1;x++){
+      bool has_lower = false;
+      for(int n=1;n<=8;n++)
+        has_lower |= dem(x+d8x[n],y+d8y[n])<dem(x,y);
+      pits += !has_lower;
+    }
+    return pits;
+  };
+
+  SUBCASE("A dam is cut through rather than going around it"){
+    //A valley draining west, dammed by a wall one cell thick
+    Array2D<double> dem(9, 5, 10);
+    for(int x=1;x<8;x++)
+      dem(x,2) = x;
+    dem(4,2) = 6;
+    LeastCostBreaching_Lindsay2016<Topology::D8>(dem, 4, std::numeric_limits<double>::infinity(), true, false);
+    CHECK(dem(4,2)<dem(5,2));
+    CHECK(dem(4,2)>dem(3,2));
+    CHECK(dem(3,1)==10);
+    CHECK(count_pits(dem)==0);
+  }
+
+  SUBCASE("Random terrain"){
+    auto original = generate_perlin_terrain(150, 321);
+    original.setNoData(-9999);
+    REQUIRE(count_pits(original)>0);
+
+    auto breached = original;
+    LeastCostBreaching_Lindsay2016<Topology::D8>(breached, 150);
+    CHECK(count_pits(breached)==0);
+    for(auto i=original.i0();i<original.size();i++)
+      CHECK(breached(i)<=original(i));
+
+    //Pits are assigned to tiles, not threads, so the result does not depend
+    //on the thread count
+    ParallelOptions one_thread, four_threads;
+    one_thread.threads   = 1;
+    four_threads.threads = 4;
+    auto serial   = original;
+    auto parallel = original;
+    LeastCostBreaching_Lindsay2016<Topology::D8>(serial,   20, std::numeric_limits<double>::infinity(), true, false, one_thread);
+    LeastCostBreaching_Lindsay2016<Topology::D8>(parallel, 20, std::numeric_limits<double>::infinity(), true, false, four_threads);
+    CHECK(serial==parallel);
+
+    //Pits which cannot be drained nearby are filled
+    auto hybrid = original;
+    LeastCostBreaching_Lindsay2016<Topology::D8>(hybrid, 3, 0.05, true, true);
+    CHECK(count_pits(hybrid)==0);
+  }
+}
+
+
+
 TEST_CASE("Checking flow accumulation") {
   Array2D<float> beauford("beauford/beauford.tif");
   PriorityFlood_Wei2018(beauford);
@@ -508,6 +1258,130 @@ TEST_CASE("flow_accumulation_from_d8"){
   }
 }
 
+TEST_CASE("SparseArray2D"){
+  //An island surrounded by NoData
+  auto dem = generate_perlin_terrain(300, 123456);
+  dem.setNoData(-9999);
+  for(int y=0;y<dem.height();y++)
+  for(int x=0;x<dem.width();x++)
+    if((x-150)*(x-150)+(y-140)*(y-140)>90*90)
+      dem(x,y) = dem.noData();
+
+  SparseArray2D<double> sparse(dem, 5);
+
+  SUBCASE("Round trip"){
+    CHECK(sparse.toArray2D()==dem);
+    CHECK(sparse.numAllocatedBlocks()<(std::size_t)(sparse.widthInBlocks()*sparse.heightInBlocks()));
+    CHECK(sparse.blockIsNoData(0,0));
+
+    sparse.set(0,0,3);
+    CHECK(!sparse.blockIsConstant(0,0));
+    CHECK(sparse(0,0)==3);
+    sparse.set(0,0,sparse.noData());
+    sparse.compact();
+    CHECK(sparse.blockIsNoData(0,0));
+  }
+
+  SUBCASE("Priority-Flood"){
+    PriorityFlood_Barnes2014<Topology::D8>(dem);
+    PriorityFlood_Barnes2014<Topology::D8>(sparse);
+    CHECK(sparse.toArray2D()==dem);
+  }
+
+  SUBCASE("Flow accumulation"){
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> dir_dist(0, 8);
+    Array2D<int> d8s(dem, 0);
+    d8s.setNoData(-1);
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      d8s(x,y) = dem.isNoData(x,y) ? d8s.noData() : dir_dist(gen);
+
+    const auto dense_accum  = flow_accumulation_from_d8(d8s);
+    const auto sparse_accum = flow_accumulation_from_d8(SparseArray2D<int>(d8s)).toArray2D();
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      if(d8s.isNoData(x,y))
+        CHECK(sparse_accum.isNoData(x,y));
+      else
+        CHECK(sparse_accum(x,y)==dense_accum(x,y));
+  }
+}
+
+TEST_CASE("Generic rasters"){
+  static_assert(is_raster_v<Array2D<float>>);
+  static_assert(is_raster_v<const Array2D<float>>);
+  static_assert(is_writable_raster_v<Array2D<float>>);
+  static_assert(!is_writable_raster_v<const Array2D<float>>);
+  static_assert(is_writable_raster_v<SparseArray2D<float>>);
+  static_assert(is_writable_raster_v<RasterView<Array2D<float>>>);
+  static_assert(!is_writable_raster_v<RasterView<const Array2D<float>>>);
+  static_assert(!is_raster_v<std::vector<float>>);
+
+  auto dem = generate_perlin_terrain(200, 4321);
+  dem.setNoData(-9999);
+  for(int y=50;y<60;y++)
+  for(int x=70;x<90;x++)
+    dem(x,y) = dem.noData();
+
+  //A window of the DEM, copied into a DEM of its own
+  const int x0 = 17;
+  const int y0 = 31;
+  Array2D<double> window(120, 95);
+  window.setNoData(dem.noData());
+  for(int y=0;y<window.height();y++)
+  for(int x=0;x<window.width();x++)
+    window(x,y) = dem(x0+x,y0+y);
+
+  SUBCASE("Views of windows"){
+    const auto original = dem;
+    RasterView<Array2D<double>> view(dem, x0, y0, window.width(), window.height());
+    PriorityFlood_Barnes2014<Topology::D8>(window);
+    PriorityFlood_Barnes2014<Topology::D8>(view);
+    for(int y=0;y<dem.height();y++)
+    for(int x=0;x<dem.width();x++)
+      if(view.inGrid(x-x0,y-y0))
+        CHECK(dem(x,y)==window(x-x0,y-y0));
+      else
+        CHECK(dem(x,y)==original(x,y));
+
+    Array2D<d8_flowdir_t> expected_fds;
+    d8_flow_directions(window, expected_fds);
+    Array2D<d8_flowdir_t> fds(window.width(), window.height(), 0);
+    fds.setNoData(FLOWDIR_NO_DATA);
+    d8_flow_directions(view, fds);
+    CHECK(fds==expected_fds);
+
+    Array2D<uint32_t> expected_area;
+    d8_flow_accum(expected_fds, expected_area);
+    Array2D<uint32_t> area(dem.width(), dem.height(), 0);
+    area.setNoData(expected_area.noData());
+    const RasterView<const Array2D<d8_flowdir_t>> fds_view(fds);
+    RasterView<Array2D<uint32_t>> area_view(area, x0, y0, window.width(), window.height());
+    d8_flow_accum(fds_view, area_view);
+    for(int y=0;y<window.height();y++)
+    for(int x=0;x<window.width();x++)
+      CHECK(area_view(x,y)==expected_area(x,y));
+  }
+
+  SUBCASE("Block-sparse rasters"){
+    SparseArray2D<double> sparse(window, 4);
+    SparseArray2D<d8_flowdir_t> sparse_fds(sparse, 0);
+    sparse_fds.setNoData(FLOWDIR_NO_DATA);
+    Array2D<d8_flowdir_t> expected_fds;
+    d8_flow_directions(window, expected_fds);
+    d8_flow_directions(sparse, sparse_fds);
+    CHECK(sparse_fds.toArray2D()==expected_fds);
+  }
+
+  SUBCASE("Mismatched dimensions"){
+    Array2D<d8_flowdir_t> fds(window.width()-1, window.height(), 0);
+    RasterView<Array2D<double>> view(window);
+    CHECK_THROWS_AS(d8_flow_directions(view, fds), std::runtime_error);
+    CHECK_THROWS_AS(RasterView<Array2D<double>>(window, 1, 0, window.width(), window.height()), std::runtime_error);
+  }
+}
+
 #ifdef RICHDEM_USE_BOOST_SERIALIZATION
 TEST_CASE("Array2D serialization"){
   auto original = generate_perlin_terrain(30, 123456);
@@ -541,3 +1415,135 @@ TEST_CASE("Array2D serialization"){
   CHECK(original.metadata == recovered.metadata);
 }
 #endif
+
+#ifdef USEGDAL
+TEST_CASE("A2Array2D Cursor"){
+  const auto prefix = (fs::temp_directory_path() / "a2array2d_cursor_test_").string();
+  A2Array2D<int> arr(prefix, 4, 3, 5, 4, 2);
+  arr.setAll(0);
+
+  {
+    auto cur = arr.cursor();
+    for(int y=0;y<arr.height();y++)
+    for(int x=0;x<arr.width();x++)
+      cur(x,y) = y*arr.width()+x;
+
+    for(int y=1;y<arr.height()-1;y++)
+    for(int x=1;x<arr.width()-1;x++)
+    for(int n=1;n<=8;n++)
+      CHECK(cur(x+d8x[n],y+d8y[n])==(y+d8y[n])*arr.width()+x+d8x[n]);
+  }
+
+  for(int y=0;y<arr.height();y++)
+  for(int x=0;x<arr.width();x++)
+    CHECK(arr(x,y)==y*arr.width()+x);
+
+  CHECK(arr.getEvictions()>0);
+}
+
+TEST_CASE("Algorithms on A2Array2D"){
+  const auto prefix = (fs::temp_directory_path() / "a2array2d_generic_test_").string();
+  auto dem = generate_perlin_terrain(60, 2468);
+  A2Array2D<double> arr(prefix, 15, 20, 4, 3, 3);
+  arr.setAll(0);
+  arr.setNoData(dem.noData());
+  for(int y=0;y<dem.height();y++)
+  for(int x=0;x<dem.width();x++)
+    arr.set(x,y,dem(x,y));
+
+  PriorityFlood_Barnes2014<Topology::D8>(dem);
+  PriorityFlood_Barnes2014<Topology::D8>(arr);
+  for(int y=0;y<dem.height();y++)
+  for(int x=0;x<dem.width();x++)
+    CHECK(arr(x,y)==dem(x,y));
+
+  Array2D<d8_flowdir_t> expected_fds;
+  d8_flow_directions(dem, expected_fds);
+  Array2D<d8_flowdir_t> fds(dem.width(), dem.height(), 0);
+  fds.setNoData(FLOWDIR_NO_DATA);
+  d8_flow_directions(arr, fds);
+  CHECK(fds==expected_fds);
+
+  CHECK(arr.getEvictions()>0);
+}
+
+TEST_CASE("Algorithms on a layout-loaded A2Array2D"){
+  //A 4x3 layout of 15x20 tiles read through a cache of 3 tiles
+  const auto dir = fs::temp_directory_path();
+  auto dem = generate_perlin_terrain(60, 1357);
+  {
+    LayoutfileWriter lfout((dir/"a2array2d_layout_test.layout").string());
+    for(int ty=0;ty<3;ty++){
+      lfout.addRow();
+      for(int tx=0;tx<4;tx++){
+        Array2D<double> tile(15, 20);
+        tile.setNoData(dem.noData());
+        tile.geotransform = {{15.0*tx, 1, 0, -20.0*ty, 0, -1}};
+        for(int y=0;y<20;y++)
+        for(int x=0;x<15;x++)
+          tile(x,y) = dem(15*tx+x, 20*ty+y);
+        const auto tile_name = (dir/("a2array2d_layout_test_"+std::to_string(tx)+"_"+std::to_string(ty)+".tif")).string();
+        tile.saveGDAL(tile_name);
+        lfout.addEntry(tile_name);
+      }
+    }
+  }
+
+  CHECK(peekLayoutType((dir/"a2array2d_layout_test.layout").string())==GDT_Float64);
+  CHECK(peekLayoutTileSize((dir/"a2array2d_layout_test.layout").string())==15*20);
+
+  A2Array2D<double> arr((dir/"a2array2d_layout_test.layout").string(), 3);
+  REQUIRE(arr.width()==60);
+  REQUIRE(arr.height()==60);
+  CHECK(arr.isReadonly());
+
+  //Reads are served across evictions
+  Array2D<d8_flowdir_t> expected_fds, fds(dem.width(), dem.height(), 0);
+  fds.setNoData(FLOWDIR_NO_DATA);
+  d8_flow_directions(dem, expected_fds);
+  d8_flow_directions(arr, fds);
+  CHECK(fds==expected_fds);
+  CHECK(arr.getEvictions()>0);
+
+  //Writes would be dropped on eviction, so they are refused
+  CHECK_THROWS(arr.set(0, 0, 1.0));
+  CHECK_THROWS(PriorityFlood_Barnes2014<Topology::D8>(arr));
+  for(int y=0;y<dem.height();y++)
+  for(int x=0;x<dem.width();x++)
+    CHECK(arr(x,y)==dem(x,y));
+}
+#endif
+
+#ifdef USEGDAL
+TEST_CASE("Tile index round trip"){
+  const auto index_filename = (fs::temp_directory_path() / "tile_index_test.rdindex").string();
+
+  TileHeader th;
+  th.filename     = "path/to/tile.tif";
+  th.basename     = "tile";
+  th.mtime        = 1234;
+  th.width        = 30;
+  th.height       = 40;
+  th.dtype        = GDT_Float32;
+  th.no_data      = -9999;
+  th.geotransform = {1,2,3,4,5,6};
+  th.projection   = "random_projection";
+  th.metadata     = {{"entry", "value"}};
+
+  SaveTileIndex(index_filename, {th});
+  const auto index = LoadTileIndex(index_filename);
+
+  REQUIRE(index.count(th.filename)==1);
+  const auto &got = index.at(th.filename);
+  CHECK(got.mtime==th.mtime);
+  CHECK(got.width==th.width);
+  CHECK(got.height==th.height);
+  CHECK(got.dtype==th.dtype);
+  CHECK(got.no_data==th.no_data);
+  CHECK(got.geotransform==th.geotransform);
+  CHECK(got.projection==th.projection);
+  CHECK(got.metadata==th.metadata);
+
+  CHECK(LoadTileIndex(index_filename+".does_not_exist").empty());
+}
+#endif
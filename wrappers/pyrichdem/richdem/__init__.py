@@ -1,7 +1,9 @@
+import contextlib
 import copy
 import datetime
 import pkg_resources
-from typing import Any, Dict, Final, List, Iterable, Optional, Tuple, Union
+import warnings
+from typing import Any, Dict, Final, Iterator, List, Iterable, Optional, Tuple, Union
 
 import numpy as np
 
@@ -24,6 +26,13 @@ except ModuleNotFoundError:
     except Exception:
         GDAL_AVAILABLE = False
 
+# True if RichDEM's engine was built with GDAL and can load rasters itself
+NATIVE_GDAL_AVAILABLE: Final[bool] = hasattr(_richdem, "load_gdal")
+GDAL_AVAILABLE = GDAL_AVAILABLE or NATIVE_GDAL_AVAILABLE
+
+# True if RichDEM's engine was built with OpenMP and can use more than one thread
+OPENMP_AVAILABLE: Final[bool] = _richdem.OpenMPEnabled()
+
 STANDARD_GEOTRANSFORM: Final[np.ndarray] = np.array([0, 1, 0, 0, 0, -1])
 
 msg_error_no_data: Final[str] = "The source data did not have a NoData value. Please use the no_data argument to specify one. If should not be equal to any of the actual data values. If you are using all possible data values, then the situation is pretty hopeless - sorry."
@@ -357,11 +366,37 @@ def load_gdal_using_gdal(filename: str, no_data: Optional[float] = None) -> rdar
     return srcdata
 
 
-def LoadGDAL(filename: str, no_data: Optional[float] = None) -> rdarray:
+def load_gdal_using_richdem(filename: str, no_data: Optional[float] = None, band: int = 1, window: Optional[Tuple[int, int, int, int]] = None, overview: Optional[int] = None) -> rdarray:
+    data, file_no_data, geotransform, projection, metadata = _richdem.load_gdal(
+        filename,
+        band=band,
+        overview=-1 if overview is None else overview,
+        window=(0, 0, 0, 0) if window is None else tuple(window),
+    )
+
+    if no_data is None:
+        no_data = file_no_data
+        if no_data is None:
+            raise Exception(msg_error_no_data)
+
+    srcdata = rdarray(data, no_data=no_data)
+    srcdata.projection = projection
+    srcdata.geotransform = geotransform if len(geotransform) == 6 else None
+    srcdata.metadata = dict(metadata)
+
+    return srcdata
+
+
+def LoadGDAL(filename: str, no_data: Optional[float] = None, band: int = 1, window: Optional[Tuple[int, int, int, int]] = None, overview: Optional[int] = None) -> rdarray:
     """Read a GDAL file.
 
-    Opens any file GDAL can read, selects the first raster band, and loads it
-    and its metadata into a RichDEM array of the appropriate data type.
+    Opens any file GDAL can read, selects a raster band, and loads it and its
+    metadata into a RichDEM array of the appropriate data type.
+
+    If RichDEM was built with GDAL, the raster is read by RichDEM itself: the
+    array is allocated once and filled by several threads reading blocks of the
+    file directly into it. Otherwise, rasterio or GDAL's Python bindings are
+    used, which copy the data; these can only read whole first bands.
 
     If you need to do something more complicated, look at the source of this
     function.
@@ -369,6 +404,13 @@ def LoadGDAL(filename: str, no_data: Optional[float] = None) -> rdarray:
     Args:
         filename (str):    Name of the raster file to open
         no_data  (float):  Optionally, set the no_data value to this.
+        band     (int):    Band to read, counting from 1
+        window   (tuple):  Optionally, read only the cells (xoff, yoff, width,
+                           height). A width or height of 0 extends the window
+                           to the edge of the raster.
+        overview (int):    Optionally, read this overview, counting from 0,
+                           rather than the full-resolution raster. The window
+                           is given in the overview's cells.
 
     Returns:
         A RichDEM array
@@ -376,6 +418,16 @@ def LoadGDAL(filename: str, no_data: Optional[float] = None) -> rdarray:
     if not GDAL_AVAILABLE:
         raise Exception("richdem.LoadGDAL() requires GDAL.")
 
+    if NATIVE_GDAL_AVAILABLE:
+        srcdata = load_gdal_using_richdem(filename=filename, no_data=no_data, band=band, window=window, overview=overview)
+        _AddAnalysis(
+            srcdata, f"LoadGDAL(filename={filename}, no_data={no_data}, band={band}, window={window}, overview={overview})"
+        )
+        return srcdata
+
+    if band != 1 or window is not None or overview is not None:
+        raise Exception("Reading bands, windows, or overviews requires RichDEM to be built with GDAL.")
+
     try:
         srcdata = load_gdal_using_rasterio(filename=filename, no_data=no_data)
     except NameError:
@@ -447,6 +499,58 @@ def SaveGDAL(filename: str, rda: rdarray) -> None:
         save_gdal_using_gdal(filename, rda)
 
 
+@contextlib.contextmanager
+def parallelism(threads: Optional[int] = None, binding: Optional[str] = None, nested: Optional[bool] = None) -> Iterator[None]:
+    """Limits the parallelism of RichDEM calls made inside a `with` block.
+
+    The settings apply only to the Python thread which enters the block, so
+    workers in a thread pool may each run RichDEM with their own limits without
+    oversubscribing the machine. If RichDEM was built without OpenMP it always
+    uses one thread, so a warning is given and the settings have no effect.
+
+    Args:
+        threads:  Maximum number of threads to use. None keeps the current setting.
+        binding:  How threads are placed on processors: "close", "spread", or
+                    "default". None keeps the current setting.
+        nested:   Whether RichDEM's parallel regions may spawn threads if
+                    RichDEM is called from a parallel region. None keeps the
+                    current setting.
+
+    Example:
+        >>> with rd.parallelism(threads=2):
+        ...     rd.FillDepressions(dem, in_place=True)
+    """
+    bindings = {
+        "default": _richdem.ThreadBinding.Default,
+        "close": _richdem.ThreadBinding.Close,
+        "spread": _richdem.ThreadBinding.Spread,
+    }
+
+    if threads is not None and threads < 1:
+        raise Exception("threads must be a positive integer!")
+    if binding is not None and binding not in bindings:
+        raise Exception("Unknown binding! Use one of: " + ", ".join(bindings))
+
+    if not OPENMP_AVAILABLE:
+        warnings.warn("RichDEM was compiled without OpenMP, so it uses one thread and rd.parallelism() has no effect.")
+
+    previous = _richdem.GetParallelism()
+    config = _richdem.GetParallelism()
+    if threads is not None:
+        config.threads = threads
+    if binding is not None:
+        config.binding = bindings[binding]
+    if nested is not None:
+        # OpenMP lowers requests for more levels than it supports to the most it supports
+        config.max_active_levels = 2**31 - 1 if nested else 1
+
+    _richdem.SetParallelism(config)
+    try:
+        yield
+    finally:
+        _richdem.SetParallelism(previous)
+
+
 def FillDepressions(dem: rdarray, epsilon: bool = False, in_place: bool = False, topology: str = "D8") -> Optional[rdarray]:
     """Fills all depressions in a DEM.
 
@@ -491,14 +595,32 @@ def FillDepressions(dem: rdarray, epsilon: bool = False, in_place: bool = False,
         return dem
 
 
-def BreachDepressions(dem: rdarray, in_place: bool = False, topology: str = "D8") -> Optional[rdarray]:
+def BreachDepressions(
+    dem: rdarray,
+    in_place: bool = False,
+    topology: str = "D8",
+    method: str = "complete",
+    max_dist: int = 100,
+    max_cost: float = float("inf"),
+    fill: bool = False,
+) -> Optional[rdarray]:
     """Breaches all depressions in a DEM.
 
     Args:
-        dem     (rdarray): An elevation model
-        in_place (bool):   If True, the DEM is modified in place and there is
-                           no return; otherwise, a new, altered DEM is returned.
-        topology (string): A topology indicator
+        dem      (rdarray): An elevation model
+        in_place (bool):    If True, the DEM is modified in place and there is
+                            no return; otherwise, a new, altered DEM is returned.
+        topology (string):  A topology indicator
+        method   (string):  "complete" carves each depression's Priority-Flood
+                            path to its outlet. "least_cost" carves, for each
+                            pit, the path which lowers the DEM least, searching
+                            no further than `max_dist` cells and in parallel.
+        max_dist (int):     least_cost only. How far, in cells, a breach path
+                            may extend from its pit.
+        max_cost (float):   least_cost only. The most a breach path may lower
+                            the DEM in total.
+        fill     (bool):    least_cost only. If True, depressions which could
+                            not be breached are filled.
 
     Returns:
         DEM without depressions.
@@ -509,14 +631,28 @@ def BreachDepressions(dem: rdarray, in_place: bool = False, topology: str = "D8"
     if topology not in ["D8", "D4"]:
         raise Exception("Unknown topology!")
 
+    if method not in ["complete", "least_cost"]:
+        raise Exception("Unknown breaching method!")
+
     if not in_place:
         dem = dem.copy()
 
-    _AddAnalysis(dem, "BreachDepressions(dem)")
+    if method == "complete":
+        _AddAnalysis(dem, "BreachDepressions(dem)")
+    else:
+        _AddAnalysis(
+            dem,
+            f"BreachDepressions(dem, method={method}, max_dist={max_dist}, max_cost={max_cost}, fill={fill})",
+        )
 
     demw = dem.wrap()
 
-    if topology == "D8":
+    if method == "least_cost":
+        if topology == "D8":
+            _richdem.rdBreachDepressionsLeastCostD8(demw, max_dist, max_cost, fill)
+        elif topology == "D4":
+            _richdem.rdBreachDepressionsLeastCostD4(demw, max_dist, max_cost, fill)
+    elif topology == "D8":
         _richdem.rdBreachDepressionsD8(demw)
     elif topology == "D4":
         _richdem.rdBreachDepressionsD4(demw)
@@ -556,7 +692,55 @@ def ResolveFlats(dem: rdarray, in_place: bool = False) -> Optional[rdarray]:
         return dem
 
 
-def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optional[float] = None, weights: Optional[rdarray] = None, in_place: bool = False) -> rdarray:
+ACCUMULATOR_DTYPES: Final[Tuple[str, ...]] = ("float32", "float64", "uint32")
+
+# Methods which send all of a cell's flow to a single neighbour and can
+# therefore accumulate into integers
+SINGLE_DIRECTION_METHODS: Final[Tuple[str, ...]] = (
+    "FairfieldLeymarieD8",
+    "FairfieldLeymarieD4",
+    "Rho8",
+    "Rho4",
+    "OCallaghanD8",
+    "OCallaghanD4",
+    "D8",
+    "D4",
+    "OrlandiniLTD",
+    "OrlandiniLAD",
+)
+
+
+def _accumulator(template: np.ndarray, shape: Tuple[int, ...], weights: Optional[rdarray], in_place: bool, dtype: Optional[str]) -> rdarray:
+    """Creates the array flow is accumulated into without changing its type.
+
+    The accumulator has the type `dtype`, if given; otherwise that of `weights`,
+    if given; otherwise float64. Weights are only copied if `in_place` is
+    False or they need to be converted to `dtype`.
+    """
+    if dtype is None:
+        dtype = str(weights.dtype) if weights is not None else "float64"
+    dtype = str(np.dtype(dtype))
+    if dtype not in ACCUMULATOR_DTYPES:
+        raise Exception(
+            f"Accumulation array must be one of {', '.join(ACCUMULATOR_DTYPES)}, not '{dtype}'!"
+        )
+    no_data = np.iinfo(dtype).max if dtype == "uint32" else -1
+
+    if weights is not None and in_place:
+        if str(weights.dtype) != dtype:
+            raise Exception(
+                f"Weights of type '{weights.dtype}' cannot be accumulated in place as '{dtype}'!"
+            )
+        accum = rdarray(weights, no_data=no_data)
+    elif weights is not None:
+        accum = rdarray(np.array(weights, dtype=dtype), meta_obj=template, no_data=no_data)
+    else:
+        accum = rdarray(np.ones(shape=shape, dtype=dtype), meta_obj=template, no_data=no_data)
+
+    return accum
+
+
+def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optional[float] = None, weights: Optional[rdarray] = None, in_place: bool = False, dtype: Optional[str] = None) -> rdarray:
     """Calculates flow accumulation. A variety of methods are available.
 
     Args:
@@ -572,6 +756,11 @@ def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optio
                             accumulation matrix is always returned, but it will
                             just be a view of the modified data if `in_place`
                             is True.
+        dtype    (str):     Type of the accumulation: float32, float64, or
+                            uint32. uint32 is only available for methods which
+                            send all flow in one direction. Defaults to the type
+                            of `weights`, if given, or float64. Pass "float32"
+                            to halve the memory used for float32 DEMs.
 
     =================== ============================== ===========================
     Method              Note                           Reference
@@ -581,6 +770,10 @@ def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optio
     Quinn               Holmgren with exponent=1.      `Quinn et al. (1991)           doi: 10.1002/hyp.3360050106        <http://dx.doi.org/10.1002/hyp.3360050106>`_
     Holmgren(E)         Generalization of Quinn.       `Holmgren (1994)               doi: 10.1002/hyp.3360080405        <http://dx.doi.org/10.1002/hyp.3360080405>`_
     Freeman(E)          TODO                           `Freeman (1991)                doi: 10.1016/0098-3004(91)90048-I  <http://dx.doi.org/10.1016/0098-3004(91)90048-I>`_
+    Seibert(E)          Alias for MDinf.               `Seibert and McGlynn (2007)    doi: 10.1029/2006WR005128          <http://dx.doi.org/10.1029/2006WR005128>`_
+    MDinf(E)            Alias for Seibert.             `Seibert and McGlynn (2007)    doi: 10.1029/2006WR005128          <http://dx.doi.org/10.1029/2006WR005128>`_
+    OrlandiniLTD(E)     D8-LTD. Exponent is lambda.    `Orlandini et al. (2003)       doi: 10.1029/2002WR001639          <http://dx.doi.org/10.1029/2002WR001639>`_
+    OrlandiniLAD(E)     D8-LAD. Exponent is lambda.    `Orlandini et al. (2003)       doi: 10.1029/2002WR001639          <http://dx.doi.org/10.1029/2002WR001639>`_
     FairfieldLeymarieD8 Alias for Rho8.                `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
     FairfieldLeymarieD4 Alias for Rho4.                `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
     Rho8                Alias for FairfieldLeymarieD8. `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
@@ -618,21 +811,18 @@ def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optio
     facc_methods_exponent: Dict[str, Any] = {
         "Freeman": _richdem.FA_Freeman,
         "Holmgren": _richdem.FA_Holmgren,
+        "Seibert": _richdem.FA_Seibert,
+        "MDinf": _richdem.FA_Seibert,
+        "OrlandiniLTD": _richdem.FA_OrlandiniLTD,
+        "OrlandiniLAD": _richdem.FA_OrlandiniLAD,
     }
 
-    if weights is not None and in_place:
-        accum = rdarray(weights, no_data=-1)
-    elif weights is not None and not in_place:
-        accum = rdarray(weights, copy=True, meta_obj=dem, no_data=-1)
-    elif weights is None:
-        accum = rdarray(
-            np.ones(shape=dem.shape, dtype="float64"), meta_obj=dem, no_data=-1
-        )
-    else:
-        raise Exception("Execution should never reach this point!")
+    accum = _accumulator(dem, dem.shape, weights, in_place, dtype)
 
-    if accum.dtype != "float64":
-        raise Exception("Accumulation array must be of type 'float64'!")
+    if accum.dtype == np.uint32 and method not in SINGLE_DIRECTION_METHODS:
+        raise Exception(
+            f'FlowAccumulation method "{method}" divides flow between cells and needs a float32 or float64 accumulator!'
+        )
 
     accumw = accum.wrap()
 
@@ -665,7 +855,7 @@ def FlowAccumulation(dem: rdarray, method: Optional[str] = None, exponent: Optio
     return accum
 
 
-def FlowAccumFromProps(props: rdarray, weights: Optional[rdarray] = None, in_place: bool = False) -> rdarray:
+def FlowAccumFromProps(props: rdarray, weights: Optional[rdarray] = None, in_place: bool = False, dtype: Optional[str] = None) -> rdarray:
     """Calculates flow accumulation from flow proportions.
 
     Args:
@@ -678,6 +868,9 @@ def FlowAccumFromProps(props: rdarray, weights: Optional[rdarray] = None, in_pla
                             accumulation matrix is always returned, but it will
                             just be a view of the modified data if `in_place`
                             is True.
+        dtype    (str):     Type of the accumulation: float32 or float64.
+                            Defaults to the type of `weights`, if given, or
+                            float64.
 
     Returns:
         A flow accumulation array. If `weights` was provided and `in_place` was
@@ -686,19 +879,10 @@ def FlowAccumFromProps(props: rdarray, weights: Optional[rdarray] = None, in_pla
     if type(props) is not rd3array:
         raise Exception("A richdem.rd3array or numpy.ndarray is required!")
 
-    if weights is not None and in_place:
-        accum = rdarray(weights, no_data=-1)
-    elif weights is not None and not in_place:
-        accum = rdarray(weights, copy=True, meta_obj=props, no_data=-1)
-    elif weights is None:
-        accum = rdarray(
-            np.ones(shape=props.shape[0:2], dtype="float64"), meta_obj=props, no_data=-1
-        )
-    else:
-        raise Exception("Execution should never reach this point!")
+    accum = _accumulator(props, props.shape[0:2], weights, in_place, dtype)
 
-    if accum.dtype != "float64":
-        raise Exception("Accumulation array must be of type 'float64'!")
+    if accum.dtype == np.uint32:
+        raise Exception("Flow proportions divide flow between cells and need a float32 or float64 accumulator!")
 
     accumw = accum.wrap()
 
@@ -733,6 +917,10 @@ def FlowProportions(dem: rdarray, method: Optional[str] = None, exponent: Option
     Quinn               Holmgren with exponent=1.      `Quinn et al. (1991)           doi: 10.1002/hyp.3360050106        <http://dx.doi.org/10.1002/hyp.3360050106>`_
     Holmgren(E)         Generalization of Quinn.       `Holmgren (1994)               doi: 10.1002/hyp.3360080405        <http://dx.doi.org/10.1002/hyp.3360080405>`_
     Freeman(E)          TODO                           `Freeman (1991)                doi: 10.1016/0098-3004(91)90048-I  <http://dx.doi.org/10.1016/0098-3004(91)90048-I>`_
+    Seibert(E)          Alias for MDinf.               `Seibert and McGlynn (2007)    doi: 10.1029/2006WR005128          <http://dx.doi.org/10.1029/2006WR005128>`_
+    MDinf(E)            Alias for Seibert.             `Seibert and McGlynn (2007)    doi: 10.1029/2006WR005128          <http://dx.doi.org/10.1029/2006WR005128>`_
+    OrlandiniLTD(E)     D8-LTD. Exponent is lambda.    `Orlandini et al. (2003)       doi: 10.1029/2002WR001639          <http://dx.doi.org/10.1029/2002WR001639>`_
+    OrlandiniLAD(E)     D8-LAD. Exponent is lambda.    `Orlandini et al. (2003)       doi: 10.1029/2002WR001639          <http://dx.doi.org/10.1029/2002WR001639>`_
     FairfieldLeymarieD8 Alias for Rho8.                `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
     FairfieldLeymarieD4 Alias for Rho4.                `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
     Rho8                Alias for FairfieldLeymarieD8. `Fairfield and Leymarie (1991) doi: 10.1029/90WR02658             <http://dx.doi.org/10.1029/90WR02658>`_
@@ -768,6 +956,10 @@ def FlowProportions(dem: rdarray, method: Optional[str] = None, exponent: Option
     fprop_methods_exponent = {
         "Freeman": _richdem.FM_Freeman,
         "Holmgren": _richdem.FM_Holmgren,
+        "Seibert": _richdem.FM_Seibert,
+        "MDinf": _richdem.FM_Seibert,
+        "OrlandiniLTD": _richdem.FM_OrlandiniLTD,
+        "OrlandiniLAD": _richdem.FM_OrlandiniLAD,
     }
 
     fprops = rd3array(
@@ -863,6 +1055,86 @@ def TerrainAttribute(dem: rdarray, attrib: str, zscale: float = 1.0) -> rdarray:
 
     return result
 
+def BatchProcess(
+    dems: Union[np.ndarray, List[np.ndarray]],
+    steps: List[str],
+    zscale: float = 1.0,
+    no_data: Optional[float] = None,
+    geotransform: Optional[Iterable[float]] = None,
+) -> Dict[str, rdarray]:
+    """Runs a pipeline of operations on each of many small rasters.
+
+    Each raster is processed by a single thread while the threads work on
+    different rasters, which is much faster for small rasters, such as chips
+    for machine learning, than processing them one at a time. This needs a
+    RichDEM built with OpenMP (see rd.OPENMP_AVAILABLE); otherwise the rasters
+    are processed one at a time. Messages and progress bars are not shown for
+    the individual rasters.
+
+    Args:
+        dems:          A (count, height, width) array of rasters, or a list of
+                         rasters of the same shape and type
+        steps:         Operations to apply, in order. Each sees the DEM as
+                         left by those before it. (See below.)
+        zscale:        How much to scale the z-axis by prior to calculating
+                         terrain attributes
+        no_data:       NoData value of the rasters. Defaults to that of `dems`,
+                         or of its first raster.
+        geotransform:  Geotransform of the rasters, which sets the cell size
+                         used by terrain attributes. Defaults to that of
+                         `dems`, or of its first raster, or to unit cells.
+
+    ======================= =========
+    Step                    Result
+    ======================= =========
+    fill                    DEM with its depressions filled
+    fill_epsilon            DEM with its depressions filled so that flats drain
+    d8_flowdirs             D8 flow directions, routed through depressions
+    d8_accumulation         Number of cells draining through each cell along the d8_flowdirs routes
+    slope_riserun, etc.     Any of the attributes of TerrainAttribute()
+    ======================= =========
+
+    Returns:
+        A dictionary mapping the name of each step to a (count, height, width)
+        rdarray of its results.
+    """
+    if isinstance(dems, (list, tuple)):
+        if len(dems) == 0:
+            raise Exception("At least one raster is required!")
+        first = dems[0]
+        stack = np.stack(dems)
+    else:
+        first = dems
+        stack = np.asarray(dems)
+
+    if stack.ndim != 3:
+        raise Exception("A (count, height, width) array or a list of 2D arrays is required!")
+    if len(set(steps)) != len(steps):
+        raise Exception("Each step may appear in the pipeline only once!")
+
+    if no_data is None:
+        no_data = getattr(first, "no_data", None)
+        if no_data is None:
+            raise Exception(msg_error_no_data)
+    if geotransform is None:
+        geotransform = getattr(first, "geotransform", None)
+        if geotransform is None:
+            geotransform = STANDARD_GEOTRANSFORM
+
+    results = _richdem.rdBatchProcess(
+        np.ascontiguousarray(stack),
+        float(no_data),
+        [float(x) for x in geotransform],
+        list(steps),
+        float(zscale),
+    )
+
+    ret = {}
+    for step, (result, result_no_data) in zip(steps, results):
+        ret[step] = rdarray(result, no_data=result_no_data, geotransform=geotransform)
+        _AddAnalysis(ret[step], f"BatchProcess(dems, steps={steps}, zscale={zscale})")
+    return ret
+
 def generate_perlin_terrain(size: int, seed: int) -> rdarray:
     """Generates random terrain based on Perlin noise
 
@@ -10,11 +10,18 @@ from setuptools.command.build_ext import build_ext as _build_ext
 richdem_compile_time: Optional[str] = None
 richdem_git_hash: Optional[str] = None
 
-# Compiler specific arguments
+# Compiler specific arguments. OpenMP provides RichDEM's parallelism; without
+# it every call runs on a single thread.
 BUILD_ARGS = {
-    "msvc": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3"],
-    "gcc": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3", "-Wno-unknown-pragmas"],
-    "unix": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3", "-Wno-unknown-pragmas"],
+    "msvc": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3", "/openmp"],
+    "gcc": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3", "-fopenmp"],
+    "unix": ["-std=c++17", "-g", "-fvisibility=hidden", "-O3", "-fopenmp"],
+}
+
+LINK_ARGS = {
+    "msvc": [],
+    "gcc": ["-fopenmp"],
+    "unix": ["-fopenmp"],
 }
 
 # Magic that hooks compiler specific arguments up with the compiler
@@ -25,7 +32,9 @@ class build_ext_compiler_check(_build_ext):
         args = BUILD_ARGS[compiler]
         for ext in self.extensions:
             ext.extra_compile_args = args
+            ext.extra_link_args = ext.extra_link_args + LINK_ARGS[compiler]
             print(f"COMPILER ARGUMENTS: {ext.extra_compile_args}")
+            print(f"LINKER ARGUMENTS: {ext.extra_link_args}")
         _build_ext.build_extensions(self)
 
 
@@ -69,16 +78,33 @@ if richdem_git_hash is None:
 
 print("Using RichDEM hash={0}, time={1}".format(richdem_git_hash, richdem_compile_time))
 
+# If GDAL's development files are installed, RichDEM loads rasters itself
+# rather than going through rasterio or GDAL's Python bindings
+gdal_include_dirs = []
+gdal_link_args = []
+gdal_macros = []
+try:
+    gdal_cflags = subprocess.check_output(["gdal-config", "--cflags"]).decode("utf8").split()
+    gdal_link_args = subprocess.check_output(["gdal-config", "--libs"]).decode("utf8").split()
+    gdal_include_dirs = [x[2:] for x in gdal_cflags if x.startswith("-I")]
+    gdal_macros = [("USEGDAL", None)]
+    print("Compiling RichDEM with GDAL.")
+except (OSError, subprocess.CalledProcessError):
+    print("Warning! gdal-config not found. Compiling RichDEM without GDAL; rasters will be loaded via rasterio or GDAL's Python bindings.")
+
 ext_modules = [
     Pybind11Extension(
         "_richdem",
         ["src/pywrapper.cpp"] + list(glob.glob("lib/richdem/src/**/*.cpp", recursive=True)),
-        include_dirs=["lib/richdem/include"],
-        define_macros=[
+        include_dirs=["lib/richdem/include"] + gdal_include_dirs,
+        extra_link_args=gdal_link_args,
+        define_macros=gdal_macros + [
             ("DOCTEST_CONFIG_DISABLE", None),
             ("RICHDEM_COMPILE_TIME", f'"\\"{richdem_compile_time}\\""'),
             ("RICHDEM_GIT_HASH", f'"\\"{richdem_git_hash}\\""'),
             # ("RICHDEM_LOGGING", None),
+            # Compile the hot kernels for AVX2 and AVX-512 too and pick one at load time
+            ("RICHDEM_CPU_DISPATCH", None),
             (
                 "_USE_MATH_DEFINES",
                 None,
@@ -1,5 +1,6 @@
 #include "pywrapper.hpp"
 
+#include <richdem/common/parallel.hpp>
 #include <richdem/misc/conversion.hpp>
 #include <richdem/methods/flow_accumulation.hpp>
 #include <richdem/depressions/depression_hierarchy.hpp>
@@ -10,12 +11,28 @@
 #include <pybind11/stl_bind.h>
 #include <pybind11/stl.h>
 
+#include <array>
 #include <string>
 
 namespace py = pybind11;
 
 using namespace richdem;
 
+#ifdef USEGDAL
+//Allocates a NumPy array for a window of a GDAL file and has GDAL fill it
+//directly, so the data is neither copied nor converted
+template<class T>
+py::array ReadGDALWindowIntoNumPy(const std::string &filename, const int band, const int overview, const GDALWindowInfo &info){
+  py::array_t<T> arr({(py::ssize_t)info.window.height, (py::ssize_t)info.window.width});
+  void *const buffer = arr.mutable_data();
+  {
+    py::gil_scoped_release release;
+    readGDALWindow(filename, band, overview, info, info.dtype, buffer);
+  }
+  return std::move(arr);
+}
+#endif
+
 PYBIND11_MODULE(_richdem, m) {
   m.doc() = "Internal library used by pyRichDEM for calculations";
 
@@ -46,11 +63,55 @@ PYBIND11_MODULE(_richdem, m) {
   TemplatedArrayWrapper<uint32_t>(m, "uint32_t");
   TemplatedArrayWrapper<uint64_t>(m, "uint64_t");
 
+  py::enum_<ThreadBinding>(m, "ThreadBinding")
+    .value("Default", ThreadBinding::Default)
+    .value("Close",   ThreadBinding::Close)
+    .value("Spread",  ThreadBinding::Spread);
+
+  py::class_<ParallelismConfig>(m, "ParallelismConfig")
+    .def(py::init<>())
+    .def_readwrite("threads",           &ParallelismConfig::threads,           "Maximum number of threads. 0 uses OpenMP's default.")
+    .def_readwrite("binding",           &ParallelismConfig::binding,           "Placement of threads on processors")
+    .def_readwrite("max_active_levels", &ParallelismConfig::max_active_levels, "Deepest nesting of parallel regions which may spawn threads. 0 uses OpenMP's default; 1 disables nested parallelism.");
+
+  m.def("OpenMPEnabled",  &OpenMPEnabled,  "Whether RichDEM was compiled with OpenMP and so can use more than one thread");
+  m.def("GetParallelism", &GetParallelism, "Parallelism settings of the calling thread");
+  m.def("SetParallelism", &SetParallelism, "Set the parallelism used by RichDEM calls made from the calling thread", py::arg("config"));
+
   m.def("rdHash",        &rdHash,        "Git hash of previous commit");
   m.def("rdCompileTime", &rdCompileTime, "Commit time of previous commit");
+  m.def("CPUDispatchTarget", &CPUDispatchTarget, "Instruction set whose version of the hot kernels was chosen for this processor");
+
+  #ifdef USEGDAL
+  m.def("load_gdal", [](const std::string &filename, const int band, const int overview, const std::array<int32_t,4> &window) -> py::tuple {
+      const auto info = getGDALWindowInfo(filename, band, overview, GDALWindow{window[0], window[1], window[2], window[3]});
+      py::array data;
+      switch(info.dtype){
+        case GDT_Byte:    data = ReadGDALWindowIntoNumPy<uint8_t >(filename, band, overview, info); break;
+        case GDT_Int16:   data = ReadGDALWindowIntoNumPy<int16_t >(filename, band, overview, info); break;
+        case GDT_UInt16:  data = ReadGDALWindowIntoNumPy<uint16_t>(filename, band, overview, info); break;
+        case GDT_Int32:   data = ReadGDALWindowIntoNumPy<int32_t >(filename, band, overview, info); break;
+        case GDT_UInt32:  data = ReadGDALWindowIntoNumPy<uint32_t>(filename, band, overview, info); break;
+        case GDT_Float32: data = ReadGDALWindowIntoNumPy<float   >(filename, band, overview, info); break;
+        case GDT_Float64: data = ReadGDALWindowIntoNumPy<double  >(filename, band, overview, info); break;
+        default:
+          throw std::runtime_error(std::string("RichDEM cannot load rasters of type ")+GDALGetDataTypeName(info.dtype)+"!");
+      }
+      return py::make_tuple(
+        data,
+        info.has_no_data ? py::cast(info.no_data) : py::none(),
+        info.geotransform,
+        info.projection,
+        info.metadata
+      );
+    },
+    "Read a window of a band of a GDAL file into a new NumPy array, in parallel. Returns (data, no_data, geotransform, projection, metadata).",
+    py::arg("filename"), py::arg("band")=1, py::arg("overview")=-1, py::arg("window")=std::array<int32_t,4>{{0,0,0,0}}
+  );
+  #endif
 
   m.def("FlowAccumulation", &FlowAccumulation<double>, "TODO");
-  m.def("flow_accumulation_from_d8", &flow_accumulation_from_d8<double>, "TODO");
+  m.def("FlowAccumulation", &FlowAccumulation<float>,  "TODO");
   m.def("convert_arc_flowdirs_to_richdem_d8", &convert_arc_flowdirs_to_richdem_d8, "Convert ArcGIS Flowdirs to Richdem D8 flowdirs");
 
   py::class_<Array3D<float>>(m, "Array3D_float", py::buffer_protocol(), py::dynamic_attr())
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <richdem/common/raster_concept.hpp>
 #include <richdem/depressions/depressions.hpp>
 #include <richdem/flats/flats.hpp>
+#include <richdem/methods/batch.hpp>
 #include <richdem/methods/flow_accumulation.hpp>
 #include <richdem/methods/terrain_attributes.hpp>
 #include <richdem/terrain_generation.hpp>
@@ -10,7 +12,10 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl_bind.h>
 #include <pybind11/stl.h>
+#include <algorithm>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 //Tutorials
 //http://www.benjack.io/2017/06/12/python-cpp-tests.html
@@ -24,13 +29,43 @@
 //py::array_t<double, py::array::c_style | py::array::forcecast>
 //forcecast forces a conversion. We don't use it here in order to ensure that memory is not unnecessarily copied
 
+//Binds the flow accumulations of a DEM of type T into an accumulator of type A.
+//Overloads are chosen by the types of the arrays passed, so no conversions are
+//made. Dispersive methods split a cell's flow into fractions, which integer
+//accumulators would truncate, so they are only bound for floating-point ones.
+template<class T, class A>
+void AccumulationFunctionsWrapper(pybind11::module &m){
+  using namespace richdem;
+
+  if constexpr(std::is_floating_point<A>::value){
+    m.def("FA_Tarboton",            &FA_Tarboton           <T,A>, "TODO");
+    m.def("FA_Dinfinity",           &FA_Dinfinity          <T,A>, "TODO");
+    m.def("FA_Holmgren",            &FA_Holmgren           <T,A>, "TODO");
+    m.def("FA_Quinn",               &FA_Quinn              <T,A>, "TODO");
+    m.def("FA_Freeman",             &FA_Freeman            <T,A>, "TODO");
+    m.def("FA_Seibert",             &FA_Seibert            <T,A>, "TODO");
+  }
+  m.def("FA_OrlandiniLTD",        &FA_OrlandiniLTD       <T,A>, "TODO");
+  m.def("FA_OrlandiniLAD",        &FA_OrlandiniLAD       <T,A>, "TODO");
+  m.def("FA_FairfieldLeymarieD8", &FA_FairfieldLeymarieD8<T,A>, "TODO");
+  m.def("FA_FairfieldLeymarieD4", &FA_FairfieldLeymarieD4<T,A>, "TODO");
+  m.def("FA_Rho8",                &FA_Rho8               <T,A>, "TODO");
+  m.def("FA_Rho4",                &FA_Rho4               <T,A>, "TODO");
+  m.def("FA_D8",                  &FA_D8                 <T,A>, "TODO");
+  m.def("FA_D4",                  &FA_D4                 <T,A>, "TODO");
+  m.def("FA_OCallaghanD8",        &FA_OCallaghanD8       <T,A>, "TODO");
+  m.def("FA_OCallaghanD4",        &FA_OCallaghanD4       <T,A>, "TODO");
+}
+
+
+
 template<class T>
 void TemplatedFunctionsWrapper(pybind11::module &m, std::string tname){
   using namespace richdem;
   namespace py = pybind11;
 
   m.def("rdFillDepressionsD8",   &PriorityFlood_Zhou2016<T>,                "@@depressions/Zhou2016pf.hpp:Zhou2016@@"); //TODO
-  m.def("rdFillDepressionsD4",   &PriorityFlood_Barnes2014<Topology::D4,T>, "@@depressions/Zhou2016pf.hpp:Zhou2016@@"); //TODO
+  m.def("rdFillDepressionsD4",   [](Array2D<T> &dem){ PriorityFlood_Barnes2014<Topology::D4>(dem); }, "@@depressions/Zhou2016pf.hpp:Zhou2016@@"); //TODO
   m.def("rdPFepsilonD8",         &PriorityFloodEpsilon_Barnes2014<Topology::D8,T>, "Fill all depressions with epsilon."); //TODO
   m.def("rdPFepsilonD4",         &PriorityFloodEpsilon_Barnes2014<Topology::D4,T>, "Fill all depressions with epsilon."); //TODO
 
@@ -38,10 +73,16 @@ void TemplatedFunctionsWrapper(pybind11::module &m, std::string tname){
 
   m.def("rdBreachDepressionsD8",   &BreachDepressions<Topology::D8,T>,               "@@depressions/Lindsay2016.hpp:Lindsay2016@@"); //TODO
   m.def("rdBreachDepressionsD4",   &BreachDepressions<Topology::D4,T>,               "@@depressions/Lindsay2016.hpp:Lindsay2016@@"); //TODO
+  m.def("rdBreachDepressionsLeastCostD8", &BreachDepressionsLeastCost<Topology::D8,T>, "@@depressions/Lindsay2016.hpp:LeastCostBreaching_Lindsay2016@@");
+  m.def("rdBreachDepressionsLeastCostD4", &BreachDepressionsLeastCost<Topology::D4,T>, "@@depressions/Lindsay2016.hpp:LeastCostBreaching_Lindsay2016@@");
 
   //m.def("rdBreach",              [](Array2D<T> &dem, const int mode, bool fill_depressions){&Lindsay2016<T>(dem,mode,fill_depressions);}, "TODO");
 
+  //Overloads are chosen by the type of the result array, so results may be
+  //kept in single precision
+  m.def("TA_SPI",                &TA_SPI<T, float, float >,       "TODO");
   m.def("TA_SPI",                &TA_SPI<T, float, double>,       "TODO");
+  m.def("TA_CTI",                &TA_CTI<T, float, float >,       "TODO");
   m.def("TA_CTI",                &TA_CTI<T, float, double>,       "TODO");
   m.def("TA_slope_riserun",      &TA_slope_riserun     <T>,       "TODO");
   m.def("TA_slope_percentage",   &TA_slope_percentage  <T>,       "TODO");
@@ -52,25 +93,20 @@ void TemplatedFunctionsWrapper(pybind11::module &m, std::string tname){
   m.def("TA_planform_curvature", &TA_planform_curvature<T>,       "TODO");
   m.def("TA_profile_curvature",  &TA_profile_curvature <T>,       "TODO");
 
-  m.def("FA_Tarboton",            &FA_Tarboton           <T,double>, "TODO");
-  m.def("FA_Dinfinity",           &FA_Dinfinity          <T,double>, "TODO");
-  m.def("FA_Holmgren",            &FA_Holmgren           <T,double>, "TODO");
-  m.def("FA_Quinn",               &FA_Quinn              <T,double>, "TODO");
-  m.def("FA_Freeman",             &FA_Freeman            <T,double>, "TODO");
-  m.def("FA_FairfieldLeymarieD8", &FA_FairfieldLeymarieD8<T,double>, "TODO");
-  m.def("FA_FairfieldLeymarieD4", &FA_FairfieldLeymarieD4<T,double>, "TODO");
-  m.def("FA_Rho8",                &FA_Rho8               <T,double>, "TODO");
-  m.def("FA_Rho4",                &FA_Rho4               <T,double>, "TODO");
-  m.def("FA_D8",                  &FA_D8                 <T,double>, "TODO");
-  m.def("FA_D4",                  &FA_D4                 <T,double>, "TODO");
-  m.def("FA_OCallaghanD8",        &FA_OCallaghanD8       <T,double>, "TODO");
-  m.def("FA_OCallaghanD4",        &FA_OCallaghanD4       <T,double>, "TODO");
+  AccumulationFunctionsWrapper<T,double  >(m);
+  AccumulationFunctionsWrapper<T,float   >(m);
+  AccumulationFunctionsWrapper<T,uint32_t>(m);
+
+  m.def("flow_accumulation_from_d8", &flow_accumulation_from_d8<T>, "TODO");
 
   m.def("FM_Tarboton",            &FM_Tarboton          <T>,              "TODO");
   m.def("FM_Dinfinity",           &FM_Dinfinity         <T>,              "TODO");
   m.def("FM_Holmgren",            &FM_Holmgren          <T>,              "TODO");
   m.def("FM_Quinn",               &FM_Quinn             <T>,              "TODO");
   m.def("FM_Freeman",             &FM_Freeman           <T>,              "TODO");
+  m.def("FM_Seibert",             &FM_Seibert           <T>,              "TODO");
+  m.def("FM_OrlandiniLTD",        &FM_OrlandiniLTD      <T>,              "TODO");
+  m.def("FM_OrlandiniLAD",        &FM_OrlandiniLAD      <T>,              "TODO");
   m.def("FM_FairfieldLeymarieD8", &FM_FairfieldLeymarie <Topology::D8,T>, "TODO");
   m.def("FM_FairfieldLeymarieD4", &FM_FairfieldLeymarie <Topology::D4,T>, "TODO");
   m.def("FM_Rho8",                &FM_Rho8              <T>,              "TODO");
@@ -79,6 +115,64 @@ void TemplatedFunctionsWrapper(pybind11::module &m, std::string tname){
   m.def("FM_OCallaghanD4",        &FM_OCallaghan        <Topology::D4,T>, "TODO");
   m.def("FM_D8",                  &FM_D8                <T>,              "TODO");
   m.def("FM_D4",                  &FM_D4                <T>,              "TODO");
+
+  //Runs a pipeline on each raster of a C-ordered (count,height,width) stack.
+  //Returns, for each step, a stack of its results and their NoData value.
+  m.def("rdBatchProcess", [](
+    py::array_t<T, py::array::c_style> stack,
+    const double no_data,
+    const std::vector<double> &geotransform,
+    const std::vector<std::string> &steps,
+    const float zscale
+  ) -> py::list {
+    if(stack.ndim()!=3)
+      throw std::runtime_error("A batch must have three dimensions: (rasters, height, width)!");
+    const auto count  = stack.shape(0);
+    const auto height = stack.shape(1);
+    const auto width  = stack.shape(2);
+    const auto cells  = height*width;
+    if(count>0 && cells==0)
+      throw std::runtime_error("The rasters of a batch must not be empty!");
+
+    std::vector<BatchStep> pipeline;
+    for(const auto &name: steps)
+      pipeline.push_back({BatchOpFromName(name), zscale});
+
+    std::vector<py::array> results;
+    std::vector<void*>     outputs;
+    for(const auto &step: pipeline){
+      switch(BatchOpResultType(step.op)){
+        case BatchResultType::Elevation:      results.push_back(py::array_t<T>           ({count, height, width})); break;
+        case BatchResultType::FlowDirections: results.push_back(py::array_t<d8_flowdir_t>({count, height, width})); break;
+        case BatchResultType::Value:          results.push_back(py::array_t<float>       ({count, height, width})); break;
+      }
+      outputs.push_back(results.back().mutable_data());
+    }
+    std::vector<double> no_datas(pipeline.size(), 0);
+
+    std::vector<Array2D<T>> dems;
+    dems.reserve(count);
+    for(py::ssize_t c=0;c<count;c++){
+      dems.emplace_back(const_cast<T*>(stack.data())+c*cells, (int)width, (int)height);
+      dems.back().setNoData(static_cast<T>(no_data));
+      dems.back().geotransform = geotransform;
+    }
+
+    {
+      py::gil_scoped_release release;
+      ProcessBatch(dems, pipeline, [&](const std::size_t c, const std::size_t s, const auto &result){
+        using result_t = raster_value_t<std::decay_t<decltype(result)>>;
+        std::copy(result.data(), result.data()+result.size(), static_cast<result_t*>(outputs[s])+c*cells);
+        if(c==0)
+          no_datas[s] = result.noData();
+      });
+    }
+
+    py::list ret;
+    for(std::size_t s=0;s<results.size();s++)
+      ret.append(py::make_tuple(results[s], no_datas[s]));
+    return ret;
+  }, "Run a pipeline of operations on each raster of a stack", py::arg("stack"), py::arg("no_data"), py::arg("geotransform"), py::arg("steps"), py::arg("zscale")=1.0f);
 }
 
 
@@ -26,4 +26,50 @@ class py_richdem_tests(unittest.TestCase):
     # A labels array where all the edge cells are in the ocean and all the
     # interior cells are not yet assigned to a depression
     labels = rd.get_new_depression_hierarchy_labels(dem.shape)
-    dh, flowdirs = rd.get_depression_hierarchy(dem, labels)
\ No newline at end of file
+    dh, flowdirs = rd.get_depression_hierarchy(dem, labels)
+
+  def test_flow_accumulation_keeps_dtypes(self) -> None:
+    dem = rd.rdarray(rd.generate_perlin_terrain(20, 20).astype(np.float32), no_data=-9999)
+    self.assertEqual(rd.FlowAccumulation(dem, method="Dinf").dtype, np.float64)
+    self.assertEqual(rd.FlowAccumulation(dem, method="Dinf", dtype="float32").dtype, np.float32)
+
+    d8_float = rd.FlowAccumulation(dem, method="D8", dtype="float64")
+    d8_uint  = rd.FlowAccumulation(dem, method="D8", dtype="uint32")
+    self.assertEqual(d8_uint.dtype, np.uint32)
+    self.assertTrue(np.array_equal(d8_uint[1:-1,1:-1], d8_float[1:-1,1:-1].astype(np.uint32)))
+
+    with self.assertRaises(Exception):
+      rd.FlowAccumulation(dem, method="Dinf", dtype="uint32")
+
+  def test_path_based_and_multiple_facet_proportions(self) -> None:
+    dem = rd.rdarray(rd.generate_perlin_terrain(20, 20), no_data=-9999)
+    for method in ("Seibert", "OrlandiniLTD", "OrlandiniLAD"):
+      props = rd.FlowProportions(dem, method=method, exponent=1.0)
+      flows = props[:,:,0] == 0
+      self.assertTrue(np.allclose(props[flows][:,1:].sum(axis=1), 1))
+      if method != "Seibert":
+        self.assertTrue(np.all(np.count_nonzero(props[flows][:,1:], axis=1) == 1))
+
+  def test_least_cost_breaching(self) -> None:
+    dem = rd.rdarray(rd.generate_perlin_terrain(50, 50), no_data=-9999)
+    breached = rd.BreachDepressions(dem, method="least_cost", max_dist=50)
+    self.assertTrue(np.all(breached <= dem))
+    filled = rd.BreachDepressions(dem, method="least_cost", max_dist=2, max_cost=0.01, fill=True)
+    self.assertTrue(np.any(filled > dem))
+
+  def test_built_with_openmp(self) -> None:
+    # Without OpenMP, BatchProcess and rd.parallelism() fall back to one thread
+    self.assertTrue(rd.OPENMP_AVAILABLE)
+
+  def test_batch_process(self) -> None:
+    chips = [rd.generate_perlin_terrain(30, seed) for seed in range(5)]
+    results = rd.BatchProcess(np.stack(chips), ["fill", "d8_accumulation", "slope_degrees"], no_data=-9999)
+    for i, chip in enumerate(chips):
+      filled = rd.FillDepressions(chip)
+      self.assertTrue(np.array_equal(results["fill"][i], filled))
+      self.assertTrue(np.allclose(results["slope_degrees"][i], rd.TerrainAttribute(filled, "slope_degrees")))
+
+    self.assertTrue(np.all(results["d8_accumulation"] >= 1))
+
+    with self.assertRaises(Exception):
+      rd.BatchProcess(chips, ["no_such_step"])